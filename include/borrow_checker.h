@@ -0,0 +1,81 @@
+#ifndef BORROW_CHECKER_H
+#define BORROW_CHECKER_H
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace void_compiler {
+
+/*
+   Checks the rules that let code generation mark borrow parameters noalias,
+   and throws std::runtime_error for the first one a program breaks:
+
+   - &T and &mut T only appear as parameter types. No variable, field, array
+     element or return value holds a borrow, so none outlives its call.
+   - Nothing is written through a &T, and borrow parameters aren't reassigned
+     or turned into *T pointers.
+   - An argument for a borrow parameter is &place, &mut place or a borrow
+     parameter, of the pointee type the parameter expects. A place is a
+     variable, a field or an array element, not reached through a *T.
+   - Within one call, a variable borrowed as &mut isn't borrowed by any other
+     argument.
+   - A variable whose address is taken for a *T pointer anywhere in the
+     function is never borrowed, since the pointer could reach it mid-call.
+
+   Together these mean a &mut T is the only way to reach its value while the
+   callee runs, and a &T's value can't change under it.
+*/
+class BorrowChecker {
+ public:
+  // external: signatures of functions defined outside program, e.g. by
+  // earlier inputs of an interactive session
+  explicit BorrowChecker(
+      const Program* program,
+      const std::unordered_map<std::string, FunctionType>& external = {});
+
+  void check();
+
+ private:
+  // Where an argument borrows from: the variable its place starts at
+  struct Loan {
+    std::string root;
+    bool is_mutable;
+  };
+
+  // The function being checked. Anonymous functions get their own, since
+  // they can't see the enclosing function's variables.
+  struct Frame {
+    std::vector<std::pair<std::string, std::string>> locals;  // name, type
+    std::vector<size_t> scopes;
+    std::unordered_set<std::string> pointer_roots;  // address taken for a *T
+    std::vector<std::pair<Loan, std::string>> loans;  // and the callee
+  };
+
+  template <typename Function>
+  void check_function(const Function* func);
+  void check_block(const std::vector<std::unique_ptr<ASTNode>>& body);
+  void check_statement(const ASTNode* node);
+  void check_expression(const ASTNode* node);
+  void check_call(const FunctionCall* call);
+  Loan check_borrow_argument(const ASTNode* arg, const BorrowType& param,
+                             const std::string& callee, size_t position);
+  // Checks the indexes inside a place and returns the variable it starts at
+  const std::string& check_place(const ASTNode* place);
+  // Where a place written to starts, which must not be a &T
+  void check_writable(const std::string& root);
+
+  void declare(const std::string& name, const std::string& type);
+  // The type of the innermost local called name, nullptr if there is none
+  [[nodiscard]] const std::string* lookup(const std::string& name) const;
+
+  const Program* program_;
+  std::unordered_map<std::string, std::vector<std::string>> signatures_;
+  std::vector<Frame> frames_;
+};
+
+}  // namespace void_compiler
+#endif  // BORROW_CHECKER_H
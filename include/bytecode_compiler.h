@@ -0,0 +1,181 @@
+#ifndef BYTECODE_COMPILER_H
+#define BYTECODE_COMPILER_H
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "call_graph.h"
+#include "types.h"
+
+namespace void_compiler {
+
+/*
+   Register based bytecode for the interpreter tier. Every function gets a
+   window of int64 registers: parameters first, then locals and temporaries.
+   Integers are kept sign-extended from the width of their type, so they hold
+   the same bit pattern the generated code would and widening is free. Bools
+   are i1 and therefore 0 or -1. Strings and functions are indices into the
+   module's string and function tables, pointers are absolute register slots.
+
+   Operands a, b and c are registers unless noted otherwise.
+*/
+enum class OpCode : uint8_t {
+  LoadConstant,  // a = constants[b]
+  Move,          // a = b
+  Truncate,      // a = b wrapped to width
+  ZeroExtend,    // a = b zero extended from width
+  Add,           // a = b + c, wrapped to width
+  Subtract,
+  Multiply,
+  Divide,
+  And,
+  Or,
+  // a = b + c etc., throwing if the result doesn't fit width as a signed
+  // integer, or for the unsigned ones as an unsigned integer
+  AddChecked,
+  SubtractChecked,
+  MultiplyChecked,
+  AddCheckedUnsigned,
+  SubtractCheckedUnsigned,
+  MultiplyCheckedUnsigned,
+  Negate,  // a = -b, wrapped to width
+  Not,     // a = ~b, wrapped to width
+  Less,    // a = b < c as a bool
+  LessEqual,
+  Greater,
+  GreaterEqual,
+  Equal,
+  NotEqual,
+  LessUnsigned,  // a = b < c with both compared as unsigned
+  AddressOf,     // a = slot of register b
+  Load,          // a = the slot held by b, wrapped to width
+  Store,         // the slot held by a = b
+  Jump,          // pc = a
+  JumpIfFalse,   // if a == 0: pc = b
+  Call,          // a = functions[b](c, c + 1, ...)
+  CallIndirect,  // a = functions[register b](c, c + 1, ...)
+  // Call that reuses the caller's registers for the callee, whose result
+  // becomes the caller's. A native callee sets a like Call instead, for the
+  // Return that follows.
+  TailCall,
+  Print,         // a = printf(strings[register b], b + 1, ... b + c - 1)
+  Return,        // return a
+  ReturnVoid,
+  Unreachable,  // control reached the end of a non-void function
+};
+
+struct Instruction {
+  OpCode op;
+  uint8_t width = 64;  // integer width of the result, for wrapping ops
+  uint32_t a = 0;
+  uint32_t b = 0;
+  uint32_t c = 0;
+};
+
+struct BytecodeFunction {
+  std::string name;
+  size_t parameter_count = 0;
+  size_t register_count = 0;
+  std::vector<Instruction> code;
+  std::vector<int64_t> constants;
+  // Top level function with only integer parameters and an integer or void
+  // result, so a JIT compiled version can stand in for it
+  bool native_callable = false;
+};
+
+struct BytecodeModule {
+  std::vector<BytecodeFunction> functions;
+  std::vector<std::string> strings;
+  size_t main = 0;  // index of main in functions
+};
+
+/*
+   Compiles the functions reachable from main to bytecode, without touching
+   LLVM. It follows code generation's rules for types and conversions, and
+   reports the same errors for invalid programs.
+*/
+class BytecodeCompiler {
+ public:
+  explicit BytecodeCompiler(const Program* program);
+
+  BytecodeModule compile();
+
+ private:
+  // A value produced by an expression and its void type
+  struct Operand {
+    uint32_t reg;
+    std::string type;
+  };
+
+  struct Local {
+    std::string name;
+    Operand operand;
+  };
+
+  struct Signature {
+    size_t index;
+    std::vector<std::string> param_types;
+    std::string return_type;
+  };
+
+  // Per-function compilation state, swapped out for anonymous functions
+  struct FunctionState {
+    BytecodeFunction function;
+    std::string return_type;
+    std::vector<Local> locals;
+    std::vector<size_t> scopes;  // locals.size() when each scope was opened
+    uint32_t next_register = 0;
+    OverflowMode overflow = OverflowMode::Wrap;
+  };
+
+  template <typename Function>
+  BytecodeFunction compile_function(const Function* func, std::string name);
+
+  Operand compile_expression(const ASTNode* node);
+  void compile_statement(const ASTNode* node);
+  void compile_block(const std::vector<std::unique_ptr<ASTNode>>& body);
+  void compile_range_loop(const LoopStatement* loop);
+  void compile_match(const MatchStatement* match_stmt);
+  Operand compile_call(const FunctionCall* call);
+  // Turn the Call just emitted for `return call` into a TailCall if no
+  // argument can point into the caller's registers
+  void mark_tail_call(const FunctionCall* call);
+  // Throws unless `return musttail call` can reuse the caller's registers
+  void check_must_tail(const FunctionCall* call) const;
+  Operand compile_print(const MemberAccess* member);
+  Operand compile_anonymous_function(const AnonymousFunction* anon_func);
+
+  // Copy value into reg, truncating it if type is narrower
+  void store(uint32_t reg, const Operand& value, const std::string& type);
+  // value zero extended to 64 bits if its type is unsigned, for widening it
+  Operand zero_extend_unsigned(const Operand& value);
+  Operand constant(int64_t value, std::string type);
+  uint32_t allocate_register();
+  size_t emit(Instruction instruction);
+  void patch_jump(size_t jump, size_t target);
+  uint32_t string_index(const std::string& value);
+
+  void push_scope();
+  void pop_scope();
+  void declare(const std::string& name, Operand operand);
+  [[nodiscard]] const Local* lookup(const std::string& name) const;
+
+  // Whether type is a struct or a pointer or borrow of one
+  [[nodiscard]] bool is_struct_type(const std::string& type) const {
+    return struct_names_.contains(pointee_type(type).value_or(type));
+  }
+
+  const Program* program_;
+  CallGraph call_graph_;
+  std::unordered_set<std::string> struct_names_;
+  BytecodeModule module_;
+  std::unordered_map<std::string, Signature> signatures_;
+  std::unordered_map<std::string, uint32_t> string_indices_;
+  FunctionState* state_ = nullptr;
+  size_t anonymous_count_ = 0;
+};
+
+}  // namespace void_compiler
+#endif  // BYTECODE_COMPILER_H
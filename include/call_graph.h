@@ -0,0 +1,52 @@
+#ifndef CALL_GRAPH_H
+#define CALL_GRAPH_H
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "const_evaluator.h"
+#include "types.h"
+
+namespace void_compiler {
+
+// Call graph over the top-level functions of a program. An edge from f to g
+// means the body of f (including any anonymous functions inside it) calls g
+// directly or takes its address as a function pointer. Calls that were folded
+// at compile time don't count as edges.
+class CallGraph {
+ public:
+  explicit CallGraph(const Program* program,
+                     const ConstantFolds* folded_calls = nullptr);
+
+  // All functions reachable from root, including root itself
+  [[nodiscard]] std::unordered_set<std::string> reachable_from(
+      const std::string& root) const;
+
+  [[nodiscard]] bool contains(const std::string& function) const {
+    return edges_.contains(function);
+  }
+
+  // Whether function can use a calling convention that guarantees tail
+  // calls: it isn't main, it can reach itself again, and it is only ever
+  // called directly, never through a function pointer
+  [[nodiscard]] bool guarantees_tail_calls(const std::string& function) const;
+
+  // Why `return musttail callee(...)` in caller can't be guaranteed to reuse
+  // caller's frame, or "" if it can. Both must guarantee tail calls, return
+  // the same type and the arguments must be integers or vectors, which
+  // can't point into the frame.
+  [[nodiscard]] std::string must_tail_error(
+      const std::string& caller, const FunctionType& caller_type,
+      const std::string& callee, const FunctionType& callee_type) const;
+
+ private:
+  void collect_edges(const ASTNode* node,
+                     std::unordered_set<std::string>& edges);
+
+  std::unordered_map<std::string, std::unordered_set<std::string>> edges_;
+  std::unordered_set<std::string> address_taken_;
+  const ConstantFolds* folded_calls_;
+};
+
+}  // namespace void_compiler
+#endif  // CALL_GRAPH_H
@@ -1,8 +1,16 @@
 #ifndef CODE_GENERATOR_H
 #define CODE_GENERATOR_H
 #include <memory>
+#include <optional>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
+#include "call_graph.h"
+#include "const_evaluator.h"
+#include "function_pointer_analysis.h"
+#include "jit_events.h"
+#include "symbol_table.h"
 #include "types.h"
 
 #pragma clang diagnostic push
@@ -11,7 +19,9 @@
 #include <llvm/ExecutionEngine/ExecutionEngine.h>
 #include <llvm/ExecutionEngine/GenericValue.h>
 #include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
 #include <llvm/IR/BasicBlock.h>
+#include <llvm/IR/DIBuilder.h>
 #include <llvm/IR/Function.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/LLVMContext.h>
@@ -20,6 +30,8 @@
 #include <llvm/IR/Type.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/MC/TargetRegistry.h>
+#include <llvm/Passes/OptimizationLevel.h>
+#include <llvm/Passes/PassBuilder.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/TargetSelect.h>
 #include <llvm/Support/raw_ostream.h>
@@ -33,35 +45,293 @@ namespace void_compiler {
 class CodeGenerator {
  public:
   CodeGenerator();
+  // Calls computed at compile time, emitted as constants instead of calls
+  void set_constant_folds(ConstantFolds folds) {
+    constant_folds_ = std::move(folds);
+  }
   void generate_program(const Program* program);
-  void generate_function(const FunctionDeclaration* func_decl);
+  // Emit every function exported, main or not, for calling from C++
+  void generate_library(const Program* program);
+  // Declare a function compiled into another module of the same JIT
+  void declare_function(const std::string& name, const FunctionType& type);
+  // Hand the module over to a long-lived JIT. The generator must outlive it,
+  // since it owns the module's context.
+  std::unique_ptr<llvm::Module> take_module();
+  void generate_function(const FunctionDeclaration* func_decl,
+                         llvm::Function::LinkageTypes linkage =
+                             llvm::Function::ExternalLinkage);
+  // Create func_decl's function without a body, so calls to it can be
+  // generated before it is defined
+  llvm::Function* declare_prototype(const FunctionDeclaration* func_decl,
+                                    llvm::Function::LinkageTypes linkage);
   void print_ir() const;
+  // Verify the module and run the standard optimization pipeline on it
+  void optimize(llvm::OptimizationLevel level = llvm::OptimizationLevel::O2);
+  // CPU compile_to_object targets: "generic" (the default), a CPU name such
+  // as "skylake", or "native" for the host. The JIT always uses the host's.
+  void set_target_cpu(std::string cpu) { target_cpu_ = std::move(cpu); }
   bool compile_to_object(const std::string& filename);
-  int run_jit();
+  bool compile_to_assembly(const std::string& filename);
+  // Hash of the unoptimized IR, the target, the LLVM version and the
+  // optimization level it will get. It becomes the module's identifier, which
+  // is what llvm::ObjectCache entries are looked up by.
+  std::string assign_cache_key(llvm::OptimizationLevel level);
+  // Run main with MCJIT, reusing and filling cache if one is given
+  int run_jit(llvm::ObjectCache* cache = nullptr);
+
+  // Profile-guided optimization, applied by optimize(). An instrumented
+  // module counts how often each edge of its functions runs; a profile is an
+  // indexed .profdata file from such a run, whose counts drive inlining,
+  // block layout and hot/cold splitting.
+  void set_profile_generate(bool generate) { profile_generate_ = generate; }
+  void set_profile_use(std::string profile) {
+    profile_use_ = std::move(profile);
+  }
+  // After run_jit of an instrumented module, write the counts the run
+  // collected as an indexed profile. Native executables need the profile
+  // runtime for that, the JIT doesn't.
+  void write_jit_profile(const std::string& filename) const;
+
+  // Describe the generated code in DWARF: a line table from the statements'
+  // source locations and a subprogram for each function, naming source_file.
+  // Call before generate_program or generate_library.
+  void set_debug_info(const std::string& source_file);
+  // Keep a frame pointer in every function, so profilers can walk the stack
+  // without unwind tables
+  void set_frame_pointers(bool frame_pointers) {
+    frame_pointers_ = frame_pointers;
+  }
+
+  // Profilers and debuggers the JIT tells about the code it loads, by
+  // default the ones $VOID_JIT_EVENTS names. Set before the module is JIT
+  // compiled.
+  void set_jit_events(JitEvents events) { jit_events_ = events; }
+
+  // Add an exported "<name>.entry" function that reads name's integer
+  // arguments from an array of sign extended i64s and returns its result
+  // sign extended to i64 (0 for void), so callers that don't know the
+  // signature can call it. Returns the entry's name.
+  std::string generate_entry_thunk(const std::string& name);
+  // Address of a function in the module, JIT compiling the module on first
+  // use. The code stays valid for the lifetime of the generator.
+  uint64_t jit_function_address(const std::string& name);
+
+  // Whether the module calls into the `loop par` runtime, which executables
+  // then have to be linked against
+  [[nodiscard]] bool uses_parallel_runtime() const;
+
+  // Byte offset of a struct's field, and the struct's size and alignment, as
+  // laid out for the target
+  [[nodiscard]] uint64_t field_offset(const std::string& struct_name,
+                                      const std::string& field) const;
+  [[nodiscard]] uint64_t struct_size(const std::string& struct_name) const;
+  [[nodiscard]] uint64_t struct_alignment(const std::string& struct_name) const;
+
+  // Number of functions dropped as unreachable from main, by the parser or by
+  // generate_program
+  [[nodiscard]] size_t eliminated_function_count() const {
+    return eliminated_functions_;
+  }
 
  private:
+  bool emit_file(const std::string& filename, llvm::CodeGenFileType file_type);
+  // Throws if `return musttail callee(...)` in caller can't reuse its frame
+  void check_must_tail(const std::string& caller,
+                       const std::string& callee) const;
+  // Frame pointers and finalized debug info for every function generated
+  void finish_program();
+  // With debug info on, give function a subprogram at location and make it
+  // the scope of statement locations until the matching end_debug_function
+  void begin_debug_function(llvm::Function* function, SourceLocation location);
+  void end_debug_function();
+  // Attribute the instructions generated next to where node is in the source
+  void set_debug_location(const ASTNode* node);
+  // MCJIT engine_ taking over module_, with the jit_events_ listeners
+  void create_engine();
+  // Make the instrumented module's counters findable once it is JIT
+  // compiled, and remember which function each belongs to
+  void expose_profile_counters();
+  // For the host triple and target_cpu_, or nullptr with error set
+  std::unique_ptr<llvm::TargetMachine> create_target_machine(
+      std::string& error) const;
   llvm::Value* generate_expression(const ASTNode* node);
   void generate_statement(const ASTNode* node, llvm::Function* function);
+  void generate_match(const MatchStatement* match_stmt,
+                      llvm::Function* function);
   void generate_range_loop(const LoopStatement* loop_stmt,
                            llvm::Function* function);
+  // A range bound converted to the loop counter's type
+  llvm::Value* convert_bound(const ASTNode* bound, llvm::Type* type);
+  // Outline the body of a `loop par` and hand it to the parallel runtime
+  void generate_parallel_range_loop(const LoopStatement* loop_stmt,
+                                    llvm::Function* function);
+  // loop x in values: each element copied into x in turn
+  void generate_array_loop(const LoopStatement* loop_stmt,
+                           llvm::Function* function);
   void generate_conditional_loop(const LoopStatement* loop_stmt,
                                  llvm::Function* function);
   llvm::Value* generate_anonymous_function(const AnonymousFunction* anon_func);
 
+  // Storage for an array local, see kStackArrayLimit
+  llvm::Value* allocate_array(const ArrayType& array, const std::string& name);
+  // Release the current function's heap arrays before each of its returns,
+  // once its body is complete
+  void free_heap_arrays(llvm::Function* function);
+  // Fill an array from a literal (empty means zeroed) or another array
+  void store_array(llvm::Value* address, const ArrayType& array,
+                   const ASTNode* value);
+  // Bounds checked address of name[index], and the element's type
+  std::pair<llvm::Value*, std::string> element_address(const std::string& name,
+                                                       const ASTNode* index);
+  // index as an i64, trapping unless 0 <= index < limit
+  llvm::Value* checked_index(const ASTNode* index_node, uint64_t limit);
+  // Branch to a cold <label>.fail block that traps unless condition holds,
+  // and continue in <label>.ok. Unless message is empty, the fail block
+  // first writes "Error: " and message, a printf format for args, to stderr,
+  // as the interpreter reports the same faults.
+  void trap_unless(llvm::Value* condition, const std::string& label,
+                   const std::string& message = "",
+                   const std::vector<llvm::Value*>& args = {});
+  // Integer +, - or * following the current function's overflow mode.
+  // name is the result's, or nullptr for the operator's usual one.
+  llvm::Value* generate_arithmetic(TokenType op, llvm::Value* left,
+                                   llvm::Value* right, bool is_unsigned,
+                                   const char* name = nullptr);
+
+  // Lane by lane arithmetic, comparisons and mask logic
+  llvm::Value* generate_vector_operation(const BinaryOperation* binop,
+                                         llvm::Value* left,
+                                         llvm::Value* right);
+  // v8i32(x) or v8i32(a, b, ...)
+  llvm::Value* generate_vector_literal(const VectorType& vector,
+                                       const FunctionCall* call);
+  // vNT.load and the simd.* builtins
+  llvm::Value* generate_simd_call(const MemberAccess* member);
+  // Bounds checked address of the vector at array[index], and its alignment
+  std::pair<llvm::Value*, llvm::Align> vector_address(
+      const ASTNode* array_node, const ASTNode* index_node,
+      const VectorType& vector);
+
+  struct StructInfo {
+    const StructDeclaration* declaration;
+    llvm::StructType* type;
+    // Element of type holding each field, which padding can shift
+    std::vector<unsigned> field_indices;
+    llvm::Align alignment;
+  };
+  // An LLVM struct type for each of program's structs
+  void declare_structs(const Program* program);
+  void define_struct(StructInfo& info, std::set<std::string>& defining);
+  // Alignment of a value of type in memory: the target's, raised to a
+  // struct's align(N)
+  llvm::Align type_alignment(const std::string& type);
+  // An alloca for a local of type, aligned as type_alignment requires
+  llvm::AllocaInst* create_local(const std::string& type,
+                                 const std::string& name);
+  // Point(x, y), or Point() for a zeroed one
+  llvm::Value* generate_struct_literal(const StructInfo& info,
+                                       const FunctionCall* call);
+
+  // Memory holding a value: its address, void type and known alignment
+  struct Place {
+    llvm::Value* address;
+    std::string type;
+    llvm::Align align;
+  };
+  // Where the struct node names lives: a variable, one a pointer variable
+  // points to, an array element or a field
+  Place struct_place(const ASTNode* node);
+  Place field_place(const ASTNode* object, const std::string& field);
+
+  // The array type if type is an array of a soa struct, which is stored as
+  // one array per field. Its elements are gathered from and scattered to
+  // those arrays.
+  [[nodiscard]] std::optional<ArrayType> soa_array(
+      const std::string& type) const;
+  llvm::Value* load_soa_element(llvm::Value* address, const ArrayType& array,
+                                llvm::Value* index);
+  void store_soa_element(llvm::Value* address, const ArrayType& array,
+                         llvm::Value* index, llvm::Value* value);
+
+  // signext/zeroext on narrow integers, as C callers expect
+  void add_c_abi_attributes(llvm::Function* function,
+                            const FunctionType& type);
+  // What the borrow rules guarantee about borrow parameters: noalias,
+  // readonly for a &T, and the size and alignment of the place borrowed
+  void add_borrow_attributes(llvm::Function* function,
+                             const std::vector<std::string>& param_types);
+  // Bind function's parameters in the current scope. Other parameters are
+  // copied to locals, but a borrow names the place it borrows directly.
+  void declare_parameters(
+      llvm::Function* function,
+      const std::vector<std::unique_ptr<Parameter>>& params);
+  // The place &node takes the address of
+  Place borrow_place(const ASTNode* node);
+  // The place a pointer or borrow called name points to, for .*
+  Place pointee_place(const std::string& name);
+
+  // Truncate or sign-extend an integer to type, or splat it into every lane
+  // of a vector type. Other values pass through.
+  llvm::Value* convert_integer(llvm::Value* value, llvm::Type* type);
+
+  // Devirtualization of calls through function pointer locals
+  std::vector<llvm::Function*> resolve_call_targets(
+      const FunctionCall* call, llvm::FunctionType* function_type) const;
+  llvm::Value* generate_guarded_call(
+      llvm::FunctionType* function_type, llvm::Value* func_ptr,
+      const std::vector<llvm::Function*>& targets,
+      const std::vector<llvm::Value*>& args);
+
   // Function pointer helpers
   bool is_function_pointer_type(const std::string& type_str);
   llvm::Type* get_llvm_type_from_string(const std::string& type_str);
-  FunctionType parse_function_type(const std::string& type_str);
 
   std::unique_ptr<llvm::LLVMContext> context_;
   std::unique_ptr<llvm::Module> module_;
   std::unique_ptr<llvm::IRBuilder<>> builder_;
-  std::unordered_map<std::string, llvm::AllocaInst*> function_params_;
-  std::unordered_map<std::string, llvm::AllocaInst*> local_variables_;
-  std::unordered_map<std::string, std::string>
-      variable_types_;  // Track variable types for proper loading
+  std::unique_ptr<llvm::ExecutionEngine> engine_;  // owns module_ once JITed
+  SymbolTable symbols_;  // Parameters and locals of the current function
   std::string current_function_return_type_;  // Track current function's return
                                               // type for validation
+  size_t eliminated_functions_ = 0;
+  std::string target_cpu_ = "generic";
+  bool c_abi_ = false;  // exported functions follow the C ABI
+  OverflowMode program_overflow_ = OverflowMode::Wrap;
+  OverflowMode overflow_mode_ = OverflowMode::Wrap;  // the current function's
+  bool in_parallel_body_ = false;  // generating an outlined `loop par` body
+  std::vector<llvm::Value*> heap_arrays_;  // to free when the function returns
+  ConstantFolds constant_folds_;
+  CallTargets call_targets_;
+  std::optional<CallGraph> call_graph_;  // of the program being generated
+  // Internal recursive functions, which use tailcc so calls in tail position
+  // can always reuse the caller's frame
+  std::unordered_set<std::string> tail_functions_;
+  std::unordered_map<std::string, FunctionType> function_types_;
+  std::unordered_set<llvm::Function*> prototypes_;  // declared, not yet defined
+  bool profile_generate_ = false;
+  std::string profile_use_;
+  // Counters of an instrumented module that was JIT compiled
+  struct ProfiledFunction {
+    std::string name;  // as the profile knows it
+    uint64_t hash;     // of the function's control flow when instrumented
+    std::string counters;
+    size_t counter_count;
+  };
+  std::vector<ProfiledFunction> profiled_functions_;
+  std::unordered_map<uint64_t, std::string> profile_names_;  // by MD5
+  bool frame_pointers_ = false;
+  JitEvents jit_events_ = jit_events_from_environment();
+  std::unique_ptr<llvm::DIBuilder> debug_builder_;  // null without debug info
+  llvm::DIFile* debug_file_ = nullptr;
+  // Subprograms of the functions being generated, innermost last, since
+  // anonymous functions and `loop par` bodies are generated mid-function.
+  // Each comes with the location to go back to when it ends.
+  std::vector<std::pair<llvm::DISubprogram*, llvm::DebugLoc>> debug_scopes_;
+  std::unordered_map<const AnonymousFunction*, llvm::Function*>
+      anonymous_functions_;
+  std::unordered_map<std::string, StructInfo> structs_;
+  // Functions from other modules, by declare_function
+  std::unordered_map<std::string, FunctionType> declared_functions_;
 };
 
 }  // namespace void_compiler
@@ -1,10 +1,14 @@
 #ifndef COMPILER_H
 #define COMPILER_H
 #include <string>
+#include <vector>
 
+#include "jit_events.h"
+#include "jit_tier.h"
 #include "types.h"
 
 namespace void_compiler {
+class CodeGenerator;
 
 struct SourcePath {
   std::string path;
@@ -14,16 +18,99 @@ struct OutputPath {
   std::string path;
 };
 
+// Counters collected during the last compilation, reported by --stats
+struct CompileStats {
+  size_t functions_eliminated = 0;
+  std::vector<std::string> folded_calls;  // "call = value", one per call site
+  bool interpreted = false;  // compile_and_run started in the interpreter
+  bool tiered = false;       // ... and handed hot functions to the JIT
+  std::vector<TierUpEvent> tier_ups;  // failed compiles too, see error
+  bool jit_cache_hit = false;  // the JIT reused cached code, skipping codegen
+};
+
+// Profile-guided optimization of native code
+struct ProfileOptions {
+  // Instrument it to count how often each branch goes which way. Executables
+  // then write default.profraw when they exit, for llvm-profdata merge.
+  bool generate = false;
+  std::string output;  // where compile_and_run writes the counts, .profdata
+  std::string use;     // an indexed profile (.profdata) to optimize with
+};
+
+// What native code carries for debuggers and sampling profilers
+struct DebugOptions {
+  // File the DWARF line tables refer to, empty for no debug info
+  std::string source_file;
+  bool frame_pointers = false;  // so the stack can be walked without unwinding
+};
+
+// Directory of the `loop par` runtime library executables are linked
+// against: the compiler's own directory in a build tree, the lib directory
+// beside its bin once installed, or else where the build put it
+std::string runtime_library_directory();
+
+// How compile_and_run executes a program
+enum class ExecutionMode : uint8_t {
+  Auto,       // tiered for small programs the interpreter can run, else JIT
+  Interpret,  // bytecode interpreter, never touches LLVM
+  Tiered,     // interpret, moving hot functions to native code as they warm up
+  Jit,        // optimize with LLVM and run native code
+};
+
 // compiler class to string together the lexer, parser, and code generator
 class Compiler {
  public:
-  int compile_and_run(const std::string& source);
+  int compile_and_run(const std::string& source,
+                      ExecutionMode mode = ExecutionMode::Auto);
 
   bool compile_to_executable(const SourcePath& source,
                              const OutputPath& output_name);
 
+  [[nodiscard]] const CompileStats& stats() const { return stats_; }
+
+  // When the tiered mode compiles a function
+  void set_tier_up_policy(TierUpPolicy policy) { tier_up_policy_ = policy; }
+
+  // CPU compile_to_executable targets, see CodeGenerator::set_target_cpu
+  void set_target_cpu(std::string cpu) { target_cpu_ = std::move(cpu); }
+
+  // What integer overflow does in functions without an overflow(mode)
+  // annotation
+  void set_overflow_mode(OverflowMode mode) { overflow_mode_ = mode; }
+
+  // Profiling only applies to native code, so compile_and_run uses the JIT
+  // in Auto mode while either is set
+  void set_profile(ProfileOptions profile) { profile_ = std::move(profile); }
+
+  // Debug info and frame pointers only apply to native code, so
+  // compile_and_run uses the JIT in Auto mode while either is set
+  void set_debug(DebugOptions debug) { debug_ = std::move(debug); }
+
+  // Listeners compile_and_run's JIT tells about the code it loads, on top of
+  // the ones $VOID_JIT_EVENTS names. Auto mode uses the JIT when any are set.
+  void set_jit_events(JitEvents events) { jit_events_ = events; }
+
+  // Where the JIT keeps compiled objects between runs, "" (the default) to
+  // always compile
+  void set_cache_directory(std::string directory) {
+    cache_directory_ = std::move(directory);
+  }
+
  private:
   std::unique_ptr<Program> compile_source(const std::string& source);
+  void set_debug_options(CodeGenerator& codegen) const;
+  void generate_code(const Program* program, CodeGenerator& codegen);
+  int interpret(const Program* program, const BytecodeModule& module,
+                bool tiered);
+
+  CompileStats stats_;
+  TierUpPolicy tier_up_policy_;
+  std::string cache_directory_;
+  std::string target_cpu_ = "generic";
+  OverflowMode overflow_mode_ = OverflowMode::Wrap;
+  ProfileOptions profile_;
+  DebugOptions debug_;
+  JitEvents jit_events_;
 };
 #endif  // COMPILER_H
 }
@@ -0,0 +1,85 @@
+#ifndef CONST_EVALUATOR_H
+#define CONST_EVALUATOR_H
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "types.h"
+
+namespace void_compiler {
+
+// A value computed at compile time. Integers are stored sign-extended from
+// their type's width, which matches the bit pattern the generated code would
+// hold (bools are stored as 0 or 1).
+struct ConstValue {
+  int64_t value;
+  std::string type;
+};
+
+// Calls replaced by their result, keyed by the call site in the AST
+using ConstantFolds = std::unordered_map<const FunctionCall*, ConstValue>;
+
+struct EvaluationLimits {
+  size_t max_steps = 1'000'000;     // per folded call site
+  size_t max_recursion_depth = 128;
+};
+
+/*
+   Compile time evaluator. A function is pure if it only works on integers and
+   bools and only calls other pure functions - no fmt, no pointers, no function
+   pointers. Calls to pure functions whose arguments are constant expressions
+   are interpreted here and their results are emitted as literals, so
+   `pow(2, 10)` costs nothing at runtime. Anything the interpreter can't finish
+   within its limits (or that would trap, like division by zero or overflow
+   in a function whose overflow mode is trap) is left to run at runtime as
+   before.
+*/
+class ConstEvaluator {
+ public:
+  explicit ConstEvaluator(const Program* program, EvaluationLimits limits = {});
+
+  ConstantFolds fold_calls();
+
+  // Human readable "call = value" lines for everything folded so far
+  [[nodiscard]] const std::vector<std::string>& report() const {
+    return report_;
+  }
+
+ private:
+  struct Frame {
+    std::unordered_map<std::string, ConstValue> variables;
+    const FunctionDeclaration* function;
+    OverflowMode overflow;
+  };
+
+  void find_pure_functions();
+  bool is_pure_node(const ASTNode* node,
+                    const std::unordered_set<std::string>& locals) const;
+  void fold_in(const ASTNode* node,
+               const std::unordered_set<std::string>& locals,
+               ConstantFolds& folds);
+  bool is_constant_expression(const ASTNode* node) const;
+
+  ConstValue call(const FunctionDeclaration* func,
+                  const std::vector<ConstValue>& args);
+  ConstValue evaluate(const ASTNode* node, Frame& frame);
+  // Returns true if the statement executed a return
+  bool execute(const ASTNode* node, Frame& frame, ConstValue& result);
+  bool execute_block(const std::vector<std::unique_ptr<ASTNode>>& body,
+                     Frame& frame, ConstValue& result);
+  void step();
+
+  const Program* program_;
+  std::unordered_map<std::string, const FunctionDeclaration*> functions_;
+  std::unordered_set<std::string> pure_functions_;
+  EvaluationLimits limits_;
+  OverflowMode caller_overflow_ = OverflowMode::Wrap;  // of the call folded
+  size_t steps_ = 0;
+  size_t depth_ = 0;
+  std::vector<std::string> report_;
+};
+
+}  // namespace void_compiler
+#endif  // CONST_EVALUATOR_H
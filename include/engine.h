@@ -0,0 +1,115 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+#include "types.h"
+
+namespace void_compiler {
+
+// The void type a C++ type crosses the native boundary as
+template <typename T>
+struct VoidType;
+
+template <>
+struct VoidType<void> {
+  static std::string name() { return "void"; }
+};
+template <>
+struct VoidType<bool> {
+  static std::string name() { return "bool"; }
+};
+template <>
+struct VoidType<int8_t> {
+  static std::string name() { return "i8"; }
+};
+template <>
+struct VoidType<int16_t> {
+  static std::string name() { return "i16"; }
+};
+template <>
+struct VoidType<int32_t> {
+  static std::string name() { return "i32"; }
+};
+template <>
+struct VoidType<int64_t> {
+  static std::string name() { return "i64"; }
+};
+template <>
+struct VoidType<uint8_t> {
+  static std::string name() { return "u8"; }
+};
+template <>
+struct VoidType<uint16_t> {
+  static std::string name() { return "u16"; }
+};
+template <>
+struct VoidType<uint32_t> {
+  static std::string name() { return "u32"; }
+};
+template <>
+struct VoidType<uint64_t> {
+  static std::string name() { return "u64"; }
+};
+template <>
+struct VoidType<const char*> {
+  static std::string name() { return "string"; }
+};
+template <typename T>
+struct VoidType<T*> {
+  static std::string name() { return "*" + VoidType<T>::name(); }
+};
+template <typename R, typename... Args>
+struct VoidType<R (*)(Args...)> {
+  static std::string name() {
+    return FunctionType({VoidType<Args>::name()...}, VoidType<R>::name())
+        .to_string();
+  }
+};
+
+/*
+   A void program compiled to native code, for calling from C++. Copies share
+   the code, which stays alive until the last copy is gone. Lookups only read
+   the module, so one module can be used from any number of threads.
+*/
+class Module {
+ public:
+  // Native code for function name. Signature must match its declared type,
+  // e.g. get<int32_t(int32_t, int32_t)>("add") for fn(i32, i32) -> i32. The
+  // pointer is valid while this module or a copy of it is alive.
+  template <typename Signature>
+  Signature* get(const std::string& name) const {
+    static_assert(std::is_function_v<Signature>,
+                  "get takes a function type, e.g. get<int32_t(int32_t)>");
+    return reinterpret_cast<Signature*>(
+        address(name, VoidType<Signature*>::name()));
+  }
+
+  [[nodiscard]] bool contains(const std::string& name) const;
+
+ private:
+  friend class Engine;
+  struct State;
+
+  explicit Module(std::shared_ptr<const State> state)
+      : state_(std::move(state)) {}
+
+  // Throws unless name exists and has type
+  [[nodiscard]] uintptr_t address(const std::string& name,
+                                  const std::string& type) const;
+
+  std::shared_ptr<const State> state_;
+};
+
+// Entry point for embedding void in a C++ program
+class Engine {
+ public:
+  // Compile source at -O2. Every top level function is exported, whether or
+  // not there is a main. Invalid programs throw std::runtime_error.
+  static Module load(const std::string& source);
+};
+
+}  // namespace void_compiler
+#endif  // ENGINE_H
@@ -0,0 +1,84 @@
+#ifndef FUNCTION_POINTER_ANALYSIS_H
+#define FUNCTION_POINTER_ANALYSIS_H
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "types.h"
+
+namespace void_compiler {
+
+// The functions a call through a local function pointer may reach, each a
+// FunctionDeclaration or an AnonymousFunction
+using CallTargets =
+    std::unordered_map<const FunctionCall*, std::vector<const ASTNode*>>;
+
+/*
+   Flow analysis of function pointer locals. Walks every function body in
+   order and tracks, for each local, the set of functions it may hold at that
+   point: assignments replace the set, if/else branches join theirs, and loop
+   bodies are iterated to a fixpoint. Calls through a local whose set is known
+   and small are reported in call_targets() so code generation can call the
+   targets directly instead of through the pointer.
+
+   Parameters and locals initialised from anything other than a function name,
+   an anonymous function or another tracked local are unknown, and calls
+   through them are left indirect. So are locals once they have been
+   borrowed, for the rest of the function.
+*/
+class FunctionPointerAnalysis {
+ public:
+  // Sites with more possible targets than this stay indirect
+  static constexpr size_t kMaxTargets = 3;
+
+  explicit FunctionPointerAnalysis(const Program* program);
+
+  [[nodiscard]] const CallTargets& call_targets() const {
+    return call_targets_;
+  }
+
+ private:
+  struct PointerTargets {
+    bool unknown = false;
+    std::vector<const ASTNode*> targets;
+
+    bool operator==(const PointerTargets& other) const = default;
+  };
+
+  using State = std::unordered_map<std::string, PointerTargets>;
+  // Names declared in the current block and the binding each one shadowed
+  using Shadowed =
+      std::vector<std::pair<std::string, std::optional<PointerTargets>>>;
+
+  void analyze_function(const std::vector<std::unique_ptr<Parameter>>& params,
+                        const std::vector<std::unique_ptr<ASTNode>>& body);
+  void analyze_block(const std::vector<std::unique_ptr<ASTNode>>& body,
+                     State& state);
+  void analyze_statement(const ASTNode* node, State& state,
+                         Shadowed& shadowed);
+  void analyze_loop(const LoopStatement* loop_stmt, State& state);
+
+  // Records any call sites inside node and returns what it may point to
+  PointerTargets evaluate(const ASTNode* node, const State& state);
+
+  static PointerTargets unknown_targets() {
+    return PointerTargets{.unknown = true, .targets = {}};
+  }
+  static void declare(const std::string& name, PointerTargets targets,
+                      State& state, Shadowed& shadowed);
+  static void restore(Shadowed& shadowed, State& state);
+  static PointerTargets join(const PointerTargets& a, const PointerTargets& b);
+  static State join(const State& a, const State& b);
+
+  std::unordered_map<std::string, const FunctionDeclaration*> functions_;
+  std::unordered_set<const AnonymousFunction*> analyzed_;
+  // Locals of the function being analyzed that have been borrowed so far
+  std::unordered_set<std::string> borrowed_;
+  CallTargets call_targets_;
+};
+
+}  // namespace void_compiler
+#endif  // FUNCTION_POINTER_ANALYSIS_H
@@ -0,0 +1,71 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bytecode_compiler.h"
+#include "jit_tier.h"
+
+namespace void_compiler {
+
+struct InterpreterLimits {
+  size_t max_call_depth = 100'000;
+};
+
+/*
+   Runs bytecode from BytecodeCompiler. Calls push a frame on an explicit
+   stack instead of recursing, and each frame's registers are a window into
+   one shared register file, so a call is a copy of its arguments and a jump.
+   A tail call copies its arguments over the caller's own registers and
+   pushes nothing, so tail recursion runs in constant space.
+
+   Anything the native code would crash on (division by zero, running off the
+   end of a function, unbounded recursion) throws std::runtime_error instead.
+
+   With a JitTier attached, calls and loop back-edges are counted per
+   function. Functions past the tier's threshold are sent to it to compile,
+   and once their native code is ready later calls run that instead.
+*/
+class Interpreter {
+ public:
+  explicit Interpreter(const BytecodeModule& module,
+                       InterpreterLimits limits = {}, JitTier* jit = nullptr);
+
+  // Runs main and returns its result, 0 for a void main
+  int64_t run();
+
+  // Calls that went to JIT compiled code during the last run
+  [[nodiscard]] size_t native_calls() const { return native_calls_; }
+
+ private:
+  struct Frame {
+    const BytecodeFunction* function;
+    size_t pc;
+    size_t base;      // first register of the frame in registers_
+    uint32_t result;  // caller register receiving the return value
+  };
+
+  // printf over the %d, %s and %% conversions fmt.println produces
+  std::string format(const std::string& format, const int64_t* args,
+                     size_t count) const;
+
+  // Count a call or back-edge in function, queueing it at the threshold
+  void count_hot(size_t function);
+  // Pick up functions the JIT tier finished since the last look
+  void install_native_code();
+
+  const BytecodeModule& module_;
+  InterpreterLimits limits_;
+  std::vector<int64_t> registers_;
+  std::vector<Frame> frames_;
+
+  JitTier* jit_;
+  std::vector<size_t> hotness_;      // by function index
+  std::vector<NativeEntry> native_;  // by function index, null if interpreted
+  size_t installed_ = 0;             // jit_->ready_count() when last installed
+  size_t native_calls_ = 0;
+};
+
+}  // namespace void_compiler
+#endif  // INTERPRETER_H
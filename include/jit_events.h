@@ -0,0 +1,47 @@
+#ifndef JIT_EVENTS_H
+#define JIT_EVENTS_H
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace llvm {
+class ExecutionEngine;
+}
+
+namespace void_compiler {
+
+/*
+   Who gets told about the code a JIT loads, so JIT compiled functions show
+   up in profiles and debuggers by name instead of as anonymous memory:
+
+   - perf: each function's address, size and name is appended to
+     /tmp/perf-<pid>.map, which `perf top` and `perf report` read as they
+     are. LLVM's perf listener also writes a jitdump with line numbers (given
+     debug info) for `perf record -k 1` followed by `perf inject --jit`, when
+     LLVM was built with perf support.
+   - gdb: objects are registered through GDB's JIT interface, so breakpoints
+     and backtraces work in JIT compiled code.
+
+   Listening costs nothing per call: it happens once, as code is loaded.
+*/
+struct JitEvents {
+  bool perf = false;
+  bool gdb = false;
+};
+
+// "perf", "gdb" or both separated by commas, nullopt for anything else
+std::optional<JitEvents> parse_jit_events(std::string_view names);
+
+// What $VOID_JIT_EVENTS asks for, in parse_jit_events' format. Unset or
+// invalid means no listeners.
+JitEvents jit_events_from_environment();
+
+// The perf map of this process
+std::string perf_map_path();
+
+// Tell events' listeners about everything engine loads from now on
+void register_jit_event_listeners(llvm::ExecutionEngine& engine,
+                                  JitEvents events);
+
+}  // namespace void_compiler
+#endif  // JIT_EVENTS_H
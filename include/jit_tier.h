@@ -0,0 +1,102 @@
+#ifndef JIT_TIER_H
+#define JIT_TIER_H
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "bytecode_compiler.h"
+#include "types.h"
+
+namespace void_compiler {
+class CodeGenerator;
+
+// JIT compiled stand-in for a bytecode function. Arguments and the result
+// are sign extended int64s, as in the interpreter's registers.
+using NativeEntry = int64_t (*)(const int64_t* args);
+
+struct TierUpPolicy {
+  size_t threshold = 1000;  // calls plus loop back-edges before compiling
+  // Compile on the interpreter's thread instead of in the background, so
+  // the switch to native code happens at a predictable point
+  bool synchronous = false;
+};
+
+// A function moved from the interpreter to native code, or that failed to
+// compile and stays interpreted
+struct TierUpEvent {
+  std::string function;
+  size_t hotness;     // calls plus loop back-edges when it was queued
+  double compile_ms;  // LLVM code generation, optimization and JIT time
+  std::string error;  // why the compile failed, empty if it succeeded
+};
+
+/*
+   Background compiler for the tiered execution mode. The interpreter counts
+   calls and loop back-edges per function and hands the hot ones to request().
+   A worker thread compiles them with LLVM at -O2 while the interpreter keeps
+   going, and publishes their entry points for the interpreter to pick up on
+   its next call.
+
+   Every compile generates the whole program in a fresh context, so the hot
+   function's callees are optimized and inlined with it. Functions queued
+   while a compile is running are batched into the next one.
+*/
+class JitTier {
+ public:
+  JitTier(const Program* program, const BytecodeModule& module,
+          TierUpPolicy policy = {});
+  ~JitTier();
+
+  JitTier(const JitTier&) = delete;
+  JitTier& operator=(const JitTier&) = delete;
+
+  [[nodiscard]] const TierUpPolicy& policy() const { return policy_; }
+
+  // Queue function (an index into the module) for compilation
+  void request(size_t function, size_t hotness);
+
+  // Number of functions compiled so far, cheap enough to poll on every call
+  [[nodiscard]] size_t ready_count() const {
+    return ready_count_.load(std::memory_order_acquire);
+  }
+  // Entry points of the compiled functions, by function index
+  [[nodiscard]] std::vector<std::pair<size_t, NativeEntry>> ready() const;
+
+  // Drop queued work, wait for a compile in progress and return what was
+  // compiled, and what failed to
+  std::vector<TierUpEvent> finish();
+
+ private:
+  struct Request {
+    size_t function;
+    size_t hotness;
+  };
+
+  void run_worker();
+  void compile(const std::vector<Request>& batch);
+
+  const Program* program_;
+  const BytecodeModule& module_;
+  TierUpPolicy policy_;
+
+  std::thread worker_;  // started by the first request
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<Request> queue_;
+  bool stopping_ = false;
+
+  std::atomic<size_t> ready_count_ = 0;
+  std::vector<std::pair<size_t, NativeEntry>> ready_;
+  std::vector<TierUpEvent> events_;
+  // Keep the JIT compiled code alive while the interpreter may call it
+  std::vector<std::unique_ptr<CodeGenerator>> generators_;
+};
+
+}  // namespace void_compiler
+#endif  // JIT_TIER_H
@@ -0,0 +1,53 @@
+#ifndef OBJECT_CACHE_H
+#define OBJECT_CACHE_H
+#include <memory>
+#include <string>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/MemoryBuffer.h>
+#pragma clang diagnostic pop
+
+namespace void_compiler {
+
+/*
+   Object files produced by the JIT, kept on disk so an unchanged program
+   skips machine code generation on its next run. Entries are named after the
+   module identifier, which CodeGenerator::assign_cache_key sets to a hash of
+   everything that affects the generated code.
+
+   The cache is only ever an optimization: entries that can't be read or
+   written are treated as misses.
+*/
+class DiskObjectCache : public llvm::ObjectCache {
+ public:
+  explicit DiskObjectCache(std::string directory);
+
+  // $XDG_CACHE_HOME/void or ~/.cache/void, or "" if neither is known
+  static std::string default_directory();
+
+  // Reads key's object file and holds it for the getObject that follows,
+  // returning whether there was a valid one. Callers that skip optimization
+  // on a hit need this: an entry evicted after a mere existence check would
+  // leave MCJIT compiling the unoptimized module
+  [[nodiscard]] bool preload(const std::string& key);
+
+  void notifyObjectCompiled(const llvm::Module* module,
+                            llvm::MemoryBufferRef object) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(
+      const llvm::Module* module) override;
+
+ private:
+  [[nodiscard]] std::unique_ptr<llvm::MemoryBuffer> load(
+      const std::string& key) const;
+  [[nodiscard]] std::string path_for(const std::string& key) const;
+
+  std::string directory_;
+  std::string preloaded_key_;
+  std::unique_ptr<llvm::MemoryBuffer> preloaded_;
+};
+
+}  // namespace void_compiler
+#endif  // OBJECT_CACHE_H
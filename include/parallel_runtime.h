@@ -0,0 +1,24 @@
+#ifndef PARALLEL_RUNTIME_H
+#define PARALLEL_RUNTIME_H
+#include <cstdint>
+
+/*
+   Runtime behind `loop par`. Generated code calls it with the loop's range
+   and the loop body outlined into a function over a sub-range, plus the
+   addresses of the variables the body uses.
+
+   It is linked into the compiler for the JIT and built as a static library
+   that executables are linked against. Tuning comes from the environment:
+     VOID_NUM_THREADS  threads to use, including the caller (default: cores)
+     VOID_PAR_GRAIN    iterations per chunk (default: range / (8 * threads))
+*/
+extern "C" {
+
+using VoidParallelBody = void (*)(int64_t begin, int64_t end, void* context);
+
+// Run body over [begin, end) in chunks and return once every chunk is done
+void void_parallel_for(int64_t begin, int64_t end, VoidParallelBody body,
+                       void* context);
+}
+
+#endif  // PARALLEL_RUNTIME_H
@@ -1,18 +1,35 @@
 #ifndef PARSER_H
 #define PARSER_H
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "types.h"
 
 namespace void_compiler {
+// Which top-level functions parse() keeps
+enum class FunctionSelection : uint8_t {
+  ReachableFromMain,  // skip functions main never uses (keeps all if no main)
+  All,                // every function, for embedding
+};
+
 // Parser
 class Parser {
  public:
-  explicit Parser(std::vector<Token> tokens) : tokens_(std::move(tokens)) {}
+  explicit Parser(
+      std::vector<Token> tokens,
+      FunctionSelection selection = FunctionSelection::ReachableFromMain)
+      : tokens_(std::move(tokens)), selection_(selection) {}
 
   std::unique_ptr<Program> parse();
 
+  // Make a function defined outside these tokens known, so calls to it get
+  // typed, e.g. one from an earlier input of an interactive session
+  void declare_function(const std::string& name,
+                        const std::string& return_type) {
+    function_return_types_[name] = return_type;
+  }
+
  private:
   Token& peek();
   Token consume(TokenType expected);
@@ -25,25 +42,68 @@ class Parser {
   std::unique_ptr<ASTNode> parse_multiplicative();
   std::unique_ptr<ASTNode> parse_unary();
   std::unique_ptr<ASTNode> parse_primary();
+  // A statement, located at its first token
   std::unique_ptr<ASTNode> parse_statement();
+  std::unique_ptr<ASTNode> parse_unlocated_statement();
   std::unique_ptr<IfStatement> parse_if_statement();
   std::unique_ptr<LoopStatement> parse_loop_statement();
-  std::unique_ptr<RangeExpression> parse_range_expression();
+  // Whether the tokens at current_ start a match statement
+  [[nodiscard]] bool at_match_statement() const;
+  std::unique_ptr<MatchStatement> parse_match_statement();
+  // A 'do' statement or a { block }
+  std::vector<std::unique_ptr<ASTNode>> parse_body();
   std::unique_ptr<ImportStatement> parse_import();
-  std::unique_ptr<FunctionDeclaration> parse_function();
+  // Whether the tokens at position start a struct declaration
+  [[nodiscard]] bool at_struct_declaration(size_t position) const;
+  std::unique_ptr<StructDeclaration> parse_struct_declaration();
+  // Field accesses following object: .x, .x.y, ...
+  std::unique_ptr<ASTNode> parse_fields(std::unique_ptr<ASTNode> object);
+  // object.field = value, with current_ at the first '.'
+  std::unique_ptr<FieldAssignment> parse_field_assignment(
+      std::unique_ptr<ASTNode> object);
+  std::unique_ptr<FunctionDeclaration> parse_function_signature();
+  void parse_function_body(FunctionDeclaration* func);
+  size_t skip_function_body();  // Returns the token index after the body
   std::unique_ptr<AnonymousFunction> parse_anonymous_function();
   std::unique_ptr<VariableDeclaration> parse_variable_declaration();
   std::unique_ptr<VariableAssignment> parse_variable_assignment();
   std::string parse_type();  // Helper to parse type tokens
   std::string infer_type(
       const ASTNode* node);  // Helper to infer types from expressions
+  // Type of a freshly built node from its children's cached types, or empty
+  // if it can't be known yet. Never recurses, so typing is linear overall.
+  std::string compute_type(const ASTNode* node) const;
+  template <typename Node>
+  std::unique_ptr<Node> typed(std::unique_ptr<Node> node);
+
+  // A top-level function found by the pre-scan: its signature is parsed
+  // eagerly, its body is only parsed once the function is known to be needed
+  struct FunctionStub {
+    std::unique_ptr<FunctionDeclaration> declaration;
+    size_t body_begin;
+    size_t body_end;
+  };
+
+  std::unordered_set<std::string> find_reachable_functions(
+      const std::vector<FunctionStub>& stubs) const;
 
   std::vector<Token> tokens_;
+  FunctionSelection selection_;
   size_t current_ = 0;
 
   // Symbol table for type tracking
   std::unordered_map<std::string, std::string> variable_types_;
   std::unordered_map<std::string, std::string> function_return_types_;
+  // Every struct name in the file, found up front so types can name structs
+  // declared further down, and the declarations parsed so far
+  std::unordered_set<std::string> struct_names_;
+  std::unordered_map<std::string, const StructDeclaration*> structs_;
+  // Functions annotated pure, and the names called in the body being parsed
+  // (fmt for fmt.println) and the functions it uses as values, which a pure
+  // function's body may only use for other pure functions
+  std::unordered_set<std::string> pure_functions_;
+  std::vector<Token> body_calls_;
+  std::vector<Token> body_function_values_;
 };
 
 }  // namespace void_compiler
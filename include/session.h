@@ -0,0 +1,62 @@
+#ifndef SESSION_H
+#define SESSION_H
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "types.h"
+
+namespace llvm {
+class ExecutionEngine;
+class LLVMContext;
+}  // namespace llvm
+
+namespace void_compiler {
+class CodeGenerator;
+
+/*
+   Interactive session on one long-lived JIT. Each input is parsed and
+   compiled on its own into a new module added to the engine, with the
+   earlier functions it uses declared as externals. Nothing from earlier
+   inputs is parsed or compiled again, so an input costs time in proportion to
+   its own size, not to the session's history.
+
+   An input is either top level declarations (functions, imports) or
+   statements that run once. A lone expression is evaluated and its value
+   returned for display. Locals only live for the input that declares them.
+*/
+class Session {
+ public:
+  Session();
+  ~Session();
+
+  Session(const Session&) = delete;
+  Session& operator=(const Session&) = delete;
+
+  // Compile and run input. Returns the value of an expression for display,
+  // or "" if there is nothing to show. Invalid input throws
+  // std::runtime_error and leaves the session unchanged.
+  std::string evaluate(const std::string& input);
+
+  [[nodiscard]] bool contains(const std::string& function) const {
+    return functions_.contains(function);
+  }
+
+ private:
+  // Parse source as a whole input, with the earlier functions it names known
+  std::unique_ptr<Program> parse(const std::string& source) const;
+  // Run the input's wrapper function and format what it returns
+  std::string run(const std::string& name, const std::string& type);
+
+  // Declared before engine_ so the modules' contexts outlive the engine
+  std::unique_ptr<llvm::LLVMContext> context_;
+  std::vector<std::unique_ptr<CodeGenerator>> inputs_;
+  std::unique_ptr<llvm::ExecutionEngine> engine_;
+
+  std::unordered_map<std::string, FunctionType> functions_;
+  size_t input_count_ = 0;
+};
+
+}  // namespace void_compiler
+#endif  // SESSION_H
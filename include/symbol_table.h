@@ -0,0 +1,80 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace llvm {
+class Value;
+}
+
+namespace void_compiler {
+
+// A variable visible to code generation: where it lives and its void type
+struct Symbol {
+  llvm::Value* address;
+  std::string type;
+  // A borrow parameter: address is the place it borrows, of type type
+  bool borrowed = false;
+};
+
+/*
+   Scoped symbol table for code generation. Names are interned to small ids and
+   every id keeps its own stack of bindings, innermost last, so a lookup is a
+   single probe and leaving a scope only pops the names declared in it.
+
+   A function scope additionally hides every binding of the enclosing function,
+   which gives anonymous functions a fresh environment in O(1) instead of
+   saving and clearing the outer one.
+*/
+class SymbolTable {
+ public:
+  // Pops its scope when destroyed, so scopes stay balanced on exceptions
+  class ScopeGuard {
+   public:
+    ~ScopeGuard() { table_.pop_scope(); }
+    ScopeGuard(const ScopeGuard&) = delete;
+    ScopeGuard& operator=(const ScopeGuard&) = delete;
+
+   private:
+    friend class SymbolTable;
+    explicit ScopeGuard(SymbolTable& table) : table_(table) {}
+
+    SymbolTable& table_;
+  };
+
+  [[nodiscard]] ScopeGuard scope();
+  [[nodiscard]] ScopeGuard function_scope();
+
+  // Declaring a name twice in the same scope replaces the first binding
+  void declare(const std::string& name, Symbol symbol);
+
+  // The innermost binding visible from the current function, or nullptr
+  [[nodiscard]] const Symbol* lookup(const std::string& name) const;
+
+ private:
+  using NameId = uint32_t;
+
+  struct Binding {
+    Symbol symbol;
+    size_t depth;
+  };
+
+  struct Scope {
+    std::vector<NameId> declared;
+    size_t enclosing_function_depth;
+  };
+
+  NameId intern(const std::string& name);
+  void push_scope(bool is_function);
+  void pop_scope();
+
+  std::unordered_map<std::string, NameId> name_ids_;
+  std::vector<std::vector<Binding>> bindings_;  // indexed by NameId
+  std::vector<Scope> scopes_;
+  size_t function_depth_ = 0;  // depth of the innermost function scope
+};
+
+}  // namespace void_compiler
+#endif  // SYMBOL_TABLE_H
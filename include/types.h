@@ -3,6 +3,8 @@
 
 #include <array>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -121,6 +123,48 @@ class FunctionType {
   }
   [[nodiscard]] const std::string& return_type() const { return return_type_; }
 
+  // Parse "fn(param1, param2) -> return_type"
+  static FunctionType parse(const std::string& type_str) {
+    if (!type_str.starts_with("fn(")) {
+      throw std::runtime_error("Invalid function type format: " + type_str);
+    }
+
+    // Find the parameter list
+    size_t params_start = 3;  // After "fn("
+    size_t params_end = type_str.find(')');
+    if (params_end == std::string::npos) {
+      throw std::runtime_error("Missing ')' in function type: " + type_str);
+    }
+
+    // Extract parameter types
+    std::vector<std::string> param_types;
+    if (params_end > params_start) {
+      std::string params_str =
+          type_str.substr(params_start, params_end - params_start);
+
+      // Simple parsing - split by comma (assumes no nested function types for
+      // now)
+      size_t start = 0;
+      while (start < params_str.length()) {
+        size_t comma_pos = params_str.find(", ", start);
+        if (comma_pos == std::string::npos) {
+          param_types.push_back(params_str.substr(start));
+          break;
+        }
+        param_types.push_back(params_str.substr(start, comma_pos - start));
+        start = comma_pos + 2;
+      }
+    }
+
+    // Find return type
+    size_t arrow_pos = type_str.find(" -> ");
+    if (arrow_pos == std::string::npos) {
+      throw std::runtime_error("Missing ' -> ' in function type: " + type_str);
+    }
+
+    return {std::move(param_types), type_str.substr(arrow_pos + 4)};
+  }
+
   // Generate a string representation for type checking
   [[nodiscard]] std::string to_string() const {
     std::string result = "fn(";
@@ -143,10 +187,121 @@ class FunctionType {
   std::string return_type_;
 };
 
+// Fixed-size array type representation, "[N]T"
+struct ArrayType {
+  size_t length;
+  std::string element_type;
+
+  // Parse "[N]T", nullopt for any other type
+  static std::optional<ArrayType> parse(const std::string& type_str) {
+    size_t close = type_str.find(']');
+    if (!type_str.starts_with("[") || close == std::string::npos ||
+        close == 1 || close + 1 == type_str.size()) {
+      return std::nullopt;
+    }
+    size_t length = 0;
+    for (size_t i = 1; i < close; ++i) {
+      if (type_str[i] < '0' || type_str[i] > '9') return std::nullopt;
+      length = length * 10 + (type_str[i] - '0');
+    }
+    return ArrayType{.length = length,
+                     .element_type = type_str.substr(close + 1)};
+  }
+
+  [[nodiscard]] std::string to_string() const {
+    return "[" + std::to_string(length) + "]" + element_type;
+  }
+};
+
+// Borrow type representation, "&T" or "&mut T". Borrows are pointers the
+// compiler can prove don't alias: a &mut T is the only way to reach its value
+// for the duration of a call, and nothing writes a &T's value meanwhile.
+struct BorrowType {
+  bool is_mutable;
+  std::string pointee;
+
+  // Parse "&T" or "&mut T", nullopt for any other type
+  static std::optional<BorrowType> parse(const std::string& type_str) {
+    if (type_str.starts_with("&mut ")) {
+      return BorrowType{.is_mutable = true, .pointee = type_str.substr(5)};
+    }
+    if (type_str.starts_with("&") && type_str.size() > 1) {
+      return BorrowType{.is_mutable = false, .pointee = type_str.substr(1)};
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] std::string to_string() const {
+    return (is_mutable ? "&mut " : "&") + pointee;
+  }
+};
+
+// The type a pointer or borrow type points to, nullopt for other types
+inline std::optional<std::string> pointee_type(const std::string& type_str) {
+  if (auto borrow = BorrowType::parse(type_str)) return borrow->pointee;
+  if (type_str.starts_with("*") && type_str.size() > 1) {
+    return type_str.substr(1);
+  }
+  return std::nullopt;
+}
+
+// SIMD vector type "v<lanes><element>", e.g. v8i32, or v8bool for the
+// masks vector comparisons produce
+struct VectorType {
+  size_t lanes;
+  std::string element_type;
+
+  // Parse a vector type name, nullopt for any other type. Lane counts are
+  // powers of two from 2 to 64.
+  static std::optional<VectorType> parse(const std::string& type_str) {
+    size_t digits = 1;
+    size_t lanes = 0;
+    while (digits < type_str.size() && type_str[digits] >= '0' &&
+           type_str[digits] <= '9') {
+      lanes = lanes * 10 + (type_str[digits] - '0');
+      digits++;
+    }
+    if (!type_str.starts_with("v") || digits == 1 || lanes < 2 ||
+        lanes > 64 || (lanes & (lanes - 1)) != 0) {
+      return std::nullopt;
+    }
+    std::string element = type_str.substr(digits);
+    if (element != "i8" && element != "i16" && element != "i32" &&
+        element != "i64" && element != "u8" && element != "u16" &&
+        element != "u32" && element != "u64" && element != "bool") {
+      return std::nullopt;
+    }
+    return VectorType{.lanes = lanes, .element_type = std::move(element)};
+  }
+
+  [[nodiscard]] std::string to_string() const {
+    return "v" + std::to_string(lanes) + element_type;
+  }
+  [[nodiscard]] bool is_mask() const { return element_type == "bool"; }
+  [[nodiscard]] bool is_unsigned() const {
+    return element_type.starts_with("u");
+  }
+};
+
 // AST Node types
 class ASTNode {
  public:
   virtual ~ASTNode() = default;
+
+  // Type the parser inferred when it built this expression, empty if unknown
+  [[nodiscard]] const std::string& inferred_type() const {
+    return inferred_type_;
+  }
+  void set_inferred_type(std::string type) { inferred_type_ = std::move(type); }
+
+  // Where the parser found this node, set for statements and functions.
+  // Line 0 means unknown.
+  [[nodiscard]] const SourceLocation& location() const { return location_; }
+  void set_location(SourceLocation location) { location_ = location; }
+
+ private:
+  std::string inferred_type_;
+  SourceLocation location_{.line = 0, .column = 0};
 };
 
 class StringLiteral : public ASTNode {
@@ -233,15 +388,19 @@ class BinaryOperation : public ASTNode {
 
 class UnaryOperation : public ASTNode {
  public:
-  UnaryOperation(TokenType op, std::unique_ptr<ASTNode> operand)
-      : operator_(op), operand_(std::move(operand)) {}
+  UnaryOperation(TokenType op, std::unique_ptr<ASTNode> operand,
+                 bool is_mutable = false)
+      : operator_(op), operand_(std::move(operand)), is_mutable_(is_mutable) {}
 
   [[nodiscard]] TokenType operator_type() const { return operator_; }
   [[nodiscard]] const ASTNode* operand() const { return operand_.get(); }
+  // Whether a borrow is &mut rather than &
+  [[nodiscard]] bool is_mutable() const { return is_mutable_; }
 
  private:
   TokenType operator_;
   std::unique_ptr<ASTNode> operand_;
+  bool is_mutable_;
 };
 
 class VariableDeclaration : public ASTNode {
@@ -277,25 +436,36 @@ class VariableAssignment : public ASTNode {
 
 class ReturnStatement : public ASTNode {
  public:
-  explicit ReturnStatement(std::unique_ptr<ASTNode> expression)
-      : expression_(std::move(expression)) {}
+  explicit ReturnStatement(std::unique_ptr<ASTNode> expression,
+                           bool must_tail = false)
+      : expression_(std::move(expression)), must_tail_(must_tail) {}
 
   [[nodiscard]] const ASTNode* expression() const { return expression_.get(); }
+  // return musttail f(...): the call has to reuse the caller's frame
+  [[nodiscard]] bool must_tail() const { return must_tail_; }
 
  private:
   std::unique_ptr<ASTNode> expression_;
+  bool must_tail_;
 };
 
+// if likely cond / if unlikely cond: how often the then branch is expected
+// to run
+enum class BranchHint : uint8_t { None, Likely, Unlikely };
+
 class IfStatement : public ASTNode {
  public:
   IfStatement(std::unique_ptr<ASTNode> condition,
               std::vector<std::unique_ptr<ASTNode>> then_body,
-              std::vector<std::unique_ptr<ASTNode>> else_body = {})
+              std::vector<std::unique_ptr<ASTNode>> else_body = {},
+              BranchHint hint = BranchHint::None)
       : condition_(std::move(condition)),
         then_body_(std::move(then_body)),
-        else_body_(std::move(else_body)) {}
+        else_body_(std::move(else_body)),
+        hint_(hint) {}
 
   [[nodiscard]] const ASTNode* condition() const { return condition_.get(); }
+  [[nodiscard]] BranchHint hint() const { return hint_; }
   [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& then_body() const {
     return then_body_;
   }
@@ -307,6 +477,134 @@ class IfStatement : public ASTNode {
   std::unique_ptr<ASTNode> condition_;
   std::vector<std::unique_ptr<ASTNode>> then_body_;
   std::vector<std::unique_ptr<ASTNode>> else_body_;
+  BranchHint hint_;
+};
+
+// One arm of a match: the values it covers, as inclusive [low, high] ranges
+// of the matched type's values (true is 1), and what it runs
+struct MatchArm {
+  std::vector<std::pair<int64_t, int64_t>> ranges;
+  std::vector<std::unique_ptr<ASTNode>> body;
+};
+
+// match op { 0 do ..., 1, 4..8 { ... } else do ... }: runs the one arm
+// covering value, or else_body if none does. The parser rejects arms that
+// overlap or don't fit value's type.
+class MatchStatement : public ASTNode {
+ public:
+  MatchStatement(std::unique_ptr<ASTNode> value, std::vector<MatchArm> arms,
+                 std::vector<std::unique_ptr<ASTNode>> else_body = {})
+      : value_(std::move(value)),
+        arms_(std::move(arms)),
+        else_body_(std::move(else_body)) {}
+
+  [[nodiscard]] const ASTNode* value() const { return value_.get(); }
+  [[nodiscard]] const std::vector<MatchArm>& arms() const { return arms_; }
+  [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& else_body() const {
+    return else_body_;
+  }
+
+ private:
+  std::unique_ptr<ASTNode> value_;
+  std::vector<MatchArm> arms_;
+  std::vector<std::unique_ptr<ASTNode>> else_body_;
+};
+
+// Array literal: [1, 2, 3]. An empty one zero fills the array it initializes.
+class ArrayLiteral : public ASTNode {
+ public:
+  explicit ArrayLiteral(std::vector<std::unique_ptr<ASTNode>> elements)
+      : elements_(std::move(elements)) {}
+
+  [[nodiscard]] const std::vector<std::unique_ptr<ASTNode>>& elements() const {
+    return elements_;
+  }
+
+ private:
+  std::vector<std::unique_ptr<ASTNode>> elements_;
+};
+
+// Array element read: values[i]
+class IndexExpression : public ASTNode {
+ public:
+  IndexExpression(std::string array_name, std::unique_ptr<ASTNode> index)
+      : array_name_(std::move(array_name)), index_(std::move(index)) {}
+
+  [[nodiscard]] const std::string& array_name() const { return array_name_; }
+  [[nodiscard]] const ASTNode* index() const { return index_.get(); }
+
+ private:
+  std::string array_name_;
+  std::unique_ptr<ASTNode> index_;
+};
+
+// Array element write: values[i] = value
+class IndexAssignment : public ASTNode {
+ public:
+  IndexAssignment(std::string array_name, std::unique_ptr<ASTNode> index,
+                  std::unique_ptr<ASTNode> value)
+      : array_name_(std::move(array_name)),
+        index_(std::move(index)),
+        value_(std::move(value)) {}
+
+  [[nodiscard]] const std::string& array_name() const { return array_name_; }
+  [[nodiscard]] const ASTNode* index() const { return index_.get(); }
+  [[nodiscard]] const ASTNode* value() const { return value_.get(); }
+
+ private:
+  std::string array_name_;
+  std::unique_ptr<ASTNode> index_;
+  std::unique_ptr<ASTNode> value_;
+};
+
+// Write through a pointer or borrow: pointer.* = value
+class DereferenceAssignment : public ASTNode {
+ public:
+  DereferenceAssignment(std::string pointer_name,
+                        std::unique_ptr<ASTNode> value)
+      : pointer_name_(std::move(pointer_name)), value_(std::move(value)) {}
+
+  [[nodiscard]] const std::string& pointer_name() const {
+    return pointer_name_;
+  }
+  [[nodiscard]] const ASTNode* value() const { return value_.get(); }
+
+ private:
+  std::string pointer_name_;
+  std::unique_ptr<ASTNode> value_;
+};
+
+// Struct field read: point.x, points[i].x or line.start.x
+class FieldAccess : public ASTNode {
+ public:
+  FieldAccess(std::unique_ptr<ASTNode> object, std::string field_name)
+      : object_(std::move(object)), field_name_(std::move(field_name)) {}
+
+  [[nodiscard]] const ASTNode* object() const { return object_.get(); }
+  [[nodiscard]] const std::string& field_name() const { return field_name_; }
+
+ private:
+  std::unique_ptr<ASTNode> object_;
+  std::string field_name_;
+};
+
+// Struct field write: point.x = value
+class FieldAssignment : public ASTNode {
+ public:
+  FieldAssignment(std::unique_ptr<ASTNode> object, std::string field_name,
+                  std::unique_ptr<ASTNode> value)
+      : object_(std::move(object)),
+        field_name_(std::move(field_name)),
+        value_(std::move(value)) {}
+
+  [[nodiscard]] const ASTNode* object() const { return object_.get(); }
+  [[nodiscard]] const std::string& field_name() const { return field_name_; }
+  [[nodiscard]] const ASTNode* value() const { return value_.get(); }
+
+ private:
+  std::unique_ptr<ASTNode> object_;
+  std::string field_name_;
+  std::unique_ptr<ASTNode> value_;
 };
 
 class RangeExpression : public ASTNode {
@@ -317,6 +615,12 @@ class RangeExpression : public ASTNode {
   [[nodiscard]] const ASTNode* start() const { return start_.get(); }
   [[nodiscard]] const ASTNode* end() const { return end_.get(); }
 
+  // Integer type of a loop counter over the range, which the parser infers
+  // from the bounds
+  [[nodiscard]] std::string counter_type() const {
+    return inferred_type().empty() ? "i32" : inferred_type();
+  }
+
  private:
   std::unique_ptr<ASTNode> start_;
   std::unique_ptr<ASTNode> end_;
@@ -324,14 +628,19 @@ class RangeExpression : public ASTNode {
 
 class LoopStatement : public ASTNode {
  public:
-  // Range-based loop: loop i in 0..10 { ... }
+  // Range-based loop: loop i in 0..10 { ... }, or with parallel set
+  // loop par i in 0..10 { ... }, whose iterations may run concurrently.
+  // With an array instead of a range, loop x in values { ... } visits each
+  // element in turn.
   LoopStatement(std::string variable_name, std::unique_ptr<ASTNode> range,
-                std::vector<std::unique_ptr<ASTNode>> body)
+                std::vector<std::unique_ptr<ASTNode>> body,
+                bool parallel = false)
       : variable_name_(std::move(variable_name)),
         range_(std::move(range)),
         condition_(nullptr),
         body_(std::move(body)),
-        is_range_loop_(true) {}
+        is_range_loop_(true),
+        is_parallel_(parallel) {}
 
   // Conditional loop: loop if condition { ... }
   LoopStatement(std::unique_ptr<ASTNode> condition,
@@ -342,6 +651,11 @@ class LoopStatement : public ASTNode {
         is_range_loop_(false) {}
 
   [[nodiscard]] bool is_range_loop() const { return is_range_loop_; }
+  [[nodiscard]] bool is_parallel() const { return is_parallel_; }
+  [[nodiscard]] bool is_array_loop() const {
+    return is_range_loop_ && dynamic_cast<const RangeExpression*>(
+                                 range_.get()) == nullptr;
+  }
   [[nodiscard]] const std::string& variable_name() const {
     return variable_name_;
   }
@@ -357,6 +671,7 @@ class LoopStatement : public ASTNode {
   std::unique_ptr<ASTNode> condition_;  // For conditional loops
   std::vector<std::unique_ptr<ASTNode>> body_;
   bool is_range_loop_;
+  bool is_parallel_ = false;
 };
 
 class FunctionCall : public ASTNode {
@@ -390,6 +705,32 @@ class Parameter : public ASTNode {
   std::string type_;
 };
 
+// What integer +, - and * do with a result that doesn't fit their type
+enum class OverflowMode : uint8_t {
+  Wrap,       // wrap around as two's complement, the default
+  Undefined,  // the optimizer may assume it never happens (nsw/nuw)
+  Trap,       // checked at runtime, stopping the program
+};
+
+// "wrap", "undefined" or "trap", nullopt for anything else
+inline std::optional<OverflowMode> parse_overflow_mode(
+    const std::string& name) {
+  if (name == "wrap") return OverflowMode::Wrap;
+  if (name == "undefined") return OverflowMode::Undefined;
+  if (name == "trap") return OverflowMode::Trap;
+  return std::nullopt;
+}
+
+// Optimization annotations of a function declaration
+struct FunctionHints {
+  bool always_inline = false;  // inline: inlined into every caller
+  bool never_inline = false;   // noinline
+  bool hot = false;            // hot: optimized hard, laid out together
+  bool cold = false;           // cold: rarely called, paths to it unlikely
+  bool pure = false;  // pure: the result only depends on the arguments,
+                      // there are no side effects and it always returns
+};
+
 class FunctionDeclaration : public ASTNode {
  public:
   FunctionDeclaration(std::string name, std::string return_type)
@@ -413,11 +754,22 @@ class FunctionDeclaration : public ASTNode {
     parameters_.push_back(std::move(parameter));
   }
 
+  // From an overflow(mode) annotation, nullopt to follow the program's
+  [[nodiscard]] std::optional<OverflowMode> overflow_mode() const {
+    return overflow_mode_;
+  }
+  void set_overflow_mode(OverflowMode mode) { overflow_mode_ = mode; }
+
+  [[nodiscard]] const FunctionHints& hints() const { return hints_; }
+  void set_hints(FunctionHints hints) { hints_ = hints; }
+
  private:
   std::string name_;
   std::string return_type_;
   std::vector<std::unique_ptr<Parameter>> parameters_;
   std::vector<std::unique_ptr<ASTNode>> body_;
+  std::optional<OverflowMode> overflow_mode_;
+  FunctionHints hints_;
 };
 
 class AnonymousFunction : public ASTNode {
@@ -448,6 +800,46 @@ class AnonymousFunction : public ASTNode {
   std::vector<std::unique_ptr<ASTNode>> body_;
 };
 
+struct StructField {
+  std::string name;
+  std::string type;
+};
+
+// Layout annotations of a struct declaration
+struct StructLayout {
+  bool packed = false;     // packed: no padding between fields
+  uint64_t alignment = 0;  // align(N): at least N byte aligned, 0 if natural
+  bool soa = false;        // soa: arrays of it keep one array per field
+};
+
+// const Point = struct { x: i32, y: i32 }
+class StructDeclaration : public ASTNode {
+ public:
+  StructDeclaration(std::string name, std::vector<StructField> fields,
+                    StructLayout layout)
+      : name_(std::move(name)), fields_(std::move(fields)), layout_(layout) {}
+
+  [[nodiscard]] const std::string& name() const { return name_; }
+  [[nodiscard]] const std::vector<StructField>& fields() const {
+    return fields_;
+  }
+  [[nodiscard]] const StructLayout& layout() const { return layout_; }
+
+  // Position of the field called name, nullopt if there is none
+  [[nodiscard]] std::optional<size_t> field_index(
+      const std::string& name) const {
+    for (size_t i = 0; i < fields_.size(); ++i) {
+      if (fields_[i].name == name) return i;
+    }
+    return std::nullopt;
+  }
+
+ private:
+  std::string name_;
+  std::vector<StructField> fields_;
+  StructLayout layout_;
+};
+
 class Program : public ASTNode {
  public:
   Program() = default;
@@ -457,6 +849,11 @@ class Program : public ASTNode {
     return imports_;
   }
 
+  [[nodiscard]] const std::vector<std::unique_ptr<StructDeclaration>>&
+  structs() const {
+    return structs_;
+  }
+
   [[nodiscard]] const std::vector<std::unique_ptr<FunctionDeclaration>>&
   functions() const {
     return functions_;
@@ -471,6 +868,10 @@ class Program : public ASTNode {
     imports_.push_back(std::move(import));
   }
 
+  void add_struct(std::unique_ptr<StructDeclaration> declaration) {
+    structs_.push_back(std::move(declaration));
+  }
+
   void add_function(std::unique_ptr<FunctionDeclaration> function) {
     functions_.push_back(std::move(function));
   }
@@ -479,10 +880,31 @@ class Program : public ASTNode {
     variables_.push_back(std::move(variable));
   }
 
+  // Functions the parser dropped without parsing their bodies, because
+  // nothing reachable from main refers to them
+  [[nodiscard]] size_t skipped_function_count() const {
+    return skipped_functions_;
+  }
+  void set_skipped_function_count(size_t count) { skipped_functions_ = count; }
+
+  // The mode of functions without an overflow(mode) annotation
+  [[nodiscard]] OverflowMode overflow_mode() const { return overflow_mode_; }
+  void set_overflow_mode(OverflowMode mode) { overflow_mode_ = mode; }
+
+  // The mode func's arithmetic follows. Anonymous functions follow the
+  // function they are written in.
+  [[nodiscard]] OverflowMode overflow_mode(
+      const FunctionDeclaration& func) const {
+    return func.overflow_mode().value_or(overflow_mode_);
+  }
+
  private:
   std::vector<std::unique_ptr<ImportStatement>> imports_;
+  std::vector<std::unique_ptr<StructDeclaration>> structs_;
   std::vector<std::unique_ptr<FunctionDeclaration>> functions_;
   std::vector<std::unique_ptr<VariableDeclaration>> variables_;
+  size_t skipped_functions_ = 0;
+  OverflowMode overflow_mode_ = OverflowMode::Wrap;
 };
 }  // namespace void_compiler
 #endif  // TYPES_H
@@ -0,0 +1,373 @@
+#include "borrow_checker.h"
+
+#include <stdexcept>
+
+namespace void_compiler {
+namespace {
+
+// Whether a value of type holds a borrow, itself or as what a pointer points
+// to or an array's element
+bool holds_borrow(const std::string& type) {
+  if (BorrowType::parse(type)) return true;
+  if (type.starts_with("*")) return holds_borrow(type.substr(1));
+  if (auto array = ArrayType::parse(type)) {
+    return holds_borrow(array->element_type);
+  }
+  return false;
+}
+
+}  // namespace
+
+BorrowChecker::BorrowChecker(
+    const Program* program,
+    const std::unordered_map<std::string, FunctionType>& external)
+    : program_(program) {
+  for (const auto& [name, type] : external) {
+    signatures_[name] = type.param_types();
+  }
+  for (const auto& func : program->functions()) {
+    std::vector<std::string> param_types;
+    for (const auto& param : func->parameters()) {
+      param_types.push_back(param->type());
+    }
+    signatures_[func->name()] = std::move(param_types);
+  }
+}
+
+void BorrowChecker::check() {
+  for (const auto& declaration : program_->structs()) {
+    for (const auto& field : declaration->fields()) {
+      if (holds_borrow(field.type)) {
+        throw std::runtime_error("Field '" + declaration->name() + "." +
+                                 field.name +
+                                 "' can't hold a borrow; use a *T pointer");
+      }
+    }
+  }
+  for (const auto& func : program_->functions()) {
+    check_function(func.get());
+  }
+}
+
+template <typename Function>
+void BorrowChecker::check_function(const Function* func) {
+  if (holds_borrow(func->return_type())) {
+    throw std::runtime_error("Functions can't return borrows");
+  }
+
+  frames_.emplace_back();
+  for (const auto& param : func->parameters()) {
+    auto borrow = BorrowType::parse(param->type());
+    if (holds_borrow(borrow ? borrow->pointee : param->type())) {
+      throw std::runtime_error("Parameter '" + param->name() +
+                               "' can only be a borrow itself, not hold one");
+    }
+    declare(param->name(), param->type());
+  }
+  check_block(func->body());
+
+  // Checked last, as the pointer may be taken after the borrow
+  const Frame& frame = frames_.back();
+  for (const auto& [loan, callee] : frame.loans) {
+    if (frame.pointer_roots.contains(loan.root)) {
+      throw std::runtime_error("'" + loan.root + "' is borrowed by a call to '" +
+                               callee +
+                               "', but its address is also taken for a "
+                               "pointer");
+    }
+  }
+  frames_.pop_back();
+}
+
+void BorrowChecker::check_block(
+    const std::vector<std::unique_ptr<ASTNode>>& body) {
+  Frame& frame = frames_.back();
+  frame.scopes.push_back(frame.locals.size());
+  for (const auto& stmt : body) {
+    check_statement(stmt.get());
+  }
+  frames_.back().locals.resize(frames_.back().scopes.back());
+  frames_.back().scopes.pop_back();
+}
+
+void BorrowChecker::check_statement(const ASTNode* node) {
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    if (holds_borrow(var_decl->type())) {
+      throw std::runtime_error(
+          "'" + var_decl->name() +
+          "' can't hold a borrow: borrows can only be passed to functions. "
+          "Declare it as a *T pointer instead");
+    }
+    check_expression(var_decl->value());
+    declare(var_decl->name(), var_decl->type());
+    return;
+  }
+
+  if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    const std::string* type = lookup(var_assign->name());
+    if (type != nullptr && BorrowType::parse(*type)) {
+      throw std::runtime_error("Borrow '" + var_assign->name() +
+                               "' can't be reassigned; write through it with " +
+                               var_assign->name() + ".* = ...");
+    }
+    check_expression(var_assign->value());
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    check_writable(assign->array_name());
+    check_expression(assign->index());
+    check_expression(assign->value());
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    check_writable(check_place(assign->object()));
+    check_expression(assign->value());
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const DereferenceAssignment*>(node)) {
+    check_writable(assign->pointer_name());
+    check_expression(assign->value());
+    return;
+  }
+
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    check_expression(ret->expression());
+    return;
+  }
+
+  if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    check_expression(if_stmt->condition());
+    check_block(if_stmt->then_body());
+    check_block(if_stmt->else_body());
+    return;
+  }
+
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    check_expression(match_stmt->value());
+    for (const auto& arm : match_stmt->arms()) {
+      check_block(arm.body);
+    }
+    check_block(match_stmt->else_body());
+    return;
+  }
+
+  if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    // Looping over a borrowed array only reads through the borrow
+    if (!loop->is_array_loop()) {
+      check_expression(loop->range());
+    }
+    check_expression(loop->condition());
+    Frame& frame = frames_.back();
+    frame.scopes.push_back(frame.locals.size());
+    if (loop->is_range_loop()) declare(loop->variable_name(), "");
+    check_block(loop->body());
+    frames_.back().locals.resize(frames_.back().scopes.back());
+    frames_.back().scopes.pop_back();
+    return;
+  }
+
+  check_expression(node);
+}
+
+void BorrowChecker::check_expression(const ASTNode* node) {
+  if (node == nullptr) return;
+
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    const std::string* type = lookup(var->name());
+    if (type != nullptr && BorrowType::parse(*type)) {
+      throw std::runtime_error("Borrow '" + var->name() +
+                               "' can only be read through, as " + var->name() +
+                               ".*, or passed on to a borrow parameter");
+    }
+    return;
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    // Dereferencing only reads through the borrow or pointer
+    if (unary->operator_type() == TokenType::DotStar) return;
+    if (unary->operator_type() != TokenType::Borrow) {
+      check_expression(unary->operand());
+      return;
+    }
+
+    // Anywhere but a borrow parameter, & makes a *T pointer
+    const std::string& root = check_place(unary->operand());
+    const std::string* type = lookup(root);
+    if (type != nullptr && BorrowType::parse(*type)) {
+      throw std::runtime_error("Borrow '" + root +
+                               "' can't be turned into a *T pointer");
+    }
+    frames_.back().pointer_roots.insert(root);
+    return;
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    check_expression(binop->left());
+    check_expression(binop->right());
+  } else if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    check_call(call);
+  } else if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    // Builtins take arrays by name, e.g. v8i32.load(values, i), and keep no
+    // pointer to them
+    for (const auto& arg : member->arguments()) {
+      if (!dynamic_cast<const VariableReference*>(arg.get())) {
+        check_expression(arg.get());
+      }
+    }
+  } else if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    check_expression(index->index());
+  } else if (dynamic_cast<const FieldAccess*>(node)) {
+    check_place(node);
+  } else if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    for (const auto& element : literal->elements()) {
+      check_expression(element.get());
+    }
+  } else if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    check_expression(range->start());
+    check_expression(range->end());
+  } else if (const auto* anon_func =
+                 dynamic_cast<const AnonymousFunction*>(node)) {
+    check_function(anon_func);
+  }
+}
+
+void BorrowChecker::check_call(const FunctionCall* call) {
+  const std::string& name = call->function_name();
+  std::vector<std::string> pointer_params;
+  const std::vector<std::string>* params = nullptr;
+  if (const std::string* type = lookup(name)) {
+    if (type->starts_with("fn(")) {
+      pointer_params = FunctionType::parse(*type).param_types();
+      params = &pointer_params;
+    }
+  } else if (auto it = signatures_.find(name); it != signatures_.end()) {
+    params = &it->second;
+  }
+
+  std::vector<Loan> loans;
+  for (size_t i = 0; i < call->arguments().size(); ++i) {
+    const ASTNode* arg = call->arguments()[i].get();
+    auto borrow = params != nullptr && i < params->size()
+                      ? BorrowType::parse((*params)[i])
+                      : std::nullopt;
+    if (borrow) {
+      loans.push_back(check_borrow_argument(arg, *borrow, name, i + 1));
+    } else {
+      check_expression(arg);
+    }
+  }
+
+  for (size_t i = 0; i < loans.size(); ++i) {
+    for (size_t j = i + 1; j < loans.size(); ++j) {
+      if (loans[i].root == loans[j].root &&
+          (loans[i].is_mutable || loans[j].is_mutable)) {
+        throw std::runtime_error("'" + loans[i].root +
+                                 "' is borrowed as &mut by one argument of '" +
+                                 name + "' and borrowed again by another");
+      }
+    }
+    frames_.back().loans.emplace_back(loans[i], name);
+  }
+}
+
+BorrowChecker::Loan BorrowChecker::check_borrow_argument(
+    const ASTNode* arg, const BorrowType& param, const std::string& callee,
+    size_t position) {
+  std::string argument =
+      "Argument " + std::to_string(position) + " of '" + callee + "'";
+
+  // A borrow parameter passed on
+  if (const auto* var = dynamic_cast<const VariableReference*>(arg)) {
+    const std::string* type = lookup(var->name());
+    auto borrow = type != nullptr ? BorrowType::parse(*type) : std::nullopt;
+    if (borrow) {
+      if (param.is_mutable && !borrow->is_mutable) {
+        throw std::runtime_error(argument + " must be a &mut, but '" +
+                                 var->name() + "' is a shared borrow");
+      }
+      if (borrow->pointee != param.pointee) {
+        throw std::runtime_error(argument + " must be a " + param.to_string() +
+                                 ", not a " + *type);
+      }
+      return {var->name(), param.is_mutable};
+    }
+  }
+
+  const auto* unary = dynamic_cast<const UnaryOperation*>(arg);
+  if (unary == nullptr || unary->operator_type() != TokenType::Borrow) {
+    throw std::runtime_error(argument + " must be borrowed, as " +
+                             (param.is_mutable ? "&mut x" : "&x"));
+  }
+  if (param.is_mutable && !unary->is_mutable()) {
+    throw std::runtime_error(argument + " must be borrowed mutably, as &mut x");
+  }
+
+  const std::string& root = check_place(unary->operand());
+  const std::string* root_type = lookup(root);
+  if (root_type == nullptr) {
+    throw std::runtime_error("Unknown variable: " + root);
+  }
+  bool whole_variable =
+      dynamic_cast<const VariableReference*>(unary->operand()) != nullptr;
+  if (auto borrow = BorrowType::parse(*root_type)) {
+    if (whole_variable) {
+      throw std::runtime_error("'" + root + "' is already a borrow; pass it as " +
+                               root + " rather than &" + root);
+    }
+    if (unary->is_mutable() && !borrow->is_mutable) {
+      throw std::runtime_error("Cannot borrow through '" + root +
+                               "' mutably: it is a shared borrow");
+    }
+  } else if (root_type->starts_with("*") && !whole_variable) {
+    throw std::runtime_error("Cannot borrow through pointer '" + root +
+                             "': it may alias other borrows");
+  }
+
+  const std::string& type = unary->operand()->inferred_type();
+  if (!type.empty() && type != param.pointee) {
+    throw std::runtime_error(argument + " must borrow a " + param.pointee +
+                             ", not a " + type);
+  }
+  return {root, param.is_mutable};
+}
+
+const std::string& BorrowChecker::check_place(const ASTNode* place) {
+  if (const auto* var = dynamic_cast<const VariableReference*>(place)) {
+    return var->name();
+  }
+  if (const auto* index = dynamic_cast<const IndexExpression*>(place)) {
+    check_expression(index->index());
+    return index->array_name();
+  }
+  if (const auto* access = dynamic_cast<const FieldAccess*>(place)) {
+    return check_place(access->object());
+  }
+  throw std::runtime_error(
+      "Only variables, their fields and array elements can be borrowed");
+}
+
+void BorrowChecker::check_writable(const std::string& root) {
+  const std::string* type = lookup(root);
+  auto borrow = type != nullptr ? BorrowType::parse(*type) : std::nullopt;
+  if (borrow && !borrow->is_mutable) {
+    throw std::runtime_error("Cannot assign through '" + root +
+                             "': it is a shared borrow (&T)");
+  }
+}
+
+void BorrowChecker::declare(const std::string& name, const std::string& type) {
+  frames_.back().locals.emplace_back(name, type);
+}
+
+const std::string* BorrowChecker::lookup(const std::string& name) const {
+  const auto& locals = frames_.back().locals;
+  for (auto it = locals.rbegin(); it != locals.rend(); ++it) {
+    if (it->first == name) return &it->second;
+  }
+  return nullptr;
+}
+
+}  // namespace void_compiler
@@ -0,0 +1,855 @@
+#include "bytecode_compiler.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <type_traits>
+
+#include "borrow_checker.h"
+#include "call_graph.h"
+
+namespace void_compiler {
+namespace {
+
+// Arrays need native code; programs using them are always JIT compiled
+constexpr const char* kArraysUnsupported =
+    "Arrays are not supported by the interpreter";
+constexpr const char* kVectorsUnsupported =
+    "Vectors are not supported by the interpreter";
+constexpr const char* kStructsUnsupported =
+    "Structs are not supported by the interpreter";
+
+bool is_integer_type(const std::string& type) {
+  return type == "i8" || type == "i16" || type == "i32" || type == "i64" ||
+         type == "u8" || type == "u16" || type == "u32" || type == "u64" ||
+         type == "bool";
+}
+
+// Width a value of type is wrapped to. Everything that isn't an integer is a
+// full register.
+uint8_t bit_width(const std::string& type) {
+  if (type == "bool") return 1;
+  if (type == "i8" || type == "u8") return 8;
+  if (type == "i16" || type == "u16") return 16;
+  if (type == "i32" || type == "u32") return 32;
+  return 64;
+}
+
+// A match range as the registers hold it: sign extended from width, so an
+// unsigned range crossing the sign bit becomes two
+std::vector<std::pair<int64_t, int64_t>> register_ranges(int64_t low,
+                                                         int64_t high,
+                                                         uint8_t width) {
+  auto extend = [width](int64_t value) {
+    if (width >= 64) return value;
+    unsigned shift = 64 - width;
+    return static_cast<int64_t>(static_cast<uint64_t>(value) << shift) >>
+           shift;
+  };
+  int64_t first = extend(low);
+  int64_t last = extend(high);
+  if (first <= last) return {{first, last}};
+  return {{first, extend((int64_t{1} << (width - 1)) - 1)},
+          {extend(int64_t{1} << (width - 1)), last}};
+}
+
+// Rust style placeholders to printf ones, as code generation does for
+// fmt.println: {:d} -> %d, {:s} -> %s, plus the trailing newline
+std::string printf_format(std::string format) {
+  for (const auto& [placeholder, conversion] :
+       {std::pair{"{:d}", "%d"}, std::pair{"{:s}", "%s"}}) {
+    size_t pos = 0;
+    while ((pos = format.find(placeholder, pos)) != std::string::npos) {
+      format.replace(pos, 4, conversion);
+      pos += 2;
+    }
+  }
+  return format + "\n";
+}
+
+}  // namespace
+
+BytecodeCompiler::BytecodeCompiler(const Program* program)
+    : program_(program), call_graph_(program) {
+  for (const auto& declaration : program->structs()) {
+    struct_names_.insert(declaration->name());
+  }
+}
+
+BytecodeModule BytecodeCompiler::compile() {
+  BorrowChecker(program_).check();
+  if (!call_graph_.contains("main")) {
+    throw std::runtime_error("Main function not found");
+  }
+  auto reachable = call_graph_.reachable_from("main");
+
+  // Give every reachable function its index up front, so calls can be
+  // compiled before the callee's body
+  std::vector<const FunctionDeclaration*> functions;
+  for (const auto& func : program_->functions()) {
+    if (!reachable.contains(func->name())) continue;
+
+    std::vector<std::string> param_types;
+    for (const auto& param : func->parameters()) {
+      param_types.push_back(param->type());
+    }
+    signatures_[func->name()] = {.index = module_.functions.size(),
+                                 .param_types = std::move(param_types),
+                                 .return_type = func->return_type()};
+    module_.functions.emplace_back();
+    functions.push_back(func.get());
+  }
+
+  for (const auto* func : functions) {
+    const Signature& signature = signatures_.at(func->name());
+    auto compiled = compile_function(func, func->name());
+    // main is entered once and never swapped out mid-run, so compiling it
+    // would be wasted work
+    compiled.native_callable =
+        func->name() != "main" &&
+        std::ranges::all_of(signature.param_types, is_integer_type) &&
+        (signature.return_type == "void" ||
+         is_integer_type(signature.return_type));
+    module_.functions[signature.index] = std::move(compiled);
+  }
+
+  module_.main = signatures_.at("main").index;
+  return std::move(module_);
+}
+
+template <typename Function>
+BytecodeFunction BytecodeCompiler::compile_function(const Function* func,
+                                                    std::string name) {
+  // Each function starts from an empty register window and sees none of the
+  // enclosing function's locals
+  bool vectors = VectorType::parse(func->return_type()).has_value();
+  bool structs = is_struct_type(func->return_type());
+  bool arrays = false;
+  for (const auto& param : func->parameters()) {
+    auto borrow = BorrowType::parse(param->type());
+    const std::string& type = borrow ? borrow->pointee : param->type();
+    vectors = vectors || VectorType::parse(type).has_value();
+    structs = structs || is_struct_type(type);
+    arrays = arrays || ArrayType::parse(type).has_value();
+  }
+  if (vectors) throw std::runtime_error(kVectorsUnsupported);
+  if (structs) throw std::runtime_error(kStructsUnsupported);
+  if (arrays) throw std::runtime_error(kArraysUnsupported);
+
+  FunctionState state;
+  state.function.name = std::move(name);
+  state.function.parameter_count = func->parameters().size();
+  state.return_type = func->return_type();
+
+  FunctionState* enclosing = state_;
+  // Anonymous functions follow the function they are written in
+  if constexpr (std::is_same_v<Function, FunctionDeclaration>) {
+    state.overflow = program_->overflow_mode(*func);
+  } else {
+    state.overflow =
+        enclosing ? enclosing->overflow : program_->overflow_mode();
+  }
+  state_ = &state;
+
+  push_scope();
+  for (const auto& param : func->parameters()) {
+    declare(param->name(), {allocate_register(), param->type()});
+  }
+  for (const auto& stmt : func->body()) {
+    compile_statement(stmt.get());
+  }
+  pop_scope();
+
+  emit({.op = state.return_type == "void" ? OpCode::ReturnVoid
+                                          : OpCode::Unreachable});
+
+  state_ = enclosing;
+  return std::move(state.function);
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_expression(
+    const ASTNode* node) {
+  if (const auto* num = dynamic_cast<const NumberLiteral*>(node)) {
+    return constant(num->value(), "i32");
+  }
+
+  if (const auto* str = dynamic_cast<const StringLiteral*>(node)) {
+    return constant(string_index(str->value()), "const string");
+  }
+
+  if (const auto* boolean = dynamic_cast<const BooleanLiteral*>(node)) {
+    return constant(boolean->value() ? -1 : 0, "bool");
+  }
+
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    if (const Local* local = lookup(var->name())) {
+      return local->operand;
+    }
+
+    // A function name used as a value is a function pointer
+    auto it = signatures_.find(var->name());
+    if (it != signatures_.end()) {
+      const Signature& signature = it->second;
+      return constant(
+          static_cast<int64_t>(signature.index),
+          FunctionType(signature.param_types, signature.return_type)
+              .to_string());
+    }
+
+    throw std::runtime_error("Unknown variable: " + var->name());
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    Operand left = compile_expression(binop->left());
+    Operand right = compile_expression(binop->right());
+
+    // Mixed width operands are extended to the wider type. Sign extension
+    // costs nothing since registers already hold sign extended values, but
+    // a narrower unsigned operand is zero extended.
+    std::string type = left.type;
+    if (left.type != "bool" && right.type != "bool") {
+      if (bit_width(right.type) > bit_width(left.type)) {
+        type = right.type;
+        left = zero_extend_unsigned(left);
+      } else if (bit_width(left.type) > bit_width(right.type)) {
+        right = zero_extend_unsigned(right);
+      }
+    }
+
+    OpCode op;
+    bool comparison = false;
+    switch (binop->operator_type()) {
+      case TokenType::Plus:
+        op = OpCode::Add;
+        break;
+      case TokenType::Minus:
+        op = OpCode::Subtract;
+        break;
+      case TokenType::Asterisk:
+        op = OpCode::Multiply;
+        break;
+      case TokenType::Divide:
+        op = OpCode::Divide;
+        break;
+      case TokenType::And:
+        op = OpCode::And;
+        break;
+      case TokenType::Or:
+        op = OpCode::Or;
+        break;
+      case TokenType::LessThan:
+        op = OpCode::Less;
+        comparison = true;
+        break;
+      case TokenType::LessEqual:
+        op = OpCode::LessEqual;
+        comparison = true;
+        break;
+      case TokenType::GreaterThan:
+        op = OpCode::Greater;
+        comparison = true;
+        break;
+      case TokenType::GreaterEqual:
+        op = OpCode::GreaterEqual;
+        comparison = true;
+        break;
+      case TokenType::EqualEqual:
+        op = OpCode::Equal;
+        comparison = true;
+        break;
+      case TokenType::NotEqual:
+        op = OpCode::NotEqual;
+        comparison = true;
+        break;
+      default:
+        throw std::runtime_error("Unknown binary operator");
+    }
+
+    if (!comparison &&
+        (!is_integer_type(left.type) || !is_integer_type(right.type))) {
+      throw std::runtime_error("Unsupported operand types for binary operator");
+    }
+
+    // The interpreter wraps for undefined overflow too, which is one of the
+    // things the native code may do
+    if (state_->overflow == OverflowMode::Trap && type != "bool") {
+      bool is_unsigned =
+          left.type.starts_with("u") || right.type.starts_with("u");
+      if (op == OpCode::Add) {
+        op = is_unsigned ? OpCode::AddCheckedUnsigned : OpCode::AddChecked;
+      } else if (op == OpCode::Subtract) {
+        op = is_unsigned ? OpCode::SubtractCheckedUnsigned
+                         : OpCode::SubtractChecked;
+      } else if (op == OpCode::Multiply) {
+        op = is_unsigned ? OpCode::MultiplyCheckedUnsigned
+                         : OpCode::MultiplyChecked;
+      }
+    }
+
+    if (comparison) type = "bool";
+    uint32_t result = allocate_register();
+    emit({.op = op,
+          .width = bit_width(type),
+          .a = result,
+          .b = left.reg,
+          .c = right.reg});
+    return {result, type};
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    switch (unary->operator_type()) {
+      case TokenType::Not: {
+        Operand operand = compile_expression(unary->operand());
+        uint32_t result = allocate_register();
+        emit({.op = OpCode::Not,
+              .width = bit_width(operand.type),
+              .a = result,
+              .b = operand.reg});
+        return {result, operand.type};
+      }
+      case TokenType::Minus: {
+        Operand operand = compile_expression(unary->operand());
+        if (!is_integer_type(operand.type)) {
+          throw std::runtime_error(
+              "Unary minus only supported for integer types");
+        }
+        // Narrow integers are promoted to i32 before negation
+        std::string type = bit_width(operand.type) < 32 ? "i32" : operand.type;
+        if (state_->overflow == OverflowMode::Trap) {
+          // Checked as a signed 0 - b, as in code generation
+          Operand zero = constant(0, type);
+          uint32_t result = allocate_register();
+          emit({.op = OpCode::SubtractChecked,
+                .width = bit_width(type),
+                .a = result,
+                .b = zero.reg,
+                .c = operand.reg});
+          return {result, type};
+        }
+        uint32_t result = allocate_register();
+        emit({.op = OpCode::Negate,
+              .width = bit_width(type),
+              .a = result,
+              .b = operand.reg});
+        return {result, type};
+      }
+      case TokenType::Borrow: {
+        const auto* var = dynamic_cast<const VariableReference*>(unary->operand());
+        const Local* local = var ? lookup(var->name()) : nullptr;
+        if (local == nullptr) {
+          throw std::runtime_error("Cannot take address of non-lvalue");
+        }
+        uint32_t result = allocate_register();
+        emit({.op = OpCode::AddressOf, .a = result, .b = local->operand.reg});
+        return {result, "*" + local->operand.type};
+      }
+      case TokenType::DotStar: {
+        Operand operand = compile_expression(unary->operand());
+        auto pointee = pointee_type(operand.type);
+        if (!pointee) {
+          throw std::runtime_error("Cannot dereference non-pointer type");
+        }
+        uint32_t result = allocate_register();
+        emit({.op = OpCode::Load,
+              .width = bit_width(*pointee),
+              .a = result,
+              .b = operand.reg});
+        return {result, *pointee};
+      }
+      default:
+        throw std::runtime_error("Unknown unary operator");
+    }
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (VectorType::parse(call->function_name())) {
+      throw std::runtime_error(kVectorsUnsupported);
+    }
+    if (struct_names_.contains(call->function_name())) {
+      throw std::runtime_error(kStructsUnsupported);
+    }
+    return compile_call(call);
+  }
+
+  if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
+    return compile_anonymous_function(anon_func);
+  }
+
+  if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    if (member->object_name() == "simd" ||
+        VectorType::parse(member->object_name())) {
+      throw std::runtime_error(kVectorsUnsupported);
+    }
+    return compile_print(member);
+  }
+
+  if (dynamic_cast<const ArrayLiteral*>(node) ||
+      dynamic_cast<const IndexExpression*>(node)) {
+    throw std::runtime_error(kArraysUnsupported);
+  }
+
+  if (dynamic_cast<const FieldAccess*>(node)) {
+    throw std::runtime_error(kStructsUnsupported);
+  }
+
+  throw std::runtime_error("Unknown expression type");
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_call(
+    const FunctionCall* call) {
+  const std::string& name = call->function_name();
+  const Local* local = lookup(name);
+  bool indirect = local != nullptr && local->operand.type.starts_with("fn(");
+
+  std::vector<std::string> param_types;
+  std::string return_type;
+  size_t callee = 0;
+  if (indirect) {
+    FunctionType func_type = FunctionType::parse(local->operand.type);
+    param_types = func_type.param_types();
+    return_type = func_type.return_type();
+    if (call->arguments().size() != param_types.size()) {
+      throw std::runtime_error(
+          "Function pointer '" + name + "' expects " +
+          std::to_string(param_types.size()) + " arguments, but " +
+          std::to_string(call->arguments().size()) + " were provided");
+    }
+  } else {
+    auto it = signatures_.find(name);
+    if (it == signatures_.end()) {
+      throw std::runtime_error("Unknown function: " + name);
+    }
+    callee = it->second.index;
+    param_types = it->second.param_types;
+    return_type = it->second.return_type;
+    if (call->arguments().size() != param_types.size()) {
+      throw std::runtime_error(
+          "Function '" + name + "' expects " +
+          std::to_string(param_types.size()) + " arguments, but " +
+          std::to_string(call->arguments().size()) + " were provided");
+    }
+  }
+
+  // Arguments go in consecutive registers, converted to the parameter types
+  uint32_t first_arg = state_->next_register;
+  for (size_t i = 0; i < param_types.size(); ++i) {
+    allocate_register();
+  }
+  for (size_t i = 0; i < param_types.size(); ++i) {
+    auto arg_reg = static_cast<uint32_t>(first_arg + i);
+    store(arg_reg, compile_expression(call->arguments()[i].get()),
+          param_types[i]);
+    state_->next_register = first_arg + param_types.size();
+  }
+
+  uint32_t result = allocate_register();
+  if (indirect) {
+    emit({.op = OpCode::CallIndirect,
+          .a = result,
+          .b = local->operand.reg,
+          .c = first_arg});
+  } else {
+    emit({.op = OpCode::Call,
+          .a = result,
+          .b = static_cast<uint32_t>(callee),
+          .c = first_arg});
+  }
+  return {result, return_type};
+}
+
+void BytecodeCompiler::check_must_tail(const FunctionCall* call) const {
+  auto type_of = [&](const std::string& name) {
+    auto it = signatures_.find(name);
+    return it != signatures_.end()
+               ? FunctionType(it->second.param_types, it->second.return_type)
+               : FunctionType({}, "void");
+  };
+  const std::string& caller = state_->function.name;
+  std::string error = call_graph_.must_tail_error(
+      caller, type_of(caller), call->function_name(),
+      type_of(call->function_name()));
+  if (!error.empty()) throw std::runtime_error(error);
+}
+
+void BytecodeCompiler::mark_tail_call(const FunctionCall* call) {
+  auto it = signatures_.find(call->function_name());
+  Instruction& last = state_->function.code.back();
+  if (last.op != OpCode::Call || it == signatures_.end() ||
+      last.b != it->second.index ||
+      it->second.return_type != state_->return_type ||
+      !std::ranges::all_of(it->second.param_types, is_integer_type)) {
+    return;
+  }
+  last.op = OpCode::TailCall;
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_print(
+    const MemberAccess* member) {
+  if (member->object_name() != "fmt" || member->member_name() != "println") {
+    throw std::runtime_error("Unknown member access: " + member->object_name() +
+                             "." + member->member_name());
+  }
+  if (member->arguments().empty()) {
+    throw std::runtime_error("fmt.println expects a format string");
+  }
+
+  // The format string and the values to print, in consecutive registers
+  uint32_t first_arg = state_->next_register;
+  for (size_t i = 0; i < member->arguments().size(); ++i) {
+    allocate_register();
+  }
+  for (size_t i = 0; i < member->arguments().size(); ++i) {
+    const ASTNode* arg = member->arguments()[i].get();
+    const auto* format = dynamic_cast<const StringLiteral*>(arg);
+    Operand value =
+        i == 0 && format != nullptr
+            ? constant(string_index(printf_format(format->value())),
+                       "const string")
+            : compile_expression(arg);
+    auto arg_reg = static_cast<uint32_t>(first_arg + i);
+    store(arg_reg, value, value.type);
+    state_->next_register = first_arg + member->arguments().size();
+  }
+
+  uint32_t result = allocate_register();
+  emit({.op = OpCode::Print,
+        .a = result,
+        .b = first_arg,
+        .c = static_cast<uint32_t>(member->arguments().size())});
+  return {result, "i32"};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::compile_anonymous_function(
+    const AnonymousFunction* anon_func) {
+  size_t index = module_.functions.size();
+  module_.functions.emplace_back();
+  auto compiled = compile_function(
+      anon_func, "anon_" + std::to_string(anonymous_count_++));
+  module_.functions[index] = std::move(compiled);
+
+  std::vector<std::string> param_types;
+  for (const auto& param : anon_func->parameters()) {
+    param_types.push_back(param->type());
+  }
+  return constant(
+      static_cast<int64_t>(index),
+      FunctionType(std::move(param_types), anon_func->return_type())
+          .to_string());
+}
+
+void BytecodeCompiler::compile_statement(const ASTNode* node) {
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    if (ret->expression() == nullptr) {
+      if (state_->return_type != "void") {
+        throw std::runtime_error(
+            "Cannot use 'return' without value in non-void function");
+      }
+      emit({.op = OpCode::ReturnVoid});
+    } else {
+      if (state_->return_type == "void") {
+        throw std::runtime_error("Cannot return a value from a void function");
+      }
+      const auto* call = dynamic_cast<const FunctionCall*>(ret->expression());
+      Operand value = compile_expression(ret->expression());
+      if (call != nullptr) {
+        if (ret->must_tail()) check_must_tail(call);
+        mark_tail_call(call);
+      }
+      uint32_t result = allocate_register();
+      store(result, value, state_->return_type);
+      emit({.op = OpCode::Return, .a = result});
+    }
+  } else if (const auto* var_decl =
+                 dynamic_cast<const VariableDeclaration*>(node)) {
+    if (VectorType::parse(var_decl->type())) {
+      throw std::runtime_error(kVectorsUnsupported);
+    }
+    if (is_struct_type(var_decl->type())) {
+      throw std::runtime_error(kStructsUnsupported);
+    }
+    // The new variable is only visible after its initializer
+    uint32_t reg = allocate_register();
+    store(reg, compile_expression(var_decl->value()), var_decl->type());
+    declare(var_decl->name(), {reg, var_decl->type()});
+  } else if (const auto* var_assign =
+                 dynamic_cast<const VariableAssignment*>(node)) {
+    Operand value = compile_expression(var_assign->value());
+    const Local* local = lookup(var_assign->name());
+    if (local == nullptr) {
+      throw std::runtime_error("Unknown variable for assignment: " +
+                               var_assign->name());
+    }
+    store(local->operand.reg, value, local->operand.type);
+  } else if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    compile_expression(member);
+  } else if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    compile_call(call);
+  } else if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    Operand condition = compile_expression(if_stmt->condition());
+    size_t skip_then =
+        emit({.op = OpCode::JumpIfFalse, .a = condition.reg});
+    compile_block(if_stmt->then_body());
+
+    if (if_stmt->else_body().empty()) {
+      patch_jump(skip_then, state_->function.code.size());
+    } else {
+      size_t skip_else = emit({.op = OpCode::Jump});
+      patch_jump(skip_then, state_->function.code.size());
+      compile_block(if_stmt->else_body());
+      patch_jump(skip_else, state_->function.code.size());
+    }
+  } else if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    compile_match(match_stmt);
+  } else if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    if (loop->is_range_loop()) {
+      compile_range_loop(loop);
+    } else {
+      size_t loop_start = state_->function.code.size();
+      Operand condition = compile_expression(loop->condition());
+      size_t exit = emit({.op = OpCode::JumpIfFalse, .a = condition.reg});
+      compile_block(loop->body());
+      emit({.op = OpCode::Jump, .a = static_cast<uint32_t>(loop_start)});
+      patch_jump(exit, state_->function.code.size());
+    }
+  } else if (dynamic_cast<const IndexAssignment*>(node)) {
+    throw std::runtime_error(kArraysUnsupported);
+  } else if (dynamic_cast<const FieldAssignment*>(node)) {
+    throw std::runtime_error(kStructsUnsupported);
+  } else if (const auto* assign =
+                 dynamic_cast<const DereferenceAssignment*>(node)) {
+    Operand value = compile_expression(assign->value());
+    const Local* local = lookup(assign->pointer_name());
+    auto pointee = local ? pointee_type(local->operand.type) : std::nullopt;
+    if (!pointee) {
+      throw std::runtime_error("Cannot dereference non-pointer type");
+    }
+    uint32_t wrapped = allocate_register();
+    store(wrapped, value, *pointee);
+    emit({.op = OpCode::Store, .a = local->operand.reg, .b = wrapped});
+  } else {
+    throw std::runtime_error("Unknown statement type");
+  }
+
+  // Temporaries die at the end of every statement
+  state_->next_register =
+      state_->locals.empty() ? 0 : state_->locals.back().operand.reg + 1;
+}
+
+void BytecodeCompiler::compile_block(
+    const std::vector<std::unique_ptr<ASTNode>>& body) {
+  push_scope();
+  for (const auto& stmt : body) {
+    compile_statement(stmt.get());
+  }
+  pop_scope();
+}
+
+void BytecodeCompiler::compile_range_loop(const LoopStatement* loop) {
+  if (loop->is_array_loop()) throw std::runtime_error(kArraysUnsupported);
+
+  const auto* range = dynamic_cast<const RangeExpression*>(loop->range());
+  if (!range) {
+    throw std::runtime_error("Expected range expression in range loop");
+  }
+
+  // Both bounds are evaluated once, before the first iteration. The end
+  // bound and the increment live in unnamed locals so the body's temporaries
+  // can't reuse their registers. Registers hold sign extended values, which
+  // keep their order when compared as unsigned 64-bit ones, so unsigned
+  // counters loop as far as native ones do.
+  std::string type = range->counter_type();
+  push_scope();
+  uint32_t end = allocate_register();
+  uint32_t counter = allocate_register();
+  store(counter, compile_expression(range->start()), type);
+  store(end, compile_expression(range->end()), type);
+  state_->next_register = counter + 1;
+  Operand one = constant(1, type);
+  declare("", {end, type});
+  declare(loop->variable_name(), {counter, type});
+  declare("", one);
+
+  size_t loop_start = state_->function.code.size();
+  uint32_t condition = allocate_register();
+  emit({.op = type.starts_with("u") ? OpCode::LessUnsigned : OpCode::Less,
+        .width = 1,
+        .a = condition,
+        .b = counter,
+        .c = end});
+  size_t exit = emit({.op = OpCode::JumpIfFalse, .a = condition});
+
+  for (const auto& stmt : loop->body()) {
+    compile_statement(stmt.get());
+  }
+
+  emit({.op = OpCode::Add,
+        .width = bit_width(type),
+        .a = counter,
+        .b = counter,
+        .c = one.reg});
+  emit({.op = OpCode::Jump, .a = static_cast<uint32_t>(loop_start)});
+  patch_jump(exit, state_->function.code.size());
+  pop_scope();
+}
+
+// The interpreter has no jump tables: each range is tested in turn, jumping
+// to its arm's body once one covers the value
+void BytecodeCompiler::compile_match(const MatchStatement* match_stmt) {
+  // The value is copied to an unnamed local, so the tests' temporaries can't
+  // reuse its register
+  push_scope();
+  Operand matched = compile_expression(match_stmt->value());
+  Operand value{allocate_register(), matched.type};
+  store(value.reg, matched, value.type);
+  declare("", value);
+  uint8_t width = bit_width(value.type);
+
+  std::vector<std::pair<size_t, size_t>> arm_jumps;  // jump, arm
+  const auto& arms = match_stmt->arms();
+  for (size_t arm = 0; arm < arms.size(); ++arm) {
+    for (const auto& [low, high] : arms[arm].ranges) {
+      if (width < 64 &&
+          (low < -(int64_t{1} << (width - 1)) ||
+           high > static_cast<int64_t>((uint64_t{1} << width) - 1))) {
+        throw std::runtime_error("Match pattern " + std::to_string(low) +
+                                 " doesn't fit in a " + std::to_string(width) +
+                                 "-bit value");
+      }
+      for (const auto& [first, last] : register_ranges(low, high, width)) {
+        uint32_t condition = allocate_register();
+        if (first == last) {
+          Operand pattern = constant(first, value.type);
+          emit({.op = OpCode::NotEqual,
+                .width = 1,
+                .a = condition,
+                .b = value.reg,
+                .c = pattern.reg});
+        } else {
+          Operand lower = constant(first, value.type);
+          emit({.op = OpCode::GreaterEqual,
+                .width = 1,
+                .a = condition,
+                .b = value.reg,
+                .c = lower.reg});
+          size_t below = emit({.op = OpCode::JumpIfFalse, .a = condition});
+          Operand upper = constant(last, value.type);
+          emit({.op = OpCode::Greater,
+                .width = 1,
+                .a = condition,
+                .b = value.reg,
+                .c = upper.reg});
+          arm_jumps.emplace_back(
+              emit({.op = OpCode::JumpIfFalse, .a = condition}), arm);
+          patch_jump(below, state_->function.code.size());
+          continue;
+        }
+        arm_jumps.emplace_back(
+            emit({.op = OpCode::JumpIfFalse, .a = condition}), arm);
+      }
+    }
+  }
+  size_t to_else = emit({.op = OpCode::Jump});
+
+  std::vector<size_t> to_end;
+  for (size_t arm = 0; arm < arms.size(); ++arm) {
+    for (const auto& [jump, target] : arm_jumps) {
+      if (target == arm) patch_jump(jump, state_->function.code.size());
+    }
+    compile_block(arms[arm].body);
+    to_end.push_back(emit({.op = OpCode::Jump}));
+  }
+  patch_jump(to_else, state_->function.code.size());
+  compile_block(match_stmt->else_body());
+  for (size_t jump : to_end) patch_jump(jump, state_->function.code.size());
+  pop_scope();
+}
+
+void BytecodeCompiler::store(uint32_t reg, const Operand& value,
+                             const std::string& type) {
+  if (is_integer_type(type) && is_integer_type(value.type) &&
+      bit_width(type) < bit_width(value.type)) {
+    emit({.op = OpCode::Truncate,
+          .width = bit_width(type),
+          .a = reg,
+          .b = value.reg});
+  } else if (reg != value.reg) {
+    emit({.op = OpCode::Move, .a = reg, .b = value.reg});
+  }
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::zero_extend_unsigned(
+    const Operand& value) {
+  if (!value.type.starts_with("u") || bit_width(value.type) == 64) {
+    return value;
+  }
+  uint32_t result = allocate_register();
+  emit({.op = OpCode::ZeroExtend,
+        .width = bit_width(value.type),
+        .a = result,
+        .b = value.reg});
+  return {result, value.type};
+}
+
+BytecodeCompiler::Operand BytecodeCompiler::constant(int64_t value,
+                                                     std::string type) {
+  auto& constants = state_->function.constants;
+  auto it = std::find(constants.begin(), constants.end(), value);
+  auto index = static_cast<uint32_t>(it - constants.begin());
+  if (it == constants.end()) constants.push_back(value);
+
+  uint32_t reg = allocate_register();
+  emit({.op = OpCode::LoadConstant, .a = reg, .b = index});
+  return {reg, std::move(type)};
+}
+
+uint32_t BytecodeCompiler::allocate_register() {
+  uint32_t reg = state_->next_register++;
+  state_->function.register_count =
+      std::max<size_t>(state_->function.register_count, reg + 1);
+  return reg;
+}
+
+size_t BytecodeCompiler::emit(Instruction instruction) {
+  state_->function.code.push_back(instruction);
+  return state_->function.code.size() - 1;
+}
+
+void BytecodeCompiler::patch_jump(size_t jump, size_t target) {
+  Instruction& instruction = state_->function.code[jump];
+  if (instruction.op == OpCode::Jump) {
+    instruction.a = static_cast<uint32_t>(target);
+  } else {
+    instruction.b = static_cast<uint32_t>(target);
+  }
+}
+
+uint32_t BytecodeCompiler::string_index(const std::string& value) {
+  auto [it, inserted] = string_indices_.try_emplace(
+      value, static_cast<uint32_t>(module_.strings.size()));
+  if (inserted) module_.strings.push_back(value);
+  return it->second;
+}
+
+void BytecodeCompiler::push_scope() {
+  state_->scopes.push_back(state_->locals.size());
+}
+
+void BytecodeCompiler::pop_scope() {
+  state_->locals.resize(state_->scopes.back());
+  state_->scopes.pop_back();
+  state_->next_register =
+      state_->locals.empty() ? 0 : state_->locals.back().operand.reg + 1;
+}
+
+void BytecodeCompiler::declare(const std::string& name, Operand operand) {
+  state_->locals.push_back({name, std::move(operand)});
+}
+
+const BytecodeCompiler::Local* BytecodeCompiler::lookup(
+    const std::string& name) const {
+  for (auto it = state_->locals.rbegin(); it != state_->locals.rend(); ++it) {
+    if (it->name == name) return &*it;
+  }
+  return nullptr;
+}
+
+}  // namespace void_compiler
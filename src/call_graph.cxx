@@ -0,0 +1,220 @@
+#include "call_graph.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace void_compiler {
+
+CallGraph::CallGraph(const Program* program,
+                     const ConstantFolds* folded_calls)
+    : folded_calls_(folded_calls) {
+  // Register every function first so references can be told apart from
+  // locals with the same spelling
+  for (const auto& func : program->functions()) {
+    edges_[func->name()];
+  }
+
+  for (const auto& func : program->functions()) {
+    auto& edges = edges_[func->name()];
+    for (const auto& stmt : func->body()) {
+      collect_edges(stmt.get(), edges);
+    }
+  }
+}
+
+std::unordered_set<std::string> CallGraph::reachable_from(
+    const std::string& root) const {
+  std::unordered_set<std::string> reachable;
+  if (!contains(root)) return reachable;
+
+  std::vector<std::string> worklist = {root};
+  reachable.insert(root);
+  while (!worklist.empty()) {
+    std::string current = std::move(worklist.back());
+    worklist.pop_back();
+
+    for (const auto& callee : edges_.at(current)) {
+      if (reachable.insert(callee).second) {
+        worklist.push_back(callee);
+      }
+    }
+  }
+
+  return reachable;
+}
+
+bool CallGraph::guarantees_tail_calls(const std::string& function) const {
+  if (function == "main" || !contains(function) ||
+      address_taken_.contains(function)) {
+    return false;
+  }
+  return std::ranges::any_of(edges_.at(function), [&](const auto& callee) {
+    return reachable_from(callee).contains(function);
+  });
+}
+
+std::string CallGraph::must_tail_error(const std::string& caller,
+                                       const FunctionType& caller_type,
+                                       const std::string& callee,
+                                       const FunctionType& callee_type) const {
+  std::string call = "'return musttail " + callee + "(...)' in '" + caller +
+                     "' can't be guaranteed: ";
+  if (!guarantees_tail_calls(caller) || !guarantees_tail_calls(callee)) {
+    return call +
+           "both functions must be recursive, not main, and only called "
+           "directly";
+  }
+  if (caller_type.return_type() != callee_type.return_type()) {
+    return call + "'" + callee + "' returns " + callee_type.return_type() +
+           " but '" + caller + "' returns " + caller_type.return_type();
+  }
+  for (const auto& type : callee_type.param_types()) {
+    bool by_value = type == "i8" || type == "i16" || type == "i32" ||
+                    type == "i64" || type == "u8" || type == "u16" ||
+                    type == "u32" || type == "u64" || type == "bool" ||
+                    VectorType::parse(type).has_value();
+    if (!by_value) {
+      return call + "a " + type +
+             " argument could point into the caller's frame";
+    }
+  }
+  return "";
+}
+
+void CallGraph::collect_edges(const ASTNode* node,
+                              std::unordered_set<std::string>& edges) {
+  if (node == nullptr) return;
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (folded_calls_ != nullptr && folded_calls_->contains(call)) return;
+    if (contains(call->function_name())) edges.insert(call->function_name());
+    for (const auto& arg : call->arguments()) {
+      collect_edges(arg.get(), edges);
+    }
+    return;
+  }
+
+  // A bare function name is a function pointer assignment or argument
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    if (contains(var->name())) {
+      edges.insert(var->name());
+      address_taken_.insert(var->name());
+    }
+    return;
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    collect_edges(binop->left(), edges);
+    collect_edges(binop->right(), edges);
+    return;
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    collect_edges(unary->operand(), edges);
+    return;
+  }
+
+  if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    for (const auto& arg : member->arguments()) {
+      collect_edges(arg.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
+    for (const auto& stmt : anon_func->body()) {
+      collect_edges(stmt.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    collect_edges(var_decl->value(), edges);
+    return;
+  }
+
+  if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    collect_edges(var_assign->value(), edges);
+    return;
+  }
+
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    collect_edges(ret->expression(), edges);
+    return;
+  }
+
+  if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    collect_edges(if_stmt->condition(), edges);
+    for (const auto& stmt : if_stmt->then_body()) {
+      collect_edges(stmt.get(), edges);
+    }
+    for (const auto& stmt : if_stmt->else_body()) {
+      collect_edges(stmt.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    collect_edges(match_stmt->value(), edges);
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& stmt : arm.body) {
+        collect_edges(stmt.get(), edges);
+      }
+    }
+    for (const auto& stmt : match_stmt->else_body()) {
+      collect_edges(stmt.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* loop_stmt = dynamic_cast<const LoopStatement*>(node)) {
+    collect_edges(loop_stmt->range(), edges);
+    collect_edges(loop_stmt->condition(), edges);
+    for (const auto& stmt : loop_stmt->body()) {
+      collect_edges(stmt.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    collect_edges(range->start(), edges);
+    collect_edges(range->end(), edges);
+    return;
+  }
+
+  if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    for (const auto& element : literal->elements()) {
+      collect_edges(element.get(), edges);
+    }
+    return;
+  }
+
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    collect_edges(index->index(), edges);
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    collect_edges(assign->index(), edges);
+    collect_edges(assign->value(), edges);
+    return;
+  }
+
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    collect_edges(access->object(), edges);
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    collect_edges(assign->object(), edges);
+    collect_edges(assign->value(), edges);
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const DereferenceAssignment*>(node)) {
+    collect_edges(assign->value(), edges);
+    return;
+  }
+}
+
+}  // namespace void_compiler
@@ -1,13 +1,270 @@
 #include "code_generation.h"
 
+#include <algorithm>
+#include <filesystem>
 #include <iostream>
+#include <set>
 #include <string>
+#include <tuple>
+
+#include "borrow_checker.h"
+#include "call_graph.h"
+#include "jit_events.h"
+#include "parallel_runtime.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/BinaryFormat/Dwarf.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Intrinsics.h>
+#include <llvm/IR/MDBuilder.h>
+#include <llvm/ProfileData/InstrProf.h>
+#include <llvm/ProfileData/InstrProfReader.h>
+#include <llvm/ProfileData/InstrProfWriter.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/SHA1.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#pragma clang diagnostic pop
 
 namespace void_compiler {
+namespace {
+
+// Anonymous functions up to this many statements, with no loops, are always
+// inlined into their callers
+constexpr size_t kAlwaysInlineStatementLimit = 4;
+
+// Match ranges up to this many values become switch cases, wider ones a
+// compare after the switch
+constexpr uint64_t kMaxMatchRangeCases = 64;
+
+// Arrays up to this many bytes live on the stack, bigger ones on the heap
+constexpr uint64_t kStackArrayLimit = 64 * 1024;
+
+// Alignment malloc guarantees on the 64-bit targets we support
+constexpr uint64_t kMallocAlignment = 16;
+
+// Arrays are locals only for now; they can't cross a call
+template <typename Function>
+void reject_array_signature(const Function* func) {
+  bool arrays = ArrayType::parse(func->return_type()).has_value();
+  for (const auto& param : func->parameters()) {
+    arrays = arrays || ArrayType::parse(param->type()).has_value();
+  }
+  if (arrays) {
+    throw std::runtime_error(
+        "Arrays can't be passed to or returned from functions yet");
+  }
+}
+
+// Statements in body including nested blocks, or SIZE_MAX if it has a loop
+size_t count_statements(const std::vector<std::unique_ptr<ASTNode>>& body) {
+  size_t count = 0;
+  for (const auto& stmt : body) {
+    if (dynamic_cast<const LoopStatement*>(stmt.get())) return SIZE_MAX;
+    count++;
+    if (const auto* if_stmt = dynamic_cast<const IfStatement*>(stmt.get())) {
+      size_t then_count = count_statements(if_stmt->then_body());
+      size_t else_count = count_statements(if_stmt->else_body());
+      if (then_count == SIZE_MAX || else_count == SIZE_MAX) return SIZE_MAX;
+      count += then_count + else_count;
+    } else if (const auto* match_stmt =
+                   dynamic_cast<const MatchStatement*>(stmt.get())) {
+      size_t else_count = count_statements(match_stmt->else_body());
+      if (else_count == SIZE_MAX) return SIZE_MAX;
+      count += else_count;
+      for (const auto& arm : match_stmt->arms()) {
+        size_t arm_count = count_statements(arm.body);
+        if (arm_count == SIZE_MAX) return SIZE_MAX;
+        count += arm_count;
+      }
+    }
+  }
+  return count;
+}
+
+// Whether body assigns to name, outside of nested anonymous functions
+bool assigns_variable(const std::vector<std::unique_ptr<ASTNode>>& body,
+                      const std::string& name) {
+  for (const auto& stmt : body) {
+    if (const auto* assign =
+            dynamic_cast<const VariableAssignment*>(stmt.get())) {
+      if (assign->name() == name) return true;
+    } else if (const auto* if_stmt =
+                   dynamic_cast<const IfStatement*>(stmt.get())) {
+      if (assigns_variable(if_stmt->then_body(), name) ||
+          assigns_variable(if_stmt->else_body(), name)) {
+        return true;
+      }
+    } else if (const auto* match_stmt =
+                   dynamic_cast<const MatchStatement*>(stmt.get())) {
+      if (assigns_variable(match_stmt->else_body(), name)) return true;
+      for (const auto& arm : match_stmt->arms()) {
+        if (assigns_variable(arm.body, name)) return true;
+      }
+    } else if (const auto* loop = dynamic_cast<const LoopStatement*>(stmt.get())) {
+      if (assigns_variable(loop->body(), name)) return true;
+    }
+  }
+  return false;
+}
+
+// How the C ABI widens a narrow integer of type crossing a call boundary
+llvm::Attribute::AttrKind abi_extension(const std::string& type) {
+  if (type == "i8" || type == "i16") return llvm::Attribute::SExt;
+  if (type == "u8" || type == "u16" || type == "bool") {
+    return llvm::Attribute::ZExt;
+  }
+  return llvm::Attribute::None;
+}
+
+// Whether arithmetic on node's value is unsigned. Arithmetic the parser
+// leaves untyped, such as a u32 plus a literal, is unsigned if either
+// operand is, as in the interpreter.
+bool is_unsigned_arithmetic(const ASTNode* node) {
+  if (!node->inferred_type().empty()) {
+    return node->inferred_type().starts_with("u");
+  }
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    return is_unsigned_arithmetic(binop->left()) ||
+           is_unsigned_arithmetic(binop->right());
+  }
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    return is_unsigned_arithmetic(unary->operand());
+  }
+  return false;
+}
+
+// Names of the variables code under node reads, writes or calls through,
+// which a parallel loop passes to its outlined body. Anonymous function
+// bodies are skipped, since they can't see the enclosing variables anyway.
+void collect_variable_names(const ASTNode* node,
+                            std::set<std::string>& names) {
+  if (node == nullptr) return;
+
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    names.insert(var->name());
+  } else if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    names.insert(call->function_name());
+    for (const auto& arg : call->arguments()) {
+      collect_variable_names(arg.get(), names);
+    }
+  } else if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    collect_variable_names(binop->left(), names);
+    collect_variable_names(binop->right(), names);
+  } else if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    collect_variable_names(unary->operand(), names);
+  } else if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    for (const auto& arg : member->arguments()) {
+      collect_variable_names(arg.get(), names);
+    }
+  } else if (const auto* decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    collect_variable_names(decl->value(), names);
+  } else if (const auto* assign =
+                 dynamic_cast<const VariableAssignment*>(node)) {
+    names.insert(assign->name());
+    collect_variable_names(assign->value(), names);
+  } else if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    collect_variable_names(ret->expression(), names);
+  } else if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    collect_variable_names(if_stmt->condition(), names);
+    for (const auto& stmt : if_stmt->then_body()) {
+      collect_variable_names(stmt.get(), names);
+    }
+    for (const auto& stmt : if_stmt->else_body()) {
+      collect_variable_names(stmt.get(), names);
+    }
+  } else if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    collect_variable_names(match_stmt->value(), names);
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& stmt : arm.body) {
+        collect_variable_names(stmt.get(), names);
+      }
+    }
+    for (const auto& stmt : match_stmt->else_body()) {
+      collect_variable_names(stmt.get(), names);
+    }
+  } else if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    collect_variable_names(loop->range(), names);
+    collect_variable_names(loop->condition(), names);
+    for (const auto& stmt : loop->body()) {
+      collect_variable_names(stmt.get(), names);
+    }
+  } else if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    collect_variable_names(range->start(), names);
+    collect_variable_names(range->end(), names);
+  } else if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    for (const auto& element : literal->elements()) {
+      collect_variable_names(element.get(), names);
+    }
+  } else if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    names.insert(index->array_name());
+    collect_variable_names(index->index(), names);
+  } else if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    names.insert(assign->array_name());
+    collect_variable_names(assign->index(), names);
+    collect_variable_names(assign->value(), names);
+  } else if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    collect_variable_names(access->object(), names);
+  } else if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    collect_variable_names(assign->object(), names);
+    collect_variable_names(assign->value(), names);
+  } else if (const auto* assign =
+                 dynamic_cast<const DereferenceAssignment*>(node)) {
+    names.insert(assign->pointer_name());
+    collect_variable_names(assign->value(), names);
+  }
+}
+
+// MCJIT looks external symbols up in the process's dynamic symbol table,
+// which the statically linked runtime isn't part of
+void register_parallel_runtime() {
+  static const bool registered = [] {
+    llvm::sys::DynamicLibrary::AddSymbol(
+        "void_parallel_for", reinterpret_cast<void*>(&void_parallel_for));
+    return true;
+  }();
+  (void)registered;
+}
+
+// A JIT training run only keeps edge counts. Value profiles, such as which
+// functions an indirect call reaches, need the profile runtime.
+void ignore_profiled_value(uint64_t /*value*/, void* /*data*/,
+                           uint32_t /*site*/) {}
+
+void register_profile_stubs() {
+  static const bool registered = [] {
+    for (const char* name : {"__llvm_profile_instrument_target",
+                             "__llvm_profile_instrument_memop"}) {
+      llvm::sys::DynamicLibrary::AddSymbol(
+          name, reinterpret_cast<void*>(&ignore_profiled_value));
+    }
+    return true;
+  }();
+  (void)registered;
+}
+
+}  // namespace
+
 CodeGenerator::CodeGenerator() {
   context_ = std::make_unique<llvm::LLVMContext>();
   module_ = std::make_unique<llvm::Module>("void_module", *context_);
   builder_ = std::make_unique<llvm::IRBuilder<>>(*context_);
+
+  // Struct layouts and the optimizer both depend on the target's data
+  // layout, so it is set from the start rather than when emitting code
+  llvm::InitializeNativeTarget();
+  auto target_triple = llvm::sys::getDefaultTargetTriple();
+  std::string error;
+  if (const auto* target =
+          llvm::TargetRegistry::lookupTarget(target_triple, error)) {
+    std::optional<llvm::Reloc::Model> relocModel;
+    std::unique_ptr<llvm::TargetMachine> target_machine(
+        target->createTargetMachine(target_triple, "generic", "",
+                                    llvm::TargetOptions(), relocModel));
+    module_->setTargetTriple(target_triple);
+    module_->setDataLayout(target_machine->createDataLayout());
+  }
 }
 
 void CodeGenerator::generate_program(const Program* program) {
@@ -16,12 +273,147 @@ void CodeGenerator::generate_program(const Program* program) {
     (void)import;  // Mark as used - imports are implicitly handled
   }
 
+  // Only emit functions reachable from main. main is the only exported
+  // symbol, so everything else gets internal linkage and the optimizer is free
+  // to inline and delete it. A program without a main is a library: all of
+  // its functions are emitted and exported.
+  //
+  // The parser has already dropped functions nothing reachable refers to;
+  // this catches the ones only reachable through calls folded at compile
+  // time, and the count covers both.
+  declare_structs(program);
+  BorrowChecker(program, declared_functions_).check();
+  program_overflow_ = program->overflow_mode();
+  call_graph_.emplace(program, &constant_folds_);
+  call_targets_ = FunctionPointerAnalysis(program).call_targets();
+  bool has_main = call_graph_->contains("main");
+  auto reachable = call_graph_->reachable_from("main");
+
+  std::vector<std::pair<const FunctionDeclaration*,
+                        llvm::Function::LinkageTypes>>
+      emitted;
+  eliminated_functions_ = program->skipped_function_count();
+  tail_functions_.clear();
+  for (const auto& func : program->functions()) {
+    if (!has_main) {
+      emitted.emplace_back(func.get(), llvm::Function::ExternalLinkage);
+    } else if (!reachable.contains(func->name())) {
+      eliminated_functions_++;
+    } else if (func->name() == "main") {
+      emitted.emplace_back(func.get(), llvm::Function::ExternalLinkage);
+    } else {
+      emitted.emplace_back(func.get(), llvm::Function::InternalLinkage);
+      // Nothing outside the module calls it, so it is free to use tailcc
+      if (call_graph_->guarantees_tail_calls(func->name())) {
+        tail_functions_.insert(func->name());
+      }
+    }
+  }
+
+  // Declare everything first, so calls can reach functions defined later
+  for (const auto& [func, linkage] : emitted) {
+    declare_prototype(func, linkage);
+  }
+  for (const auto& [func, linkage] : emitted) {
+    generate_function(func, linkage);
+  }
+  finish_program();
+}
+
+void CodeGenerator::generate_library(const Program* program) {
+  declare_structs(program);
+  BorrowChecker(program, declared_functions_).check();
+  program_overflow_ = program->overflow_mode();
+  call_graph_.emplace(program, &constant_folds_);
+  call_targets_ = FunctionPointerAnalysis(program).call_targets();
+  c_abi_ = true;
+  tail_functions_.clear();
+  for (const auto& func : program->functions()) {
+    declare_prototype(func.get(), llvm::Function::ExternalLinkage);
+  }
   for (const auto& func : program->functions()) {
     generate_function(func.get());
   }
+  finish_program();
+}
+
+void CodeGenerator::declare_function(const std::string& name,
+                                     const FunctionType& type) {
+  std::vector<llvm::Type*> param_types;
+  for (const auto& param_type : type.param_types()) {
+    param_types.push_back(get_llvm_type_from_string(param_type));
+  }
+  llvm::Function* function = llvm::Function::Create(
+      llvm::FunctionType::get(get_llvm_type_from_string(type.return_type()),
+                              param_types, false),
+      llvm::Function::ExternalLinkage, name, module_.get());
+  add_c_abi_attributes(function, type);
+  add_borrow_attributes(function, type.param_types());
+  declared_functions_.insert_or_assign(name, type);
+}
+
+std::unique_ptr<llvm::Module> CodeGenerator::take_module() {
+  return std::move(module_);
+}
+
+void CodeGenerator::add_c_abi_attributes(llvm::Function* function,
+                                         const FunctionType& type) {
+  for (size_t i = 0; i < type.param_types().size(); ++i) {
+    auto extension = abi_extension(type.param_types()[i]);
+    if (extension != llvm::Attribute::None) {
+      function->addParamAttr(i, extension);
+    }
+  }
+  auto extension = abi_extension(type.return_type());
+  if (extension != llvm::Attribute::None) function->addRetAttr(extension);
+}
+
+void CodeGenerator::add_borrow_attributes(
+    llvm::Function* function, const std::vector<std::string>& param_types) {
+  for (size_t i = 0; i < param_types.size(); ++i) {
+    auto borrow = BorrowType::parse(param_types[i]);
+    if (!borrow) continue;
+
+    // Only the callee reaches the place while it runs, and it keeps no copy
+    // of the pointer, so loads through it can be hoisted and vectorized
+    // without alias checks
+    function->addParamAttr(i, llvm::Attribute::NoAlias);
+    function->addParamAttr(i, llvm::Attribute::NoCapture);
+    function->addParamAttr(i, llvm::Attribute::NonNull);
+    if (!borrow->is_mutable) {
+      function->addParamAttr(i, llvm::Attribute::ReadOnly);
+    }
+    function->addDereferenceableParamAttr(
+        i, module_->getDataLayout().getTypeAllocSize(
+               get_llvm_type_from_string(borrow->pointee)));
+    function->addParamAttr(
+        i, llvm::Attribute::getWithAlignment(*context_,
+                                             type_alignment(borrow->pointee)));
+  }
+}
+
+void CodeGenerator::declare_parameters(
+    llvm::Function* function,
+    const std::vector<std::unique_ptr<Parameter>>& params) {
+  size_t idx = 0;
+  for (auto& arg : function->args()) {
+    const std::string& type = params[idx++]->type();
+    std::string name(arg.getName());
+    if (auto borrow = BorrowType::parse(type)) {
+      symbols_.declare(name, {&arg, borrow->pointee, /*borrowed=*/true});
+      continue;
+    }
+    llvm::AllocaInst* alloca = create_local(type, name);
+    builder_->CreateStore(&arg, alloca);
+    symbols_.declare(name, {alloca, type});
+  }
 }
 
-void CodeGenerator::generate_function(const FunctionDeclaration* func_decl) {
+llvm::Function* CodeGenerator::declare_prototype(
+    const FunctionDeclaration* func_decl,
+    llvm::Function::LinkageTypes linkage) {
+  reject_array_signature(func_decl);
+
   // Create parameter types
   std::vector<llvm::Type*> param_types;
   for (const auto& param : func_decl->parameters()) {
@@ -37,8 +429,23 @@ void CodeGenerator::generate_function(const FunctionDeclaration* func_decl) {
 
   // Create function
   llvm::Function* function =
-      llvm::Function::Create(func_type, llvm::Function::ExternalLinkage,
-                             func_decl->name(), module_.get());
+      llvm::Function::Create(func_type, linkage, func_decl->name(),
+                             module_.get());
+  if (tail_functions_.contains(func_decl->name())) {
+    function->setCallingConv(llvm::CallingConv::Tail);
+  }
+
+  const FunctionHints& hints = func_decl->hints();
+  if (hints.always_inline) function->addFnAttr(llvm::Attribute::AlwaysInline);
+  if (hints.never_inline) function->addFnAttr(llvm::Attribute::NoInline);
+  if (hints.hot) function->addFnAttr(llvm::Attribute::Hot);
+  if (hints.cold) function->addFnAttr(llvm::Attribute::Cold);
+  if (hints.pure) {
+    // The parser made sure it neither prints nor calls anything that does
+    function->setDoesNotAccessMemory();
+    function->addFnAttr(llvm::Attribute::WillReturn);
+    function->setDoesNotThrow();
+  }
 
   // Set parameter names
   size_t idx = 0;
@@ -46,74 +453,270 @@ void CodeGenerator::generate_function(const FunctionDeclaration* func_decl) {
     arg.setName(func_decl->parameters()[idx++]->name());
   }
 
+  std::vector<std::string> param_type_names;
+  for (const auto& param : func_decl->parameters()) {
+    param_type_names.push_back(param->type());
+  }
+  add_borrow_attributes(function, param_type_names);
+
+  // C callers expect narrow integers to arrive and return already extended
+  // to 32 bits
+  if (c_abi_ && linkage == llvm::Function::ExternalLinkage) {
+    add_c_abi_attributes(function,
+                         FunctionType(param_type_names, func_decl->return_type()));
+  }
+  function_types_.insert_or_assign(
+      func_decl->name(), FunctionType(std::move(param_type_names),
+                                      func_decl->return_type()));
+  prototypes_.insert(function);
+  return function;
+}
+
+void CodeGenerator::check_must_tail(const std::string& caller,
+                                    const std::string& callee) const {
+  std::string call = "'return musttail " + callee + "(...)' in '" + caller +
+                     "' can't be guaranteed: ";
+  if (!call_graph_) {
+    throw std::runtime_error(call + "it needs the whole program");
+  }
+  auto type_of = [&](const std::string& name) {
+    auto it = function_types_.find(name);
+    return it != function_types_.end() ? it->second
+                                       : FunctionType({}, "void");
+  };
+  std::string error = call_graph_->must_tail_error(caller, type_of(caller),
+                                                   callee, type_of(callee));
+  if (error.empty() &&
+      (!tail_functions_.contains(caller) || !tail_functions_.contains(callee))) {
+    error = call + "exported functions keep the C calling convention";
+  }
+  if (error.empty() && !heap_arrays_.empty()) {
+    error = call + "'" + caller + "' frees heap arrays when it returns";
+  }
+  if (!error.empty()) throw std::runtime_error(error);
+}
+
+void CodeGenerator::generate_function(const FunctionDeclaration* func_decl,
+                                      llvm::Function::LinkageTypes linkage) {
+  // generate_program declares every function before defining any
+  llvm::Function* function = module_->getFunction(func_decl->name());
+  if (function == nullptr || !prototypes_.contains(function)) {
+    function = declare_prototype(func_decl, linkage);
+  }
+  prototypes_.erase(function);
+
   // Create basic block
   llvm::BasicBlock* entry =
       llvm::BasicBlock::Create(*context_, "entry", function);
   builder_->SetInsertPoint(entry);
+  begin_debug_function(function, func_decl->location());
 
-  // Store parameter values in allocas for later reference
-  function_params_.clear();
-  local_variables_.clear();
+  // Parameters and locals live in a fresh function scope
+  auto scope = symbols_.function_scope();
+  heap_arrays_.clear();
 
   // Track current function's return type for validation
   current_function_return_type_ = func_decl->return_type();
+  overflow_mode_ = func_decl->overflow_mode().value_or(program_overflow_);
 
-  idx = 0;
-  for (auto& arg : function->args()) {
-    // Use the actual parameter type for the alloca
-    llvm::Type* param_type =
-        get_llvm_type_from_string(func_decl->parameters()[idx]->type());
-    llvm::AllocaInst* alloca =
-        builder_->CreateAlloca(param_type, nullptr, arg.getName());
-    builder_->CreateStore(&arg, alloca);
-    function_params_[std::string(arg.getName())] = alloca;
-
-    // Track parameter types for variable reference handling
-    variable_types_[std::string(arg.getName())] =
-        func_decl->parameters()[idx]->type();
-
-    idx++;
-  }
+  declare_parameters(function, func_decl->parameters());
 
   // Generate function body
   for (const auto& stmt : func_decl->body()) {
     generate_statement(stmt.get(), function);
   }
 
-  // If this is a void function and there's no terminator, add a void return
-  if (func_decl->return_type() == "void" &&
-      !builder_->GetInsertBlock()->getTerminator()) {
-    builder_->CreateRetVoid();
+  // Terminate the last block: void functions fall through to a return
+  if (!builder_->GetInsertBlock()->getTerminator()) {
+    if (func_decl->return_type() == "void") {
+      builder_->CreateRetVoid();
+    } else {
+      // Every path has returned already, e.g. an if/else returning from both
+      // branches leaves an empty merge block behind
+      builder_->CreateUnreachable();
+    }
+  }
+  free_heap_arrays(function);
+  end_debug_function();
+}
+
+void CodeGenerator::finish_program() {
+  if (frame_pointers_) {
+    for (auto& function : *module_) {
+      if (!function.isDeclaration()) {
+        function.addFnAttr("frame-pointer", "all");
+      }
+    }
+  }
+  if (debug_builder_) debug_builder_->finalize();
+}
+
+void CodeGenerator::set_debug_info(const std::string& source_file) {
+  debug_builder_ = std::make_unique<llvm::DIBuilder>(*module_);
+  std::filesystem::path path = std::filesystem::absolute(source_file);
+  debug_file_ = debug_builder_->createFile(path.filename().string(),
+                                           path.parent_path().string());
+  debug_builder_->createCompileUnit(llvm::dwarf::DW_LANG_C, debug_file_,
+                                    "void_compiler", /*isOptimized=*/true,
+                                    /*Flags=*/"", /*RV=*/0);
+  module_->addModuleFlag(llvm::Module::Warning, "Debug Info Version",
+                         llvm::DEBUG_METADATA_VERSION);
+  module_->addModuleFlag(llvm::Module::Warning, "Dwarf Version",
+                         llvm::dwarf::DWARF_VERSION);
+}
+
+void CodeGenerator::begin_debug_function(llvm::Function* function,
+                                         SourceLocation location) {
+  if (!debug_builder_) return;
+  auto line = static_cast<unsigned>(location.line);
+  llvm::DISubprogram::DISPFlags flags =
+      llvm::DISubprogram::SPFlagDefinition | llvm::DISubprogram::SPFlagOptimized;
+  if (function->hasLocalLinkage()) {
+    flags |= llvm::DISubprogram::SPFlagLocalToUnit;
   }
+  // Profilers and debuggers only need where it is, so its type is left bare
+  llvm::DISubprogram* subprogram = debug_builder_->createFunction(
+      debug_file_, function->getName(), /*LinkageName=*/"", debug_file_, line,
+      debug_builder_->createSubroutineType(
+          debug_builder_->getOrCreateTypeArray({})),
+      line, llvm::DINode::FlagPrototyped, flags);
+  function->setSubprogram(subprogram);
+  debug_scopes_.emplace_back(subprogram, builder_->getCurrentDebugLocation());
+  builder_->SetCurrentDebugLocation(
+      llvm::DILocation::get(*context_, line, location.column, subprogram));
+}
+
+void CodeGenerator::end_debug_function() {
+  if (!debug_builder_) return;
+  builder_->SetCurrentDebugLocation(debug_scopes_.back().second);
+  debug_scopes_.pop_back();
+}
+
+void CodeGenerator::set_debug_location(const ASTNode* node) {
+  if (debug_scopes_.empty() || node->location().line == 0) return;
+  builder_->SetCurrentDebugLocation(llvm::DILocation::get(
+      *context_, static_cast<unsigned>(node->location().line),
+      node->location().column, debug_scopes_.back().first));
 }
 
 void CodeGenerator::print_ir() const { module_->print(llvm::outs(), nullptr); }
 
+void CodeGenerator::optimize(llvm::OptimizationLevel level) {
+  // The optimizer assumes well-formed IR, so catch codegen bugs here rather
+  // than as miscompiles
+  std::string errors;
+  llvm::raw_string_ostream error_stream(errors);
+  if (llvm::verifyModule(*module_, &error_stream)) {
+    throw std::runtime_error("Generated invalid IR: " + errors);
+  }
+
+  llvm::LoopAnalysisManager loop_analyses;
+  llvm::FunctionAnalysisManager function_analyses;
+  llvm::CGSCCAnalysisManager cgscc_analyses;
+  llvm::ModuleAnalysisManager module_analyses;
+
+  // The target's cost model tells the vectorizers how wide its registers are;
+  // without one they never vectorize
+  std::string error;
+  auto target_machine = create_target_machine(error);
+  std::optional<llvm::PGOOptions> pgo;
+  if (profile_generate_) {
+    // How the counters are laid out and registered depends on the target
+    module_->setTargetTriple(llvm::sys::getDefaultTargetTriple());
+    pgo = llvm::PGOOptions("", "", "",
+                           "", llvm::vfs::getRealFileSystem(),
+                           llvm::PGOOptions::IRInstr);
+    // Counters refer to their function by the MD5 of its name, so keep the
+    // names while every function is still around, before inlining
+    profile_names_.clear();
+    for (const auto& function : *module_) {
+      if (function.isDeclaration()) continue;
+      std::string name = llvm::getPGOFuncName(function);
+      profile_names_.emplace(llvm::IndexedInstrProf::ComputeHash(name), name);
+    }
+  } else if (!profile_use_.empty()) {
+    // The optimizer reports unreadable profiles by exiting
+    auto reader = llvm::IndexedInstrProfReader::create(profile_use_);
+    if (!reader) {
+      throw std::runtime_error("Can't read profile '" + profile_use_ +
+                               "': " + llvm::toString(reader.takeError()));
+    }
+    pgo = llvm::PGOOptions(profile_use_, "", "",
+                           "", llvm::vfs::getRealFileSystem(),
+                           llvm::PGOOptions::IRUse);
+  }
+  llvm::PassBuilder pass_builder(target_machine.get(),
+                                 llvm::PipelineTuningOptions(), pgo);
+  pass_builder.registerModuleAnalyses(module_analyses);
+  pass_builder.registerCGSCCAnalyses(cgscc_analyses);
+  pass_builder.registerFunctionAnalyses(function_analyses);
+  pass_builder.registerLoopAnalyses(loop_analyses);
+  pass_builder.crossRegisterProxies(loop_analyses, function_analyses,
+                                    cgscc_analyses, module_analyses);
+
+  // O0 still runs the always-inliner, so small lambdas are inlined even in
+  // unoptimized builds
+  llvm::ModulePassManager passes =
+      level == llvm::OptimizationLevel::O0
+          ? pass_builder.buildO0DefaultPipeline(level)
+          : pass_builder.buildPerModuleDefaultPipeline(level);
+  passes.run(*module_, module_analyses);
+}
+
 bool CodeGenerator::compile_to_object(const std::string& filename) {
+  return emit_file(filename, llvm::CodeGenFileType::ObjectFile);
+}
+
+bool CodeGenerator::compile_to_assembly(const std::string& filename) {
+  return emit_file(filename, llvm::CodeGenFileType::AssemblyFile);
+}
+
+std::unique_ptr<llvm::TargetMachine> CodeGenerator::create_target_machine(
+    std::string& error) const {
+  auto target_triple = llvm::sys::getDefaultTargetTriple();
+  const auto* target = llvm::TargetRegistry::lookupTarget(target_triple, error);
+  if (!target) return nullptr;
+
+  // "native" also turns on exactly the features the host has, e.g. the
+  // vector extensions wider SIMD types need
+  std::string cpu = target_cpu_;
+  std::string features;
+  if (cpu == "native") {
+    cpu = llvm::sys::getHostCPUName().str();
+    llvm::StringMap<bool> host_features;
+    if (llvm::sys::getHostCPUFeatures(host_features)) {
+      for (const auto& feature : host_features) {
+        if (!features.empty()) features += ',';
+        features += (feature.getValue() ? "+" : "-") + feature.getKey().str();
+      }
+    }
+  }
+
+  llvm::TargetOptions opt;
+  // Move the blocks a profile never saw run to a cold section, away from the
+  // hot code. Splitting whole functions instead would mark ones entered once,
+  // like main, for size even when their loops are hot.
+  opt.EnableMachineFunctionSplitter = !profile_use_.empty();
+  std::optional<llvm::Reloc::Model> relocModel;
+  return std::unique_ptr<llvm::TargetMachine>(target->createTargetMachine(
+      target_triple, cpu, features, opt, relocModel));
+}
+
+bool CodeGenerator::emit_file(const std::string& filename,
+                              llvm::CodeGenFileType file_type) {
   // Initialize only native target (much simpler and smaller)
   llvm::InitializeNativeTarget();
   llvm::InitializeNativeTargetAsmPrinter();
   llvm::InitializeNativeTargetAsmParser();
 
-  // Get target triple
-  auto target_triple = llvm::sys::getDefaultTargetTriple();
-  module_->setTargetTriple(target_triple);
-
+  module_->setTargetTriple(llvm::sys::getDefaultTargetTriple());
   std::string error;
-  auto target = llvm::TargetRegistry::lookupTarget(target_triple, error);
-  if (!target) {
+  auto target_machine = create_target_machine(error);
+  if (!target_machine) {
     std::cerr << "Error: " << error << '\n';
     return false;
   }
 
-  auto cpu = "generic";
-  auto features = "";
-
-  llvm::TargetOptions opt;
-  std::optional<llvm::Reloc::Model> relocModel;
-  auto target_machine = target->createTargetMachine(target_triple, cpu,
-                                                    features, opt, relocModel);
-
   module_->setDataLayout(target_machine->createDataLayout());
 
   // Open output file
@@ -124,10 +727,7 @@ bool CodeGenerator::compile_to_object(const std::string& filename) {
     return false;
   }
 
-  // Generate object file
   llvm::legacy::PassManager pass;
-  auto file_type = llvm::CodeGenFileType::ObjectFile;
-
   if (target_machine->addPassesToEmitFile(pass, dest, nullptr, file_type)) {
     std::cerr << "TargetMachine can't emit a file of this type" << '\n';
     return false;
@@ -136,35 +736,183 @@ bool CodeGenerator::compile_to_object(const std::string& filename) {
   pass.run(*module_);
   dest.flush();
 
-  std::cout << "Object file written to " << filename << '\n';
+  std::cout << (file_type == llvm::CodeGenFileType::ObjectFile ? "Object"
+                                                               : "Assembly")
+            << " file written to " << filename << '\n';
   return true;
 }
 
-int CodeGenerator::run_jit() {
+std::string CodeGenerator::assign_cache_key(llvm::OptimizationLevel level) {
+  std::string key_source;
+  llvm::raw_string_ostream out(key_source);
+  module_->print(out, nullptr);
+  out << '\n'
+      << LLVM_VERSION_STRING << ' ' << llvm::sys::getProcessTriple() << ' '
+      << llvm::sys::getHostCPUName() << " O" << level.getSpeedupLevel() << 's'
+      << level.getSizeLevel();
+  out.flush();
+
+  std::string key = llvm::toHex(llvm::SHA1::hash(
+                                    llvm::arrayRefFromStringRef(key_source)),
+                                /*LowerCase=*/true);
+  module_->setModuleIdentifier(key);
+  return key;
+}
+
+int CodeGenerator::run_jit(llvm::ObjectCache* cache) {
   // Initialize LLVM
   llvm::InitializeNativeTarget();
   llvm::InitializeNativeTargetAsmPrinter();
+  if (profile_generate_) {
+    register_profile_stubs();
+    expose_profile_counters();
+  }
+
+  create_engine();
+  if (cache) engine_->setObjectCache(cache);
+
+  // Get the main function
+  llvm::Function* main_func = engine_->FindFunctionNamed("main");
+  if (!main_func) {
+    throw std::runtime_error("Main function not found");
+  }
 
-  // Create execution engine
+  // Execute. A void main exits with 0, as in the interpreter, rather than
+  // whatever its caller finds in the return register.
+  llvm::GenericValue result = engine_->runFunction(main_func, {});
+  if (main_func->getReturnType()->isVoidTy()) return 0;
+  return static_cast<int>(result.IntVal.getSExtValue());
+}
+
+void CodeGenerator::create_engine() {
   std::string error_str;
-  llvm::ExecutionEngine* ee =
+  engine_.reset(
       llvm::EngineBuilder(std::unique_ptr<llvm::Module>(module_.release()))
           .setErrorStr(&error_str)
-          .create();
-
-  if (!ee) {
+          .setMCPU(llvm::sys::getHostCPUName())
+          .create());
+  if (!engine_) {
     throw std::runtime_error("Failed to create execution engine: " + error_str);
   }
+  register_jit_event_listeners(*engine_, jit_events_);
+}
 
-  // Get the main function
-  llvm::Function* main_func = ee->FindFunctionNamed("main");
-  if (!main_func) {
-    throw std::runtime_error("Main function not found");
+// Each instrumented function has a data record with the MD5 of its name and
+// its control flow hash, next to its array of counters
+void CodeGenerator::expose_profile_counters() {
+  const std::string data_prefix = llvm::getInstrProfDataVarPrefix().str();
+  const std::string counters_prefix =
+      llvm::getInstrProfCountersVarPrefix().str();
+  profiled_functions_.clear();
+  for (auto& data : module_->globals()) {
+    if (!data.getName().starts_with(data_prefix)) continue;
+    auto* fields = llvm::cast<llvm::ConstantStruct>(data.getInitializer());
+    uint64_t name_hash =
+        llvm::cast<llvm::ConstantInt>(fields->getOperand(0))->getZExtValue();
+    uint64_t cfg_hash =
+        llvm::cast<llvm::ConstantInt>(fields->getOperand(1))->getZExtValue();
+
+    // Counters are private, which MCJIT doesn't let us look up
+    std::string counters_name =
+        counters_prefix + data.getName().substr(data_prefix.size()).str();
+    llvm::GlobalVariable* counters = module_->getNamedGlobal(counters_name);
+    counters->setLinkage(llvm::GlobalValue::ExternalLinkage);
+    counters->setVisibility(llvm::GlobalValue::DefaultVisibility);
+    profiled_functions_.push_back(
+        {.name = profile_names_.at(name_hash),
+         .hash = cfg_hash,
+         .counters = counters_name,
+         .counter_count =
+             llvm::cast<llvm::ArrayType>(counters->getValueType())
+                 ->getNumElements()});
   }
+}
 
-  // Execute
-  llvm::GenericValue result = ee->runFunction(main_func, {});
-  return static_cast<int>(result.IntVal.getSExtValue());
+void CodeGenerator::write_jit_profile(const std::string& filename) const {
+  if (!engine_ || !profile_generate_) {
+    throw std::runtime_error("Only a JIT run of an instrumented module has "
+                             "a profile to write");
+  }
+
+  llvm::InstrProfWriter writer;
+  if (llvm::Error error =
+          writer.mergeProfileKind(llvm::InstrProfKind::IRInstrumentation)) {
+    throw std::runtime_error(llvm::toString(std::move(error)));
+  }
+  for (const auto& function : profiled_functions_) {
+    const auto* counts = reinterpret_cast<const uint64_t*>(
+        engine_->getGlobalValueAddress(function.counters));
+    writer.addRecord(
+        llvm::NamedInstrProfRecord(
+            function.name, function.hash,
+            std::vector<uint64_t>(counts, counts + function.counter_count)),
+        [](llvm::Error error) { llvm::consumeError(std::move(error)); });
+  }
+
+  std::error_code error_code;
+  llvm::raw_fd_ostream out(filename, error_code);
+  if (error_code) {
+    throw std::runtime_error("Can't write profile '" + filename +
+                             "': " + error_code.message());
+  }
+  if (llvm::Error error = writer.write(out)) {
+    throw std::runtime_error(llvm::toString(std::move(error)));
+  }
+}
+
+std::string CodeGenerator::generate_entry_thunk(const std::string& name) {
+  llvm::Function* target = module_->getFunction(name);
+  if (!target) {
+    throw std::runtime_error("Function '" + name + "' not found");
+  }
+
+  llvm::Type* i64 = builder_->getInt64Ty();
+  auto* thunk_type = llvm::FunctionType::get(
+      i64, {llvm::PointerType::get(i64, 0)}, false);
+  llvm::Function* thunk =
+      llvm::Function::Create(thunk_type, llvm::Function::ExternalLinkage,
+                             name + ".entry", module_.get());
+  builder_->SetInsertPoint(llvm::BasicBlock::Create(*context_, "entry", thunk));
+
+  std::vector<llvm::Value*> args;
+  for (auto& param : target->args()) {
+    if (!param.getType()->isIntegerTy()) {
+      throw std::runtime_error("Function '" + name +
+                               "' takes a non-integer parameter");
+    }
+    llvm::Value* slot = builder_->CreateGEP(i64, thunk->getArg(0),
+                                            builder_->getInt64(args.size()));
+    args.push_back(convert_integer(builder_->CreateLoad(i64, slot),
+                                   param.getType()));
+  }
+
+  if (!target->getReturnType()->isVoidTy() &&
+      !target->getReturnType()->isIntegerTy()) {
+    throw std::runtime_error("Function '" + name +
+                             "' returns a non-integer value");
+  }
+  llvm::CallInst* result = builder_->CreateCall(target, args);
+  result->setCallingConv(target->getCallingConv());
+  if (target->getReturnType()->isVoidTy()) {
+    builder_->CreateRet(builder_->getInt64(0));
+  } else {
+    builder_->CreateRet(convert_integer(result, i64));
+  }
+  return std::string(thunk->getName());
+}
+
+uint64_t CodeGenerator::jit_function_address(const std::string& name) {
+  if (!engine_) {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+    create_engine();
+  }
+
+  uint64_t address = engine_->getFunctionAddress(name);
+  if (address == 0) {
+    throw std::runtime_error("Function '" + name + "' not found");
+  }
+  return address;
 }
 
 llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
@@ -183,34 +931,17 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
   }
 
   if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
-    // Check function parameters first
-    auto it = function_params_.find(var->name());
-    if (it != function_params_.end()) {
-      // Get the parameter type and use correct load type
-      auto type_it = variable_types_.find(var->name());
-      if (type_it != variable_types_.end()) {
-        llvm::Type* load_type = get_llvm_type_from_string(type_it->second);
-        return builder_->CreateLoad(load_type, it->second, var->name());
-      } else {
-        // Fallback to i32 if type not found (shouldn't happen for parameters)
-        return builder_->CreateLoad(llvm::Type::getInt32Ty(*context_),
-                                    it->second, var->name());
-      }
-    }
-
-    // Check local variables
-    auto local_it = local_variables_.find(var->name());
-    if (local_it != local_variables_.end()) {
-      // Get the variable type and use correct load type
-      auto type_it = variable_types_.find(var->name());
-      if (type_it != variable_types_.end()) {
-        llvm::Type* load_type = get_llvm_type_from_string(type_it->second);
-        return builder_->CreateLoad(load_type, local_it->second, var->name());
-      } else {
-        // Fallback to i32 if type not found (shouldn't happen)
-        return builder_->CreateLoad(llvm::Type::getInt32Ty(*context_),
-                                    local_it->second, var->name());
+    // Parameters and local variables, innermost scope first
+    if (const Symbol* symbol = symbols_.lookup(var->name())) {
+      // A borrow's value is the pointer, passed on to other borrows
+      if (symbol->borrowed) return symbol->address;
+      if (ArrayType::parse(symbol->type)) {
+        throw std::runtime_error("Array '" + var->name() +
+                                 "' can only be indexed, assigned or looped "
+                                 "over");
       }
+      llvm::Type* load_type = get_llvm_type_from_string(symbol->type);
+      return builder_->CreateLoad(load_type, symbol->address, var->name());
     }
 
     // Check if it's a function name (for function pointer assignment)
@@ -226,14 +957,39 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
   if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
     llvm::Value* left = generate_expression(binop->left());
     llvm::Value* right = generate_expression(binop->right());
+    if (left->getType()->isVectorTy() || right->getType()->isVectorTy()) {
+      return generate_vector_operation(binop, left, right);
+    }
+    if (left->getType()->isStructTy() || right->getType()->isStructTy()) {
+      throw std::runtime_error("Structs can't be used with operators");
+    }
+
+    // Mixed width integer operands, e.g. an i64 parameter plus a literal,
+    // are extended to the wider type: zero extended if the narrower one is
+    // unsigned, sign extended otherwise
+    if (left->getType()->isIntegerTy() && right->getType()->isIntegerTy() &&
+        !left->getType()->isIntegerTy(1) && !right->getType()->isIntegerTy(1)) {
+      if (left->getType()->getIntegerBitWidth() <
+          right->getType()->getIntegerBitWidth()) {
+        left = is_unsigned_arithmetic(binop->left())
+                   ? builder_->CreateZExt(left, right->getType())
+                   : convert_integer(left, right->getType());
+      } else if (left->getType()->getIntegerBitWidth() >
+                 right->getType()->getIntegerBitWidth()) {
+        right = is_unsigned_arithmetic(binop->right())
+                    ? builder_->CreateZExt(right, left->getType())
+                    : convert_integer(right, left->getType());
+      }
+    }
 
     switch (binop->operator_type()) {
       case TokenType::Plus:
-        return builder_->CreateAdd(left, right, "addtmp");
       case TokenType::Minus:
-        return builder_->CreateSub(left, right, "subtmp");
       case TokenType::Asterisk:
-        return builder_->CreateMul(left, right, "multmp");
+        return generate_arithmetic(
+            binop->operator_type(), left, right,
+            is_unsigned_arithmetic(binop->left()) ||
+                is_unsigned_arithmetic(binop->right()));
       case TokenType::Divide:
         return builder_->CreateSDiv(left, right, "divtmp");
       case TokenType::GreaterThan:
@@ -258,12 +1014,35 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
   }
 
   if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    // & and .* work on the operand's place rather than its value
+    if (unary->operator_type() == TokenType::Borrow) {
+      return borrow_place(unary->operand()).address;
+    }
+    if (unary->operator_type() == TokenType::DotStar) {
+      const auto* var = dynamic_cast<const VariableReference*>(unary->operand());
+      if (var == nullptr) {
+        throw std::runtime_error("Cannot dereference non-pointer type");
+      }
+      Place place = pointee_place(var->name());
+      if (ArrayType::parse(place.type)) {
+        throw std::runtime_error("Array '" + var->name() +
+                                 ".*' can only be indexed, assigned or "
+                                 "looped over");
+      }
+      return builder_->CreateAlignedLoad(get_llvm_type_from_string(place.type),
+                                         place.address, place.align,
+                                         "dereftmp");
+    }
+
     llvm::Value* operand = generate_expression(unary->operand());
 
     switch (unary->operator_type()) {
       case TokenType::Not:
         return builder_->CreateNot(operand, "nottmp");
       case TokenType::Minus:
+        if (operand->getType()->isVectorTy()) {
+          return builder_->CreateNeg(operand, "negtmp");
+        }
         // Handle unary minus (negation) - promote to i32 and use explicit
         // subtraction from zero
         if (operand->getType()->isIntegerTy()) {
@@ -274,56 +1053,45 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
                 operand, llvm::Type::getInt32Ty(*context_), "promoted");
           }
 
+          // Negation is signed whatever the operand's type, so only the
+          // most negative value overflows
           llvm::Value* zero =
               llvm::ConstantInt::get(promoted_operand->getType(), 0);
-          return builder_->CreateSub(zero, promoted_operand, "negtmp");
+          return generate_arithmetic(TokenType::Minus, zero, promoted_operand,
+                                     /*is_unsigned=*/false, "negtmp");
         } else {
           throw std::runtime_error(
               "Unary minus only supported for integer types");
         }
-      case TokenType::Borrow:
-        // Handle borrowing (&variable) - get address of operand
-        if (auto* alloca = llvm::dyn_cast<llvm::AllocaInst>(operand)) {
-          return alloca;  // Return the pointer directly
-        } else if (auto* load = llvm::dyn_cast<llvm::LoadInst>(operand)) {
-          // If operand is a load, return the pointer being loaded from
-          return load->getPointerOperand();
-        } else {
-          throw std::runtime_error("Cannot take address of non-lvalue");
-        }
-      case TokenType::DotStar:
-        // Handle explicit dereference (.*)
-        if (operand->getType()->isPointerTy()) {
-          // We need to know what type this pointer points to
-          // For now, let's try a different approach - cast to specific types
-          // This is a simplified implementation that assumes i32 pointers for
-          // now In a full implementation, we'd need better type tracking
-          llvm::Type* int32_type = llvm::Type::getInt32Ty(*context_);
-          return builder_->CreateLoad(int32_type, operand, "dereftmp");
-        } else {
-          throw std::runtime_error("Cannot dereference non-pointer type");
-        }
       default:
         throw std::runtime_error("Unknown unary operator");
     }
   }
 
   if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    auto fold_it = constant_folds_.find(call);
+    if (fold_it != constant_folds_.end()) {
+      const ConstValue& folded = fold_it->second;
+      return llvm::ConstantInt::get(
+          get_llvm_type_from_string(folded.type),
+          static_cast<uint64_t>(folded.value), folded.type != "bool");
+    }
+
+    if (auto vector = VectorType::parse(call->function_name())) {
+      return generate_vector_literal(*vector, call);
+    }
+    auto struct_it = structs_.find(call->function_name());
+    if (struct_it != structs_.end()) {
+      return generate_struct_literal(struct_it->second, call);
+    }
+
     // Check if this is a function pointer call first
-    auto local_it = local_variables_.find(call->function_name());
-    if (local_it != local_variables_.end()) {
+    if (const Symbol* symbol = symbols_.lookup(call->function_name())) {
       // Check if it's a function pointer variable
-      auto type_it = variable_types_.find(call->function_name());
-      if (type_it != variable_types_.end() &&
-          is_function_pointer_type(type_it->second)) {
+      if (is_function_pointer_type(symbol->type)) {
         // This is a function pointer call
-        // Load the function pointer from the variable
-        llvm::Type* func_ptr_type = get_llvm_type_from_string(type_it->second);
-        llvm::Value* func_ptr = builder_->CreateLoad(
-            func_ptr_type, local_it->second, call->function_name());
-
         // Parse function type to get parameter and return types
-        FunctionType func_type = parse_function_type(type_it->second);
+        FunctionType func_type = FunctionType::parse(symbol->type);
 
         // Validate argument count
         size_t expected_args = func_type.param_types().size();
@@ -335,22 +1103,40 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
               std::to_string(provided_args) + " were provided");
         }
 
-        // Generate arguments
-        std::vector<llvm::Value*> args;
-        for (const auto& arg : call->arguments()) {
-          args.push_back(generate_expression(arg.get()));
-        }
-
         // Get the LLVM function type for the indirect call
         std::vector<llvm::Type*> llvm_param_types;
         for (const auto& param_type : func_type.param_types()) {
           llvm_param_types.push_back(get_llvm_type_from_string(param_type));
         }
+
+        // Generate arguments, converted to the parameter types
+        std::vector<llvm::Value*> args;
+        for (size_t i = 0; i < call->arguments().size(); ++i) {
+          args.push_back(convert_integer(
+              generate_expression(call->arguments()[i].get()),
+              llvm_param_types[i]));
+        }
         llvm::Type* llvm_return_type =
             get_llvm_type_from_string(func_type.return_type());
         llvm::FunctionType* function_type =
             llvm::FunctionType::get(llvm_return_type, llvm_param_types, false);
 
+        // A pointer that can only hold one function is a plain direct call
+        auto targets = resolve_call_targets(call, function_type);
+        if (targets.size() == 1) {
+          return builder_->CreateCall(targets.front(), args);
+        }
+
+        // Load the function pointer from the variable
+        llvm::Type* func_ptr_type = get_llvm_type_from_string(symbol->type);
+        llvm::Value* func_ptr = builder_->CreateLoad(
+            func_ptr_type, symbol->address, call->function_name());
+
+        if (!targets.empty()) {
+          return generate_guarded_call(function_type, func_ptr, targets,
+                                       args);
+        }
+
         // Create indirect call through function pointer
         return builder_->CreateCall(function_type, func_ptr, args);
       }
@@ -372,13 +1158,27 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
           std::to_string(provided_args) + " were provided");
     }
 
-    // Generate arguments
+    // Generate arguments, converted to the parameter types
     std::vector<llvm::Value*> args;
-    for (const auto& arg : call->arguments()) {
-      args.push_back(generate_expression(arg.get()));
+    for (size_t i = 0; i < call->arguments().size(); ++i) {
+      args.push_back(
+          convert_integer(generate_expression(call->arguments()[i].get()),
+                          func->getFunctionType()->getParamType(i)));
     }
 
-    return builder_->CreateCall(func, args);
+    // The caller extends narrow arguments, so it must see the callee's
+    // signext/zeroext attributes too
+    llvm::CallInst* result = builder_->CreateCall(func, args);
+    result->setCallingConv(func->getCallingConv());
+    llvm::AttributeList attributes = func->getAttributes();
+    std::vector<llvm::AttributeSet> param_attributes;
+    for (unsigned i = 0; i < func->arg_size(); ++i) {
+      param_attributes.push_back(attributes.getParamAttrs(i));
+    }
+    result->setAttributes(llvm::AttributeList::get(
+        *context_, llvm::AttributeSet(), attributes.getRetAttrs(),
+        param_attributes));
+    return result;
   }
 
   if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
@@ -463,17 +1263,59 @@ llvm::Value* CodeGenerator::generate_expression(const ASTNode* node) {
       return builder_->CreateCall(printf_func, printf_args);
     }
 
+    if (member->object_name() == "simd" ||
+        VectorType::parse(member->object_name())) {
+      return generate_simd_call(member);
+    }
+
     throw std::runtime_error("Unknown member access: " + member->object_name() +
                              "." + member->member_name());
   }
 
-  throw std::runtime_error("Unknown expression type");
-}
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    const Symbol* symbol = symbols_.lookup(index->array_name());
+    if (auto vector = symbol ? VectorType::parse(symbol->type) : std::nullopt) {
+      llvm::Value* lane = checked_index(index->index(), vector->lanes);
+      llvm::Value* value = builder_->CreateLoad(
+          get_llvm_type_from_string(symbol->type), symbol->address);
+      return builder_->CreateExtractElement(value, lane,
+                                            index->array_name() + ".lane");
+    }
 
-void CodeGenerator::generate_statement(const ASTNode* node,
-                                       llvm::Function* function) {
-  (void)function;  // Mark as used
+    if (auto soa = symbol ? soa_array(symbol->type) : std::nullopt) {
+      return load_soa_element(symbol->address, *soa,
+                              checked_index(index->index(), soa->length));
+    }
+
+    auto [address, type] = element_address(index->array_name(), index->index());
+    return builder_->CreateLoad(get_llvm_type_from_string(type), address,
+                                index->array_name() + ".elem");
+  }
+
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    Place field = field_place(access->object(), access->field_name());
+    return builder_->CreateAlignedLoad(get_llvm_type_from_string(field.type),
+                                       field.address, field.align,
+                                       access->field_name());
+  }
+
+  if (dynamic_cast<const ArrayLiteral*>(node)) {
+    throw std::runtime_error(
+        "Array literals can only initialize or assign array variables");
+  }
+
+  throw std::runtime_error("Unknown expression type");
+}
+
+void CodeGenerator::generate_statement(const ASTNode* node,
+                                       llvm::Function* function) {
+  (void)function;  // Mark as used
+  set_debug_location(node);
   if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    // The body runs in its own function, possibly on another thread
+    if (in_parallel_body_) {
+      throw std::runtime_error("Cannot return from inside a 'loop par' body");
+    }
     if (ret->expression() == nullptr) {
       // Return without value - only allowed for void functions
       if (current_function_return_type_ != "void") {
@@ -486,28 +1328,30 @@ void CodeGenerator::generate_statement(const ASTNode* node,
       if (current_function_return_type_ == "void") {
         throw std::runtime_error("Cannot return a value from a void function");
       }
+      const auto* call = dynamic_cast<const FunctionCall*>(ret->expression());
+      if (ret->must_tail()) {
+        check_must_tail(function->getName().str(), call->function_name());
+      }
       llvm::Value* ret_val = generate_expression(ret->expression());
 
+      // A call returned as is can reuse the caller's frame, as long as no
+      // argument points into it. Folded calls leave a constant behind.
+      auto* tail_call = llvm::dyn_cast<llvm::CallInst>(ret_val);
+      if (call != nullptr && tail_call != nullptr && heap_arrays_.empty() &&
+          std::ranges::all_of(tail_call->args(), [](const llvm::Use& arg) {
+            return arg->getType()->isIntOrIntVectorTy();
+          })) {
+        tail_call->setTailCallKind(ret->must_tail()
+                                       ? llvm::CallInst::TCK_MustTail
+                                       : llvm::CallInst::TCK_Tail);
+      }
+
       // Get the expected return type
       llvm::Type* expected_type =
           get_llvm_type_from_string(current_function_return_type_);
 
       // Convert the return value to the correct type if needed
-      if (ret_val->getType() != expected_type) {
-        // Handle integer type conversions
-        if (expected_type->isIntegerTy() && ret_val->getType()->isIntegerTy()) {
-          unsigned expected_bits = expected_type->getIntegerBitWidth();
-          unsigned actual_bits = ret_val->getType()->getIntegerBitWidth();
-
-          if (expected_bits < actual_bits) {
-            // Truncate to smaller type
-            ret_val = builder_->CreateTrunc(ret_val, expected_type);
-          } else if (expected_bits > actual_bits) {
-            // Extend to larger type (sign extend for now)
-            ret_val = builder_->CreateSExt(ret_val, expected_type);
-          }
-        }
-      }
+      ret_val = convert_integer(ret_val, expected_type);
 
       builder_->CreateRet(ret_val);
     }
@@ -515,6 +1359,13 @@ void CodeGenerator::generate_statement(const ASTNode* node,
   }
 
   if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    if (auto array = ArrayType::parse(var_decl->type())) {
+      llvm::Value* address = allocate_array(*array, var_decl->name());
+      store_array(address, *array, var_decl->value());
+      symbols_.declare(var_decl->name(), {address, var_decl->type()});
+      return;
+    }
+
     // Generate the initial value
     llvm::Value* init_value = generate_expression(var_decl->value());
 
@@ -522,55 +1373,103 @@ void CodeGenerator::generate_statement(const ASTNode* node,
     llvm::Type* var_type = get_llvm_type_from_string(var_decl->type());
 
     // Create local variable (alloca)
-    llvm::AllocaInst* alloca =
-        builder_->CreateAlloca(var_type, nullptr, var_decl->name());
+    llvm::AllocaInst* alloca = create_local(var_decl->type(), var_decl->name());
 
     // Convert the initial value to the correct type if needed
-    llvm::Value* converted_value = init_value;
-    if (init_value->getType() != var_type) {
-      // Handle integer type conversions
-      if (var_type->isIntegerTy() && init_value->getType()->isIntegerTy()) {
-        unsigned var_bits = var_type->getIntegerBitWidth();
-        unsigned init_bits = init_value->getType()->getIntegerBitWidth();
-
-        if (var_bits < init_bits) {
-          // Truncate to smaller type
-          converted_value = builder_->CreateTrunc(init_value, var_type);
-        } else if (var_bits > init_bits) {
-          // Extend to larger type (sign extend for now)
-          converted_value = builder_->CreateSExt(init_value, var_type);
-        }
-      }
-    }
+    llvm::Value* converted_value = convert_integer(init_value, var_type);
 
     // Store the converted value
     builder_->CreateStore(converted_value, alloca);
 
-    // Add to local variables map for later reference
-    local_variables_[var_decl->name()] = alloca;
-    variable_types_[var_decl->name()] = var_decl->type();  // Track the type
+    // Make the variable visible for the rest of its scope
+    symbols_.declare(var_decl->name(), {alloca, var_decl->type()});
     return;
   }
 
   if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    // Arrays are assigned whole, from a literal or another array
+    const Symbol* array_symbol = symbols_.lookup(var_assign->name());
+    if (array_symbol != nullptr) {
+      if (auto array = ArrayType::parse(array_symbol->type)) {
+        store_array(array_symbol->address, *array, var_assign->value());
+        return;
+      }
+    }
+
     // Generate the new value
     llvm::Value* new_value = generate_expression(var_assign->value());
 
-    // Find the variable (check local variables first, then function parameters)
-    auto local_it = local_variables_.find(var_assign->name());
-    if (local_it != local_variables_.end()) {
-      builder_->CreateStore(new_value, local_it->second);
+    // Find the innermost variable or parameter with this name
+    if (const Symbol* symbol = symbols_.lookup(var_assign->name())) {
+      builder_->CreateStore(
+          convert_integer(new_value, get_llvm_type_from_string(symbol->type)),
+          symbol->address);
       return;
     }
 
-    auto param_it = function_params_.find(var_assign->name());
-    if (param_it != function_params_.end()) {
-      builder_->CreateStore(new_value, param_it->second);
+    throw std::runtime_error("Unknown variable for assignment: " +
+                             var_assign->name());
+  }
+
+  if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    llvm::Value* value = generate_expression(assign->value());
+
+    // A vector lane is replaced in a copy of the whole vector
+    const Symbol* symbol = symbols_.lookup(assign->array_name());
+    if (auto vector = symbol ? VectorType::parse(symbol->type) : std::nullopt) {
+      llvm::Value* lane = checked_index(assign->index(), vector->lanes);
+      llvm::Type* vector_type = get_llvm_type_from_string(symbol->type);
+      llvm::Value* updated = builder_->CreateInsertElement(
+          builder_->CreateLoad(vector_type, symbol->address),
+          convert_integer(value,
+                          get_llvm_type_from_string(vector->element_type)),
+          lane);
+      builder_->CreateStore(updated, symbol->address);
       return;
     }
 
-    throw std::runtime_error("Unknown variable for assignment: " +
-                             var_assign->name());
+    if (auto soa = symbol ? soa_array(symbol->type) : std::nullopt) {
+      store_soa_element(
+          symbol->address, *soa, checked_index(assign->index(), soa->length),
+          value);
+      return;
+    }
+
+    auto [address, type] =
+        element_address(assign->array_name(), assign->index());
+    builder_->CreateStore(
+        convert_integer(value, get_llvm_type_from_string(type)), address);
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    llvm::Value* value = generate_expression(assign->value());
+    Place field = field_place(assign->object(), assign->field_name());
+    llvm::Type* field_type = get_llvm_type_from_string(field.type);
+    value = convert_integer(value, field_type);
+    if (value->getType() != field_type) {
+      throw std::runtime_error("Field '" + assign->field_name() +
+                               "' has type " + field.type);
+    }
+    builder_->CreateAlignedStore(value, field.address, field.align);
+    return;
+  }
+
+  if (const auto* assign = dynamic_cast<const DereferenceAssignment*>(node)) {
+    Place place = pointee_place(assign->pointer_name());
+    if (auto array = ArrayType::parse(place.type)) {
+      store_array(place.address, *array, assign->value());
+      return;
+    }
+    llvm::Type* type = get_llvm_type_from_string(place.type);
+    llvm::Value* value = convert_integer(generate_expression(assign->value()),
+                                         type);
+    if (value->getType() != type) {
+      throw std::runtime_error("'" + assign->pointer_name() + "' points to " +
+                               place.type);
+    }
+    builder_->CreateAlignedStore(value, place.address, place.align);
+    return;
   }
 
   // Handle member access as a statement (e.g., fmt.println calls)
@@ -600,13 +1499,24 @@ void CodeGenerator::generate_statement(const ASTNode* node,
     llvm::BasicBlock* merge_block =
         llvm::BasicBlock::Create(*context_, "ifcont", function);
 
+    // likely and unlikely weigh the branch like __builtin_expect does
+    llvm::MDNode* weights = nullptr;
+    if (if_stmt->hint() != BranchHint::None) {
+      bool likely = if_stmt->hint() == BranchHint::Likely;
+      weights = llvm::MDBuilder(*context_).createBranchWeights(
+          likely ? 2000 : 1, likely ? 1 : 2000);
+    }
+
     // Create conditional branch
-    builder_->CreateCondBr(condition, then_block, else_block);
+    builder_->CreateCondBr(condition, then_block, else_block, weights);
 
     // Generate then block
     builder_->SetInsertPoint(then_block);
-    for (const auto& stmt : if_stmt->then_body()) {
-      generate_statement(stmt.get(), function);
+    {
+      auto scope = symbols_.scope();
+      for (const auto& stmt : if_stmt->then_body()) {
+        generate_statement(stmt.get(), function);
+      }
     }
     // Only add branch if the block doesn't already have a terminator (e.g.,
     // return)
@@ -616,8 +1526,11 @@ void CodeGenerator::generate_statement(const ASTNode* node,
 
     // Generate else block
     builder_->SetInsertPoint(else_block);
-    for (const auto& stmt : if_stmt->else_body()) {
-      generate_statement(stmt.get(), function);
+    {
+      auto scope = symbols_.scope();
+      for (const auto& stmt : if_stmt->else_body()) {
+        generate_statement(stmt.get(), function);
+      }
     }
     // Only add branch if the block doesn't already have a terminator
     if (!builder_->GetInsertBlock()->getTerminator()) {
@@ -629,6 +1542,11 @@ void CodeGenerator::generate_statement(const ASTNode* node,
     return;
   }
 
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    generate_match(match_stmt, function);
+    return;
+  }
+
   // Handle loop statements
   if (const auto* loop_stmt = dynamic_cast<const LoopStatement*>(node)) {
     if (loop_stmt->is_range_loop()) {
@@ -642,17 +1560,118 @@ void CodeGenerator::generate_statement(const ASTNode* node,
   throw std::runtime_error("Unknown statement type");
 }
 
+// One switch over the value, so the backend picks a jump table, a bit test
+// or a binary search rather than testing arms one by one. Ranges too wide to
+// list as cases are tested after the switch misses.
+void CodeGenerator::generate_match(const MatchStatement* match_stmt,
+                                   llvm::Function* function) {
+  llvm::Value* value = generate_expression(match_stmt->value());
+  auto* type = llvm::dyn_cast<llvm::IntegerType>(value->getType());
+  if (type == nullptr) {
+    throw std::runtime_error("match needs an integer or bool value");
+  }
+  // The parser checked patterns against the value's type when it knew it
+  unsigned width = type->getBitWidth();
+  for (const auto& arm : match_stmt->arms()) {
+    for (const auto& [low, high] : arm.ranges) {
+      if (width < 64 && (low < -(int64_t{1} << (width - 1)) ||
+                         high > static_cast<int64_t>((uint64_t{1} << width) - 1))) {
+        throw std::runtime_error("Match pattern " + std::to_string(low) +
+                                 " doesn't fit in a " + std::to_string(width) +
+                                 "-bit value");
+      }
+    }
+  }
+
+  llvm::BasicBlock* default_block =
+      llvm::BasicBlock::Create(*context_, "match.default", function);
+  llvm::BasicBlock* merge_block =
+      llvm::BasicBlock::Create(*context_, "match.end", function);
+  llvm::SwitchInst* switch_inst =
+      builder_->CreateSwitch(value, default_block);
+
+  // Each arm's body, then the ranges still to test in the default block
+  std::vector<llvm::BasicBlock*> arm_blocks;
+  std::vector<std::tuple<int64_t, int64_t, llvm::BasicBlock*>> wide_ranges;
+  for (const auto& arm : match_stmt->arms()) {
+    auto* block = llvm::BasicBlock::Create(*context_, "match.arm", function,
+                                           default_block);
+    arm_blocks.push_back(block);
+    for (const auto& [low, high] : arm.ranges) {
+      if (static_cast<uint64_t>(high) - static_cast<uint64_t>(low) >=
+          kMaxMatchRangeCases) {
+        wide_ranges.emplace_back(low, high, block);
+        continue;
+      }
+      for (int64_t v = low;; ++v) {
+        switch_inst->addCase(llvm::ConstantInt::get(type, v, true), block);
+        if (v == high) break;
+      }
+    }
+  }
+
+  auto generate_body = [&](const std::vector<std::unique_ptr<ASTNode>>& body) {
+    auto scope = symbols_.scope();
+    for (const auto& stmt : body) {
+      generate_statement(stmt.get(), function);
+    }
+    if (!builder_->GetInsertBlock()->getTerminator()) {
+      builder_->CreateBr(merge_block);
+    }
+  };
+
+  for (size_t i = 0; i < arm_blocks.size(); ++i) {
+    builder_->SetInsertPoint(arm_blocks[i]);
+    generate_body(match_stmt->arms()[i].body);
+  }
+
+  // low <= value <= high as one unsigned compare of value - low
+  builder_->SetInsertPoint(default_block);
+  for (const auto& [low, high, block] : wide_ranges) {
+    llvm::Value* offset = builder_->CreateSub(
+        value, llvm::ConstantInt::get(type, low, true), "match.offset");
+    llvm::Value* in_range = builder_->CreateICmpULE(
+        offset,
+        llvm::ConstantInt::get(type, static_cast<uint64_t>(high) -
+                                         static_cast<uint64_t>(low)),
+        "match.inrange");
+    auto* next = llvm::BasicBlock::Create(*context_, "match.next", function,
+                                          merge_block);
+    builder_->CreateCondBr(in_range, block, next);
+    builder_->SetInsertPoint(next);
+  }
+  generate_body(match_stmt->else_body());
+
+  builder_->SetInsertPoint(merge_block);
+}
+
 void CodeGenerator::generate_range_loop(const LoopStatement* loop_stmt,
                                         llvm::Function* function) {
+  if (loop_stmt->is_array_loop()) {
+    if (loop_stmt->is_parallel()) {
+      throw std::runtime_error("'loop par' needs a range, not an array");
+    }
+    generate_array_loop(loop_stmt, function);
+    return;
+  }
+  if (loop_stmt->is_parallel()) {
+    generate_parallel_range_loop(loop_stmt, function);
+    return;
+  }
+
   // Get the range expression
   const auto* range = dynamic_cast<const RangeExpression*>(loop_stmt->range());
   if (!range) {
     throw std::runtime_error("Expected range expression in range loop");
   }
 
-  // Generate start and end values
-  llvm::Value* start_val = generate_expression(range->start());
-  llvm::Value* end_val = generate_expression(range->end());
+  // The counter has the bounds' type, so a 64-bit range neither truncates
+  // nor sign-extends inside the loop
+  std::string counter_type = range->counter_type();
+  llvm::Type* type = get_llvm_type_from_string(counter_type);
+  bool is_unsigned = counter_type.starts_with("u");
+  llvm::Value* start_val = convert_bound(range->start(), type);
+  llvm::Value* end_val = convert_bound(range->end(), type);
 
   // Create basic blocks
   llvm::BasicBlock* loop_cond =
@@ -663,24 +1682,25 @@ void CodeGenerator::generate_range_loop(const LoopStatement* loop_stmt,
       llvm::BasicBlock::Create(*context_, "loop.end", function);
 
   // Create loop variable (allocate space for iterator)
-  llvm::AllocaInst* loop_var = builder_->CreateAlloca(
-      llvm::Type::getInt32Ty(*context_), nullptr, loop_stmt->variable_name());
+  llvm::AllocaInst* loop_var =
+      builder_->CreateAlloca(type, nullptr, loop_stmt->variable_name());
 
   // Initialize loop variable with start value
   builder_->CreateStore(start_val, loop_var);
 
-  // Store the loop variable for use in the loop body
-  local_variables_[loop_stmt->variable_name()] = loop_var;
+  // The loop variable and body locals go out of scope after the loop
+  auto scope = symbols_.scope();
+  symbols_.declare(loop_stmt->variable_name(), {loop_var, counter_type});
 
   // Jump to condition check
   builder_->CreateBr(loop_cond);
 
   // Generate condition block: check if i < end
   builder_->SetInsertPoint(loop_cond);
-  llvm::Value* current_val =
-      builder_->CreateLoad(llvm::Type::getInt32Ty(*context_), loop_var);
+  llvm::Value* current_val = builder_->CreateLoad(type, loop_var);
   llvm::Value* condition =
-      builder_->CreateICmpSLT(current_val, end_val, "loopcond");
+      is_unsigned ? builder_->CreateICmpULT(current_val, end_val, "loopcond")
+                  : builder_->CreateICmpSLT(current_val, end_val, "loopcond");
   builder_->CreateCondBr(condition, loop_body, loop_end);
 
   // Generate loop body
@@ -689,12 +1709,14 @@ void CodeGenerator::generate_range_loop(const LoopStatement* loop_stmt,
     generate_statement(stmt.get(), function);
   }
 
-  // Increment loop variable: i = i + 1
-  llvm::Value* current_val_body =
-      builder_->CreateLoad(llvm::Type::getInt32Ty(*context_), loop_var);
-  llvm::Value* one =
-      llvm::ConstantInt::get(llvm::Type::getInt32Ty(*context_), 1);
-  llvm::Value* incremented = builder_->CreateAdd(current_val_body, one, "inc");
+  // Increment loop variable: i = i + 1. Since i < end, this can't wrap,
+  // unless the body assigned i itself.
+  bool no_wrap =
+      !assigns_variable(loop_stmt->body(), loop_stmt->variable_name());
+  llvm::Value* current_val_body = builder_->CreateLoad(type, loop_var);
+  llvm::Value* incremented = builder_->CreateAdd(
+      current_val_body, llvm::ConstantInt::get(type, 1), "inc",
+      /*HasNUW=*/no_wrap && is_unsigned, /*HasNSW=*/no_wrap && !is_unsigned);
   builder_->CreateStore(incremented, loop_var);
 
   // Jump back to condition
@@ -702,9 +1724,1101 @@ void CodeGenerator::generate_range_loop(const LoopStatement* loop_stmt,
 
   // Continue after loop
   builder_->SetInsertPoint(loop_end);
+}
+
+llvm::Value* CodeGenerator::convert_bound(const ASTNode* bound,
+                                          llvm::Type* type) {
+  llvm::Value* value = generate_expression(bound);
+  if (!value->getType()->isIntegerTy() || value->getType()->isIntegerTy(1)) {
+    throw std::runtime_error("Range bounds must be integers");
+  }
+  // An unsigned bound is zero extended
+  if (bound->inferred_type().starts_with("u") &&
+      value->getType()->getIntegerBitWidth() < type->getIntegerBitWidth()) {
+    return builder_->CreateZExt(value, type);
+  }
+  return convert_integer(value, type);
+}
+
+void CodeGenerator::generate_parallel_range_loop(const LoopStatement* loop_stmt,
+                                                 llvm::Function* function) {
+  const auto* range = dynamic_cast<const RangeExpression*>(loop_stmt->range());
+  if (!range) {
+    throw std::runtime_error("Expected range expression in range loop");
+  }
+
+  // The runtime splits the range as i64s, which the body narrows back to
+  // the counter's type. So u64 ranges must stay below 2^63.
+  llvm::Type* i64 = llvm::Type::getInt64Ty(*context_);
+  llvm::Type* i8_ptr =
+      llvm::PointerType::get(llvm::Type::getInt8Ty(*context_), 0);
+  std::string counter_type = range->counter_type();
+  llvm::Type* type = get_llvm_type_from_string(counter_type);
+  bool is_unsigned = counter_type.starts_with("u");
+  auto widen = [&](llvm::Value* value) {
+    return is_unsigned ? builder_->CreateZExtOrTrunc(value, i64)
+                       : builder_->CreateSExtOrTrunc(value, i64);
+  };
+  llvm::Value* start_val = widen(convert_bound(range->start(), type));
+  llvm::Value* end_val = widen(convert_bound(range->end(), type));
+
+  // The body becomes "void <function>.par_body(i64 begin, i64 end, i8* ctx)",
+  // run over sub-ranges by the runtime. ctx holds the addresses of the
+  // enclosing variables the body uses, so it shares them rather than copies.
+  std::set<std::string> names;
+  for (const auto& stmt : loop_stmt->body()) {
+    collect_variable_names(stmt.get(), names);
+  }
+  names.erase(loop_stmt->variable_name());
+  std::vector<std::pair<std::string, Symbol>> captures;
+  for (const auto& name : names) {
+    if (const Symbol* symbol = symbols_.lookup(name)) {
+      captures.emplace_back(name, *symbol);
+    }
+  }
+
+  auto* captures_type = llvm::ArrayType::get(i8_ptr, captures.size());
+  llvm::Value* context = llvm::ConstantPointerNull::get(
+      llvm::cast<llvm::PointerType>(i8_ptr));
+  if (!captures.empty()) {
+    llvm::AllocaInst* slots =
+        builder_->CreateAlloca(captures_type, nullptr, "par.captures");
+    for (size_t i = 0; i < captures.size(); ++i) {
+      builder_->CreateStore(
+          builder_->CreateBitCast(captures[i].second.address, i8_ptr),
+          builder_->CreateConstInBoundsGEP2_32(captures_type, slots, 0, i));
+    }
+    context = builder_->CreateBitCast(slots, i8_ptr);
+  }
+
+  auto* body_type = llvm::FunctionType::get(llvm::Type::getVoidTy(*context_),
+                                            {i64, i64, i8_ptr}, false);
+  llvm::Function* body =
+      llvm::Function::Create(body_type, llvm::Function::InternalLinkage,
+                             function->getName() + ".par_body", module_.get());
+  body->getArg(0)->setName("begin");
+  body->getArg(1)->setName("end");
+  body->getArg(2)->setName("captures");
+
+  llvm::BasicBlock* current_block = builder_->GetInsertBlock();
+  bool saved_in_parallel_body = in_parallel_body_;
+  in_parallel_body_ = true;
+  auto saved_heap_arrays = std::move(heap_arrays_);
+  heap_arrays_.clear();
+  {
+    auto scope = symbols_.function_scope();
+    builder_->SetInsertPoint(
+        llvm::BasicBlock::Create(*context_, "entry", body));
+    begin_debug_function(body, loop_stmt->location());
+
+    llvm::Value* slots = builder_->CreateBitCast(
+        body->getArg(2), llvm::PointerType::get(captures_type, 0));
+    for (size_t i = 0; i < captures.size(); ++i) {
+      const auto& [name, symbol] = captures[i];
+      llvm::Value* address = builder_->CreateLoad(
+          i8_ptr,
+          builder_->CreateConstInBoundsGEP2_32(captures_type, slots, 0, i));
+      address = builder_->CreateBitCast(
+          address,
+          llvm::PointerType::get(get_llvm_type_from_string(symbol.type), 0),
+          name);
+      symbols_.declare(name, {address, symbol.type, symbol.borrowed});
+    }
+
+    llvm::BasicBlock* loop_cond =
+        llvm::BasicBlock::Create(*context_, "loop.cond", body);
+    llvm::BasicBlock* loop_body =
+        llvm::BasicBlock::Create(*context_, "loop.body", body);
+    llvm::BasicBlock* loop_end =
+        llvm::BasicBlock::Create(*context_, "loop.end", body);
+
+    // Same loop variable as a sequential loop, over [begin, end)
+    llvm::AllocaInst* loop_var =
+        builder_->CreateAlloca(type, nullptr, loop_stmt->variable_name());
+    builder_->CreateStore(builder_->CreateTrunc(body->getArg(0), type),
+                          loop_var);
+    llvm::Value* loop_end_val = builder_->CreateTrunc(body->getArg(1), type);
+    symbols_.declare(loop_stmt->variable_name(), {loop_var, counter_type});
+    builder_->CreateBr(loop_cond);
+
+    builder_->SetInsertPoint(loop_cond);
+    llvm::Value* current = builder_->CreateLoad(type, loop_var);
+    llvm::Value* condition =
+        is_unsigned
+            ? builder_->CreateICmpULT(current, loop_end_val, "loopcond")
+            : builder_->CreateICmpSLT(current, loop_end_val, "loopcond");
+    builder_->CreateCondBr(condition, loop_body, loop_end);
+
+    builder_->SetInsertPoint(loop_body);
+    for (const auto& stmt : loop_stmt->body()) {
+      generate_statement(stmt.get(), body);
+    }
+    bool no_wrap =
+        !assigns_variable(loop_stmt->body(), loop_stmt->variable_name());
+    llvm::Value* incremented = builder_->CreateAdd(
+        builder_->CreateLoad(type, loop_var), llvm::ConstantInt::get(type, 1),
+        "inc", /*HasNUW=*/no_wrap && is_unsigned,
+        /*HasNSW=*/no_wrap && !is_unsigned);
+    builder_->CreateStore(incremented, loop_var);
+    builder_->CreateBr(loop_cond);
+
+    builder_->SetInsertPoint(loop_end);
+    builder_->CreateRetVoid();
+    free_heap_arrays(body);
+    end_debug_function();
+  }
+  in_parallel_body_ = saved_in_parallel_body;
+  heap_arrays_ = std::move(saved_heap_arrays);
+  builder_->SetInsertPoint(current_block);
+
+  register_parallel_runtime();
+  llvm::FunctionCallee runtime = module_->getOrInsertFunction(
+      "void_parallel_for",
+      llvm::FunctionType::get(
+          llvm::Type::getVoidTy(*context_),
+          {i64, i64, llvm::PointerType::get(body_type, 0), i8_ptr}, false));
+  builder_->CreateCall(runtime, {start_val, end_val, body, context});
+}
+
+bool CodeGenerator::uses_parallel_runtime() const {
+  return module_->getFunction("void_parallel_for") != nullptr;
+}
+
+void CodeGenerator::generate_array_loop(const LoopStatement* loop_stmt,
+                                        llvm::Function* function) {
+  const auto* var = dynamic_cast<const VariableReference*>(loop_stmt->range());
+  const Symbol* symbol = var ? symbols_.lookup(var->name()) : nullptr;
+  auto array = symbol ? ArrayType::parse(symbol->type) : std::nullopt;
+  if (!array) {
+    throw std::runtime_error("Can only loop over a range or an array variable");
+  }
+
+  llvm::Type* i64 = llvm::Type::getInt64Ty(*context_);
+  llvm::Type* array_type = get_llvm_type_from_string(symbol->type);
+  llvm::Type* element_type = get_llvm_type_from_string(array->element_type);
+
+  llvm::BasicBlock* loop_cond =
+      llvm::BasicBlock::Create(*context_, "loop.cond", function);
+  llvm::BasicBlock* loop_body =
+      llvm::BasicBlock::Create(*context_, "loop.body", function);
+  llvm::BasicBlock* loop_end =
+      llvm::BasicBlock::Create(*context_, "loop.end", function);
+
+  // The index never leaves the array, so elements are read unchecked
+  llvm::AllocaInst* index = builder_->CreateAlloca(i64, nullptr, "index");
+  builder_->CreateStore(llvm::ConstantInt::get(i64, 0), index);
+  llvm::AllocaInst* element =
+      create_local(array->element_type, loop_stmt->variable_name());
+
+  auto scope = symbols_.scope();
+  symbols_.declare(loop_stmt->variable_name(),
+                   {element, array->element_type});
+  builder_->CreateBr(loop_cond);
+
+  builder_->SetInsertPoint(loop_cond);
+  llvm::Value* current = builder_->CreateLoad(i64, index);
+  builder_->CreateCondBr(
+      builder_->CreateICmpULT(current,
+                              llvm::ConstantInt::get(i64, array->length),
+                              "loopcond"),
+      loop_body, loop_end);
+
+  builder_->SetInsertPoint(loop_body);
+  if (auto soa = soa_array(symbol->type)) {
+    builder_->CreateStore(load_soa_element(symbol->address, *soa, current),
+                          element);
+  } else {
+    llvm::Value* address = builder_->CreateInBoundsGEP(
+        array_type, symbol->address, {llvm::ConstantInt::get(i64, 0), current});
+    builder_->CreateStore(builder_->CreateLoad(element_type, address), element);
+  }
+  for (const auto& stmt : loop_stmt->body()) {
+    generate_statement(stmt.get(), function);
+  }
+
+  llvm::Value* incremented = builder_->CreateAdd(
+      builder_->CreateLoad(i64, index), llvm::ConstantInt::get(i64, 1), "inc");
+  builder_->CreateStore(incremented, index);
+  builder_->CreateBr(loop_cond);
+
+  builder_->SetInsertPoint(loop_end);
+}
 
-  // Remove loop variable from scope
-  local_variables_.erase(loop_stmt->variable_name());
+llvm::Value* CodeGenerator::allocate_array(const ArrayType& array,
+                                           const std::string& name) {
+  if (ArrayType::parse(array.element_type)) {
+    throw std::runtime_error("Arrays of arrays aren't supported yet");
+  }
+
+  // Allocated once in the entry block, however often the declaration runs,
+  // so a declaration inside a loop doesn't grow the stack
+  llvm::Type* type = get_llvm_type_from_string(array.to_string());
+  llvm::Function* function = builder_->GetInsertBlock()->getParent();
+  llvm::BasicBlock& entry = function->getEntryBlock();
+  llvm::IRBuilder<> entry_builder(&entry, entry.begin());
+
+  uint64_t size = module_->getDataLayout().getTypeAllocSize(type);
+  llvm::Align align = type_alignment(array.to_string());
+  if (size <= kStackArrayLimit) {
+    llvm::AllocaInst* alloca = entry_builder.CreateAlloca(type, nullptr, name);
+    alloca->setAlignment(std::max(alloca->getAlign(), align));
+    return alloca;
+  }
+
+  // Too big for the stack, so on the heap until the function returns.
+  // malloc only aligns for the widest scalar, which align(N) can exceed.
+  llvm::Type* i8_ptr =
+      llvm::PointerType::get(llvm::Type::getInt8Ty(*context_), 0);
+  llvm::Type* i64 = llvm::Type::getInt64Ty(*context_);
+  llvm::Value* memory;
+  if (align.value() > kMallocAlignment) {
+    llvm::FunctionCallee aligned_alloc_fn =
+        module_->getOrInsertFunction("aligned_alloc", i8_ptr, i64, i64);
+    memory = entry_builder.CreateCall(
+        aligned_alloc_fn,
+        {entry_builder.getInt64(align.value()), entry_builder.getInt64(size)},
+        name + ".heap");
+  } else {
+    llvm::FunctionCallee malloc_fn =
+        module_->getOrInsertFunction("malloc", i8_ptr, i64);
+    memory = entry_builder.CreateCall(
+        malloc_fn, {entry_builder.getInt64(size)}, name + ".heap");
+  }
+  heap_arrays_.push_back(memory);
+  llvm::Value* address = entry_builder.CreateBitCast(
+      memory, llvm::PointerType::get(type, 0), name);
+  trap_unless(builder_->CreateIsNotNull(memory), name + ".allocated",
+              "out of memory allocating " + std::to_string(size) +
+                  " bytes for '" + name + "'");
+  return address;
+}
+
+void CodeGenerator::free_heap_arrays(llvm::Function* function) {
+  if (heap_arrays_.empty()) return;
+
+  // The allocations are all in the entry block, so every return frees all
+  // of them, including returns generated before the declaration. free(NULL)
+  // does nothing, which covers returns before a failed allocation traps.
+  llvm::Type* i8_ptr =
+      llvm::PointerType::get(llvm::Type::getInt8Ty(*context_), 0);
+  llvm::FunctionCallee free_fn = module_->getOrInsertFunction(
+      "free", llvm::Type::getVoidTy(*context_), i8_ptr);
+  for (llvm::BasicBlock& block : *function) {
+    auto* ret =
+        llvm::dyn_cast_or_null<llvm::ReturnInst>(block.getTerminator());
+    if (ret == nullptr) continue;
+
+    if (const auto* call =
+            llvm::dyn_cast_or_null<llvm::CallInst>(ret->getPrevNode());
+        call != nullptr && call->isMustTailCall()) {
+      std::string caller = function->getName().str();
+      throw std::runtime_error("'return musttail' in '" + caller +
+                               "' can't be guaranteed: '" + caller +
+                               "' frees heap arrays when it returns");
+    }
+    llvm::IRBuilder<> ret_builder(ret);
+    for (llvm::Value* memory : heap_arrays_) {
+      ret_builder.CreateCall(free_fn, {memory});
+    }
+  }
+}
+
+void CodeGenerator::store_array(llvm::Value* address, const ArrayType& array,
+                                const ASTNode* value) {
+  llvm::Type* array_type = get_llvm_type_from_string(array.to_string());
+  llvm::Type* element_type = get_llvm_type_from_string(array.element_type);
+  uint64_t size = module_->getDataLayout().getTypeAllocSize(array_type);
+  llvm::Align align = type_alignment(array.to_string());
+  auto soa = soa_array(array.to_string());
+
+  // Copied from another array of the same type
+  if (const auto* var = dynamic_cast<const VariableReference*>(value)) {
+    const Symbol* source = symbols_.lookup(var->name());
+    if (source == nullptr || source->type != array.to_string()) {
+      throw std::runtime_error("Cannot assign '" + var->name() +
+                               "' to an array of type " + array.to_string());
+    }
+    if (source->address != address) {
+      builder_->CreateMemCpy(address, align, source->address, align, size);
+    }
+    return;
+  }
+
+  const auto* literal = dynamic_cast<const ArrayLiteral*>(value);
+  if (literal == nullptr) {
+    throw std::runtime_error("Expected an array value of type " +
+                             array.to_string());
+  }
+
+  if (literal->elements().empty()) {
+    builder_->CreateMemSet(address, builder_->getInt8(0), size, align);
+    return;
+  }
+  if (literal->elements().size() != array.length) {
+    throw std::runtime_error(
+        "Array literal has " + std::to_string(literal->elements().size()) +
+        " elements, expected " + std::to_string(array.length));
+  }
+
+  std::vector<llvm::Value*> elements;
+  bool constant = true;
+  for (const auto& element : literal->elements()) {
+    elements.push_back(
+        convert_integer(generate_expression(element.get()), element_type));
+    constant = constant && llvm::isa<llvm::Constant>(elements.back());
+  }
+
+  // A constant literal is kept as a global and copied in one go
+  if (constant && !soa) {
+    std::vector<llvm::Constant*> constants;
+    for (llvm::Value* element : elements) {
+      constants.push_back(llvm::cast<llvm::Constant>(element));
+    }
+    auto* initializer = llvm::ConstantArray::get(
+        llvm::cast<llvm::ArrayType>(array_type), constants);
+    auto* global = new llvm::GlobalVariable(
+        *module_, array_type, true, llvm::GlobalValue::PrivateLinkage,
+        initializer, "array.init");
+    global->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+    builder_->CreateMemCpy(address, align, global, align, size);
+    return;
+  }
+
+  llvm::Type* i64 = llvm::Type::getInt64Ty(*context_);
+  for (size_t i = 0; i < elements.size(); ++i) {
+    if (soa) {
+      store_soa_element(address, *soa, llvm::ConstantInt::get(i64, i),
+                        elements[i]);
+      continue;
+    }
+    builder_->CreateStore(
+        elements[i],
+        builder_->CreateInBoundsGEP(array_type, address,
+                                    {llvm::ConstantInt::get(i64, 0),
+                                     llvm::ConstantInt::get(i64, i)}));
+  }
+}
+
+std::pair<llvm::Value*, std::string> CodeGenerator::element_address(
+    const std::string& name, const ASTNode* index_node) {
+  const Symbol* symbol = symbols_.lookup(name);
+  if (symbol == nullptr) {
+    throw std::runtime_error("Unknown variable: " + name);
+  }
+  auto array = ArrayType::parse(symbol->type);
+  if (!array) {
+    throw std::runtime_error("Cannot index '" + name + "': not an array");
+  }
+
+  llvm::Value* index = checked_index(index_node, array->length);
+  llvm::Value* address = builder_->CreateInBoundsGEP(
+      get_llvm_type_from_string(symbol->type), symbol->address,
+      {builder_->getInt64(0), index}, name + ".addr");
+  return {address, array->element_type};
+}
+
+llvm::Value* CodeGenerator::checked_index(const ASTNode* index_node,
+                                          uint64_t limit) {
+  llvm::Value* index = generate_expression(index_node);
+  if (!index->getType()->isIntegerTy() ||
+      index->getType()->isIntegerTy(1)) {
+    throw std::runtime_error("Index must be an integer");
+  }
+
+  // Negative indices wrap to huge unsigned ones, so one unsigned compare
+  // checks both ends. Inside a loop over the array's range the optimizer
+  // can prove it always holds and drops it.
+  llvm::Type* i64 = llvm::Type::getInt64Ty(*context_);
+  index = convert_integer(index, i64);
+  llvm::Value* in_bounds = builder_->CreateICmpULT(
+      index, llvm::ConstantInt::get(i64, limit), "inbounds");
+  trap_unless(in_bounds, "bounds", "index %lld out of bounds for length %llu",
+              {index, llvm::ConstantInt::get(i64, limit)});
+  return index;
+}
+
+void CodeGenerator::trap_unless(llvm::Value* condition,
+                                const std::string& label,
+                                const std::string& message,
+                                const std::vector<llvm::Value*>& args) {
+  llvm::Function* function = builder_->GetInsertBlock()->getParent();
+  llvm::BasicBlock* ok_block =
+      llvm::BasicBlock::Create(*context_, label + ".ok", function);
+  llvm::BasicBlock* fail_block =
+      llvm::BasicBlock::Create(*context_, label + ".fail", function);
+  builder_->CreateCondBr(
+      condition, ok_block, fail_block,
+      llvm::MDBuilder(*context_).createBranchWeights(1 << 20, 1));
+
+  builder_->SetInsertPoint(fail_block);
+  if (!message.empty()) {
+    llvm::FunctionCallee dprintf_fn = module_->getOrInsertFunction(
+        "dprintf",
+        llvm::FunctionType::get(
+            builder_->getInt32Ty(),
+            {builder_->getInt32Ty(),
+             llvm::PointerType::get(builder_->getInt8Ty(), 0)},
+            /*isVarArg=*/true));
+    std::vector<llvm::Value*> dprintf_args = {
+        builder_->getInt32(2),  // stderr
+        builder_->CreateGlobalStringPtr("Error: " + message + "\n",
+                                        label + ".message")};
+    dprintf_args.insert(dprintf_args.end(), args.begin(), args.end());
+    builder_->CreateCall(dprintf_fn, dprintf_args);
+  }
+  builder_->CreateCall(
+      llvm::Intrinsic::getDeclaration(module_.get(), llvm::Intrinsic::trap));
+  builder_->CreateUnreachable();
+
+  builder_->SetInsertPoint(ok_block);
+}
+
+llvm::Value* CodeGenerator::generate_arithmetic(TokenType op,
+                                                llvm::Value* left,
+                                                llvm::Value* right,
+                                                bool is_unsigned,
+                                                const char* name) {
+  // Bools have nothing to overflow into, so they always wrap
+  bool is_bool = left->getType()->isIntegerTy(1);
+  if (overflow_mode_ == OverflowMode::Trap && !is_bool) {
+    llvm::Intrinsic::ID checked;
+    switch (op) {
+      case TokenType::Plus:
+        checked = is_unsigned ? llvm::Intrinsic::uadd_with_overflow
+                              : llvm::Intrinsic::sadd_with_overflow;
+        break;
+      case TokenType::Minus:
+        checked = is_unsigned ? llvm::Intrinsic::usub_with_overflow
+                              : llvm::Intrinsic::ssub_with_overflow;
+        break;
+      default:
+        checked = is_unsigned ? llvm::Intrinsic::umul_with_overflow
+                              : llvm::Intrinsic::smul_with_overflow;
+        break;
+    }
+    llvm::Value* result =
+        builder_->CreateBinaryIntrinsic(checked, left, right, nullptr,
+                                        "checked");
+    llvm::Value* overflowed =
+        builder_->CreateExtractValue(result, 1, "overflowed");
+    trap_unless(builder_->CreateNot(overflowed, "fits"), "overflow",
+                "Integer overflow");
+    return builder_->CreateExtractValue(result, 0, name ? name : "value");
+  }
+
+  bool no_wrap = overflow_mode_ == OverflowMode::Undefined && !is_bool;
+  bool nuw = no_wrap && is_unsigned;
+  bool nsw = no_wrap && !is_unsigned;
+  switch (op) {
+    case TokenType::Plus:
+      return builder_->CreateAdd(left, right, name ? name : "addtmp", nuw,
+                                 nsw);
+    case TokenType::Minus:
+      return builder_->CreateSub(left, right, name ? name : "subtmp", nuw,
+                                 nsw);
+    default:
+      return builder_->CreateMul(left, right, name ? name : "multmp", nuw,
+                                 nsw);
+  }
+}
+
+void CodeGenerator::declare_structs(const Program* program) {
+  // Named and defined in two steps, so fields can use structs declared later
+  for (const auto& declaration : program->structs()) {
+    structs_[declaration->name()] = {
+        .declaration = declaration.get(),
+        .type = llvm::StructType::create(*context_, declaration->name()),
+        .field_indices = {},
+        .alignment = llvm::Align(1)};
+  }
+  std::set<std::string> defining;
+  for (const auto& declaration : program->structs()) {
+    define_struct(structs_.at(declaration->name()), defining);
+  }
+}
+
+void CodeGenerator::define_struct(StructInfo& info,
+                                  std::set<std::string>& defining) {
+  if (!info.type->isOpaque()) return;
+  const StructDeclaration* declaration = info.declaration;
+  if (!defining.insert(declaration->name()).second) {
+    throw std::runtime_error("Struct '" + declaration->name() +
+                             "' contains itself");
+  }
+
+  // Structs held by value are laid out first, since their size and
+  // alignment decide this one's
+  const llvm::DataLayout& data_layout = module_->getDataLayout();
+  std::vector<llvm::Type*> field_types;
+  bool over_aligned = false;
+  for (const auto& field : declaration->fields()) {
+    if (ArrayType::parse(field.type)) {
+      throw std::runtime_error("Arrays inside structs aren't supported yet");
+    }
+    auto it = structs_.find(field.type);
+    if (it != structs_.end()) define_struct(it->second, defining);
+
+    llvm::Type* type = get_llvm_type_from_string(field.type);
+    if (type->isVoidTy()) {
+      throw std::runtime_error("Field '" + field.name + "' can't be void");
+    }
+    field_types.push_back(type);
+    over_aligned = over_aligned || type_alignment(field.type) >
+                                       data_layout.getABITypeAlign(type);
+  }
+
+  const StructLayout& layout = declaration->layout();
+  std::vector<llvm::Type*> body;
+  llvm::Align alignment(std::max<uint64_t>(layout.alignment, 1));
+  bool packed = layout.packed;
+  if (layout.packed || !over_aligned) {
+    body = field_types;
+    for (unsigned i = 0; i < field_types.size(); ++i) {
+      info.field_indices.push_back(i);
+    }
+    if (!layout.packed) {
+      alignment = std::max(
+          alignment,
+          data_layout.getABITypeAlign(llvm::StructType::get(*context_, body)));
+    }
+  } else {
+    // LLVM only knows the natural alignment of nested align(N) structs, so
+    // the fields are placed the way a C compiler would, with explicit padding
+    uint64_t offset = 0;
+    for (size_t i = 0; i < field_types.size(); ++i) {
+      llvm::Align field_alignment =
+          type_alignment(declaration->fields()[i].type);
+      uint64_t padding = llvm::alignTo(offset, field_alignment) - offset;
+      if (padding > 0) {
+        body.push_back(llvm::ArrayType::get(builder_->getInt8Ty(), padding));
+      }
+      info.field_indices.push_back(body.size());
+      body.push_back(field_types[i]);
+      offset += padding + data_layout.getTypeAllocSize(field_types[i]);
+      alignment = std::max(alignment, field_alignment);
+    }
+    packed = true;
+  }
+
+  // Tail padding makes the size a multiple of the alignment, so every
+  // element of an array is aligned too
+  uint64_t size = data_layout.getTypeAllocSize(
+      llvm::StructType::get(*context_, body, packed));
+  if (size % alignment.value() != 0) {
+    body.push_back(llvm::ArrayType::get(
+        builder_->getInt8Ty(), llvm::alignTo(size, alignment) - size));
+  }
+  info.type->setBody(body, packed);
+  info.alignment = alignment;
+  defining.erase(declaration->name());
+}
+
+llvm::Align CodeGenerator::type_alignment(const std::string& type) {
+  if (auto array = ArrayType::parse(type)) {
+    if (!soa_array(type)) return type_alignment(array->element_type);
+  }
+  auto it = structs_.find(type);
+  if (it != structs_.end()) return it->second.alignment;
+  return module_->getDataLayout().getABITypeAlign(
+      get_llvm_type_from_string(type));
+}
+
+llvm::AllocaInst* CodeGenerator::create_local(const std::string& type,
+                                              const std::string& name) {
+  llvm::AllocaInst* alloca = builder_->CreateAlloca(
+      get_llvm_type_from_string(type), nullptr, name);
+  alloca->setAlignment(std::max(alloca->getAlign(), type_alignment(type)));
+  return alloca;
+}
+
+uint64_t CodeGenerator::field_offset(const std::string& struct_name,
+                                     const std::string& field) const {
+  const StructInfo& info = structs_.at(struct_name);
+  auto index = info.declaration->field_index(field);
+  if (!index) {
+    throw std::runtime_error("Struct '" + struct_name + "' has no field '" +
+                             field + "'");
+  }
+  return module_->getDataLayout()
+      .getStructLayout(info.type)
+      ->getElementOffset(info.field_indices[*index]);
+}
+
+uint64_t CodeGenerator::struct_size(const std::string& struct_name) const {
+  return module_->getDataLayout().getTypeAllocSize(
+      structs_.at(struct_name).type);
+}
+
+uint64_t CodeGenerator::struct_alignment(
+    const std::string& struct_name) const {
+  return structs_.at(struct_name).alignment.value();
+}
+
+llvm::Value* CodeGenerator::generate_struct_literal(const StructInfo& info,
+                                                    const FunctionCall* call) {
+  const auto& fields = info.declaration->fields();
+  const auto& args = call->arguments();
+  if (!args.empty() && args.size() != fields.size()) {
+    throw std::runtime_error(
+        "Struct '" + info.declaration->name() + "' has " +
+        std::to_string(fields.size()) + " fields, but " +
+        std::to_string(args.size()) + " values were given");
+  }
+
+  // Built up from a zeroed value, so padding and Point() are zeroes too
+  llvm::Value* value = llvm::Constant::getNullValue(info.type);
+  for (size_t i = 0; i < args.size(); ++i) {
+    llvm::Type* field_type = get_llvm_type_from_string(fields[i].type);
+    llvm::Value* field =
+        convert_integer(generate_expression(args[i].get()), field_type);
+    if (field->getType() != field_type) {
+      throw std::runtime_error("Field '" + fields[i].name + "' of '" +
+                               info.declaration->name() + "' has type " +
+                               fields[i].type);
+    }
+    value = builder_->CreateInsertValue(value, field, info.field_indices[i]);
+  }
+  return value;
+}
+
+CodeGenerator::Place CodeGenerator::struct_place(const ASTNode* node) {
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    const Symbol* symbol = symbols_.lookup(var->name());
+    if (symbol == nullptr) {
+      throw std::runtime_error("Unknown variable: " + var->name());
+    }
+    // Fields are reached through a pointer as if it were the struct itself
+    if (symbol->type.starts_with("*") &&
+        structs_.contains(symbol->type.substr(1))) {
+      std::string type = symbol->type.substr(1);
+      llvm::Value* address = builder_->CreateLoad(
+          get_llvm_type_from_string(symbol->type), symbol->address,
+          var->name());
+      return {address, type, type_alignment(type)};
+    }
+    return {symbol->address, symbol->type, type_alignment(symbol->type)};
+  }
+
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    auto [address, type] = element_address(index->array_name(), index->index());
+    return {address, type, type_alignment(type)};
+  }
+
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    return field_place(access->object(), access->field_name());
+  }
+
+  throw std::runtime_error("Fields can only be accessed on variables, array "
+                           "elements and other fields");
+}
+
+CodeGenerator::Place CodeGenerator::field_place(const ASTNode* object,
+                                                const std::string& field) {
+  auto find_field = [&](const StructInfo& info) {
+    auto index = info.declaration->field_index(field);
+    if (!index) {
+      throw std::runtime_error("Struct '" + info.declaration->name() +
+                               "' has no field '" + field + "'");
+    }
+    return *index;
+  };
+
+  // The field of an element of a soa array is in that field's own array
+  if (const auto* index = dynamic_cast<const IndexExpression*>(object)) {
+    const Symbol* symbol = symbols_.lookup(index->array_name());
+    if (auto soa = symbol ? soa_array(symbol->type) : std::nullopt) {
+      const StructInfo& info = structs_.at(soa->element_type);
+      size_t field_index = find_field(info);
+      llvm::Value* element = checked_index(index->index(), soa->length);
+      llvm::Value* address = builder_->CreateInBoundsGEP(
+          get_llvm_type_from_string(symbol->type), symbol->address,
+          {builder_->getInt64(0),
+           builder_->getInt32(static_cast<uint32_t>(field_index)), element},
+          index->array_name() + "." + field + ".addr");
+      const std::string& type = info.declaration->fields()[field_index].type;
+      return {address, type, type_alignment(type)};
+    }
+  }
+
+  Place place = struct_place(object);
+  auto it = structs_.find(place.type);
+  if (it == structs_.end()) {
+    throw std::runtime_error("Cannot access field '" + field +
+                             "' of a value of type " + place.type);
+  }
+  const StructInfo& info = it->second;
+  size_t field_index = find_field(info);
+  unsigned element = info.field_indices[field_index];
+
+  // A packed struct's fields are only as aligned as their offset allows
+  uint64_t offset = module_->getDataLayout()
+                        .getStructLayout(info.type)
+                        ->getElementOffset(element);
+  llvm::Value* address = builder_->CreateStructGEP(info.type, place.address,
+                                                   element, field + ".addr");
+  return {address, info.declaration->fields()[field_index].type,
+          llvm::commonAlignment(place.align, offset)};
+}
+
+CodeGenerator::Place CodeGenerator::borrow_place(const ASTNode* node) {
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    const Symbol* symbol = symbols_.lookup(var->name());
+    if (symbol == nullptr) {
+      throw std::runtime_error("Unknown variable: " + var->name());
+    }
+    return {symbol->address, symbol->type, type_alignment(symbol->type)};
+  }
+
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    const Symbol* symbol = symbols_.lookup(index->array_name());
+    if (symbol != nullptr &&
+        (VectorType::parse(symbol->type) || soa_array(symbol->type))) {
+      throw std::runtime_error("Elements of '" + index->array_name() +
+                               "' can't be borrowed: vector lanes and soa "
+                               "elements aren't stored as a unit");
+    }
+    auto [address, type] = element_address(index->array_name(), index->index());
+    return {address, type, type_alignment(type)};
+  }
+
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    Place place = field_place(access->object(), access->field_name());
+    if (place.align < type_alignment(place.type)) {
+      throw std::runtime_error("Field '" + access->field_name() +
+                               "' of a packed struct can't be borrowed: it "
+                               "may be misaligned");
+    }
+    return place;
+  }
+
+  throw std::runtime_error("Cannot take address of non-lvalue");
+}
+
+CodeGenerator::Place CodeGenerator::pointee_place(const std::string& name) {
+  const Symbol* symbol = symbols_.lookup(name);
+  if (symbol == nullptr) {
+    throw std::runtime_error("Unknown variable: " + name);
+  }
+  if (symbol->borrowed) {
+    return {symbol->address, symbol->type, type_alignment(symbol->type)};
+  }
+  auto pointee = pointee_type(symbol->type);
+  if (!pointee) {
+    throw std::runtime_error("Cannot dereference non-pointer type");
+  }
+  llvm::Value* address = builder_->CreateLoad(
+      get_llvm_type_from_string(symbol->type), symbol->address, name);
+  return {address, *pointee, type_alignment(*pointee)};
+}
+
+std::optional<ArrayType> CodeGenerator::soa_array(
+    const std::string& type) const {
+  auto array = ArrayType::parse(type);
+  if (!array) return std::nullopt;
+  auto it = structs_.find(array->element_type);
+  if (it == structs_.end() || !it->second.declaration->layout().soa) {
+    return std::nullopt;
+  }
+  return array;
+}
+
+llvm::Value* CodeGenerator::load_soa_element(llvm::Value* address,
+                                             const ArrayType& array,
+                                             llvm::Value* index) {
+  const StructInfo& info = structs_.at(array.element_type);
+  llvm::Type* storage_type = get_llvm_type_from_string(array.to_string());
+  const auto& fields = info.declaration->fields();
+
+  llvm::Value* value = llvm::Constant::getNullValue(info.type);
+  for (size_t i = 0; i < fields.size(); ++i) {
+    llvm::Value* column = builder_->CreateInBoundsGEP(
+        storage_type, address,
+        {builder_->getInt64(0), builder_->getInt32(static_cast<uint32_t>(i)),
+         index});
+    value = builder_->CreateInsertValue(
+        value,
+        builder_->CreateLoad(get_llvm_type_from_string(fields[i].type),
+                             column, fields[i].name),
+        info.field_indices[i]);
+  }
+  return value;
+}
+
+void CodeGenerator::store_soa_element(llvm::Value* address,
+                                      const ArrayType& array,
+                                      llvm::Value* index, llvm::Value* value) {
+  const StructInfo& info = structs_.at(array.element_type);
+  if (value->getType() != info.type) {
+    throw std::runtime_error("Expected a value of type " + array.element_type);
+  }
+  llvm::Type* storage_type = get_llvm_type_from_string(array.to_string());
+  for (size_t i = 0; i < info.declaration->fields().size(); ++i) {
+    llvm::Value* column = builder_->CreateInBoundsGEP(
+        storage_type, address,
+        {builder_->getInt64(0), builder_->getInt32(static_cast<uint32_t>(i)),
+         index});
+    builder_->CreateStore(
+        builder_->CreateExtractValue(value, info.field_indices[i]), column);
+  }
+}
+
+llvm::Value* CodeGenerator::generate_vector_operation(
+    const BinaryOperation* binop, llvm::Value* left, llvm::Value* right) {
+  auto vector = VectorType::parse(left->getType()->isVectorTy()
+                                      ? binop->left()->inferred_type()
+                                      : binop->right()->inferred_type());
+  if (!vector) {
+    throw std::runtime_error("Cannot infer the type of a vector operation");
+  }
+
+  // A scalar operand is used in every lane
+  llvm::Type* type = get_llvm_type_from_string(vector->to_string());
+  left = convert_integer(left, type);
+  right = convert_integer(right, type);
+  if (left->getType() != type || right->getType() != type) {
+    throw std::runtime_error("Vector operands must have the same type, got " +
+                             binop->left()->inferred_type() + " and " +
+                             binop->right()->inferred_type());
+  }
+
+  bool is_unsigned = vector->is_unsigned();
+  TokenType op = binop->operator_type();
+  if (vector->is_mask() != (op == TokenType::And || op == TokenType::Or) &&
+      op != TokenType::EqualEqual && op != TokenType::NotEqual) {
+    throw std::runtime_error(
+        vector->is_mask() ? "Masks only support and, or, == and !="
+                          : "and/or need masks, not " + vector->to_string());
+  }
+  switch (op) {
+    case TokenType::Plus:
+      return builder_->CreateAdd(left, right, "addtmp");
+    case TokenType::Minus:
+      return builder_->CreateSub(left, right, "subtmp");
+    case TokenType::Asterisk:
+      return builder_->CreateMul(left, right, "multmp");
+    case TokenType::Divide:
+      return is_unsigned ? builder_->CreateUDiv(left, right, "divtmp")
+                         : builder_->CreateSDiv(left, right, "divtmp");
+    case TokenType::GreaterThan:
+      return is_unsigned ? builder_->CreateICmpUGT(left, right, "gttmp")
+                         : builder_->CreateICmpSGT(left, right, "gttmp");
+    case TokenType::LessThan:
+      return is_unsigned ? builder_->CreateICmpULT(left, right, "lttmp")
+                         : builder_->CreateICmpSLT(left, right, "lttmp");
+    case TokenType::GreaterEqual:
+      return is_unsigned ? builder_->CreateICmpUGE(left, right, "getmp")
+                         : builder_->CreateICmpSGE(left, right, "getmp");
+    case TokenType::LessEqual:
+      return is_unsigned ? builder_->CreateICmpULE(left, right, "letmp")
+                         : builder_->CreateICmpSLE(left, right, "letmp");
+    case TokenType::EqualEqual:
+      return builder_->CreateICmpEQ(left, right, "eqtmp");
+    case TokenType::NotEqual:
+      return builder_->CreateICmpNE(left, right, "netmp");
+    case TokenType::And:
+      return builder_->CreateAnd(left, right, "andtmp");
+    case TokenType::Or:
+      return builder_->CreateOr(left, right, "ortmp");
+    default:
+      throw std::runtime_error("Unknown binary operator");
+  }
+}
+
+llvm::Value* CodeGenerator::generate_vector_literal(const VectorType& vector,
+                                                    const FunctionCall* call) {
+  llvm::Type* type = get_llvm_type_from_string(vector.to_string());
+  const auto& args = call->arguments();
+  if (args.size() == 1) {
+    llvm::Value* splat =
+        convert_integer(generate_expression(args.front().get()), type);
+    if (splat->getType() != type) {
+      throw std::runtime_error("Cannot splat " +
+                               args.front()->inferred_type() + " into " +
+                               vector.to_string());
+    }
+    return splat;
+  }
+  if (args.size() != vector.lanes) {
+    throw std::runtime_error(vector.to_string() + " takes 1 or " +
+                             std::to_string(vector.lanes) + " values, got " +
+                             std::to_string(args.size()));
+  }
+
+  // Constant lanes fold into a constant vector
+  llvm::Type* element_type = get_llvm_type_from_string(vector.element_type);
+  llvm::Value* result = llvm::PoisonValue::get(type);
+  for (size_t i = 0; i < args.size(); ++i) {
+    llvm::Value* lane =
+        convert_integer(generate_expression(args[i].get()), element_type);
+    if (lane->getType() != element_type) {
+      throw std::runtime_error("Lanes of " + vector.to_string() + " must be " +
+                               vector.element_type);
+    }
+    result = builder_->CreateInsertElement(result, lane, builder_->getInt64(i));
+  }
+  return result;
+}
+
+llvm::Value* CodeGenerator::generate_simd_call(const MemberAccess* member) {
+  const std::string& name = member->member_name();
+  const std::string full_name = member->object_name() + "." + name;
+  const auto& args = member->arguments();
+  auto expect_arguments = [&](size_t count) {
+    if (args.size() != count) {
+      throw std::runtime_error(full_name + " expects " + std::to_string(count) +
+                               " arguments, but " +
+                               std::to_string(args.size()) + " were provided");
+    }
+  };
+  auto vector_argument = [&](size_t i) {
+    auto vector = VectorType::parse(args[i]->inferred_type());
+    if (!vector) {
+      throw std::runtime_error(full_name + " expects a vector argument");
+    }
+    return *vector;
+  };
+
+  // v8i32.load(values, i) reads values[i] to values[i + 7]
+  if (auto vector = VectorType::parse(member->object_name())) {
+    if (name != "load") {
+      throw std::runtime_error("Unknown member access: " + full_name);
+    }
+    expect_arguments(2);
+    auto [address, align] =
+        vector_address(args[0].get(), args[1].get(), *vector);
+    return builder_->CreateAlignedLoad(
+        get_llvm_type_from_string(vector->to_string()), address, align,
+        "vload");
+  }
+
+  if (name == "store") {
+    expect_arguments(3);
+    VectorType vector = vector_argument(2);
+    llvm::Value* value = generate_expression(args[2].get());
+    auto [address, align] =
+        vector_address(args[0].get(), args[1].get(), vector);
+    return builder_->CreateAlignedStore(value, address, align);
+  }
+
+  if (name == "select") {
+    expect_arguments(3);
+    VectorType mask = vector_argument(0);
+    VectorType vector = vector_argument(1);
+    if (!mask.is_mask() || mask.lanes != vector.lanes ||
+        args[2]->inferred_type() != vector.to_string()) {
+      throw std::runtime_error(
+          "simd.select expects a mask and two vectors with as many lanes");
+    }
+    llvm::Value* condition = generate_expression(args[0].get());
+    llvm::Value* if_true = generate_expression(args[1].get());
+    llvm::Value* if_false = generate_expression(args[2].get());
+    return builder_->CreateSelect(condition, if_true, if_false, "select");
+  }
+
+  // simd.shuffle(a, b, lanes...) picks lanes of a (0 to n-1) and of b (n to
+  // 2n-1) by constant index
+  if (name == "shuffle") {
+    if (args.size() < 3) {
+      throw std::runtime_error("simd.shuffle expects two vectors and lanes");
+    }
+    VectorType vector = vector_argument(0);
+    if (args[1]->inferred_type() != vector.to_string()) {
+      throw std::runtime_error(
+          "simd.shuffle expects two vectors of the same type");
+    }
+    std::vector<int> lanes;
+    for (size_t i = 2; i < args.size(); ++i) {
+      const auto* lane = dynamic_cast<const NumberLiteral*>(args[i].get());
+      if (lane == nullptr || lane->value() < 0 ||
+          static_cast<size_t>(lane->value()) >= 2 * vector.lanes) {
+        throw std::runtime_error("simd.shuffle lanes must be constants from 0 "
+                                 "to " +
+                                 std::to_string(2 * vector.lanes - 1));
+      }
+      lanes.push_back(lane->value());
+    }
+    if (!VectorType::parse(member->inferred_type())) {
+      throw std::runtime_error("simd.shuffle can't make a vector of " +
+                               std::to_string(lanes.size()) + " lanes");
+    }
+    llvm::Value* first = generate_expression(args[0].get());
+    llvm::Value* second = generate_expression(args[1].get());
+    return builder_->CreateShuffleVector(first, second, lanes, "shuffle");
+  }
+
+  if (args.empty()) {
+    throw std::runtime_error(full_name + " expects a vector argument");
+  }
+  VectorType vector = vector_argument(0);
+  bool is_unsigned = vector.is_unsigned();
+
+  // Lane by lane minimum and maximum
+  if ((name == "min" || name == "max") && !vector.is_mask()) {
+    expect_arguments(2);
+    if (args[1]->inferred_type() != vector.to_string()) {
+      throw std::runtime_error(full_name +
+                               " expects two vectors of the same type");
+    }
+    llvm::Intrinsic::ID id =
+        name == "min"
+            ? (is_unsigned ? llvm::Intrinsic::umin : llvm::Intrinsic::smin)
+            : (is_unsigned ? llvm::Intrinsic::umax : llvm::Intrinsic::smax);
+    llvm::Value* first = generate_expression(args[0].get());
+    llvm::Value* second = generate_expression(args[1].get());
+    return builder_->CreateBinaryIntrinsic(id, first, second, nullptr, name);
+  }
+
+  // Horizontal reductions to a scalar
+  expect_arguments(1);
+  llvm::Value* value = generate_expression(args[0].get());
+  if (vector.is_mask()) {
+    if (name == "any") return builder_->CreateOrReduce(value);
+    if (name == "all") return builder_->CreateAndReduce(value);
+  } else {
+    if (name == "reduce_add") return builder_->CreateAddReduce(value);
+    if (name == "reduce_mul") return builder_->CreateMulReduce(value);
+    if (name == "reduce_min") {
+      return builder_->CreateIntMinReduce(value, !is_unsigned);
+    }
+    if (name == "reduce_max") {
+      return builder_->CreateIntMaxReduce(value, !is_unsigned);
+    }
+    if (name == "reduce_and") return builder_->CreateAndReduce(value);
+    if (name == "reduce_or") return builder_->CreateOrReduce(value);
+  }
+  throw std::runtime_error("Unknown member access: " + full_name + " on " +
+                           vector.to_string());
+}
+
+std::pair<llvm::Value*, llvm::Align> CodeGenerator::vector_address(
+    const ASTNode* array_node, const ASTNode* index_node,
+    const VectorType& vector) {
+  const auto* var = dynamic_cast<const VariableReference*>(array_node);
+  const Symbol* symbol = var ? symbols_.lookup(var->name()) : nullptr;
+  auto array = symbol ? ArrayType::parse(symbol->type) : std::nullopt;
+  if (vector.is_mask()) {
+    throw std::runtime_error("Masks can't be loaded from or stored to arrays");
+  }
+  if (!array || array->element_type != vector.element_type) {
+    throw std::runtime_error(vector.to_string() +
+                             " is loaded from and stored to arrays of " +
+                             vector.element_type);
+  }
+  if (array->length < vector.lanes) {
+    throw std::runtime_error("Array '" + var->name() + "' is shorter than " +
+                             vector.to_string());
+  }
+
+  // Every lane must be in bounds, so the first can be at most length - lanes.
+  // Arrays are only aligned for their elements.
+  llvm::Value* index =
+      checked_index(index_node, array->length - vector.lanes + 1);
+  llvm::Value* address = builder_->CreateInBoundsGEP(
+      get_llvm_type_from_string(symbol->type), symbol->address,
+      {builder_->getInt64(0), index}, var->name() + ".addr");
+  llvm::Type* type = get_llvm_type_from_string(vector.to_string());
+  return {builder_->CreateBitCast(address, llvm::PointerType::get(type, 0)),
+          module_->getDataLayout().getABITypeAlign(type->getScalarType())};
 }
 
 void CodeGenerator::generate_conditional_loop(const LoopStatement* loop_stmt,
@@ -727,8 +2841,11 @@ void CodeGenerator::generate_conditional_loop(const LoopStatement* loop_stmt,
 
   // Generate loop body
   builder_->SetInsertPoint(loop_body);
-  for (const auto& stmt : loop_stmt->body()) {
-    generate_statement(stmt.get(), function);
+  {
+    auto scope = symbols_.scope();
+    for (const auto& stmt : loop_stmt->body()) {
+      generate_statement(stmt.get(), function);
+    }
   }
 
   // Jump back to condition
@@ -766,11 +2883,31 @@ llvm::Type* CodeGenerator::get_llvm_type_from_string(
     return llvm::Type::getInt1Ty(*context_);
   } else if (type_str == "string" || type_str == "const string") {
     return llvm::PointerType::get(llvm::Type::getInt8Ty(*context_), 0);
+  } else if (auto borrow = BorrowType::parse(type_str)) {
+    return llvm::PointerType::get(get_llvm_type_from_string(borrow->pointee),
+                                  0);
   } else if (type_str.starts_with("*")) {
     // Handle pointer types like *i32, *string
     std::string base_type = type_str.substr(1);  // Remove the '*'
     llvm::Type* base_llvm_type = get_llvm_type_from_string(base_type);
     return llvm::PointerType::get(base_llvm_type, 0);
+  } else if (auto it = structs_.find(type_str); it != structs_.end()) {
+    return it->second.type;
+  } else if (auto soa = soa_array(type_str)) {
+    // One array per field
+    std::vector<llvm::Type*> columns;
+    for (const auto& field :
+         structs_.at(soa->element_type).declaration->fields()) {
+      columns.push_back(llvm::ArrayType::get(
+          get_llvm_type_from_string(field.type), soa->length));
+    }
+    return llvm::StructType::get(*context_, columns);
+  } else if (auto array = ArrayType::parse(type_str)) {
+    return llvm::ArrayType::get(get_llvm_type_from_string(array->element_type),
+                                array->length);
+  } else if (auto vector = VectorType::parse(type_str)) {
+    return llvm::FixedVectorType::get(
+        get_llvm_type_from_string(vector->element_type), vector->lanes);
   } else if (type_str.starts_with("[]")) {
     // Handle slice types like []i32, []string
     std::string element_type = type_str.substr(2);  // Remove the '[]'
@@ -787,7 +2924,7 @@ llvm::Type* CodeGenerator::get_llvm_type_from_string(
         });
   } else if (is_function_pointer_type(type_str)) {
     // Parse function pointer type and create LLVM function pointer type
-    FunctionType func_type = parse_function_type(type_str);
+    FunctionType func_type = FunctionType::parse(type_str);
 
     // Convert parameter types
     std::vector<llvm::Type*> param_types;
@@ -808,53 +2945,10 @@ llvm::Type* CodeGenerator::get_llvm_type_from_string(
   }
 }
 
-FunctionType CodeGenerator::parse_function_type(const std::string& type_str) {
-  // Parse "fn(param1, param2) -> return_type"
-  if (!type_str.starts_with("fn(")) {
-    throw std::runtime_error("Invalid function type format: " + type_str);
-  }
-
-  // Find the parameter list
-  size_t params_start = 3;  // After "fn("
-  size_t params_end = type_str.find(')');
-  if (params_end == std::string::npos) {
-    throw std::runtime_error("Missing ')' in function type: " + type_str);
-  }
-
-  // Extract parameter types
-  std::vector<std::string> param_types;
-  if (params_end > params_start) {
-    std::string params_str =
-        type_str.substr(params_start, params_end - params_start);
-
-    // Simple parsing - split by comma (assumes no nested function types for
-    // now)
-    size_t start = 0;
-    while (start < params_str.length()) {
-      size_t comma_pos = params_str.find(", ", start);
-      if (comma_pos == std::string::npos) {
-        param_types.push_back(params_str.substr(start));
-        break;
-      } else {
-        param_types.push_back(params_str.substr(start, comma_pos - start));
-        start = comma_pos + 2;
-      }
-    }
-  }
-
-  // Find return type
-  size_t arrow_pos = type_str.find(" -> ");
-  if (arrow_pos == std::string::npos) {
-    throw std::runtime_error("Missing ' -> ' in function type: " + type_str);
-  }
-
-  std::string return_type = type_str.substr(arrow_pos + 4);
-
-  return {std::move(param_types), std::move(return_type)};
-}
-
 llvm::Value* CodeGenerator::generate_anonymous_function(
     const AnonymousFunction* anon_func) {
+  reject_array_signature(anon_func);
+
   // Generate a unique name for the anonymous function
   static int anon_counter = 0;
   std::string func_name = "anon_" + std::to_string(anon_counter++);
@@ -862,19 +2956,11 @@ llvm::Value* CodeGenerator::generate_anonymous_function(
   // Create parameter types
   std::vector<llvm::Type*> param_types;
   for (const auto& param : anon_func->parameters()) {
-    (void)param;  // Mark as used to avoid warning
-    // For now, assume all parameters are i32 (can be enhanced later with proper
-    // type system)
-    param_types.push_back(llvm::Type::getInt32Ty(*context_));
+    param_types.push_back(get_llvm_type_from_string(param->type()));
   }
 
   // Create function type
-  llvm::Type* return_type;
-  if (anon_func->return_type() == "void") {
-    return_type = llvm::Type::getVoidTy(*context_);
-  } else {
-    return_type = llvm::Type::getInt32Ty(*context_);
-  }
+  llvm::Type* return_type = get_llvm_type_from_string(anon_func->return_type());
 
   llvm::FunctionType* func_type =
       llvm::FunctionType::get(return_type, param_types, false);
@@ -883,54 +2969,167 @@ llvm::Value* CodeGenerator::generate_anonymous_function(
   llvm::Function* function = llvm::Function::Create(
       func_type, llvm::Function::InternalLinkage, func_name, module_.get());
 
+  anonymous_functions_[anon_func] = function;
+
+  // Small lambdas are mostly call overhead; inline them wherever the call
+  // is direct, including devirtualized calls through function pointers
+  if (count_statements(anon_func->body()) <= kAlwaysInlineStatementLimit) {
+    function->addFnAttr(llvm::Attribute::AlwaysInline);
+  }
+
   // Set parameter names
   size_t idx = 0;
+  std::vector<std::string> param_type_names;
   for (auto& arg : function->args()) {
+    param_type_names.push_back(anon_func->parameters()[idx]->type());
     arg.setName(anon_func->parameters()[idx++]->name());
   }
+  add_borrow_attributes(function, param_type_names);
 
-  // Save current insertion point and local state
+  // Save current insertion point; the enclosing function's variables are
+  // hidden by the new function scope rather than copied aside
   llvm::BasicBlock* current_block = builder_->GetInsertBlock();
-  auto saved_params = function_params_;
-  auto saved_locals = local_variables_;
   auto saved_return_type = current_function_return_type_;
+  bool saved_in_parallel_body = in_parallel_body_;
+  in_parallel_body_ = false;
+  auto saved_heap_arrays = std::move(heap_arrays_);
+  heap_arrays_.clear();
+  auto scope = symbols_.function_scope();
 
   // Create basic block for anonymous function
   llvm::BasicBlock* entry =
       llvm::BasicBlock::Create(*context_, "entry", function);
   builder_->SetInsertPoint(entry);
+  begin_debug_function(function, anon_func->location());
 
-  // Clear and set up parameter allocas for anonymous function
-  function_params_.clear();
-  local_variables_.clear();
+  // Set up parameter allocas for anonymous function
   current_function_return_type_ = anon_func->return_type();
 
-  for (auto& arg : function->args()) {
-    llvm::AllocaInst* alloca = builder_->CreateAlloca(
-        llvm::Type::getInt32Ty(*context_), nullptr, arg.getName());
-    builder_->CreateStore(&arg, alloca);
-    function_params_[std::string(arg.getName())] = alloca;
-  }
+  declare_parameters(function, anon_func->parameters());
 
   // Generate function body
   for (const auto& stmt : anon_func->body()) {
     generate_statement(stmt.get(), function);
   }
 
-  // If this is a void function and there's no terminator, add a void return
-  if (anon_func->return_type() == "void" &&
-      !builder_->GetInsertBlock()->getTerminator()) {
-    builder_->CreateRetVoid();
+  // Terminate the last block: void functions fall through to a return
+  if (!builder_->GetInsertBlock()->getTerminator()) {
+    if (anon_func->return_type() == "void") {
+      builder_->CreateRetVoid();
+    } else {
+      // Every path has returned already, e.g. an if/else returning from both
+      // branches leaves an empty merge block behind
+      builder_->CreateUnreachable();
+    }
   }
 
+  free_heap_arrays(function);
+
   // Restore previous state
+  end_debug_function();
   builder_->SetInsertPoint(current_block);
-  function_params_ = saved_params;
-  local_variables_ = saved_locals;
   current_function_return_type_ = saved_return_type;
+  in_parallel_body_ = saved_in_parallel_body;
+  heap_arrays_ = std::move(saved_heap_arrays);
 
   // Return the function as a value (function pointer)
   return function;
 }
 
+llvm::Value* CodeGenerator::convert_integer(llvm::Value* value,
+                                           llvm::Type* type) {
+  if (auto* vector_type = llvm::dyn_cast<llvm::FixedVectorType>(type)) {
+    if (!value->getType()->isIntegerTy() ||
+        value->getType()->isIntegerTy(1) !=
+            vector_type->getElementType()->isIntegerTy(1)) {
+      return value;
+    }
+    return builder_->CreateVectorSplat(
+        vector_type->getNumElements(),
+        convert_integer(value, vector_type->getElementType()), "splat");
+  }
+  if (!value->getType()->isIntegerTy() || !type->isIntegerTy()) return value;
+
+  unsigned value_bits = value->getType()->getIntegerBitWidth();
+  unsigned type_bits = type->getIntegerBitWidth();
+  if (type_bits < value_bits) {
+    // Truncate to smaller type
+    return builder_->CreateTrunc(value, type);
+  }
+  if (type_bits > value_bits) {
+    // Extend to larger type (sign extend for now)
+    return builder_->CreateSExt(value, type);
+  }
+  return value;
+}
+
+std::vector<llvm::Function*> CodeGenerator::resolve_call_targets(
+    const FunctionCall* call, llvm::FunctionType* function_type) const {
+  auto it = call_targets_.find(call);
+  if (it == call_targets_.end()) return {};
+
+  // Every target must already be emitted with exactly the pointer's
+  // signature, otherwise the call stays indirect
+  std::vector<llvm::Function*> targets;
+  for (const ASTNode* target : it->second) {
+    llvm::Function* function = nullptr;
+    if (const auto* decl = dynamic_cast<const FunctionDeclaration*>(target)) {
+      function = module_->getFunction(decl->name());
+    } else if (const auto* anon_func =
+                   dynamic_cast<const AnonymousFunction*>(target)) {
+      auto anon_it = anonymous_functions_.find(anon_func);
+      if (anon_it != anonymous_functions_.end()) function = anon_it->second;
+    }
+
+    if (function == nullptr || function->getFunctionType() != function_type) {
+      return {};
+    }
+    targets.push_back(function);
+  }
+  return targets;
+}
+
+llvm::Value* CodeGenerator::generate_guarded_call(
+    llvm::FunctionType* function_type, llvm::Value* func_ptr,
+    const std::vector<llvm::Function*>& targets,
+    const std::vector<llvm::Value*>& args) {
+  llvm::Function* function = builder_->GetInsertBlock()->getParent();
+  llvm::BasicBlock* merge_block =
+      llvm::BasicBlock::Create(*context_, "devirt.merge", function);
+
+  // Compare the pointer against each known target and call the match
+  // directly; the indirect call only remains as a fallback
+  std::vector<std::pair<llvm::Value*, llvm::BasicBlock*>> results;
+  for (llvm::Function* target : targets) {
+    llvm::BasicBlock* direct_block =
+        llvm::BasicBlock::Create(*context_, "devirt.direct", function);
+    llvm::BasicBlock* next_block =
+        llvm::BasicBlock::Create(*context_, "devirt.next", function);
+
+    llvm::Value* matches =
+        builder_->CreateICmpEQ(func_ptr, target, "devirt.match");
+    builder_->CreateCondBr(matches, direct_block, next_block);
+
+    builder_->SetInsertPoint(direct_block);
+    results.emplace_back(builder_->CreateCall(target, args), direct_block);
+    builder_->CreateBr(merge_block);
+
+    builder_->SetInsertPoint(next_block);
+  }
+
+  llvm::Value* fallback = builder_->CreateCall(function_type, func_ptr, args);
+  results.emplace_back(fallback, builder_->GetInsertBlock());
+  builder_->CreateBr(merge_block);
+
+  builder_->SetInsertPoint(merge_block);
+  if (function_type->getReturnType()->isVoidTy()) return fallback;
+
+  llvm::PHINode* result = builder_->CreatePHI(
+      function_type->getReturnType(), results.size(), "devirt.result");
+  for (const auto& [value, block] : results) {
+    result->addIncoming(value, block);
+  }
+  return result;
+}
+
 }  // namespace void_compiler
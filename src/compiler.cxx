@@ -1,28 +1,153 @@
 #include "compiler.h"
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
 #include <string>
 
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#pragma clang diagnostic pop
+
+#include "bytecode_compiler.h"
 #include "code_generation.h"
+#include "const_evaluator.h"
+#include "interpreter.h"
 #include "lexer.h"
+#include "object_cache.h"
 #include "parser.h"
 
 namespace void_compiler {
+namespace {
+
+// In Auto mode, programs up to this many bytes of source start in the
+// interpreter: for short scripts LLVM codegen and JIT setup take far longer
+// than the program itself, and the ones that do run long tier up
+constexpr size_t kInterpretSourceLimit = 4096;
+
+// Whether body has a `loop par`, which only native code runs in parallel
+bool has_parallel_loop(const std::vector<std::unique_ptr<ASTNode>>& body) {
+  for (const auto& stmt : body) {
+    if (const auto* loop = dynamic_cast<const LoopStatement*>(stmt.get())) {
+      if (loop->is_parallel() || has_parallel_loop(loop->body())) return true;
+    } else if (const auto* if_stmt =
+                   dynamic_cast<const IfStatement*>(stmt.get())) {
+      if (has_parallel_loop(if_stmt->then_body()) ||
+          has_parallel_loop(if_stmt->else_body())) {
+        return true;
+      }
+    } else if (const auto* match_stmt =
+                   dynamic_cast<const MatchStatement*>(stmt.get())) {
+      if (has_parallel_loop(match_stmt->else_body()) ||
+          std::ranges::any_of(match_stmt->arms(), [](const MatchArm& arm) {
+            return has_parallel_loop(arm.body);
+          })) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// program's bytecode, or nullopt if the interpreter can't run it. Programs
+// it can't, such as ones using arrays, go to the JIT instead, which also
+// reports the same errors for invalid ones.
+std::optional<BytecodeModule> interpretable(const Program* program) {
+  try {
+    return BytecodeCompiler(program).compile();
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+}  // namespace
+
+std::string runtime_library_directory() {
+  // Any function's address identifies the executable on platforms that
+  // can't simply ask for it
+  std::string executable = llvm::sys::fs::getMainExecutable(
+      nullptr, reinterpret_cast<void*>(&runtime_library_directory));
+  llvm::StringRef bin = llvm::sys::path::parent_path(executable);
+  for (const char* relative : {".", VOID_RUNTIME_INSTALL_DIR}) {
+    llvm::SmallString<256> directory(bin);
+    llvm::sys::path::append(directory, relative);
+    llvm::SmallString<256> library(directory);
+    llvm::sys::path::append(library, "libvoid_runtime.a");
+    if (llvm::sys::fs::exists(library)) {
+      llvm::sys::path::remove_dots(directory, /*remove_dot_dot=*/true);
+      return directory.str().str();
+    }
+  }
+  return llvm::sys::path::parent_path(VOID_RUNTIME_LIBRARY).str();
+}
+
 // Compiler class that ties everything together
-int Compiler::compile_and_run(const std::string& source) {
+int Compiler::compile_and_run(const std::string& source, ExecutionMode mode) {
   try {
     auto ast = compile_source(source);
 
+    bool profiling = profile_.generate || !profile_.use.empty();
+    bool debugging = !debug_.source_file.empty() || debug_.frame_pointers ||
+                     jit_events_.perf || jit_events_.gdb;
+    if (mode == ExecutionMode::Auto && (profiling || debugging)) {
+      mode = ExecutionMode::Jit;
+    }
+    // The bytecode Auto mode compiled to find out, which it then runs
+    std::optional<BytecodeModule> bytecode;
+    if (mode == ExecutionMode::Auto) {
+      bool parallel = std::ranges::any_of(
+          ast->functions(),
+          [](const auto& func) { return has_parallel_loop(func->body()); });
+      if (source.size() <= kInterpretSourceLimit && !parallel) {
+        bytecode = interpretable(ast.get());
+      }
+      mode = bytecode ? ExecutionMode::Tiered : ExecutionMode::Jit;
+    }
+    stats_.interpreted = mode != ExecutionMode::Jit;
+    stats_.tiered = mode == ExecutionMode::Tiered;
+    stats_.tier_ups.clear();
+    if (mode != ExecutionMode::Jit) {
+      if (!bytecode) bytecode = BytecodeCompiler(ast.get()).compile();
+      return interpret(ast.get(), *bytecode, stats_.tiered);
+    }
+
     // Generate code
     CodeGenerator codegen;
-    codegen.generate_program(ast.get());
+    codegen.set_profile_generate(profile_.generate);
+    codegen.set_profile_use(profile_.use);
+    set_debug_options(codegen);
+    JitEvents environment = jit_events_from_environment();
+    codegen.set_jit_events({.perf = jit_events_.perf || environment.perf,
+                            .gdb = jit_events_.gdb || environment.gdb});
+    generate_code(ast.get(), codegen);
 
     std::cout << "Generated LLVM IR:" << '\n';
     codegen.print_ir();
     std::cout << '\n';
 
+    // An unchanged program already has its optimized object in the cache,
+    // so both optimization and machine code generation can be skipped. The
+    // cache key doesn't cover profiles, so profiled runs bypass it.
+    std::unique_ptr<DiskObjectCache> cache;
+    stats_.jit_cache_hit = false;
+    if (!cache_directory_.empty() && !profiling) {
+      cache = std::make_unique<DiskObjectCache>(cache_directory_);
+      stats_.jit_cache_hit = cache->preload(
+          codegen.assign_cache_key(llvm::OptimizationLevel::O2));
+    }
+    if (!stats_.jit_cache_hit) {
+      codegen.optimize(llvm::OptimizationLevel::O2);
+    }
+
     // Run with JIT
-    return codegen.run_jit();
+    int result = codegen.run_jit(cache.get());
+    if (profile_.generate && !profile_.output.empty()) {
+      codegen.write_jit_profile(profile_.output);
+    }
+    return result;
 
   } catch (const std::exception& e) {
     std::cerr << "Error: " << e.what() << '\n';
@@ -37,11 +162,16 @@ bool Compiler::compile_to_executable(const SourcePath& source,
 
     // Generate code
     CodeGenerator codegen;
-    codegen.generate_program(ast.get());
+    codegen.set_target_cpu(target_cpu_);
+    codegen.set_profile_generate(profile_.generate);
+    codegen.set_profile_use(profile_.use);
+    set_debug_options(codegen);
+    generate_code(ast.get(), codegen);
 
     std::cout << "Generated LLVM IR:" << '\n';
     codegen.print_ir();
     std::cout << '\n';
+    codegen.optimize();
 
     // Compile to object file
     std::string obj_file = output_name.path + ".o";
@@ -51,6 +181,14 @@ bool Compiler::compile_to_executable(const SourcePath& source,
 
     // Link to executable
     std::string link_cmd = "clang " + obj_file + " -o " + output_name.path;
+    if (codegen.uses_parallel_runtime()) {
+      link_cmd += " -L" + runtime_library_directory() +
+                  " -lvoid_runtime -lstdc++ -lpthread";
+    }
+    if (profile_.generate) {
+      // Links the profile runtime, which writes the counts at exit
+      link_cmd += " -fprofile-instr-generate";
+    }
     std::cout << "Linking: " << link_cmd << '\n';
 
     int result = system(link_cmd.c_str());
@@ -71,6 +209,34 @@ bool Compiler::compile_to_executable(const SourcePath& source,
   }
 }
 
+void Compiler::set_debug_options(CodeGenerator& codegen) const {
+  if (!debug_.source_file.empty()) codegen.set_debug_info(debug_.source_file);
+  codegen.set_frame_pointers(debug_.frame_pointers);
+}
+
+void Compiler::generate_code(const Program* program, CodeGenerator& codegen) {
+  // Fold calls to pure functions first, so functions only used at compile
+  // time are eliminated along with the calls
+  ConstEvaluator evaluator(program);
+  codegen.set_constant_folds(evaluator.fold_calls());
+  stats_.folded_calls = evaluator.report();
+
+  codegen.generate_program(program);
+  stats_.functions_eliminated = codegen.eliminated_function_count();
+}
+
+int Compiler::interpret(const Program* program, const BytecodeModule& module,
+                        bool tiered) {
+  if (!tiered) {
+    return static_cast<int>(Interpreter(module).run());
+  }
+
+  JitTier jit(program, module, tier_up_policy_);
+  int result = static_cast<int>(Interpreter(module, {}, &jit).run());
+  stats_.tier_ups = jit.finish();
+  return result;
+}
+
 std::unique_ptr<Program> Compiler::compile_source(const std::string& source) {
   // Lex
   Lexer lexer(source);
@@ -84,6 +250,8 @@ std::unique_ptr<Program> Compiler::compile_source(const std::string& source) {
 
   // Parse
   Parser parser(std::move(tokens));
-  return parser.parse();
+  auto program = parser.parse();
+  program->set_overflow_mode(overflow_mode_);
+  return program;
 }
 }  // namespace void_compiler
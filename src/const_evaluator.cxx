@@ -0,0 +1,715 @@
+#include "const_evaluator.h"
+
+#include <limits>
+#include <stdexcept>
+
+namespace void_compiler {
+namespace {
+
+// Thrown when an expression turns out not to be computable at compile time.
+// It never escapes the evaluator: the call is simply left for runtime.
+struct NotConstant {};
+
+bool is_integer_type(const std::string& type) {
+  return type == "i8" || type == "i16" || type == "i32" || type == "i64" ||
+         type == "u8" || type == "u16" || type == "u32" || type == "u64" ||
+         type == "bool";
+}
+
+unsigned bit_width(const std::string& type) {
+  if (type == "bool") return 1;
+  if (type == "i8" || type == "u8") return 8;
+  if (type == "i16" || type == "u16") return 16;
+  if (type == "i32" || type == "u32") return 32;
+  return 64;
+}
+
+// Wrap a value to the width of its type, like the truncation the generated
+// code performs
+ConstValue normalize(uint64_t bits, const std::string& type) {
+  unsigned width = bit_width(type);
+  if (width == 1) return {static_cast<int64_t>(bits & 1), type};
+  if (width == 64) return {static_cast<int64_t>(bits), type};
+
+  unsigned shift = 64 - width;
+  return {static_cast<int64_t>(bits << shift) >> shift, type};
+}
+
+// left op right for +, - and *, or false if it overflows 64 bits
+template <typename T>
+bool exact(TokenType op, T left, T right, T& result) {
+  switch (op) {
+    case TokenType::Plus:
+      return !__builtin_add_overflow(left, right, &result);
+    case TokenType::Minus:
+      return !__builtin_sub_overflow(left, right, &result);
+    default:
+      return !__builtin_mul_overflow(left, right, &result);
+  }
+}
+
+// Whether left op right, for +, - and *, doesn't fit type: the overflow
+// checked arithmetic traps on
+bool overflows(TokenType op, const ConstValue& left, const ConstValue& right,
+               const std::string& type, bool is_unsigned) {
+  if (type == "bool") return false;
+  if (is_unsigned) {
+    unsigned width = bit_width(type);
+    uint64_t mask = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    uint64_t result = 0;
+    return !exact(op, static_cast<uint64_t>(left.value) & mask,
+                  static_cast<uint64_t>(right.value) & mask, result) ||
+           result > mask;
+  }
+  int64_t result = 0;
+  return !exact(op, left.value, right.value, result) ||
+         normalize(static_cast<uint64_t>(result), type).value != result;
+}
+
+ConstValue convert(const ConstValue& value, const std::string& type) {
+  return normalize(static_cast<uint64_t>(value.value), type);
+}
+
+// value converted to a type at least as wide, zero extending it if it is
+// unsigned and sign extending it otherwise
+ConstValue widen(const ConstValue& value, const std::string& type) {
+  unsigned width = bit_width(value.type);
+  if (!value.type.starts_with("u") || width == 64 ||
+      width == bit_width(type)) {
+    return convert(value, type);
+  }
+  uint64_t mask = (uint64_t{1} << width) - 1;
+  return normalize(static_cast<uint64_t>(value.value) & mask, type);
+}
+
+const char* operator_symbol(TokenType op) {
+  switch (op) {
+    case TokenType::Plus:
+      return "+";
+    case TokenType::Minus:
+      return "-";
+    case TokenType::Asterisk:
+      return "*";
+    case TokenType::Divide:
+      return "/";
+    case TokenType::GreaterThan:
+      return ">";
+    case TokenType::LessThan:
+      return "<";
+    case TokenType::GreaterEqual:
+      return ">=";
+    case TokenType::LessEqual:
+      return "<=";
+    case TokenType::EqualEqual:
+      return "==";
+    case TokenType::NotEqual:
+      return "!=";
+    case TokenType::And:
+      return "and";
+    case TokenType::Or:
+      return "or";
+    case TokenType::Not:
+      return "not ";
+    default:
+      return "?";
+  }
+}
+
+// Render a constant expression back to void source for the fold report
+std::string render(const ASTNode* node) {
+  if (const auto* num = dynamic_cast<const NumberLiteral*>(node)) {
+    return std::to_string(num->value());
+  }
+  if (const auto* boolean = dynamic_cast<const BooleanLiteral*>(node)) {
+    return boolean->value() ? "true" : "false";
+  }
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    return operator_symbol(unary->operator_type()) + render(unary->operand());
+  }
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    return "(" + render(binop->left()) + " " +
+           operator_symbol(binop->operator_type()) + " " +
+           render(binop->right()) + ")";
+  }
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    std::string result = call->function_name() + "(";
+    for (size_t i = 0; i < call->arguments().size(); ++i) {
+      if (i > 0) result += ", ";
+      result += render(call->arguments()[i].get());
+    }
+    return result + ")";
+  }
+  return "?";
+}
+
+// Every name a function body can bind: parameters, variables and loop
+// counters. Scoping in void is per function, so a flat set is enough.
+void collect_locals(const ASTNode* node,
+                    std::unordered_set<std::string>& locals) {
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    locals.insert(var_decl->name());
+  } else if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    for (const auto& stmt : if_stmt->then_body()) {
+      collect_locals(stmt.get(), locals);
+    }
+    for (const auto& stmt : if_stmt->else_body()) {
+      collect_locals(stmt.get(), locals);
+    }
+  } else if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& stmt : arm.body) {
+        collect_locals(stmt.get(), locals);
+      }
+    }
+    for (const auto& stmt : match_stmt->else_body()) {
+      collect_locals(stmt.get(), locals);
+    }
+  } else if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    if (loop->is_range_loop()) locals.insert(loop->variable_name());
+    for (const auto& stmt : loop->body()) {
+      collect_locals(stmt.get(), locals);
+    }
+  }
+}
+
+template <typename Function>
+std::unordered_set<std::string> locals_of(const Function* func) {
+  std::unordered_set<std::string> locals;
+  for (const auto& param : func->parameters()) {
+    locals.insert(param->name());
+  }
+  for (const auto& stmt : func->body()) {
+    collect_locals(stmt.get(), locals);
+  }
+  return locals;
+}
+
+}  // namespace
+
+ConstEvaluator::ConstEvaluator(const Program* program, EvaluationLimits limits)
+    : program_(program), limits_(limits) {
+  for (const auto& func : program->functions()) {
+    functions_[func->name()] = func.get();
+  }
+  find_pure_functions();
+}
+
+// Start by assuming every function with an integer signature is pure, then
+// drop functions that do something impure (or call something impure) until
+// nothing changes. Recursive functions stay pure unless the cycle touches an
+// impure function.
+void ConstEvaluator::find_pure_functions() {
+  for (const auto& [name, func] : functions_) {
+    bool integer_signature = is_integer_type(func->return_type());
+    for (const auto& param : func->parameters()) {
+      integer_signature = integer_signature && is_integer_type(param->type());
+    }
+    if (integer_signature) pure_functions_.insert(name);
+  }
+
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (auto it = pure_functions_.begin(); it != pure_functions_.end();) {
+      const FunctionDeclaration* func = functions_.at(*it);
+      auto locals = locals_of(func);
+
+      bool pure = true;
+      for (const auto& stmt : func->body()) {
+        pure = pure && is_pure_node(stmt.get(), locals);
+      }
+
+      if (pure) {
+        ++it;
+      } else {
+        it = pure_functions_.erase(it);
+        changed = true;
+      }
+    }
+  }
+}
+
+bool ConstEvaluator::is_pure_node(
+    const ASTNode* node, const std::unordered_set<std::string>& locals) const {
+  if (node == nullptr) return true;
+
+  if (dynamic_cast<const NumberLiteral*>(node) ||
+      dynamic_cast<const BooleanLiteral*>(node)) {
+    return true;
+  }
+
+  // A function name used as a value is a function pointer
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    return locals.contains(var->name());
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    return is_pure_node(binop->left(), locals) &&
+           is_pure_node(binop->right(), locals);
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    return (unary->operator_type() == TokenType::Minus ||
+            unary->operator_type() == TokenType::Not) &&
+           is_pure_node(unary->operand(), locals);
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (locals.contains(call->function_name()) ||
+        !pure_functions_.contains(call->function_name())) {
+      return false;
+    }
+    for (const auto& arg : call->arguments()) {
+      if (!is_pure_node(arg.get(), locals)) return false;
+    }
+    return true;
+  }
+
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    return is_integer_type(var_decl->type()) &&
+           is_pure_node(var_decl->value(), locals);
+  }
+
+  if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    return locals.contains(var_assign->name()) &&
+           is_pure_node(var_assign->value(), locals);
+  }
+
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    return is_pure_node(ret->expression(), locals);
+  }
+
+  if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    bool pure = is_pure_node(if_stmt->condition(), locals);
+    for (const auto& stmt : if_stmt->then_body()) {
+      pure = pure && is_pure_node(stmt.get(), locals);
+    }
+    for (const auto& stmt : if_stmt->else_body()) {
+      pure = pure && is_pure_node(stmt.get(), locals);
+    }
+    return pure;
+  }
+
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    bool pure = is_pure_node(match_stmt->value(), locals);
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& stmt : arm.body) {
+        pure = pure && is_pure_node(stmt.get(), locals);
+      }
+    }
+    for (const auto& stmt : match_stmt->else_body()) {
+      pure = pure && is_pure_node(stmt.get(), locals);
+    }
+    return pure;
+  }
+
+  if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    bool pure = is_pure_node(loop->range(), locals) &&
+                is_pure_node(loop->condition(), locals);
+    for (const auto& stmt : loop->body()) {
+      pure = pure && is_pure_node(stmt.get(), locals);
+    }
+    return pure;
+  }
+
+  if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    return is_pure_node(range->start(), locals) &&
+           is_pure_node(range->end(), locals);
+  }
+
+  // Strings, fmt, anonymous functions and anything new are impure
+  return false;
+}
+
+ConstantFolds ConstEvaluator::fold_calls() {
+  ConstantFolds folds;
+  for (const auto& [name, func] : functions_) {
+    auto locals = locals_of(func);
+    caller_overflow_ = program_->overflow_mode(*func);
+    for (const auto& stmt : func->body()) {
+      fold_in(stmt.get(), locals, folds);
+    }
+  }
+  return folds;
+}
+
+void ConstEvaluator::fold_in(const ASTNode* node,
+                             const std::unordered_set<std::string>& locals,
+                             ConstantFolds& folds) {
+  if (node == nullptr) return;
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (!locals.contains(call->function_name()) &&
+        is_constant_expression(call)) {
+      try {
+        steps_ = 0;
+        depth_ = 0;
+        Frame frame{.variables = {},
+                    .function = nullptr,
+                    .overflow = caller_overflow_};
+        ConstValue value = evaluate(call, frame);
+        report_.push_back(render(call) + " = " + std::to_string(value.value));
+        folds.emplace(call, std::move(value));
+        return;
+      } catch (const NotConstant&) {
+        // Leave the call for runtime, but its arguments may still fold
+      }
+    }
+    for (const auto& arg : call->arguments()) {
+      fold_in(arg.get(), locals, folds);
+    }
+    return;
+  }
+
+  if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
+    auto anon_locals = locals_of(anon_func);
+    for (const auto& stmt : anon_func->body()) {
+      fold_in(stmt.get(), anon_locals, folds);
+    }
+    return;
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    fold_in(binop->left(), locals, folds);
+    fold_in(binop->right(), locals, folds);
+  } else if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    fold_in(unary->operand(), locals, folds);
+  } else if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    for (const auto& arg : member->arguments()) {
+      fold_in(arg.get(), locals, folds);
+    }
+  } else if (const auto* var_decl =
+                 dynamic_cast<const VariableDeclaration*>(node)) {
+    fold_in(var_decl->value(), locals, folds);
+  } else if (const auto* var_assign =
+                 dynamic_cast<const VariableAssignment*>(node)) {
+    fold_in(var_assign->value(), locals, folds);
+  } else if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    fold_in(ret->expression(), locals, folds);
+  } else if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    fold_in(if_stmt->condition(), locals, folds);
+    for (const auto& stmt : if_stmt->then_body()) {
+      fold_in(stmt.get(), locals, folds);
+    }
+    for (const auto& stmt : if_stmt->else_body()) {
+      fold_in(stmt.get(), locals, folds);
+    }
+  } else if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    fold_in(match_stmt->value(), locals, folds);
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& stmt : arm.body) {
+        fold_in(stmt.get(), locals, folds);
+      }
+    }
+    for (const auto& stmt : match_stmt->else_body()) {
+      fold_in(stmt.get(), locals, folds);
+    }
+  } else if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    fold_in(loop->range(), locals, folds);
+    fold_in(loop->condition(), locals, folds);
+    for (const auto& stmt : loop->body()) {
+      fold_in(stmt.get(), locals, folds);
+    }
+  } else if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    fold_in(range->start(), locals, folds);
+    fold_in(range->end(), locals, folds);
+  } else if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    for (const auto& element : literal->elements()) {
+      fold_in(element.get(), locals, folds);
+    }
+  } else if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    fold_in(index->index(), locals, folds);
+  } else if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    fold_in(assign->index(), locals, folds);
+    fold_in(assign->value(), locals, folds);
+  } else if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    fold_in(access->object(), locals, folds);
+  } else if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    fold_in(assign->object(), locals, folds);
+    fold_in(assign->value(), locals, folds);
+  } else if (const auto* assign =
+                 dynamic_cast<const DereferenceAssignment*>(node)) {
+    fold_in(assign->value(), locals, folds);
+  }
+}
+
+bool ConstEvaluator::is_constant_expression(const ASTNode* node) const {
+  if (dynamic_cast<const NumberLiteral*>(node) ||
+      dynamic_cast<const BooleanLiteral*>(node)) {
+    return true;
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    return (unary->operator_type() == TokenType::Minus ||
+            unary->operator_type() == TokenType::Not) &&
+           is_constant_expression(unary->operand());
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    return is_constant_expression(binop->left()) &&
+           is_constant_expression(binop->right());
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (!pure_functions_.contains(call->function_name())) return false;
+    for (const auto& arg : call->arguments()) {
+      if (!is_constant_expression(arg.get())) return false;
+    }
+    return true;
+  }
+
+  return false;
+}
+
+void ConstEvaluator::step() {
+  if (++steps_ > limits_.max_steps) throw NotConstant{};
+}
+
+ConstValue ConstEvaluator::call(const FunctionDeclaration* func,
+                                const std::vector<ConstValue>& args) {
+  if (args.size() != func->parameters().size()) throw NotConstant{};
+  if (depth_ >= limits_.max_recursion_depth) throw NotConstant{};
+
+  Frame frame{.variables = {},
+              .function = func,
+              .overflow = program_->overflow_mode(*func)};
+  for (size_t i = 0; i < args.size(); ++i) {
+    const auto& param = func->parameters()[i];
+    frame.variables[param->name()] = convert(args[i], param->type());
+  }
+
+  depth_++;
+  ConstValue result{.value = 0, .type = func->return_type()};
+  bool returned = execute_block(func->body(), frame, result);
+  depth_--;
+
+  // Falling off the end of a non-void function has no defined value
+  if (!returned) throw NotConstant{};
+  return result;
+}
+
+ConstValue ConstEvaluator::evaluate(const ASTNode* node, Frame& frame) {
+  step();
+
+  if (const auto* num = dynamic_cast<const NumberLiteral*>(node)) {
+    return normalize(static_cast<uint64_t>(num->value()), "i32");
+  }
+
+  if (const auto* boolean = dynamic_cast<const BooleanLiteral*>(node)) {
+    return {boolean->value() ? 1 : 0, "bool"};
+  }
+
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    auto it = frame.variables.find(var->name());
+    if (it == frame.variables.end()) throw NotConstant{};
+    return it->second;
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    ConstValue operand = evaluate(unary->operand(), frame);
+    auto bits = static_cast<uint64_t>(operand.value);
+
+    if (unary->operator_type() == TokenType::Not) {
+      return normalize(~bits, operand.type);
+    }
+    if (unary->operator_type() == TokenType::Minus) {
+      // Negation promotes narrow integers to i32, as in code generation
+      std::string type = bit_width(operand.type) < 32 ? "i32" : operand.type;
+      if (frame.overflow == OverflowMode::Trap &&
+          overflows(TokenType::Minus, {0, type}, operand, type,
+                    /*is_unsigned=*/false)) {
+        throw NotConstant{};
+      }
+      return normalize(0 - bits, type);
+    }
+    throw NotConstant{};
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    ConstValue left = evaluate(binop->left(), frame);
+    ConstValue right = evaluate(binop->right(), frame);
+    bool is_unsigned =
+        left.type.starts_with("u") || right.type.starts_with("u");
+
+    // Mixed width operands are extended to the wider type, as in code
+    // generation, so e.g. 1 + x for an i64 x is computed in 64 bits
+    if (left.type != "bool" && right.type != "bool") {
+      if (bit_width(left.type) < bit_width(right.type)) {
+        left = widen(left, right.type);
+      } else {
+        right = widen(right, left.type);
+      }
+    }
+    auto lhs = static_cast<uint64_t>(left.value);
+    auto rhs = static_cast<uint64_t>(right.value);
+
+    // Overflow that would trap at runtime is left to do so
+    TokenType op = binop->operator_type();
+    if (frame.overflow == OverflowMode::Trap &&
+        (op == TokenType::Plus || op == TokenType::Minus ||
+         op == TokenType::Asterisk) &&
+        overflows(op, left, right, left.type, is_unsigned)) {
+      throw NotConstant{};
+    }
+
+    switch (op) {
+      case TokenType::Plus:
+        return normalize(lhs + rhs, left.type);
+      case TokenType::Minus:
+        return normalize(lhs - rhs, left.type);
+      case TokenType::Asterisk:
+        return normalize(lhs * rhs, left.type);
+      case TokenType::Divide: {
+        // Division by zero and INT_MIN / -1 trap at runtime, so keep them
+        int64_t min = bit_width(left.type) == 64
+                          ? std::numeric_limits<int64_t>::min()
+                          : -(int64_t{1} << (bit_width(left.type) - 1));
+        if (right.value == 0 || (left.value == min && right.value == -1)) {
+          throw NotConstant{};
+        }
+        return normalize(static_cast<uint64_t>(left.value / right.value),
+                         left.type);
+      }
+      case TokenType::GreaterThan:
+        return {left.value > right.value ? 1 : 0, "bool"};
+      case TokenType::LessThan:
+        return {left.value < right.value ? 1 : 0, "bool"};
+      case TokenType::GreaterEqual:
+        return {left.value >= right.value ? 1 : 0, "bool"};
+      case TokenType::LessEqual:
+        return {left.value <= right.value ? 1 : 0, "bool"};
+      case TokenType::EqualEqual:
+        return {left.value == right.value ? 1 : 0, "bool"};
+      case TokenType::NotEqual:
+        return {left.value != right.value ? 1 : 0, "bool"};
+      case TokenType::And:
+        return normalize(lhs & rhs, left.type);
+      case TokenType::Or:
+        return normalize(lhs | rhs, left.type);
+      default:
+        throw NotConstant{};
+    }
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    if (!pure_functions_.contains(call->function_name())) throw NotConstant{};
+
+    std::vector<ConstValue> args;
+    for (const auto& arg : call->arguments()) {
+      args.push_back(evaluate(arg.get(), frame));
+    }
+    return this->call(functions_.at(call->function_name()), args);
+  }
+
+  throw NotConstant{};
+}
+
+bool ConstEvaluator::execute_block(
+    const std::vector<std::unique_ptr<ASTNode>>& body, Frame& frame,
+    ConstValue& result) {
+  for (const auto& stmt : body) {
+    if (execute(stmt.get(), frame, result)) return true;
+  }
+  return false;
+}
+
+bool ConstEvaluator::execute(const ASTNode* node, Frame& frame,
+                             ConstValue& result) {
+  step();
+
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    if (ret->expression() == nullptr) throw NotConstant{};
+    result = convert(evaluate(ret->expression(), frame),
+                     frame.function->return_type());
+    return true;
+  }
+
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    frame.variables[var_decl->name()] =
+        convert(evaluate(var_decl->value(), frame), var_decl->type());
+    return false;
+  }
+
+  if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    auto it = frame.variables.find(var_assign->name());
+    if (it == frame.variables.end()) throw NotConstant{};
+    it->second = convert(evaluate(var_assign->value(), frame), it->second.type);
+    return false;
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    evaluate(call, frame);
+    return false;
+  }
+
+  if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    if (evaluate(if_stmt->condition(), frame).value != 0) {
+      return execute_block(if_stmt->then_body(), frame, result);
+    }
+    return execute_block(if_stmt->else_body(), frame, result);
+  }
+
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    // Patterns are the type's values, so compare unsigned values zero
+    // extended rather than in their normalized form
+    ConstValue value = evaluate(match_stmt->value(), frame);
+    unsigned width = bit_width(value.type);
+    auto bits = static_cast<uint64_t>(value.value);
+    if (value.type.starts_with("u") && width < 64) {
+      bits &= (uint64_t{1} << width) - 1;
+    }
+    bool is_signed = value.type.starts_with("i");
+    for (const auto& arm : match_stmt->arms()) {
+      for (const auto& [low, high] : arm.ranges) {
+        bool covered =
+            is_signed ? low <= value.value && value.value <= high
+                      : static_cast<uint64_t>(low) <= bits &&
+                            bits <= static_cast<uint64_t>(high);
+        if (covered) return execute_block(arm.body, frame, result);
+      }
+    }
+    return execute_block(match_stmt->else_body(), frame, result);
+  }
+
+  if (const auto* loop = dynamic_cast<const LoopStatement*>(node)) {
+    if (!loop->is_range_loop()) {
+      while (evaluate(loop->condition(), frame).value != 0) {
+        if (execute_block(loop->body(), frame, result)) return true;
+      }
+      return false;
+    }
+
+    const auto* range = dynamic_cast<const RangeExpression*>(loop->range());
+    if (range == nullptr) throw NotConstant{};
+
+    // The counter is re-read every iteration, so the body may change it.
+    // Normalized values of one type order like their unsigned bit patterns.
+    std::string type = range->counter_type();
+    bool is_unsigned = type.starts_with("u");
+    ConstValue start = convert(evaluate(range->start(), frame), type);
+    ConstValue end = convert(evaluate(range->end(), frame), type);
+    auto less = [&](const ConstValue& a, const ConstValue& b) {
+      return is_unsigned ? static_cast<uint64_t>(a.value) <
+                               static_cast<uint64_t>(b.value)
+                         : a.value < b.value;
+    };
+    const std::string& name = loop->variable_name();
+    auto counter = [&]() -> ConstValue& {
+      auto it = frame.variables.find(name);
+      if (it == frame.variables.end()) throw NotConstant{};
+      return it->second;
+    };
+
+    frame.variables[name] = start;
+    while (less(counter(), end)) {
+      if (execute_block(loop->body(), frame, result)) return true;
+      counter() = normalize(static_cast<uint64_t>(counter().value) + 1, type);
+    }
+    frame.variables.erase(name);
+    return false;
+  }
+
+  throw NotConstant{};
+}
+
+}  // namespace void_compiler
@@ -0,0 +1,74 @@
+#include "engine.h"
+
+#include <stdexcept>
+#include <unordered_map>
+
+#include "code_generation.h"
+#include "const_evaluator.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+
+struct Module::State {
+  struct Export {
+    std::string type;
+    uintptr_t address;
+  };
+
+  std::unique_ptr<CodeGenerator> codegen;  // owns the JIT compiled code
+  std::unordered_map<std::string, Export> functions;
+};
+
+Module Engine::load(const std::string& source) {
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  Token token;
+  do {
+    token = lexer.next_token();
+    tokens.push_back(token);
+  } while (token.type != TokenType::EndOfFile);
+  auto program = Parser(std::move(tokens), FunctionSelection::All).parse();
+
+  auto state = std::make_shared<Module::State>();
+  state->codegen = std::make_unique<CodeGenerator>();
+  CodeGenerator& codegen = *state->codegen;
+  codegen.set_constant_folds(ConstEvaluator(program.get()).fold_calls());
+  codegen.generate_library(program.get());
+  codegen.optimize();
+
+  // Resolve every address now, so lookups never touch the JIT and a module
+  // can be shared between threads
+  for (const auto& func : program->functions()) {
+    std::vector<std::string> param_types;
+    for (const auto& param : func->parameters()) {
+      param_types.push_back(param->type());
+    }
+    state->functions[func->name()] = {
+        .type = FunctionType(std::move(param_types), func->return_type())
+                    .to_string(),
+        .address = static_cast<uintptr_t>(
+            codegen.jit_function_address(func->name()))};
+  }
+
+  return Module(std::move(state));
+}
+
+bool Module::contains(const std::string& name) const {
+  return state_->functions.contains(name);
+}
+
+uintptr_t Module::address(const std::string& name,
+                          const std::string& type) const {
+  auto it = state_->functions.find(name);
+  if (it == state_->functions.end()) {
+    throw std::runtime_error("Function '" + name + "' not found");
+  }
+  if (it->second.type != type) {
+    throw std::runtime_error("Function '" + name + "' has type " +
+                             it->second.type + ", not " + type);
+  }
+  return it->second.address;
+}
+
+}  // namespace void_compiler
@@ -0,0 +1,290 @@
+#include "function_pointer_analysis.h"
+
+#include <algorithm>
+
+namespace void_compiler {
+
+FunctionPointerAnalysis::FunctionPointerAnalysis(const Program* program) {
+  for (const auto& func : program->functions()) {
+    functions_[func->name()] = func.get();
+  }
+
+  for (const auto& func : program->functions()) {
+    analyze_function(func->parameters(), func->body());
+  }
+}
+
+void FunctionPointerAnalysis::analyze_function(
+    const std::vector<std::unique_ptr<Parameter>>& params,
+    const std::vector<std::unique_ptr<ASTNode>>& body) {
+  // Functions don't see the locals of their enclosing function, so every
+  // body starts from scratch with its parameters unknown
+  State state;
+  for (const auto& param : params) {
+    state[param->name()] = unknown_targets();
+  }
+  std::unordered_set<std::string> enclosing_borrowed;
+  std::swap(borrowed_, enclosing_borrowed);
+  analyze_block(body, state);
+  borrowed_ = std::move(enclosing_borrowed);
+}
+
+void FunctionPointerAnalysis::analyze_block(
+    const std::vector<std::unique_ptr<ASTNode>>& body, State& state) {
+  Shadowed shadowed;
+  for (const auto& stmt : body) {
+    analyze_statement(stmt.get(), state, shadowed);
+  }
+
+  restore(shadowed, state);
+}
+
+void FunctionPointerAnalysis::analyze_statement(const ASTNode* node,
+                                                State& state,
+                                                Shadowed& shadowed) {
+  if (const auto* var_decl = dynamic_cast<const VariableDeclaration*>(node)) {
+    declare(var_decl->name(), evaluate(var_decl->value(), state), state,
+            shadowed);
+    return;
+  }
+
+  if (const auto* var_assign = dynamic_cast<const VariableAssignment*>(node)) {
+    PointerTargets value = evaluate(var_assign->value(), state);
+    auto it = state.find(var_assign->name());
+    if (it != state.end()) it->second = std::move(value);
+    return;
+  }
+
+  if (const auto* ret = dynamic_cast<const ReturnStatement*>(node)) {
+    evaluate(ret->expression(), state);
+    return;
+  }
+
+  if (const auto* if_stmt = dynamic_cast<const IfStatement*>(node)) {
+    evaluate(if_stmt->condition(), state);
+    State then_state = state;
+    analyze_block(if_stmt->then_body(), then_state);
+    analyze_block(if_stmt->else_body(), state);
+    state = join(then_state, state);
+    return;
+  }
+
+  if (const auto* match_stmt = dynamic_cast<const MatchStatement*>(node)) {
+    evaluate(match_stmt->value(), state);
+    State entry = state;
+    analyze_block(match_stmt->else_body(), state);
+    for (const auto& arm : match_stmt->arms()) {
+      State arm_state = entry;
+      analyze_block(arm.body, arm_state);
+      state = join(arm_state, state);
+    }
+    return;
+  }
+
+  if (const auto* loop_stmt = dynamic_cast<const LoopStatement*>(node)) {
+    analyze_loop(loop_stmt, state);
+    return;
+  }
+
+  evaluate(node, state);
+}
+
+void FunctionPointerAnalysis::analyze_loop(const LoopStatement* loop_stmt,
+                                           State& state) {
+  if (const auto* range =
+          dynamic_cast<const RangeExpression*>(loop_stmt->range())) {
+    evaluate(range->start(), state);
+    evaluate(range->end(), state);
+  }
+
+  // The body may run any number of times, so iterate until the state at the
+  // top of the loop stops growing. Sets only grow and are capped at
+  // kMaxTargets before turning unknown, so this terminates quickly. Call
+  // sites are re-recorded on every pass and end up reflecting the fixpoint,
+  // which includes the locals the body borrows.
+  State entry = state;
+  while (true) {
+    size_t borrowed = borrowed_.size();
+    State iteration = entry;
+    evaluate(loop_stmt->condition(), iteration);
+
+    Shadowed loop_scope;
+    if (loop_stmt->is_range_loop()) {
+      declare(loop_stmt->variable_name(), unknown_targets(), iteration,
+              loop_scope);
+    }
+    analyze_block(loop_stmt->body(), iteration);
+    restore(loop_scope, iteration);
+
+    State joined = join(entry, iteration);
+    if (joined == entry && borrowed_.size() == borrowed) break;
+    entry = std::move(joined);
+  }
+  state = std::move(entry);
+}
+
+FunctionPointerAnalysis::PointerTargets FunctionPointerAnalysis::evaluate(
+    const ASTNode* node, const State& state) {
+  if (node == nullptr) return unknown_targets();
+
+  if (const auto* var = dynamic_cast<const VariableReference*>(node)) {
+    auto local_it = state.find(var->name());
+    if (local_it != state.end()) {
+      return borrowed_.contains(var->name()) ? unknown_targets()
+                                             : local_it->second;
+    }
+
+    auto func_it = functions_.find(var->name());
+    if (func_it != functions_.end()) {
+      return PointerTargets{.unknown = false, .targets = {func_it->second}};
+    }
+    return unknown_targets();
+  }
+
+  if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
+    if (analyzed_.insert(anon_func).second) {
+      analyze_function(anon_func->parameters(), anon_func->body());
+    }
+    return PointerTargets{.unknown = false, .targets = {anon_func}};
+  }
+
+  if (const auto* call = dynamic_cast<const FunctionCall*>(node)) {
+    for (const auto& arg : call->arguments()) {
+      evaluate(arg.get(), state);
+    }
+
+    auto local_it = state.find(call->function_name());
+    if (local_it != state.end()) {
+      const PointerTargets& callee = local_it->second;
+      if (!callee.unknown && !callee.targets.empty() &&
+          !borrowed_.contains(call->function_name())) {
+        call_targets_[call] = callee.targets;
+      } else {
+        call_targets_.erase(call);
+      }
+    }
+    return unknown_targets();
+  }
+
+  if (const auto* binop = dynamic_cast<const BinaryOperation*>(node)) {
+    evaluate(binop->left(), state);
+    evaluate(binop->right(), state);
+    return unknown_targets();
+  }
+
+  if (const auto* unary = dynamic_cast<const UnaryOperation*>(node)) {
+    // Whoever holds the borrow may store any function through it, at any
+    // later point
+    if (unary->operator_type() == TokenType::Borrow) {
+      if (const auto* var =
+              dynamic_cast<const VariableReference*>(unary->operand())) {
+        if (state.contains(var->name())) borrowed_.insert(var->name());
+      }
+    }
+    evaluate(unary->operand(), state);
+    return unknown_targets();
+  }
+
+  if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    for (const auto& arg : member->arguments()) {
+      evaluate(arg.get(), state);
+    }
+    return unknown_targets();
+  }
+
+  // Function pointers aren't tracked through arrays
+  if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    for (const auto& element : literal->elements()) {
+      evaluate(element.get(), state);
+    }
+    return unknown_targets();
+  }
+
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    evaluate(index->index(), state);
+    return unknown_targets();
+  }
+
+  if (const auto* assign = dynamic_cast<const IndexAssignment*>(node)) {
+    evaluate(assign->index(), state);
+    evaluate(assign->value(), state);
+    return unknown_targets();
+  }
+
+  // Nor through struct fields
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    evaluate(access->object(), state);
+    return unknown_targets();
+  }
+
+  if (const auto* assign = dynamic_cast<const FieldAssignment*>(node)) {
+    evaluate(assign->object(), state);
+    evaluate(assign->value(), state);
+    return unknown_targets();
+  }
+
+  if (const auto* assign = dynamic_cast<const DereferenceAssignment*>(node)) {
+    evaluate(assign->value(), state);
+    return unknown_targets();
+  }
+
+  return unknown_targets();
+}
+
+void FunctionPointerAnalysis::declare(const std::string& name,
+                                      PointerTargets targets, State& state,
+                                      Shadowed& shadowed) {
+  auto it = state.find(name);
+  bool redeclared = std::any_of(shadowed.begin(), shadowed.end(),
+                                [&](const auto& entry) {
+                                  return entry.first == name;
+                                });
+  if (!redeclared) {
+    shadowed.emplace_back(name, it != state.end()
+                                    ? std::optional(std::move(it->second))
+                                    : std::nullopt);
+  }
+  state[name] = std::move(targets);
+}
+
+void FunctionPointerAnalysis::restore(Shadowed& shadowed, State& state) {
+  // Undo the declarations newest first so each name gets back the binding
+  // it had before the scope
+  for (auto it = shadowed.rbegin(); it != shadowed.rend(); ++it) {
+    if (it->second) {
+      state[it->first] = std::move(*it->second);
+    } else {
+      state.erase(it->first);
+    }
+  }
+}
+
+FunctionPointerAnalysis::PointerTargets FunctionPointerAnalysis::join(
+    const PointerTargets& a, const PointerTargets& b) {
+  if (a.unknown || b.unknown) return unknown_targets();
+
+  PointerTargets result = a;
+  for (const ASTNode* target : b.targets) {
+    if (std::find(result.targets.begin(), result.targets.end(), target) ==
+        result.targets.end()) {
+      result.targets.push_back(target);
+    }
+  }
+  if (result.targets.size() > kMaxTargets) {
+    return unknown_targets();
+  }
+  return result;
+}
+
+FunctionPointerAnalysis::State FunctionPointerAnalysis::join(const State& a,
+                                                             const State& b) {
+  State result;
+  for (const auto& [name, targets] : a) {
+    auto it = b.find(name);
+    result[name] =
+        it != b.end() ? join(targets, it->second) : unknown_targets();
+  }
+  return result;
+}
+
+}  // namespace void_compiler
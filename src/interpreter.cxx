@@ -0,0 +1,328 @@
+#include "interpreter.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+namespace void_compiler {
+namespace {
+
+// Wrap to width bits and sign extend back to 64, like an integer of that
+// width stored in a register
+int64_t wrap(uint64_t bits, uint8_t width) {
+  if (width >= 64) return static_cast<int64_t>(bits);
+  unsigned shift = 64 - width;
+  return static_cast<int64_t>(bits << shift) >> shift;
+}
+
+// left op right for the checked opcodes, throwing if it doesn't fit width
+// as a signed integer, or for the unsigned ones as an unsigned integer
+int64_t checked(OpCode op, int64_t left, int64_t right, uint8_t width) {
+  bool overflowed = false;
+  switch (op) {
+    case OpCode::AddCheckedUnsigned:
+    case OpCode::SubtractCheckedUnsigned:
+    case OpCode::MultiplyCheckedUnsigned: {
+      uint64_t mask = width >= 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+      uint64_t lhs = static_cast<uint64_t>(left) & mask;
+      uint64_t rhs = static_cast<uint64_t>(right) & mask;
+      uint64_t result = 0;
+      if (op == OpCode::AddCheckedUnsigned) {
+        overflowed = __builtin_add_overflow(lhs, rhs, &result);
+      } else if (op == OpCode::SubtractCheckedUnsigned) {
+        overflowed = __builtin_sub_overflow(lhs, rhs, &result);
+      } else {
+        overflowed = __builtin_mul_overflow(lhs, rhs, &result);
+      }
+      if (overflowed || result > mask) {
+        throw std::runtime_error("Integer overflow");
+      }
+      return wrap(result, width);
+    }
+    default: {
+      int64_t result = 0;
+      if (op == OpCode::AddChecked) {
+        overflowed = __builtin_add_overflow(left, right, &result);
+      } else if (op == OpCode::SubtractChecked) {
+        overflowed = __builtin_sub_overflow(left, right, &result);
+      } else {
+        overflowed = __builtin_mul_overflow(left, right, &result);
+      }
+      if (overflowed || wrap(static_cast<uint64_t>(result), width) != result) {
+        throw std::runtime_error("Integer overflow");
+      }
+      return result;
+    }
+  }
+}
+
+}  // namespace
+
+Interpreter::Interpreter(const BytecodeModule& module, InterpreterLimits limits,
+                         JitTier* jit)
+    : module_(module), limits_(limits), jit_(jit) {}
+
+int64_t Interpreter::run() {
+  const BytecodeFunction* function = &module_.functions.at(module_.main);
+  size_t pc = 0;
+  size_t base = 0;
+  registers_.assign(function->register_count, 0);
+  frames_.clear();
+  hotness_.assign(module_.functions.size(), 0);
+  native_.assign(module_.functions.size(), nullptr);
+  installed_ = 0;
+  native_calls_ = 0;
+  int64_t* regs = registers_.data();
+
+  // Arithmetic is done on the unsigned bit patterns, so overflow wraps
+  auto bits = [&regs](uint32_t reg) { return static_cast<uint64_t>(regs[reg]); };
+
+  for (;;) {
+    const Instruction& ins = function->code[pc++];
+
+    switch (ins.op) {
+      case OpCode::LoadConstant:
+        regs[ins.a] = function->constants[ins.b];
+        break;
+      case OpCode::Move:
+        regs[ins.a] = regs[ins.b];
+        break;
+      case OpCode::Truncate:
+        regs[ins.a] = wrap(bits(ins.b), ins.width);
+        break;
+      case OpCode::ZeroExtend:
+        regs[ins.a] = static_cast<int64_t>(
+            bits(ins.b) & ((uint64_t{1} << ins.width) - 1));
+        break;
+      case OpCode::Add:
+        regs[ins.a] = wrap(bits(ins.b) + bits(ins.c), ins.width);
+        break;
+      case OpCode::Subtract:
+        regs[ins.a] = wrap(bits(ins.b) - bits(ins.c), ins.width);
+        break;
+      case OpCode::Multiply:
+        regs[ins.a] = wrap(bits(ins.b) * bits(ins.c), ins.width);
+        break;
+      case OpCode::AddChecked:
+      case OpCode::SubtractChecked:
+      case OpCode::MultiplyChecked:
+      case OpCode::AddCheckedUnsigned:
+      case OpCode::SubtractCheckedUnsigned:
+      case OpCode::MultiplyCheckedUnsigned:
+        regs[ins.a] = checked(ins.op, regs[ins.b], regs[ins.c], ins.width);
+        break;
+      case OpCode::Divide:
+        if (regs[ins.c] == 0) throw std::runtime_error("Division by zero");
+        // Dividing by -1 is a negation, which also covers INT64_MIN / -1
+        regs[ins.a] = wrap(regs[ins.c] == -1 ? 0 - bits(ins.b)
+                                             : static_cast<uint64_t>(
+                                                   regs[ins.b] / regs[ins.c]),
+                           ins.width);
+        break;
+      case OpCode::And:
+        regs[ins.a] = wrap(bits(ins.b) & bits(ins.c), ins.width);
+        break;
+      case OpCode::Or:
+        regs[ins.a] = wrap(bits(ins.b) | bits(ins.c), ins.width);
+        break;
+      case OpCode::Negate:
+        regs[ins.a] = wrap(0 - bits(ins.b), ins.width);
+        break;
+      case OpCode::Not:
+        regs[ins.a] = wrap(~bits(ins.b), ins.width);
+        break;
+      case OpCode::Less:
+        regs[ins.a] = regs[ins.b] < regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::LessEqual:
+        regs[ins.a] = regs[ins.b] <= regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::Greater:
+        regs[ins.a] = regs[ins.b] > regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::GreaterEqual:
+        regs[ins.a] = regs[ins.b] >= regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::LessUnsigned:
+        regs[ins.a] = bits(ins.b) < bits(ins.c) ? -1 : 0;
+        break;
+      case OpCode::Equal:
+        regs[ins.a] = regs[ins.b] == regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::NotEqual:
+        regs[ins.a] = regs[ins.b] != regs[ins.c] ? -1 : 0;
+        break;
+      case OpCode::AddressOf:
+        regs[ins.a] = static_cast<int64_t>(base + ins.b);
+        break;
+      case OpCode::Load: {
+        auto slot = static_cast<size_t>(regs[ins.b]);
+        if (slot >= registers_.size()) {
+          throw std::runtime_error("Invalid pointer dereference");
+        }
+        regs[ins.a] = wrap(static_cast<uint64_t>(registers_[slot]), ins.width);
+        break;
+      }
+      case OpCode::Store: {
+        auto slot = static_cast<size_t>(regs[ins.a]);
+        if (slot >= registers_.size()) {
+          throw std::runtime_error("Invalid pointer dereference");
+        }
+        registers_[slot] = regs[ins.b];
+        break;
+      }
+      case OpCode::Jump:
+        // Jumping backwards closes a loop iteration
+        if (jit_ && ins.a < pc) {
+          count_hot(static_cast<size_t>(function - module_.functions.data()));
+        }
+        pc = ins.a;
+        break;
+      case OpCode::JumpIfFalse:
+        if (regs[ins.a] == 0) pc = ins.b;
+        break;
+      case OpCode::Call:
+      case OpCode::CallIndirect: {
+        auto index = ins.op == OpCode::Call ? ins.b
+                                            : static_cast<size_t>(regs[ins.b]);
+        if (index >= module_.functions.size()) {
+          throw std::runtime_error("Call through invalid function pointer");
+        }
+        if (jit_) {
+          if (jit_->ready_count() != installed_) install_native_code();
+          if (native_[index]) {
+            regs[ins.a] = native_[index](regs + ins.c);
+            native_calls_++;
+            break;
+          }
+          count_hot(index);
+        }
+        if (frames_.size() >= limits_.max_call_depth) {
+          throw std::runtime_error("Stack overflow: call depth exceeded " +
+                                   std::to_string(limits_.max_call_depth));
+        }
+
+        // The callee's window starts right after the caller's, with its
+        // parameters in the first registers
+        const BytecodeFunction* callee = &module_.functions[index];
+        size_t callee_base = base + function->register_count;
+        size_t needed = callee_base + callee->register_count;
+        if (registers_.size() < needed) {
+          registers_.resize(std::max(needed, registers_.size() * 2));
+        }
+        std::copy_n(registers_.begin() + base + ins.c,
+                    callee->parameter_count,
+                    registers_.begin() + callee_base);
+
+        frames_.push_back({function, pc, base, ins.a});
+        function = callee;
+        pc = 0;
+        base = callee_base;
+        regs = registers_.data() + base;
+        break;
+      }
+      case OpCode::TailCall: {
+        if (jit_) {
+          if (jit_->ready_count() != installed_) install_native_code();
+          if (native_[ins.b]) {
+            regs[ins.a] = native_[ins.b](regs + ins.c);
+            native_calls_++;
+            break;
+          }
+          count_hot(ins.b);
+        }
+
+        // The callee takes over the caller's window and frame, so the call
+        // depth stays the same however long the chain of tail calls is
+        const BytecodeFunction* callee = &module_.functions[ins.b];
+        size_t needed = base + callee->register_count;
+        if (registers_.size() < needed) {
+          registers_.resize(std::max(needed, registers_.size() * 2));
+          regs = registers_.data() + base;
+        }
+        std::copy_n(regs + ins.c, callee->parameter_count, regs);
+        function = callee;
+        pc = 0;
+        break;
+      }
+      case OpCode::Print: {
+        auto format_index = static_cast<size_t>(regs[ins.b]);
+        std::string output = format(module_.strings.at(format_index),
+                                    regs + ins.b + 1, ins.c - 1);
+        std::fwrite(output.data(), 1, output.size(), stdout);
+        regs[ins.a] = static_cast<int64_t>(output.size());
+        break;
+      }
+      case OpCode::Return:
+      case OpCode::ReturnVoid: {
+        int64_t value = ins.op == OpCode::Return ? regs[ins.a] : 0;
+        if (frames_.empty()) return value;
+
+        Frame caller = frames_.back();
+        frames_.pop_back();
+        function = caller.function;
+        pc = caller.pc;
+        base = caller.base;
+        regs = registers_.data() + base;
+        regs[caller.result] = value;
+        break;
+      }
+      case OpCode::Unreachable:
+        throw std::runtime_error("Function '" + function->name +
+                                 "' ended without returning a value");
+    }
+  }
+}
+
+void Interpreter::count_hot(size_t function) {
+  if (++hotness_[function] == jit_->policy().threshold &&
+      module_.functions[function].native_callable) {
+    jit_->request(function, hotness_[function]);
+  }
+}
+
+void Interpreter::install_native_code() {
+  auto ready = jit_->ready();
+  for (const auto& [function, entry] : ready) {
+    native_[function] = entry;
+  }
+  installed_ = ready.size();
+}
+
+std::string Interpreter::format(const std::string& format,
+                                const int64_t* args, size_t count) const {
+  std::string output;
+  size_t next_arg = 0;
+  for (size_t i = 0; i < format.size(); ++i) {
+    if (format[i] != '%' || i + 1 == format.size()) {
+      output += format[i];
+      continue;
+    }
+
+    char conversion = format[++i];
+    if (conversion == '%') {
+      output += '%';
+      continue;
+    }
+    if (conversion != 'd' && conversion != 's') {
+      output += '%';
+      output += conversion;
+      continue;
+    }
+    if (next_arg == count) {
+      throw std::runtime_error("Not enough arguments for format string");
+    }
+
+    int64_t arg = args[next_arg++];
+    if (conversion == 'd') {
+      // printf reads an int, so wider integers print their low 32 bits
+      output += std::to_string(static_cast<int32_t>(arg));
+    } else {
+      output += module_.strings.at(static_cast<size_t>(arg));
+    }
+  }
+  return output;
+}
+
+}  // namespace void_compiler
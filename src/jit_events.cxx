@@ -0,0 +1,115 @@
+#include "jit_events.h"
+
+#include <cstdlib>
+#include <mutex>
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/JITEventListener.h>
+#include <llvm/Object/SymbolSize.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/Process.h>
+#include <llvm/Support/raw_ostream.h>
+#pragma clang diagnostic pop
+
+namespace void_compiler {
+namespace {
+
+// Appends "<address> <size> <name>" in hex for every function in the
+// objects it hears about. One per process, shared by every engine, which
+// may load code on the tiered mode's compile thread.
+class PerfMapListener : public llvm::JITEventListener {
+ public:
+  static PerfMapListener& instance() {
+    static PerfMapListener listener;
+    return listener;
+  }
+
+  void notifyObjectLoaded(
+      ObjectKey /*key*/, const llvm::object::ObjectFile& object,
+      const llvm::RuntimeDyld::LoadedObjectInfo& info) override {
+    // The debug copy has its sections at the addresses they were loaded to
+    llvm::object::OwningBinary<llvm::object::ObjectFile> loaded =
+        info.getObjectForDebug(object);
+    if (!loaded.getBinary()) return;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!out_) return;
+    for (const auto& [symbol, size] :
+         llvm::object::computeSymbolSizes(*loaded.getBinary())) {
+      auto type = symbol.getType();
+      auto name = symbol.getName();
+      auto address = symbol.getAddress();
+      if (!type || !name || !address ||
+          *type != llvm::object::SymbolRef::ST_Function || size == 0) {
+        llvm::consumeError(type.takeError());
+        llvm::consumeError(name.takeError());
+        llvm::consumeError(address.takeError());
+        continue;
+      }
+      *out_ << llvm::format_hex_no_prefix(*address, 1) << ' '
+            << llvm::format_hex_no_prefix(size, 1) << ' ' << *name << '\n';
+    }
+    out_->flush();
+  }
+
+ private:
+  PerfMapListener() {
+    std::error_code error;
+    out_ = std::make_unique<llvm::raw_fd_ostream>(
+        perf_map_path(), error, llvm::sys::fs::OF_Append);
+    if (error) out_.reset();
+  }
+
+  std::mutex mutex_;
+  std::unique_ptr<llvm::raw_fd_ostream> out_;  // null if it can't be opened
+};
+
+}  // namespace
+
+std::optional<JitEvents> parse_jit_events(std::string_view names) {
+  JitEvents events;
+  while (true) {
+    size_t comma = names.find(',');
+    std::string_view name = names.substr(0, comma);
+    if (name == "perf") {
+      events.perf = true;
+    } else if (name == "gdb") {
+      events.gdb = true;
+    } else {
+      return std::nullopt;
+    }
+    if (comma == std::string_view::npos) return events;
+    names.remove_prefix(comma + 1);
+  }
+}
+
+JitEvents jit_events_from_environment() {
+  const char* value = std::getenv("VOID_JIT_EVENTS");
+  if (!value) return {};
+  return parse_jit_events(value).value_or(JitEvents{});
+}
+
+std::string perf_map_path() {
+  return "/tmp/perf-" + std::to_string(llvm::sys::Process::getProcessId()) +
+         ".map";
+}
+
+void register_jit_event_listeners(llvm::ExecutionEngine& engine,
+                                  JitEvents events) {
+  if (events.perf) {
+    engine.RegisterJITEventListener(&PerfMapListener::instance());
+    // Null unless LLVM was built with perf support
+    if (llvm::JITEventListener* jitdump =
+            llvm::JITEventListener::createPerfJITEventListener()) {
+      engine.RegisterJITEventListener(jitdump);
+    }
+  }
+  if (events.gdb) {
+    engine.RegisterJITEventListener(
+        llvm::JITEventListener::createGDBRegistrationListener());
+  }
+}
+
+}  // namespace void_compiler
@@ -0,0 +1,119 @@
+#include "jit_tier.h"
+
+#include <chrono>
+
+#include "code_generation.h"
+
+namespace void_compiler {
+
+JitTier::JitTier(const Program* program, const BytecodeModule& module,
+                 TierUpPolicy policy)
+    : program_(program), module_(module), policy_(policy) {
+  // LLVM's target registry isn't safe to initialize from two threads at once
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+}
+
+JitTier::~JitTier() { finish(); }
+
+void JitTier::request(size_t function, size_t hotness) {
+  if (policy_.synchronous) {
+    compile({{function, hotness}});
+    return;
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    if (stopping_) return;
+    queue_.push_back({function, hotness});
+  }
+  if (!worker_.joinable()) {
+    worker_ = std::thread(&JitTier::run_worker, this);
+  }
+  wake_.notify_one();
+}
+
+std::vector<std::pair<size_t, NativeEntry>> JitTier::ready() const {
+  std::lock_guard lock(mutex_);
+  return ready_;
+}
+
+std::vector<TierUpEvent> JitTier::finish() {
+  {
+    std::lock_guard lock(mutex_);
+    stopping_ = true;
+    queue_.clear();
+  }
+  wake_.notify_one();
+  if (worker_.joinable()) worker_.join();
+
+  std::lock_guard lock(mutex_);
+  return events_;
+}
+
+void JitTier::run_worker() {
+  for (;;) {
+    std::vector<Request> batch;
+    {
+      std::unique_lock lock(mutex_);
+      wake_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (stopping_) return;
+      batch.swap(queue_);
+    }
+    compile(batch);
+  }
+}
+
+void JitTier::compile(const std::vector<Request>& batch) {
+  auto start = std::chrono::steady_clock::now();
+
+  // No constant folds: a function the interpreter calls must not be
+  // eliminated because its compile time calls were folded away
+  auto codegen = std::make_unique<CodeGenerator>();
+  std::vector<std::pair<size_t, NativeEntry>> compiled;
+  try {
+    codegen->generate_program(program_);
+    std::vector<std::string> entries;
+    for (const auto& request : batch) {
+      entries.push_back(codegen->generate_entry_thunk(
+          module_.functions[request.function].name));
+    }
+    codegen->optimize();
+    for (size_t i = 0; i < batch.size(); ++i) {
+      compiled.emplace_back(batch[i].function,
+                            reinterpret_cast<NativeEntry>(
+                                codegen->jit_function_address(entries[i])));
+    }
+  } catch (const std::exception& e) {
+    // The batch stays interpreted, which is always correct, but --stats
+    // says why
+    double compile_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+    std::lock_guard lock(mutex_);
+    for (const auto& request : batch) {
+      events_.push_back({.function = module_.functions[request.function].name,
+                         .hotness = request.hotness,
+                         .compile_ms = compile_ms,
+                         .error = e.what()});
+    }
+    return;
+  }
+
+  double compile_ms = std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+
+  std::lock_guard lock(mutex_);
+  for (size_t i = 0; i < batch.size(); ++i) {
+    ready_.push_back(compiled[i]);
+    events_.push_back({.function = module_.functions[batch[i].function].name,
+                       .hotness = batch[i].hotness,
+                       .compile_ms = compile_ms,
+                       .error = {}});
+  }
+  generators_.push_back(std::move(codegen));
+  ready_count_.store(ready_.size(), std::memory_order_release);
+}
+
+}  // namespace void_compiler
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
@@ -7,6 +8,8 @@
 
 #include "compiler.h"
 #include "lexer.h"
+#include "object_cache.h"
+#include "session.h"
 #include "types.h"
 
 /* TODO: remove this from main */
@@ -31,39 +34,214 @@ std::string read_file(const std::string& filename) {
   return source;
 }
 
+void print_stats(const void_compiler::CompileStats& stats) {
+  std::cout << "Stats:" << '\n'
+            << "  functions eliminated: " << stats.functions_eliminated
+            << '\n'
+            << "  calls folded: " << stats.folded_calls.size() << '\n';
+}
+
+void print_run_stats(const void_compiler::CompileStats& stats) {
+  const char* executed_by = stats.tiered        ? "tiered"
+                            : stats.interpreted ? "interpreter"
+                                                : "jit";
+  std::cout << "Stats:" << '\n'
+            << "  executed by: " << executed_by << '\n';
+  if (!stats.interpreted) {
+    std::cout << "  jit cache: " << (stats.jit_cache_hit ? "hit" : "miss")
+              << '\n';
+  }
+  if (!stats.tiered) return;
+
+  auto failed = std::ranges::count_if(
+      stats.tier_ups, [](const auto& event) { return !event.error.empty(); });
+  std::cout << "  tier-ups: " << stats.tier_ups.size() - failed << '\n';
+  for (const auto& event : stats.tier_ups) {
+    if (!event.error.empty()) continue;
+    std::cout << "    " << event.function << " after " << event.hotness
+              << " calls and back-edges, compiled in " << event.compile_ms
+              << " ms" << '\n';
+  }
+  if (failed == 0) return;
+  std::cout << "  failed tier-ups: " << failed << '\n';
+  for (const auto& event : stats.tier_ups) {
+    if (event.error.empty()) continue;
+    std::cout << "    " << event.function << " after " << event.hotness
+              << " calls and back-edges, stays interpreted: " << event.error
+              << '\n';
+  }
+}
+
+void print_fold_report(const void_compiler::CompileStats& stats) {
+  std::cout << "Folded at compile time:" << '\n';
+  for (const auto& folded : stats.folded_calls) {
+    std::cout << "  " << folded << '\n';
+  }
+}
+
+// Read inputs until end of file. An input ends at a line where every brace
+// opened so far is closed, so functions can span lines.
+int run_repl() {
+  void_compiler::Session session;
+  std::string input;
+  int depth = 0;
+  std::string line;
+  std::cout << "void> " << std::flush;
+  while (std::getline(std::cin, line)) {
+    input += line + '\n';
+    for (char c : line) {
+      if (c == '{') depth++;
+      if (c == '}') depth--;
+    }
+    if (depth > 0) {
+      std::cout << "...   " << std::flush;
+      continue;
+    }
+
+    if (input.find_first_not_of(" \t\r\n") != std::string::npos) {
+      try {
+        std::string value = session.evaluate(input);
+        if (!value.empty()) std::cout << value << '\n';
+      } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << '\n';
+      }
+    }
+    input.clear();
+    depth = 0;
+    std::cout << "void> " << std::flush;
+  }
+  std::cout << '\n';
+  return 0;
+}
+
 int main(int argc, char** argv) {
   std::string filename;
   enum class Command : uint8_t {
     Build,
+    Run,
+    Repl,
     Tokenise,
     // Parse,
   };
   Command command;
+  bool show_stats = false;
+  bool show_fold_report = false;
+  auto mode = void_compiler::ExecutionMode::Auto;
+  bool use_cache = true;
+  std::string target_cpu = "generic";
+  auto overflow = void_compiler::OverflowMode::Wrap;
+  void_compiler::ProfileOptions profile;
+  void_compiler::DebugOptions debug;
+  void_compiler::JitEvents jit_events;
 
-  if (argc == 3 && std::string(argv[1]) == "build") {
+  if (argc >= 3 && std::string(argv[1]) == "build") {
     command = Command::Build;
     filename = argv[2];
+  } else if (argc >= 3 && std::string(argv[1]) == "run") {
+    command = Command::Run;
+    filename = argv[2];
+  } else if (argc == 2 && std::string(argv[1]) == "repl") {
+    command = Command::Repl;
   } else if (argc == 3 && std::string(argv[1]) == "tokenise") {
     command = Command::Tokenise;
     filename = argv[2];
   } else {
-    std::cerr << "Usage: " << argv[0] << " build <source_file>" << '\n';
+    std::cerr << "Usage: " << argv[0]
+              << " build <source_file> [--cpu=<name>|native] [--stats]"
+              << " [--fold-report] [--overflow=wrap|undefined|trap]"
+              << " [--profile-generate | --profile-use=<file.profdata>]"
+              << " [-g] [--frame-pointers]" << '\n'
+              << "       " << argv[0]
+              << " run <source_file> [--interp | --tiered | --jit] [--no-cache]"
+              << " [--stats] [--overflow=wrap|undefined|trap]"
+              << " [--profile-generate=<file.profdata> |"
+              << " --profile-use=<file.profdata>] [-g] [--frame-pointers]"
+              << " [--jit-events=perf,gdb]" << '\n'
+              << "       " << argv[0] << " repl" << '\n';
     return 1;
   }
 
+  for (int i = 3; i < argc; ++i) {
+    std::string flag = argv[i];
+    if (flag == "--stats") {
+      show_stats = true;
+    } else if (flag == "--fold-report") {
+      show_fold_report = true;
+    } else if (flag == "--interp" && command == Command::Run) {
+      mode = void_compiler::ExecutionMode::Interpret;
+    } else if (flag == "--tiered" && command == Command::Run) {
+      mode = void_compiler::ExecutionMode::Tiered;
+    } else if (flag == "--jit" && command == Command::Run) {
+      mode = void_compiler::ExecutionMode::Jit;
+    } else if (flag == "--no-cache" && command == Command::Run) {
+      use_cache = false;
+    } else if (flag.starts_with("--cpu=") && command == Command::Build) {
+      target_cpu = flag.substr(6);
+    } else if (flag == "--profile-generate" && command == Command::Build) {
+      profile.generate = true;
+    } else if (flag.starts_with("--profile-generate=") &&
+               command == Command::Run) {
+      profile.generate = true;
+      profile.output = flag.substr(19);
+    } else if (flag.starts_with("--profile-use=")) {
+      profile.use = flag.substr(14);
+    } else if (flag == "-g") {
+      debug.source_file = filename;
+    } else if (flag == "--frame-pointers") {
+      debug.frame_pointers = true;
+    } else if (flag.starts_with("--jit-events=") && command == Command::Run &&
+               void_compiler::parse_jit_events(flag.substr(13))) {
+      jit_events = *void_compiler::parse_jit_events(flag.substr(13));
+    } else if (flag.starts_with("--overflow=") &&
+               void_compiler::parse_overflow_mode(flag.substr(11))) {
+      overflow = *void_compiler::parse_overflow_mode(flag.substr(11));
+    } else {
+      std::cerr << "Unknown option: " << flag << '\n';
+      return 1;
+    }
+  }
+
   switch (command) {
     case Command::Build: {
       auto source = read_file(filename);
       std::cout << "source: " << source << '\n';
 
       void_compiler::Compiler compiler;
+      compiler.set_target_cpu(target_cpu);
+      compiler.set_overflow_mode(overflow);
+      compiler.set_profile(profile);
+      compiler.set_debug(debug);
       if (compiler.compile_to_executable(
               void_compiler::SourcePath{.path = source},
               void_compiler::OutputPath{"a.out"})) {
         std::cout << "Success! Run with: ./a.out" << '\n';
       }
+      if (show_stats) {
+        print_stats(compiler.stats());
+      }
+      if (show_fold_report) {
+        print_fold_report(compiler.stats());
+      }
       break;
     }
+    case Command::Run: {
+      void_compiler::Compiler compiler;
+      compiler.set_overflow_mode(overflow);
+      compiler.set_profile(profile);
+      compiler.set_debug(debug);
+      compiler.set_jit_events(jit_events);
+      if (use_cache) {
+        compiler.set_cache_directory(
+            void_compiler::DiskObjectCache::default_directory());
+      }
+      int result = compiler.compile_and_run(read_file(filename), mode);
+      if (show_stats) {
+        print_run_stats(compiler.stats());
+      }
+      return result;
+    }
+    case Command::Repl:
+      return run_repl();
     case Command::Tokenise: {
       auto source = read_file(filename);
       std::cout << "source: " << source << '\n';
@@ -0,0 +1,86 @@
+#include "object_cache.h"
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wunused-parameter"
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Object/ObjectFile.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#pragma clang diagnostic pop
+
+namespace void_compiler {
+
+DiskObjectCache::DiskObjectCache(std::string directory)
+    : directory_(std::move(directory)) {}
+
+std::string DiskObjectCache::default_directory() {
+  llvm::SmallString<128> path;
+  if (!llvm::sys::path::cache_directory(path)) return "";
+  llvm::sys::path::append(path, "void");
+  return std::string(path);
+}
+
+bool DiskObjectCache::preload(const std::string& key) {
+  preloaded_ = load(key);
+  preloaded_key_ = preloaded_ ? key : "";
+  return preloaded_ != nullptr;
+}
+
+void DiskObjectCache::notifyObjectCompiled(const llvm::Module* module,
+                                           llvm::MemoryBufferRef object) {
+  if (llvm::sys::fs::create_directories(directory_)) return;
+
+  // Write to a private file and rename it into place, so a concurrent run
+  // never sees half an object
+  std::string path = path_for(module->getModuleIdentifier());
+  llvm::SmallString<128> temp_path;
+  int fd;
+  if (llvm::sys::fs::createUniqueFile(path + ".%%%%%%.tmp", fd, temp_path)) {
+    return;
+  }
+  {
+    llvm::raw_fd_ostream out(fd, /*shouldClose=*/true);
+    out << object.getBuffer();
+    if (out.has_error()) {
+      out.clear_error();
+      llvm::sys::fs::remove(temp_path);
+      return;
+    }
+  }
+  if (llvm::sys::fs::rename(temp_path, path)) {
+    llvm::sys::fs::remove(temp_path);
+  }
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::getObject(
+    const llvm::Module* module) {
+  if (preloaded_ && module->getModuleIdentifier() == preloaded_key_) {
+    preloaded_key_.clear();
+    return std::move(preloaded_);
+  }
+  return load(module->getModuleIdentifier());
+}
+
+std::unique_ptr<llvm::MemoryBuffer> DiskObjectCache::load(
+    const std::string& key) const {
+  auto buffer = llvm::MemoryBuffer::getFile(path_for(key));
+  if (!buffer) return nullptr;
+
+  // A damaged entry would make the JIT's linker abort, so recompile instead
+  auto object = llvm::object::ObjectFile::createObjectFile(
+      (*buffer)->getMemBufferRef());
+  if (!object) {
+    llvm::consumeError(object.takeError());
+    return nullptr;
+  }
+  return std::move(*buffer);
+}
+
+std::string DiskObjectCache::path_for(const std::string& key) const {
+  llvm::SmallString<128> path(directory_);
+  llvm::sys::path::append(path, key + ".o");
+  return std::string(path);
+}
+
+}  // namespace void_compiler
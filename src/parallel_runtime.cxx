@@ -0,0 +1,173 @@
+#include "parallel_runtime.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct Job {
+  VoidParallelBody body;
+  void* context;
+  std::atomic<int64_t> remaining;  // chunks not finished yet
+};
+
+struct Chunk {
+  int64_t begin;
+  int64_t end;
+  Job* job;
+};
+
+// Each thread pops its own chunks from the back, thieves take from the front
+struct WorkQueue {
+  std::mutex mutex;
+  std::deque<Chunk> chunks;
+};
+
+// Set while a thread runs a loop body, so nested parallel loops run inline
+// instead of waiting on a pool that is busy running their parent
+thread_local bool in_parallel_body = false;
+
+size_t env_or(const char* name, size_t fallback) {
+  const char* value = std::getenv(name);
+  if (!value) return fallback;
+  char* end;
+  unsigned long long parsed = std::strtoull(value, &end, 10);
+  return *end == '\0' && parsed > 0 ? parsed : fallback;
+}
+
+class ThreadPool {
+ public:
+  static ThreadPool& instance() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  [[nodiscard]] size_t thread_count() const { return queues_.size(); }
+
+  void run(int64_t begin, int64_t end, int64_t grain, VoidParallelBody body,
+           void* context) {
+    int64_t chunk_count = (end - begin + grain - 1) / grain;
+    Job job{body, context, chunk_count};
+
+    // Deal the chunks out round robin; stealing evens out the rest
+    for (size_t queue = 0; queue < queues_.size(); ++queue) {
+      std::lock_guard lock(queues_[queue]->mutex);
+      for (int64_t chunk = static_cast<int64_t>(queue); chunk < chunk_count;
+           chunk += static_cast<int64_t>(queues_.size())) {
+        int64_t chunk_begin = begin + chunk * grain;
+        queues_[queue]->chunks.push_back(
+            {chunk_begin, std::min(end, chunk_begin + grain), &job});
+      }
+    }
+    queued_.fetch_add(chunk_count);
+    { std::lock_guard lock(sleep_mutex_); }
+    wake_.notify_all();
+
+    // The caller works too, on queue 0, until its own job is finished
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+      if (!run_one(0)) std::this_thread::yield();
+    }
+  }
+
+ private:
+  ThreadPool() {
+    size_t threads = env_or("VOID_NUM_THREADS",
+                            std::max(1U, std::thread::hardware_concurrency()));
+    for (size_t i = 0; i < threads; ++i) {
+      queues_.push_back(std::make_unique<WorkQueue>());
+    }
+    for (size_t i = 1; i < threads; ++i) {
+      workers_.emplace_back(&ThreadPool::work, this, i);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(sleep_mutex_);
+      stopping_ = true;
+    }
+    wake_.notify_all();
+    for (auto& worker : workers_) worker.join();
+  }
+
+  void work(size_t self) {
+    for (;;) {
+      if (run_one(self)) continue;
+
+      std::unique_lock lock(sleep_mutex_);
+      wake_.wait(lock, [this] { return stopping_ || queued_.load() > 0; });
+      if (stopping_) return;
+    }
+  }
+
+  // Run a chunk from our own queue, or stolen from another. False if every
+  // queue was empty.
+  bool run_one(size_t self) {
+    Chunk chunk;
+    bool found = take(self, /*steal=*/false, chunk);
+    for (size_t i = 1; !found && i < queues_.size(); ++i) {
+      found = take((self + i) % queues_.size(), /*steal=*/true, chunk);
+    }
+    if (!found) return false;
+
+    queued_.fetch_sub(1);
+    bool nested = in_parallel_body;
+    in_parallel_body = true;
+    chunk.job->body(chunk.begin, chunk.end, chunk.job->context);
+    in_parallel_body = nested;
+    chunk.job->remaining.fetch_sub(1, std::memory_order_release);
+    return true;
+  }
+
+  bool take(size_t queue, bool steal, Chunk& chunk) {
+    std::lock_guard lock(queues_[queue]->mutex);
+    auto& chunks = queues_[queue]->chunks;
+    if (chunks.empty()) return false;
+    if (steal) {
+      chunk = chunks.front();
+      chunks.pop_front();
+    } else {
+      chunk = chunks.back();
+      chunks.pop_back();
+    }
+    return true;
+  }
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;  // one per thread
+  std::vector<std::thread> workers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<int64_t> queued_ = 0;  // chunks waiting in any queue
+  bool stopping_ = false;
+};
+
+}  // namespace
+
+extern "C" void void_parallel_for(int64_t begin, int64_t end,
+                                  VoidParallelBody body, void* context) {
+  if (begin >= end) return;
+  if (in_parallel_body) {
+    body(begin, end, context);
+    return;
+  }
+
+  ThreadPool& pool = ThreadPool::instance();
+  auto threads = static_cast<int64_t>(pool.thread_count());
+  int64_t grain = static_cast<int64_t>(env_or(
+      "VOID_PAR_GRAIN",
+      static_cast<size_t>(std::max<int64_t>(1, (end - begin) / (8 * threads)))));
+  if (threads == 1 || grain >= end - begin) {
+    in_parallel_body = true;
+    body(begin, end, context);
+    in_parallel_body = false;
+    return;
+  }
+  pool.run(begin, end, grain, body, context);
+}
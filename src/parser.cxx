@@ -1,8 +1,13 @@
 #include "parser.h"
 
+#include <algorithm>
+#include <cctype>
 #include <iostream>  // Include iostream for debug logs
+#include <limits>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <tuple>
 #include <vector>
 
 #include "parse_exception.h"
@@ -22,26 +27,151 @@ std::string join(const std::vector<std::string>& elements,
   return os.str();
 }
 
+// Where token starts. The lexer reports the column after a word (a keyword,
+// name or number) but the first column of a symbol.
+SourceLocation start_of(const Token& token) {
+  bool word = !token.value.empty() &&
+              (std::isalnum(static_cast<unsigned char>(token.value[0])) ||
+               token.value[0] == '_');
+  return {.line = token.line,
+          .column = word ? token.column -
+                               static_cast<uint32_t>(token.value.size())
+                         : token.column};
+}
+
+// What a value of type is used as: a borrow's pointee, or type itself
+std::string borrowed_type(const std::string& type) {
+  auto borrow = BorrowType::parse(type);
+  return borrow ? borrow->pointee : type;
+}
+
+// The values a match on type can cover, or none if it can't be matched on.
+// u64 stops at the largest i64, which is as far as literals go.
+std::optional<std::pair<int64_t, int64_t>> match_bounds(
+    const std::string& type) {
+  if (type == "bool") return std::pair<int64_t, int64_t>{0, 1};
+  for (int64_t width : {8, 16, 32, 64}) {
+    if (type == "i" + std::to_string(width)) {
+      if (width == 64) {
+        return std::pair{std::numeric_limits<int64_t>::min(),
+                         std::numeric_limits<int64_t>::max()};
+      }
+      return std::pair{-(int64_t{1} << (width - 1)),
+                       (int64_t{1} << (width - 1)) - 1};
+    }
+    if (type == "u" + std::to_string(width)) {
+      if (width == 64) {
+        return std::pair<int64_t, int64_t>{
+            0, std::numeric_limits<int64_t>::max()};
+      }
+      return std::pair<int64_t, int64_t>{0, (int64_t{1} << width) - 1};
+    }
+  }
+  return std::nullopt;
+}
+
 /*
    This is a recursive descent parser
 */
 
 // entry point to the parser
+//
+// Parsing happens in two phases. The pre-scan parses imports and function
+// signatures, and skips over each function body by brace matching, recording
+// its token range. Bodies are then parsed only for functions reachable from
+// main, so unused helpers in large files cost a token scan rather than a full
+// parse. A file without a main is treated as a library and parsed in full.
 std::unique_ptr<Program> Parser::parse() {
   auto program = std::make_unique<Program>();
+  std::vector<FunctionStub> stubs;
+
+  for (size_t i = 0; i < tokens_.size(); ++i) {
+    if (at_struct_declaration(i)) struct_names_.insert(tokens_[i + 1].value);
+  }
 
   while (!match(TokenType::EndOfFile)) {
     if (match(TokenType::Import)) {
       program->add_import(parse_import());
+    } else if (at_struct_declaration(current_)) {
+      program->add_struct(parse_struct_declaration());
     } else if (match(TokenType::Const)) {
-      program->add_function(parse_function());
+      auto declaration = parse_function_signature();
+      size_t body_begin = current_;
+      size_t body_end = skip_function_body();
+      stubs.push_back(FunctionStub{.declaration = std::move(declaration),
+                                   .body_begin = body_begin,
+                                   .body_end = body_end});
     } else {
       throw ParseError("Expected import or function declaration", peek());
     }
   }
+  size_t end_of_file = current_;
+
+  for (const auto& stub : stubs) {
+    if (struct_names_.contains(stub.declaration->name())) {
+      throw ParseError("'" + stub.declaration->name() +
+                       "' is declared as both a struct and a function");
+    }
+  }
+
+  auto reachable = find_reachable_functions(stubs);
 
+  // Parse the needed bodies in source order so declarations keep their order
+  for (auto& stub : stubs) {
+    if (!reachable.contains(stub.declaration->name())) continue;
+
+    current_ = stub.body_begin;
+    parse_function_body(stub.declaration.get());
+    if (current_ != stub.body_end) {
+      throw ParseError("Unexpected token after function body", peek());
+    }
+    program->add_function(std::move(stub.declaration));
+  }
+
+  program->set_skipped_function_count(stubs.size() -
+                                      program->functions().size());
+  current_ = end_of_file;
   return program;
 }
+
+// Walk the call graph from main at the token level: any identifier in a body
+// that names a top-level function (a call or a function pointer use) makes
+// that function reachable
+std::unordered_set<std::string> Parser::find_reachable_functions(
+    const std::vector<FunctionStub>& stubs) const {
+  std::unordered_map<std::string, const FunctionStub*> stubs_by_name;
+  for (const auto& stub : stubs) {
+    stubs_by_name[stub.declaration->name()] = &stub;
+  }
+
+  std::unordered_set<std::string> reachable;
+  if (selection_ == FunctionSelection::All ||
+      !stubs_by_name.contains("main")) {
+    for (const auto& stub : stubs) {
+      reachable.insert(stub.declaration->name());
+    }
+    return reachable;
+  }
+
+  std::vector<const FunctionStub*> worklist = {stubs_by_name["main"]};
+  reachable.insert("main");
+  while (!worklist.empty()) {
+    const FunctionStub* stub = worklist.back();
+    worklist.pop_back();
+
+    for (size_t i = stub->body_begin; i < stub->body_end; ++i) {
+      if (tokens_[i].type != TokenType::Identifier) continue;
+
+      auto it = stubs_by_name.find(tokens_[i].value);
+      if (it != stubs_by_name.end() && reachable.insert(it->first).second) {
+        worklist.push_back(it->second);
+      }
+    }
+  }
+
+  return reachable;
+}
+
 Token& Parser::peek() {
   if (current_ >= tokens_.size()) {
     throw ParseError("Unexpected end of input");
@@ -72,8 +202,8 @@ std::unique_ptr<ASTNode> Parser::parse_logical_or() {
     TokenType op = peek().type;
     consume(op);
     auto right = parse_logical_and();
-    left = std::make_unique<BinaryOperation>(std::move(left), op,
-                                             std::move(right));
+    left = typed(std::make_unique<BinaryOperation>(std::move(left), op,
+                                                   std::move(right)));
   }
 
   return left;
@@ -86,8 +216,8 @@ std::unique_ptr<ASTNode> Parser::parse_logical_and() {
     TokenType op = peek().type;
     consume(op);
     auto right = parse_comparison();
-    left = std::make_unique<BinaryOperation>(std::move(left), op,
-                                             std::move(right));
+    left = typed(std::make_unique<BinaryOperation>(std::move(left), op,
+                                                   std::move(right)));
   }
 
   return left;
@@ -98,7 +228,7 @@ std::unique_ptr<ASTNode> Parser::parse_comparison() {
   if (match(TokenType::Not)) {
     TokenType op = consume(TokenType::Not).type;
     auto operand = parse_comparison();  // Parse the comparison after 'not'
-    return std::make_unique<UnaryOperation>(op, std::move(operand));
+    return typed(std::make_unique<UnaryOperation>(op, std::move(operand)));
   }
 
   auto left = parse_additive();
@@ -109,8 +239,8 @@ std::unique_ptr<ASTNode> Parser::parse_comparison() {
     TokenType op = peek().type;
     consume(op);
     auto right = parse_additive();
-    left = std::make_unique<BinaryOperation>(std::move(left), op,
-                                             std::move(right));
+    left = typed(std::make_unique<BinaryOperation>(std::move(left), op,
+                                                   std::move(right)));
   }
 
   return left;
@@ -123,8 +253,8 @@ std::unique_ptr<ASTNode> Parser::parse_additive() {
     TokenType op = peek().type;
     consume(op);
     auto right = parse_multiplicative();
-    left = std::make_unique<BinaryOperation>(std::move(left), op,
-                                             std::move(right));
+    left = typed(std::make_unique<BinaryOperation>(std::move(left), op,
+                                                   std::move(right)));
   }
 
   return left;
@@ -137,8 +267,8 @@ std::unique_ptr<ASTNode> Parser::parse_multiplicative() {
     TokenType op = peek().type;
     consume(op);
     auto right = parse_unary();
-    left = std::make_unique<BinaryOperation>(std::move(left), op,
-                                             std::move(right));
+    left = typed(std::make_unique<BinaryOperation>(std::move(left), op,
+                                                   std::move(right)));
   }
 
   return left;
@@ -150,14 +280,19 @@ std::unique_ptr<ASTNode> Parser::parse_unary() {
     TokenType op = consume(TokenType::Minus).type;
     auto operand =
         parse_unary();  // Recursively parse unary for things like --5
-    return std::make_unique<UnaryOperation>(op, std::move(operand));
+    return typed(std::make_unique<UnaryOperation>(op, std::move(operand)));
   }
 
-  // Handle borrow operator (&)
+  // Handle borrow operator (&), or &mut for a mutable borrow
   if (match(TokenType::Borrow)) {
     TokenType op = consume(TokenType::Borrow).type;
+    bool is_mutable = match(TokenType::Identifier) && peek().value == "mut" &&
+                      current_ + 1 < tokens_.size() &&
+                      tokens_[current_ + 1].type == TokenType::Identifier;
+    if (is_mutable) consume(TokenType::Identifier);
     auto operand = parse_unary();
-    return std::make_unique<UnaryOperation>(op, std::move(operand));
+    return typed(
+        std::make_unique<UnaryOperation>(op, std::move(operand), is_mutable));
   }
 
   return parse_primary();
@@ -166,22 +301,22 @@ std::unique_ptr<ASTNode> Parser::parse_unary() {
 std::unique_ptr<ASTNode> Parser::parse_primary() {
   if (match(TokenType::Number)) {
     int value = std::stoi(consume(TokenType::Number).value);
-    return std::make_unique<NumberLiteral>(value);
+    return typed(std::make_unique<NumberLiteral>(value));
   }
 
   if (match(TokenType::StringLiteral)) {
     std::string value = consume(TokenType::StringLiteral).value;
-    return std::make_unique<StringLiteral>(value);
+    return typed(std::make_unique<StringLiteral>(value));
   }
 
   if (match(TokenType::True)) {
     consume(TokenType::True);
-    return std::make_unique<BooleanLiteral>(true);
+    return typed(std::make_unique<BooleanLiteral>(true));
   }
 
   if (match(TokenType::False)) {
     consume(TokenType::False);
-    return std::make_unique<BooleanLiteral>(false);
+    return typed(std::make_unique<BooleanLiteral>(false));
   }
 
   if (match(TokenType::LParen)) {
@@ -191,14 +326,28 @@ std::unique_ptr<ASTNode> Parser::parse_primary() {
     return expr;
   }
 
+  // Array literal: [a, b, c]
+  if (match(TokenType::LBracket)) {
+    consume(TokenType::LBracket);
+    std::vector<std::unique_ptr<ASTNode>> elements;
+    if (!match(TokenType::RBracket)) {
+      do {
+        elements.push_back(parse_expression());
+      } while (match(TokenType::Comma) && (consume(TokenType::Comma), true));
+    }
+    consume(TokenType::RBracket);
+    return typed(std::make_unique<ArrayLiteral>(std::move(elements)));
+  }
+
   // Parse anonymous functions
   if (match(TokenType::Fn)) {
-    return parse_anonymous_function();
+    return typed(parse_anonymous_function());
   }
 
   // Parse function calls and variable references
   if (match(TokenType::Identifier)) {
-    std::string name = consume(TokenType::Identifier).value;
+    Token name_token = consume(TokenType::Identifier);
+    std::string name = name_token.value;
 
     // Check for member access (e.g., fmt.println) or explicit dereference (.*)
     if (match(TokenType::Dot)) {
@@ -219,19 +368,23 @@ std::unique_ptr<ASTNode> Parser::parse_primary() {
         }
 
         consume(TokenType::RParen);
-        return std::make_unique<MemberAccess>(name, member_name,
-                                              std::move(arguments));
+        body_calls_.push_back(name_token);
+        return typed(std::make_unique<MemberAccess>(name, member_name,
+                                                    std::move(arguments)));
       }
 
-      throw ParseError("Expected function call after member access", peek());
+      // Struct field: point.x, or line.start.x
+      return parse_fields(typed(std::make_unique<FieldAccess>(
+          typed(std::make_unique<VariableReference>(name)),
+          std::move(member_name))));
     }
 
     // Check for explicit dereference (.*)
     if (match(TokenType::DotStar)) {
       consume(TokenType::DotStar);
-      auto variable_ref = std::make_unique<VariableReference>(name);
-      return std::make_unique<UnaryOperation>(TokenType::DotStar,
-                                              std::move(variable_ref));
+      auto variable_ref = typed(std::make_unique<VariableReference>(name));
+      return typed(std::make_unique<UnaryOperation>(TokenType::DotStar,
+                                                    std::move(variable_ref)));
     }
 
     if (match(TokenType::LParen)) {
@@ -246,16 +399,36 @@ std::unique_ptr<ASTNode> Parser::parse_primary() {
       }
 
       consume(TokenType::RParen);
-      return std::make_unique<FunctionCall>(name, std::move(arguments));
+      body_calls_.push_back(name_token);
+      return typed(std::make_unique<FunctionCall>(name, std::move(arguments)));
+    }
+    // Array element: name[index]
+    if (match(TokenType::LBracket)) {
+      consume(TokenType::LBracket);
+      auto index = parse_expression();
+      consume(TokenType::RBracket);
+      return parse_fields(
+          typed(std::make_unique<IndexExpression>(name, std::move(index))));
+    }
+
+    // It's a variable reference, or a function used as a value
+    if (function_return_types_.contains(name)) {
+      body_function_values_.push_back(name_token);
     }
-    // It's a variable reference
-    return std::make_unique<VariableReference>(name);
+    return typed(std::make_unique<VariableReference>(name));
   }
 
   throw ParseError("Expected expression", peek());
 }
 
 std::unique_ptr<ASTNode> Parser::parse_statement() {
+  SourceLocation location = start_of(peek());
+  auto statement = parse_unlocated_statement();
+  statement->set_location(location);
+  return statement;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_unlocated_statement() {
   if (match(TokenType::Return)) {
     consume(TokenType::Return);
     // Check if we're at the end of a statement (return without expression)
@@ -266,10 +439,24 @@ std::unique_ptr<ASTNode> Parser::parse_statement() {
         match(TokenType::If) ||      // Next statement (if statement)
         match(TokenType::Loop) ||    // Next statement (loop statement)
         match(TokenType::Return) ||  // Next statement (another return)
+        at_match_statement() ||      // Next statement (match statement)
         match(TokenType::Const)) {   // Next declaration (function declaration)
       // Return without expression for void functions
       return std::make_unique<ReturnStatement>(nullptr);
     }
+    // return musttail f(...), where "musttail" is only a keyword before a
+    // call
+    if (peek().value == "musttail" && current_ + 2 < tokens_.size() &&
+        tokens_[current_ + 1].type == TokenType::Identifier &&
+        tokens_[current_ + 2].type == TokenType::LParen) {
+      Token annotation = consume(TokenType::Identifier);
+      auto expr = parse_expression();
+      if (dynamic_cast<const FunctionCall*>(expr.get()) == nullptr) {
+        throw ParseError("'return musttail' needs a function call", annotation);
+      }
+      return std::make_unique<ReturnStatement>(std::move(expr),
+                                               /*must_tail=*/true);
+    }
     auto expr = parse_expression();
     return std::make_unique<ReturnStatement>(std::move(expr));
   }
@@ -282,6 +469,10 @@ std::unique_ptr<ASTNode> Parser::parse_statement() {
     return parse_loop_statement();
   }
 
+  if (at_match_statement()) {
+    return parse_match_statement();
+  }
+
   // Check for variable declaration with explicit type: identifier : type =
   // value
   if (match(TokenType::Identifier) && current_ + 1 < tokens_.size() &&
@@ -301,6 +492,50 @@ std::unique_ptr<ASTNode> Parser::parse_statement() {
     return parse_variable_assignment();
   }
 
+  // Check for array element assignment: identifier[index] = value
+  if (match(TokenType::Identifier) && current_ + 1 < tokens_.size() &&
+      tokens_[current_ + 1].type == TokenType::LBracket) {
+    std::string name = consume(TokenType::Identifier).value;
+    consume(TokenType::LBracket);
+    auto index = parse_expression();
+    consume(TokenType::RBracket);
+    if (match(TokenType::Dot)) {
+      // A field of an array element: points[i].x = value
+      return parse_field_assignment(
+          typed(std::make_unique<IndexExpression>(name, std::move(index))));
+    }
+    consume(TokenType::Equals);
+    auto value = parse_expression();
+    return std::make_unique<IndexAssignment>(std::move(name), std::move(index),
+                                             std::move(value));
+  }
+
+  // Check for a write through a pointer: identifier.* = value
+  if (match(TokenType::Identifier) && current_ + 2 < tokens_.size() &&
+      tokens_[current_ + 1].type == TokenType::DotStar &&
+      tokens_[current_ + 2].type == TokenType::Equals) {
+    std::string name = consume(TokenType::Identifier).value;
+    consume(TokenType::DotStar);
+    consume(TokenType::Equals);
+    return std::make_unique<DereferenceAssignment>(std::move(name),
+                                                   parse_expression());
+  }
+
+  // Check for field assignment: identifier.field = value, or a.b.c = value
+  if (match(TokenType::Identifier) && current_ + 1 < tokens_.size() &&
+      tokens_[current_ + 1].type == TokenType::Dot) {
+    size_t next = current_ + 1;
+    while (next + 1 < tokens_.size() && tokens_[next].type == TokenType::Dot &&
+           tokens_[next + 1].type == TokenType::Identifier) {
+      next += 2;
+    }
+    if (next < tokens_.size() && tokens_[next].type == TokenType::Equals) {
+      std::string name = consume(TokenType::Identifier).value;
+      return parse_field_assignment(
+          typed(std::make_unique<VariableReference>(name)));
+    }
+  }
+
   // Check for member access: identifier . member(...)
   if (match(TokenType::Identifier) && current_ + 1 < tokens_.size() &&
       tokens_[current_ + 1].type == TokenType::Dot) {
@@ -329,12 +564,35 @@ std::unique_ptr<VariableDeclaration> Parser::parse_variable_declaration() {
     consume(TokenType::ColonEquals);
     value = parse_expression();
     type = infer_type(value.get());
+    // Only parameters hold borrows, so p := &x makes a pointer
+    if (auto borrow = BorrowType::parse(type)) type = "*" + borrow->pointee;
   } else {
     // Explicit type: name: type = value
     consume(TokenType::Colon);
     type = parse_type();
-    consume(TokenType::Equals);
-    value = parse_expression();
+    if (type.starts_with("[") && !match(TokenType::Equals)) {
+      // An array without a value starts out zeroed
+      value = typed(std::make_unique<ArrayLiteral>(
+          std::vector<std::unique_ptr<ASTNode>>{}));
+    } else if (struct_names_.contains(type) && !match(TokenType::Equals)) {
+      // So does a struct, as if built by Point()
+      value = typed(std::make_unique<FunctionCall>(
+          type, std::vector<std::unique_ptr<ASTNode>>{}));
+    } else {
+      consume(TokenType::Equals);
+      value = parse_expression();
+    }
+
+    // [_]T takes its length from the literal
+    if (type.starts_with("[_]")) {
+      const auto* literal = dynamic_cast<const ArrayLiteral*>(value.get());
+      if (literal == nullptr || literal->elements().empty()) {
+        throw ParseError("'" + name +
+                         "' needs an array literal to infer its length");
+      }
+      type = "[" + std::to_string(literal->elements().size()) + "]" +
+             type.substr(3);
+    }
   }
 
   // Add variable to symbol table
@@ -358,6 +616,27 @@ std::unique_ptr<VariableAssignment> Parser::parse_variable_assignment() {
 
 std::unique_ptr<IfStatement> Parser::parse_if_statement() {
   consume(TokenType::If);
+
+  // "likely" and "unlikely" are only keywords right before a condition, so
+  // `if likely {` still reads a variable and `if likely(x)` calls a function
+  BranchHint hint = BranchHint::None;
+  if (match(TokenType::Identifier) &&
+      (peek().value == "likely" || peek().value == "unlikely") &&
+      current_ + 1 < tokens_.size()) {
+    switch (tokens_[current_ + 1].type) {
+      case TokenType::Identifier:
+      case TokenType::Number:
+      case TokenType::Not:
+      case TokenType::True:
+      case TokenType::False:
+        hint = consume(TokenType::Identifier).value == "likely"
+                   ? BranchHint::Likely
+                   : BranchHint::Unlikely;
+        break;
+      default:
+        break;
+    }
+  }
   auto condition = parse_expression();
 
   // Parse then body - check for 'do' or block syntax
@@ -399,8 +678,145 @@ std::unique_ptr<IfStatement> Parser::parse_if_statement() {
     }
   }
 
-  return std::make_unique<IfStatement>(
-      std::move(condition), std::move(then_body), std::move(else_body));
+  return std::make_unique<IfStatement>(std::move(condition),
+                                       std::move(then_body),
+                                       std::move(else_body), hint);
+}
+
+// "match" is only a keyword at the start of a statement, followed by the
+// value rather than by what makes it a variable or a call: match x { ... }
+// and match (x) { ... }, but not match = 1 or match(x)
+bool Parser::at_match_statement() const {
+  if (current_ + 1 >= tokens_.size() ||
+      tokens_[current_].type != TokenType::Identifier ||
+      tokens_[current_].value != "match") {
+    return false;
+  }
+  switch (tokens_[current_ + 1].type) {
+    case TokenType::Identifier:
+    case TokenType::Number:
+    case TokenType::Minus:
+    case TokenType::Not:
+    case TokenType::True:
+    case TokenType::False:
+      return true;
+    case TokenType::LParen: {
+      size_t depth = 0;
+      for (size_t i = current_ + 1; i + 1 < tokens_.size(); ++i) {
+        if (tokens_[i].type == TokenType::LParen) depth++;
+        if (tokens_[i].type == TokenType::RParen && --depth == 0) {
+          return tokens_[i + 1].type == TokenType::LBrace;
+        }
+      }
+      return false;
+    }
+    default:
+      return false;
+  }
+}
+
+std::vector<std::unique_ptr<ASTNode>> Parser::parse_body() {
+  std::vector<std::unique_ptr<ASTNode>> body;
+  if (match(TokenType::Do)) {
+    consume(TokenType::Do);
+    body.push_back(parse_statement());
+    return body;
+  }
+  consume(TokenType::LBrace);
+  while (!match(TokenType::RBrace)) {
+    body.push_back(parse_statement());
+  }
+  consume(TokenType::RBrace);
+  return body;
+}
+
+// match value {
+//   0 do ...                 one value
+//   1, 5..8 { ... }          several, with ranges excluding their end like
+//                            loop ranges
+//   else do ...              optional, for every other value
+// }
+std::unique_ptr<MatchStatement> Parser::parse_match_statement() {
+  Token keyword = consume(TokenType::Identifier);
+  auto value = parse_expression();
+  // Values only typed during code generation, like mixed width arithmetic,
+  // get any i64 pattern; code generation then checks they fit
+  const std::string& type =
+      value->inferred_type().empty() ? "i64" : value->inferred_type();
+  auto bounds = match_bounds(type);
+  if (!bounds) {
+    throw ParseError("match needs an integer or bool value, not " + type,
+                     keyword);
+  }
+
+  // A pattern value: a possibly negative integer, or true or false
+  auto parse_pattern_value = [&]() -> int64_t {
+    Token token = peek();
+    if (type == "bool") {
+      if (match(TokenType::True) || match(TokenType::False)) {
+        return consume(token.type).type == TokenType::True ? 1 : 0;
+      }
+      throw ParseError("Expected true or false, got: " + token.value, token);
+    }
+    bool negative = match(TokenType::Minus);
+    if (negative) consume(TokenType::Minus);
+    Token number = consume(TokenType::Number);
+    int64_t result = std::stoll(number.value);
+    return negative ? -result : result;
+  };
+
+  std::vector<MatchArm> arms;
+  std::vector<std::unique_ptr<ASTNode>> else_body;
+  // Every arm's ranges with the token they start at, to report overlaps
+  std::vector<std::tuple<int64_t, int64_t, Token>> covered;
+  consume(TokenType::LBrace);
+  while (!match(TokenType::RBrace)) {
+    if (match(TokenType::Else)) {
+      consume(TokenType::Else);
+      else_body = parse_body();
+      if (!match(TokenType::RBrace)) {
+        throw ParseError("The else arm of a match must come last", peek());
+      }
+      break;
+    }
+
+    MatchArm arm;
+    while (true) {
+      Token start = peek();
+      int64_t low = parse_pattern_value();
+      int64_t high = low;
+      if (match(TokenType::DotDot)) {
+        consume(TokenType::DotDot);
+        high = parse_pattern_value() - 1;
+        if (high < low) throw ParseError("Empty match range", start);
+      }
+      if (low < bounds->first || high > bounds->second) {
+        throw ParseError("Match pattern doesn't fit in " + type, start);
+      }
+      arm.ranges.emplace_back(low, high);
+      covered.emplace_back(low, high, start);
+      if (!match(TokenType::Comma)) break;
+      consume(TokenType::Comma);
+    }
+    arm.body = parse_body();
+    arms.push_back(std::move(arm));
+  }
+  consume(TokenType::RBrace);
+
+  std::ranges::sort(covered, {}, [](const auto& range) {
+    return std::get<0>(range);
+  });
+  for (size_t i = 1; i < covered.size(); ++i) {
+    if (std::get<0>(covered[i]) <= std::get<1>(covered[i - 1])) {
+      throw ParseError("Match pattern overlaps an earlier one: " +
+                           std::to_string(std::get<0>(covered[i])) +
+                           " is already covered",
+                       std::get<2>(covered[i]));
+    }
+  }
+
+  return std::make_unique<MatchStatement>(std::move(value), std::move(arms),
+                                          std::move(else_body));
 }
 
 std::unique_ptr<ImportStatement> Parser::parse_import() {
@@ -409,10 +825,155 @@ std::unique_ptr<ImportStatement> Parser::parse_import() {
   return std::make_unique<ImportStatement>(std::move(module_name));
 }
 
-std::unique_ptr<FunctionDeclaration> Parser::parse_function() {
+bool Parser::at_struct_declaration(size_t position) const {
+  if (position + 3 >= tokens_.size() ||
+      tokens_[position].type != TokenType::Const ||
+      tokens_[position + 1].type != TokenType::Identifier ||
+      tokens_[position + 2].type != TokenType::Equals) {
+    return false;
+  }
+  for (size_t i = position + 3; i < tokens_.size(); ++i) {
+    if (tokens_[i].type != TokenType::Identifier) return false;
+    if (tokens_[i].value == "struct") return true;
+    if (tokens_[i].value != "packed" && tokens_[i].value != "soa") {
+      return false;
+    }
+  }
+  return false;
+}
+
+// const Name = [packed] [soa] struct [align(N)] { field: type, ... }
+//
+// "struct" and the annotations are only keywords here, so they stay usable
+// as names elsewhere
+std::unique_ptr<StructDeclaration> Parser::parse_struct_declaration() {
   consume(TokenType::Const);
+  Token name = consume(TokenType::Identifier);
+  consume(TokenType::Equals);
+
+  StructLayout layout;
+  while (peek().value != "struct") {
+    Token annotation = consume(TokenType::Identifier);
+    if (annotation.value == "packed") {
+      layout.packed = true;
+    } else {
+      layout.soa = true;
+    }
+  }
+  consume(TokenType::Identifier);
+
+  if (match(TokenType::Identifier) && peek().value == "align") {
+    consume(TokenType::Identifier);
+    consume(TokenType::LParen);
+    Token alignment = consume(TokenType::Number);
+    consume(TokenType::RParen);
+    layout.alignment = std::stoull(alignment.value);
+    if (layout.alignment == 0 ||
+        (layout.alignment & (layout.alignment - 1)) != 0) {
+      throw ParseError("Struct alignment must be a power of two", alignment);
+    }
+  }
+  if (layout.soa && (layout.packed || layout.alignment != 0)) {
+    throw ParseError("A soa struct can't also be packed or aligned", name);
+  }
+
+  std::vector<StructField> fields;
+  consume(TokenType::LBrace);
+  while (!match(TokenType::RBrace)) {
+    Token field = consume(TokenType::Identifier);
+    consume(TokenType::Colon);
+    for (const auto& other : fields) {
+      if (other.name == field.value) {
+        throw ParseError("Duplicate field '" + field.value + "'", field);
+      }
+    }
+    fields.push_back({.name = field.value, .type = parse_type()});
+    if (!match(TokenType::Comma)) break;
+    consume(TokenType::Comma);
+  }
+  consume(TokenType::RBrace);
+  if (fields.empty()) {
+    throw ParseError("Struct '" + name.value + "' needs at least one field",
+                     name);
+  }
+
+  auto declaration = std::make_unique<StructDeclaration>(
+      name.value, std::move(fields), layout);
+  structs_[name.value] = declaration.get();
+  return declaration;
+}
+
+std::unique_ptr<ASTNode> Parser::parse_fields(std::unique_ptr<ASTNode> object) {
+  while (match(TokenType::Dot)) {
+    consume(TokenType::Dot);
+    std::string field = consume(TokenType::Identifier).value;
+    object = typed(
+        std::make_unique<FieldAccess>(std::move(object), std::move(field)));
+  }
+  return object;
+}
+
+std::unique_ptr<FieldAssignment> Parser::parse_field_assignment(
+    std::unique_ptr<ASTNode> object) {
+  consume(TokenType::Dot);
+  std::string field = consume(TokenType::Identifier).value;
+  while (match(TokenType::Dot)) {
+    object = typed(
+        std::make_unique<FieldAccess>(std::move(object), std::move(field)));
+    consume(TokenType::Dot);
+    field = consume(TokenType::Identifier).value;
+  }
+  consume(TokenType::Equals);
+  return std::make_unique<FieldAssignment>(std::move(object), std::move(field),
+                                           parse_expression());
+}
+
+// const name = [annotations] fn(params) [-> type]
+//
+// where the annotations are overflow(wrap|undefined|trap), inline, noinline,
+// hot, cold and pure, in any order. Like struct annotations, they are only
+// keywords here.
+std::unique_ptr<FunctionDeclaration> Parser::parse_function_signature() {
+  Token start = consume(TokenType::Const);
   std::string name = consume(TokenType::Identifier).value;
   consume(TokenType::Equals);
+
+  std::optional<OverflowMode> overflow_mode;
+  FunctionHints hints;
+  while (match(TokenType::Identifier)) {
+    Token annotation = consume(TokenType::Identifier);
+    if (annotation.value == "overflow") {
+      consume(TokenType::LParen);
+      Token mode = consume(TokenType::Identifier);
+      consume(TokenType::RParen);
+      overflow_mode = parse_overflow_mode(mode.value);
+      if (!overflow_mode) {
+        throw ParseError("Unknown overflow mode '" + mode.value +
+                             "', expected wrap, undefined or trap",
+                         mode);
+      }
+    } else if (annotation.value == "inline") {
+      hints.always_inline = true;
+    } else if (annotation.value == "noinline") {
+      hints.never_inline = true;
+    } else if (annotation.value == "hot") {
+      hints.hot = true;
+    } else if (annotation.value == "cold") {
+      hints.cold = true;
+    } else if (annotation.value == "pure") {
+      hints.pure = true;
+    } else {
+      throw ParseError("Unknown function annotation '" + annotation.value + "'",
+                       annotation);
+    }
+    if (hints.always_inline && hints.never_inline) {
+      throw ParseError("A function can't be both inline and noinline",
+                       annotation);
+    }
+    if (hints.hot && hints.cold) {
+      throw ParseError("A function can't be both hot and cold", annotation);
+    }
+  }
   consume(TokenType::Fn);
   consume(TokenType::LParen);
 
@@ -420,10 +981,19 @@ std::unique_ptr<FunctionDeclaration> Parser::parse_function() {
   std::vector<std::unique_ptr<Parameter>> parameters;
   if (!match(TokenType::RParen)) {
     do {
-      std::string param_name = consume(TokenType::Identifier).value;
+      Token param_name = consume(TokenType::Identifier);
       consume(TokenType::Colon);
       std::string param_type = parse_type();
-      parameters.push_back(std::make_unique<Parameter>(param_name, param_type));
+      // Its result could then depend on memory, or on what the function does
+      if (hints.pure &&
+          (param_type.starts_with("*") || param_type.starts_with("&") ||
+           param_type.starts_with("fn("))) {
+        throw ParseError("Pure function '" + name + "' can't take a " +
+                             param_type + " parameter",
+                         param_name);
+      }
+      parameters.push_back(
+          std::make_unique<Parameter>(param_name.value, param_type));
     } while (match(TokenType::Comma) && (consume(TokenType::Comma), true));
   }
 
@@ -439,6 +1009,10 @@ std::unique_ptr<FunctionDeclaration> Parser::parse_function() {
 
   // Create function with return type
   auto func = std::make_unique<FunctionDeclaration>(name, return_type);
+  func->set_location(start_of(start));
+  if (overflow_mode) func->set_overflow_mode(*overflow_mode);
+  func->set_hints(hints);
+  if (hints.pure) pure_functions_.insert(name);
 
   // Add function to symbol table
   function_return_types_[name] = return_type;
@@ -448,6 +1022,16 @@ std::unique_ptr<FunctionDeclaration> Parser::parse_function() {
     func->add_parameter(std::move(param));
   }
 
+  return func;
+}
+
+void Parser::parse_function_body(FunctionDeclaration* func) {
+  body_calls_.clear();
+  body_function_values_.clear();
+  for (const auto& param : func->parameters()) {
+    variable_types_[param->name()] = param->type();
+  }
+
   // Parse function body - check for 'do' or block syntax
   if (match(TokenType::Do)) {
     consume(TokenType::Do);
@@ -462,7 +1046,74 @@ std::unique_ptr<FunctionDeclaration> Parser::parse_function() {
     consume(TokenType::RBrace);
   }
 
-  return func;
+  if (!func->hints().pure) return;
+  for (const Token& call : body_calls_) {
+    if (call.value == "fmt") {
+      throw ParseError("Pure function '" + func->name() + "' can't print",
+                       call);
+    }
+    if (function_return_types_.contains(call.value) &&
+        !pure_functions_.contains(call.value)) {
+      throw ParseError("Pure function '" + func->name() + "' calls '" +
+                           call.value + "', which isn't pure",
+                       call);
+    }
+    // Calls through a function pointer could reach anything
+    auto var = variable_types_.find(call.value);
+    if (var != variable_types_.end() && var->second.starts_with("fn(")) {
+      throw ParseError("Pure function '" + func->name() +
+                           "' calls through the function pointer '" +
+                           call.value + "'",
+                       call);
+    }
+  }
+  for (const Token& value : body_function_values_) {
+    if (!pure_functions_.contains(value.value)) {
+      throw ParseError("Pure function '" + func->name() + "' uses '" +
+                           value.value + "', which isn't pure, as a value",
+                       value);
+    }
+  }
+}
+
+size_t Parser::skip_function_body() {
+  if (match(TokenType::LBrace)) {
+    Token open = consume(TokenType::LBrace);
+    size_t depth = 1;
+    while (depth > 0) {
+      if (match(TokenType::EndOfFile)) {
+        throw ParseError("Unterminated function body", open);
+      }
+      if (match(TokenType::LBrace)) depth++;
+      if (match(TokenType::RBrace)) depth--;
+      current_++;
+    }
+    return current_;
+  }
+
+  // A 'do' body is a single statement, which runs until the next top-level
+  // declaration. 'const' followed by a name starts a declaration, whereas
+  // 'const string' is a type inside the body.
+  consume(TokenType::Do);
+  size_t depth = 0;
+  while (!match(TokenType::EndOfFile)) {
+    if (depth == 0 &&
+        (match(TokenType::Import) ||
+         (match(TokenType::Const) && current_ + 1 < tokens_.size() &&
+          tokens_[current_ + 1].type == TokenType::Identifier))) {
+      break;
+    }
+    if (match(TokenType::LBrace) || match(TokenType::LParen) ||
+        match(TokenType::LBracket)) {
+      depth++;
+    } else if ((match(TokenType::RBrace) || match(TokenType::RParen) ||
+                match(TokenType::RBracket)) &&
+               depth > 0) {
+      depth--;
+    }
+    current_++;
+  }
+  return current_;
 }
 
 std::unique_ptr<LoopStatement> Parser::parse_loop_statement() {
@@ -490,10 +1141,31 @@ std::unique_ptr<LoopStatement> Parser::parse_loop_statement() {
                                            std::move(body));
   }
 
-  // Otherwise it's a range loop: loop i in 0..10 { ... }
+  // Otherwise it's a range loop: loop i in 0..10 { ... }. "par" is only a
+  // keyword right before the loop variable, so it stays usable as a name.
+  bool parallel = false;
+  if (peek().type == TokenType::Identifier && peek().value == "par" &&
+      current_ + 1 < tokens_.size() &&
+      tokens_[current_ + 1].type == TokenType::Identifier) {
+    consume(TokenType::Identifier);
+    parallel = true;
+  }
   std::string variable_name = consume(TokenType::Identifier).value;
   consume(TokenType::In);
-  auto range = parse_range_expression();
+
+  // A range, or an array whose elements are visited in turn
+  std::unique_ptr<ASTNode> range;
+  auto start = parse_additive();
+  if (match(TokenType::DotDot)) {
+    consume(TokenType::DotDot);
+    range = typed(std::make_unique<RangeExpression>(std::move(start),
+                                                    parse_additive()));
+    variable_types_[variable_name] = range->inferred_type();
+  } else {
+    auto array = ArrayType::parse(borrowed_type(start->inferred_type()));
+    if (array) variable_types_[variable_name] = array->element_type;
+    range = std::move(start);
+  }
 
   std::vector<std::unique_ptr<ASTNode>> body;
   if (match(TokenType::Do)) {
@@ -509,15 +1181,7 @@ std::unique_ptr<LoopStatement> Parser::parse_loop_statement() {
   }
 
   return std::make_unique<LoopStatement>(variable_name, std::move(range),
-                                         std::move(body));
-}
-
-std::unique_ptr<RangeExpression> Parser::parse_range_expression() {
-  auto start = parse_additive();  // Parse the start expression
-  consume(TokenType::DotDot);
-  auto end = parse_additive();  // Parse the end expression
-
-  return std::make_unique<RangeExpression>(std::move(start), std::move(end));
+                                         std::move(body), parallel);
 }
 
 std::string Parser::parse_type() {
@@ -566,6 +1230,32 @@ std::string Parser::parse_type() {
   } else if (tokens_[current_].type == TokenType::String) {
     current_++;
     return "string";
+  } else if (tokens_[current_].type == TokenType::LBracket) {
+    // Array types: [4]i32, or [_]i32 with the length taken from the value
+    current_++;
+    std::string length;
+    if (match(TokenType::Number)) {
+      length = consume(TokenType::Number).value;
+    } else if (match(TokenType::Identifier) && peek().value == "_") {
+      length = consume(TokenType::Identifier).value;
+    } else {
+      throw ParseError("Expected array length", peek());
+    }
+    consume(TokenType::RBracket);
+    return "[" + length + "]" + parse_type();
+  } else if (tokens_[current_].type == TokenType::Identifier &&
+             VectorType::parse(tokens_[current_].value)) {
+    return tokens_[current_++].value;  // SIMD vectors: v8i32, v16u8, ...
+  } else if (tokens_[current_].type == TokenType::Identifier &&
+             struct_names_.contains(tokens_[current_].value)) {
+    return tokens_[current_++].value;
+  } else if (tokens_[current_].type == TokenType::Borrow) {  // &T, &mut T
+    current_++;
+    bool is_mutable = tokens_[current_].type == TokenType::Identifier &&
+                      tokens_[current_].value == "mut";
+    if (is_mutable) current_++;
+    return BorrowType{.is_mutable = is_mutable, .pointee = parse_type()}
+        .to_string();
   } else if (tokens_[current_].type == TokenType::Asterisk) {  // pointer types
     current_++;
     std::string base_type = parse_type();
@@ -591,7 +1281,7 @@ std::string Parser::parse_type() {
 }
 
 std::unique_ptr<AnonymousFunction> Parser::parse_anonymous_function() {
-  consume(TokenType::Fn);
+  Token start = consume(TokenType::Fn);
   consume(TokenType::LParen);
 
   // Parse parameters first, store them temporarily
@@ -617,9 +1307,17 @@ std::unique_ptr<AnonymousFunction> Parser::parse_anonymous_function() {
 
   // Create anonymous function with return type
   auto func = std::make_unique<AnonymousFunction>(return_type);
+  func->set_location(start_of(start));
 
-  // Add all parameters
+  // Parameters shadow any outer variables of the same name inside the body
+  std::vector<std::pair<std::string, std::optional<std::string>>> shadowed;
   for (auto& param : parameters) {
+    auto it = variable_types_.find(param->name());
+    shadowed.emplace_back(param->name(),
+                          it != variable_types_.end()
+                              ? std::optional<std::string>(it->second)
+                              : std::nullopt);
+    variable_types_[param->name()] = param->type();
     func->add_parameter(std::move(param));
   }
 
@@ -637,10 +1335,226 @@ std::unique_ptr<AnonymousFunction> Parser::parse_anonymous_function() {
     consume(TokenType::RBrace);
   }
 
+  for (auto it = shadowed.rbegin(); it != shadowed.rend(); ++it) {
+    if (it->second) {
+      variable_types_[it->first] = *it->second;
+    } else {
+      variable_types_.erase(it->first);
+    }
+  }
+
   return func;
 }
 
+template <typename Node>
+std::unique_ptr<Node> Parser::typed(std::unique_ptr<Node> node) {
+  node->set_inferred_type(compute_type(node.get()));
+  return node;
+}
+
+std::string Parser::compute_type(const ASTNode* node) const {
+  if (dynamic_cast<const NumberLiteral*>(node)) return "i32";
+  if (dynamic_cast<const StringLiteral*>(node)) return "const string";
+  if (dynamic_cast<const BooleanLiteral*>(node)) return "bool";
+
+  if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
+    std::vector<std::string> param_types;
+    for (const auto& param : anon_func->parameters()) {
+      param_types.push_back(param->type());
+    }
+    return "fn(" + join(param_types, ", ") + ") -> " + anon_func->return_type();
+  }
+
+  if (const auto* var_ref = dynamic_cast<const VariableReference*>(node)) {
+    auto it = variable_types_.find(var_ref->name());
+    return it != variable_types_.end() ? it->second : "";
+  }
+
+  if (const auto* bin_op = dynamic_cast<const BinaryOperation*>(node)) {
+    const std::string& left_type = bin_op->left()->inferred_type();
+    const std::string& right_type = bin_op->right()->inferred_type();
+    if (left_type.empty() || right_type.empty()) return "";
+
+    TokenType op = bin_op->operator_type();
+    bool arithmetic = op == TokenType::Plus || op == TokenType::Minus ||
+                      op == TokenType::Asterisk || op == TokenType::Divide;
+    bool comparison =
+        op == TokenType::EqualEqual || op == TokenType::NotEqual ||
+        op == TokenType::LessThan || op == TokenType::LessEqual ||
+        op == TokenType::GreaterThan || op == TokenType::GreaterEqual;
+
+    // Vectors work lane by lane, with a scalar operand used in every lane.
+    // Comparisons give a mask, which and/or combine.
+    auto left_vector = VectorType::parse(left_type);
+    auto right_vector = VectorType::parse(right_type);
+    if (left_vector || right_vector) {
+      const VectorType& vector = left_vector ? *left_vector : *right_vector;
+      const std::string& other = left_vector ? right_type : left_type;
+      bool scalar = other == "i8" || other == "i16" || other == "i32" ||
+                    other == "i64" || other == "u8" || other == "u16" ||
+                    other == "u32" || other == "u64";
+      if (other != vector.to_string() && (!scalar || vector.is_mask())) {
+        return "";
+      }
+      if (arithmetic && !vector.is_mask()) return vector.to_string();
+      if (comparison) {
+        return VectorType{.lanes = vector.lanes, .element_type = "bool"}
+            .to_string();
+      }
+      if ((op == TokenType::And || op == TokenType::Or) && vector.is_mask()) {
+        return vector.to_string();
+      }
+      return "";
+    }
+
+    if (arithmetic) {
+      if (left_type == "i32" && right_type == "i32") return "i32";
+      if (op == TokenType::Plus && left_type == "const string" &&
+          right_type == "const string") {
+        return "const string";
+      }
+      return "";
+    }
+    if (comparison) return left_type == right_type ? "bool" : "";
+    if (op == TokenType::And || op == TokenType::Or) {
+      return left_type == "bool" && right_type == "bool" ? "bool" : "";
+    }
+    return "";
+  }
+
+  if (const auto* unary_op = dynamic_cast<const UnaryOperation*>(node)) {
+    const std::string& operand_type = unary_op->operand()->inferred_type();
+    if (operand_type.empty()) return "";
+    if (unary_op->operator_type() == TokenType::Minus) return operand_type;
+    if (unary_op->operator_type() == TokenType::Not) {
+      auto vector = VectorType::parse(operand_type);
+      return vector && vector->is_mask() ? operand_type : "bool";
+    }
+    if (unary_op->operator_type() == TokenType::Borrow) {
+      return BorrowType{.is_mutable = unary_op->is_mutable(),
+                        .pointee = operand_type}
+          .to_string();
+    }
+    if (unary_op->operator_type() == TokenType::DotStar) {
+      return pointee_type(operand_type).value_or("");
+    }
+    return "";
+  }
+
+  // A range counts in the wider of its bounds' types, the end's if they are
+  // as wide. Literals fit any counter, so they only make it i32 on their own.
+  if (const auto* range = dynamic_cast<const RangeExpression*>(node)) {
+    auto bits = [](const ASTNode* bound) -> int {
+      if (dynamic_cast<const NumberLiteral*>(bound)) return 0;
+      const std::string& type = bound->inferred_type();
+      if (type == "i8" || type == "u8") return 8;
+      if (type == "i16" || type == "u16") return 16;
+      if (type == "i32" || type == "u32") return 32;
+      if (type == "i64" || type == "u64") return 64;
+      return 0;
+    };
+    int start_bits = bits(range->start());
+    int end_bits = bits(range->end());
+    if (start_bits == 0 && end_bits == 0) return "i32";
+    return start_bits > end_bits ? range->start()->inferred_type()
+                                 : range->end()->inferred_type();
+  }
+
+  // [a, b] is [2]T when every element has type T
+  if (const auto* literal = dynamic_cast<const ArrayLiteral*>(node)) {
+    if (literal->elements().empty()) return "";
+    const std::string& element_type =
+        literal->elements().front()->inferred_type();
+    for (const auto& element : literal->elements()) {
+      if (element->inferred_type() != element_type) return "";
+    }
+    if (element_type.empty()) return "";
+    return ArrayType{.length = literal->elements().size(),
+                     .element_type = element_type}
+        .to_string();
+  }
+
+  // An array element or a vector lane
+  if (const auto* index = dynamic_cast<const IndexExpression*>(node)) {
+    auto it = variable_types_.find(index->array_name());
+    if (it == variable_types_.end()) return "";
+    if (auto vector = VectorType::parse(it->second)) {
+      return vector->element_type;
+    }
+    auto array = ArrayType::parse(borrowed_type(it->second));
+    return array ? array->element_type : "";
+  }
+
+  // A field of a struct, or of the struct a pointer or borrow points to
+  if (const auto* access = dynamic_cast<const FieldAccess*>(node)) {
+    std::string object_type = access->object()->inferred_type();
+    object_type = pointee_type(object_type).value_or(object_type);
+    auto it = structs_.find(object_type);
+    if (it == structs_.end()) return "";
+    auto field = it->second->field_index(access->field_name());
+    return field ? it->second->fields()[*field].type : "";
+  }
+
+  // v8i32.load(values, i) and the simd builtins
+  if (const auto* member = dynamic_cast<const MemberAccess*>(node)) {
+    if (VectorType::parse(member->object_name())) {
+      return member->member_name() == "load" ? member->object_name() : "";
+    }
+    const auto& args = member->arguments();
+    if (member->object_name() != "simd" || args.empty()) return "";
+
+    const std::string& name = member->member_name();
+    const std::string& first_type = args.front()->inferred_type();
+    auto vector = VectorType::parse(first_type);
+    if (name == "store") return "void";
+    if (name == "select") {
+      return args.size() == 3 ? args[1]->inferred_type() : "";
+    }
+    if (!vector) return "";
+    if (name == "min" || name == "max") return first_type;
+    if (name == "any" || name == "all") return "bool";
+    if (name.starts_with("reduce_")) return vector->element_type;
+    if (name == "shuffle" && args.size() > 2) {
+      return VectorType{.lanes = args.size() - 2,
+                        .element_type = vector->element_type}
+          .to_string();
+    }
+    return "";
+  }
+
+  if (const auto* func_call = dynamic_cast<const FunctionCall*>(node)) {
+    // v8i32(x) splats x, v8i32(a, b, ...) gives every lane
+    if (VectorType::parse(func_call->function_name())) {
+      return func_call->function_name();
+    }
+    // Point(x, y) builds a struct from its fields, Point() a zeroed one
+    if (struct_names_.contains(func_call->function_name())) {
+      return func_call->function_name();
+    }
+
+    auto it = function_return_types_.find(func_call->function_name());
+    if (it != function_return_types_.end()) return it->second;
+
+    auto var_it = variable_types_.find(func_call->function_name());
+    if (var_it != variable_types_.end()) {
+      auto arrow_pos = var_it->second.find(" -> ");
+      if (arrow_pos != std::string::npos) {
+        return var_it->second.substr(arrow_pos + 4);
+      }
+    }
+    return "";
+  }
+
+  return "";
+}
+
 std::string Parser::infer_type(const ASTNode* node) {
+  // Expressions are typed as they are built, so this is usually a lookup
+  if (!node->inferred_type().empty()) {
+    return node->inferred_type();
+  }
+
+  // Otherwise work it out again to report why the type is unknown
   // Debug log: Trace the type inference
   std::cout << "Inferring type for ASTNode: " << typeid(*node).name() << "\n";
 
@@ -659,16 +1573,7 @@ std::string Parser::infer_type(const ASTNode* node) {
 
   // Infer type from anonymous functions
   if (const auto* anon_func = dynamic_cast<const AnonymousFunction*>(node)) {
-    // Build function type string: fn(param_types) -> return_type
-    std::string func_type = "fn(";
-    for (size_t i = 0; i < anon_func->parameters().size(); ++i) {
-      if (i > 0) func_type += ", ";
-      // For now, assume all parameters are i32 (can be enhanced with parameter
-      // type info)
-      func_type += "i32";
-    }
-    func_type += ") -> i32";  // Assume return type is i32 for now
-    return func_type;
+    return compute_type(anon_func);
   }
 
   // Infer type from variable references
@@ -0,0 +1,172 @@
+#include "session.h"
+
+#include <stdexcept>
+#include <unordered_set>
+
+#include "code_generation.h"
+#include "const_evaluator.h"
+#include "jit_events.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+std::vector<Token> tokenize(const std::string& source) {
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  Token token;
+  do {
+    token = lexer.next_token();
+    tokens.push_back(token);
+  } while (token.type != TokenType::EndOfFile);
+  return tokens;
+}
+
+template <typename T>
+T call(uint64_t address) {
+  return reinterpret_cast<T (*)()>(address)();
+}
+
+}  // namespace
+
+Session::Session() : context_(std::make_unique<llvm::LLVMContext>()) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  // MCJIT starts from a module; every input is added to it as another one
+  std::string error_str;
+  engine_.reset(llvm::EngineBuilder(
+                    std::make_unique<llvm::Module>("session", *context_))
+                    .setErrorStr(&error_str)
+                    .setMCPU(llvm::sys::getHostCPUName())
+                    .create());
+  if (!engine_) {
+    throw std::runtime_error("Failed to create execution engine: " + error_str);
+  }
+  register_jit_event_listeners(*engine_, jit_events_from_environment());
+}
+
+Session::~Session() = default;
+
+std::string Session::evaluate(const std::string& input) {
+  std::string name = "__input_" + std::to_string(input_count_);
+  auto first = tokenize(input).front().type;
+  bool declarations = first == TokenType::Const || first == TokenType::Import;
+
+  // Anything else runs inside a wrapper function. A lone expression parses
+  // as the initializer of a variable, which tells us its type, and is then
+  // returned from the wrapper instead.
+  std::string result_type = "void";
+  if (!declarations) {
+    try {
+      auto probe = parse("const " + name + " = fn() {\n__value := (" + input +
+                         ")\n}\n");
+      const auto& body = probe->functions().front()->body();
+      const auto* decl =
+          dynamic_cast<const VariableDeclaration*>(body.front().get());
+      // fmt.println is called for its output, not its printf result
+      if (body.size() == 1 && decl && !decl->type().empty() &&
+          !dynamic_cast<const MemberAccess*>(decl->value())) {
+        result_type = decl->type();
+      }
+    } catch (const std::exception&) {
+      // Not an expression, so statements
+    }
+  }
+
+  std::unique_ptr<Program> program;
+  if (declarations) {
+    program = parse(input);
+  } else if (result_type == "void") {
+    program = parse("const " + name + " = fn() {\n" + input + "\n}\n");
+  } else {
+    program = parse("const " + name + " = fn() -> " + result_type +
+                    " {\nreturn (" + input + ")\n}\n");
+  }
+
+  // Check before compiling, so a rejected input leaves no trace
+  for (const auto& func : program->functions()) {
+    if (functions_.contains(func->name())) {
+      throw std::runtime_error("Function '" + func->name() +
+                               "' is already defined");
+    }
+  }
+
+  auto codegen = std::make_unique<CodeGenerator>();
+  std::unordered_set<std::string> declared;
+  for (const auto& token : tokenize(input)) {
+    auto it = functions_.find(token.value);
+    if (token.type == TokenType::Identifier && it != functions_.end() &&
+        declared.insert(token.value).second) {
+      codegen->declare_function(it->first, it->second);
+    }
+  }
+  codegen->set_constant_folds(ConstEvaluator(program.get()).fold_calls());
+  codegen->generate_library(program.get());
+  codegen->optimize();
+
+  engine_->addModule(codegen->take_module());
+  inputs_.push_back(std::move(codegen));
+  input_count_++;
+
+  if (declarations) {
+    for (const auto& func : program->functions()) {
+      std::vector<std::string> param_types;
+      for (const auto& param : func->parameters()) {
+        param_types.push_back(param->type());
+      }
+      functions_.emplace(func->name(),
+                         FunctionType(std::move(param_types),
+                                      func->return_type()));
+    }
+    return "";
+  }
+  return run(name, result_type);
+}
+
+std::unique_ptr<Program> Session::parse(const std::string& source) const {
+  auto tokens = tokenize(source);
+  std::vector<std::pair<std::string, std::string>> known;
+  for (const auto& token : tokens) {
+    auto it = functions_.find(token.value);
+    if (token.type == TokenType::Identifier && it != functions_.end()) {
+      known.emplace_back(it->first, it->second.return_type());
+    }
+  }
+
+  Parser parser(std::move(tokens), FunctionSelection::All);
+  for (const auto& [name, return_type] : known) {
+    parser.declare_function(name, return_type);
+  }
+  return parser.parse();
+}
+
+std::string Session::run(const std::string& name, const std::string& type) {
+  // Only the new module is compiled here; earlier ones already are
+  uint64_t address = engine_->getFunctionAddress(name);
+  if (address == 0) {
+    throw std::runtime_error("Function '" + name + "' not found");
+  }
+
+  if (type == "void") {
+    call<void>(address);
+    return "";
+  }
+  if (type == "bool") return call<bool>(address) ? "true" : "false";
+  if (type == "i8") return std::to_string(call<int8_t>(address));
+  if (type == "i16") return std::to_string(call<int16_t>(address));
+  if (type == "i32") return std::to_string(call<int32_t>(address));
+  if (type == "i64") return std::to_string(call<int64_t>(address));
+  if (type == "u8") return std::to_string(call<uint8_t>(address));
+  if (type == "u16") return std::to_string(call<uint16_t>(address));
+  if (type == "u32") return std::to_string(call<uint32_t>(address));
+  if (type == "u64") return std::to_string(call<uint64_t>(address));
+  if (type == "string" || type == "const string") {
+    return call<const char*>(address);
+  }
+  call<void*>(address);
+  return "<" + type + ">";
+}
+
+}  // namespace void_compiler
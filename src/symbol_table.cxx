@@ -0,0 +1,64 @@
+#include "symbol_table.h"
+
+#include <stdexcept>
+
+namespace void_compiler {
+
+SymbolTable::ScopeGuard SymbolTable::scope() {
+  push_scope(false);
+  return ScopeGuard(*this);
+}
+
+SymbolTable::ScopeGuard SymbolTable::function_scope() {
+  push_scope(true);
+  return ScopeGuard(*this);
+}
+
+void SymbolTable::push_scope(bool is_function) {
+  scopes_.push_back(Scope{.declared = {},
+                          .enclosing_function_depth = function_depth_});
+  if (is_function) function_depth_ = scopes_.size();
+}
+
+void SymbolTable::pop_scope() {
+  for (NameId id : scopes_.back().declared) {
+    bindings_[id].pop_back();
+  }
+  function_depth_ = scopes_.back().enclosing_function_depth;
+  scopes_.pop_back();
+}
+
+void SymbolTable::declare(const std::string& name, Symbol symbol) {
+  if (scopes_.empty()) {
+    throw std::runtime_error("Cannot declare '" + name + "' outside a scope");
+  }
+
+  NameId id = intern(name);
+  auto& stack = bindings_[id];
+  if (!stack.empty() && stack.back().depth == scopes_.size()) {
+    stack.back().symbol = std::move(symbol);
+    return;
+  }
+
+  stack.push_back(
+      Binding{.symbol = std::move(symbol), .depth = scopes_.size()});
+  scopes_.back().declared.push_back(id);
+}
+
+const Symbol* SymbolTable::lookup(const std::string& name) const {
+  auto it = name_ids_.find(name);
+  if (it == name_ids_.end()) return nullptr;
+
+  const auto& stack = bindings_[it->second];
+  if (stack.empty() || stack.back().depth < function_depth_) return nullptr;
+  return &stack.back().symbol;
+}
+
+SymbolTable::NameId SymbolTable::intern(const std::string& name) {
+  auto [it, inserted] =
+      name_ids_.emplace(name, static_cast<NameId>(bindings_.size()));
+  if (inserted) bindings_.emplace_back();
+  return it->second;
+}
+
+}  // namespace void_compiler
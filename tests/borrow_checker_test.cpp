@@ -0,0 +1,199 @@
+#include "borrow_checker.h"
+
+#include <gtest/gtest.h>
+
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+class BorrowCheckerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+  void TearDown() override {}
+
+  std::unique_ptr<Program> ParseSource(const std::string& source) {
+    Lexer lexer(source);
+    std::vector<Token> tokens;
+    Token token;
+    do {
+      token = lexer.next_token();
+      tokens.push_back(token);
+    } while (token.type != TokenType::EndOfFile);
+
+    Parser parser(std::move(tokens));
+    return parser.parse();
+  }
+
+  // The checker's error for source, or empty if it is accepted
+  std::string CheckSource(const std::string& source) {
+    auto program = ParseSource(source);
+    try {
+      BorrowChecker(program.get()).check();
+    } catch (const std::runtime_error& e) {
+      return e.what();
+    }
+    return "";
+  }
+};
+
+TEST_F(BorrowCheckerTest, AcceptsBorrowsOfPlaces) {
+  const std::string source = R"(
+const Point = struct { x: i32, y: i32 }
+
+const bump = fn(target: &mut i32, amount: &i32) {
+  target.* = target.* + amount.*
+}
+
+const bump_twice = fn(target: &mut i32, amount: &i32) {
+  bump(target, amount)
+  bump(target, amount)
+}
+
+const main = fn() -> i32 {
+  total: i32 = 0
+  step: i32 = 2
+  values: [4]i32 = [1, 2, 3, 4]
+  p := Point(1, 2)
+  bump(&mut total, &step)
+  bump_twice(&mut values[1], &step)
+  bump(&mut p.x, &step)
+  return total
+}
+)";
+
+  EXPECT_EQ(CheckSource(source), "");
+}
+
+TEST_F(BorrowCheckerTest, AllowsSharedBorrowsOfTheSameVariable) {
+  const std::string source = R"(
+const sum = fn(a: &i32, b: &i32) -> i32 {
+  return a.* + b.*
+}
+
+const main = fn() -> i32 {
+  x: i32 = 4
+  return sum(&x, &x)
+}
+)";
+
+  EXPECT_EQ(CheckSource(source), "");
+}
+
+TEST_F(BorrowCheckerTest, RejectsMutableBorrowThatAliasesAnotherArgument) {
+  const std::string source = R"(
+const bump = fn(target: &mut i32, amount: &i32) {
+  target.* = target.* + amount.*
+}
+
+const main = fn() -> i32 {
+  values: [4]i32 = [1, 2, 3, 4]
+  bump(&mut values[0], &values[1])
+  return values[0]
+}
+)";
+
+  EXPECT_NE(CheckSource(source).find("borrowed as &mut"), std::string::npos);
+}
+
+TEST_F(BorrowCheckerTest, RejectsWritesThroughSharedBorrows) {
+  const std::string source = R"(
+const reset = fn(target: &i32) {
+  target.* = 0
+}
+
+const main = fn() -> i32 {
+  x: i32 = 4
+  reset(&x)
+  return x
+}
+)";
+
+  EXPECT_NE(CheckSource(source).find("shared borrow"), std::string::npos);
+}
+
+TEST_F(BorrowCheckerTest, RejectsBorrowsOutsideParameters) {
+  EXPECT_NE(CheckSource(R"(
+const main = fn() -> i32 {
+  x: i32 = 4
+  r: &i32 = &x
+  return r.*
+}
+)")
+                .find("can't hold a borrow"),
+            std::string::npos);
+
+  EXPECT_NE(CheckSource(R"(
+const leak = fn(r: &i32) -> *i32 {
+  return r
+}
+
+const main = fn() -> i32 {
+  x: i32 = 4
+  p: *i32 = leak(&x)
+  return p.*
+}
+)")
+                .find("can only be read through"),
+            std::string::npos);
+}
+
+TEST_F(BorrowCheckerTest, RejectsBorrowsOfVariablesWithPointers) {
+  const std::string source = R"(
+const bump = fn(target: &mut i32) {
+  target.* = target.* + 1
+}
+
+const main = fn() -> i32 {
+  x: i32 = 4
+  bump(&mut x)
+  p: *i32 = &x
+  return p.*
+}
+)";
+
+  EXPECT_NE(CheckSource(source).find("address is also taken"),
+            std::string::npos);
+}
+
+TEST_F(BorrowCheckerTest, RejectsMismatchedBorrowArguments) {
+  const std::string bump = R"(
+const bump = fn(target: &mut i32) {
+  target.* = target.* + 1
+}
+)";
+
+  EXPECT_NE(CheckSource(bump + R"(
+const main = fn() -> i32 {
+  x: i32 = 4
+  bump(x)
+  return x
+}
+)")
+                .find("must be borrowed"),
+            std::string::npos);
+
+  EXPECT_NE(CheckSource(bump + R"(
+const main = fn() -> i32 {
+  x: i32 = 4
+  bump(&x)
+  return x
+}
+)")
+                .find("borrowed mutably"),
+            std::string::npos);
+
+  EXPECT_NE(CheckSource(bump + R"(
+const main = fn() -> i32 {
+  x: i64 = 4
+  bump(&mut x)
+  return 0
+}
+)")
+                .find("must borrow a i32"),
+            std::string::npos);
+}
+
+}  // namespace
+}  // namespace void_compiler
@@ -2,6 +2,10 @@
 
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
 #include "lexer.h"
 #include "parser.h"
 
@@ -903,6 +907,187 @@ const test = fn() -> i32 {
               std::string::npos);  // Comparison instruction
 }
 
+TEST_F(CodeGenerationTest, OutlinesParallelRangeLoop) {
+  const std::string source = R"(
+const test = fn(n: i32) -> i32 {
+  found :i32 = 0
+  loop par i in 0..n {
+    if i * i == 49 {
+      found = i
+    }
+  }
+  return found
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  EXPECT_TRUE(codegen.uses_parallel_runtime());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // The body moves into its own function, handed to the runtime along with
+  // the address of found
+  EXPECT_NE(output.find("define internal void @test.par_body(i64 %begin, "
+                        "i64 %end"),
+            std::string::npos);
+  EXPECT_NE(output.find("call void @void_parallel_for("), std::string::npos);
+  EXPECT_NE(output.find("%par.captures = alloca [1 x"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, RejectsReturnFromParallelLoop) {
+  const std::string source = R"(
+const test = fn() -> i32 {
+  loop par i in 0..10 {
+    return i
+  }
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  EXPECT_THROW(codegen.generate_program(program.get()), std::runtime_error);
+}
+
+TEST_F(CodeGenerationTest, GeneratesBoundsCheckedArrays) {
+  const std::string source = R"(
+const test = fn(i: i32) -> i32 {
+  values := [1, 2, 3, 4]
+  values[i] = 10
+  return values[0]
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // A stack array filled from a constant global, and every index checked
+  EXPECT_NE(output.find("%values = alloca [4 x i32]"), std::string::npos);
+  EXPECT_NE(output.find("@array.init = private unnamed_addr constant [4 x "
+                        "i32] [i32 1, i32 2, i32 3, i32 4]"),
+            std::string::npos);
+  EXPECT_NE(output.find("icmp ult i64"), std::string::npos);
+  EXPECT_NE(output.find("bounds.fail:"), std::string::npos);
+  EXPECT_NE(output.find("out of bounds for length"), std::string::npos);
+  EXPECT_NE(output.find("call void @llvm.trap()"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, PutsLargeArraysOnTheHeap) {
+  const std::string source = R"(
+const test = fn(n: i32) -> i64 {
+  values: [100000]i64
+  if n > 0 {
+    return values[n]
+  }
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("@malloc(i64 800000)"), std::string::npos);
+  EXPECT_EQ(output.find("alloca [100000 x i64]"), std::string::npos);
+
+  // Freed on both returns
+  size_t frees = 0;
+  for (size_t pos = output.find("call void @free("); pos != std::string::npos;
+       pos = output.find("call void @free(", pos + 1)) {
+    frees++;
+  }
+  EXPECT_EQ(frees, 2);
+}
+
+TEST_F(CodeGenerationTest, FreesLargeArraysOnReturnsBeforeTheirDeclaration) {
+  const std::string source = R"(
+const test = fn(c: i32) -> i64 {
+  if c > 0 do return 1
+  big: [100000]i64
+  big[0] = 7
+  return big[0]
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // The buffer is allocated on entry, so the early return frees it too
+  size_t frees = 0;
+  for (size_t pos = output.find("call void @free("); pos != std::string::npos;
+       pos = output.find("call void @free(", pos + 1)) {
+    frees++;
+  }
+  EXPECT_EQ(frees, 2);
+  size_t early_return = output.find("ret i64 1");
+  ASSERT_NE(early_return, std::string::npos);
+  EXPECT_NE(output.rfind("call void @free(", early_return), std::string::npos);
+
+  // A failed allocation traps instead of writing through null
+  EXPECT_NE(output.find("big.allocated.fail:"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, RejectsArraysAsValues) {
+  auto generate = [this](const std::string& source) {
+    auto program = ParseSource(source);
+    CodeGenerator codegen;
+    codegen.generate_program(program.get());
+  };
+
+  EXPECT_THROW(generate("const f = fn(values: [2]i32) -> i32 do return 0"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const f = fn() -> i32 {
+  values := [1, 2]
+  copy: [3]i32 = values
+  return 0
+}
+)"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const f = fn() -> i32 {
+  values: [2]i32 = [1, 2, 3]
+  return 0
+}
+)"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const f = fn() -> i32 {
+  values := [1, 2]
+  return values + 1
+}
+)"),
+               std::runtime_error);
+}
+
 TEST_F(CodeGenerationTest, GeneratesConditionalLoop) {
   const std::string source = R"(
 const test = fn() -> i32 {
@@ -2114,5 +2299,1090 @@ const test = fn() -> i32 {
   EXPECT_TRUE(output.find("load i32") != std::string::npos);      // dereference
 }
 
+TEST_F(CodeGenerationTest, EliminatesFunctionsUnreachableFromMain) {
+  auto program = std::make_unique<Program>();
+
+  auto unused = std::make_unique<FunctionDeclaration>("unused", "i32");
+  unused->add_statement(
+      std::make_unique<ReturnStatement>(std::make_unique<NumberLiteral>(1)));
+  program->add_function(std::move(unused));
+
+  auto main_func = std::make_unique<FunctionDeclaration>("main", "i32");
+  main_func->add_statement(
+      std::make_unique<ReturnStatement>(std::make_unique<NumberLiteral>(0)));
+  program->add_function(std::move(main_func));
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  EXPECT_EQ(codegen.eliminated_function_count(), 1);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("@unused") == std::string::npos);
+  EXPECT_TRUE(output.find("define i32 @main()") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, CountsFunctionsTheParserSkipped) {
+  const std::string source = R"(
+const unused = fn() -> i32 do return 1
+const also_unused = fn() -> i32 do return unused()
+const square = fn(x: i32) -> i32 do return x * x
+const main = fn() -> i32 do return square(12)
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  EXPECT_EQ(program->skipped_function_count(), 2);
+
+  CodeGenerator codegen;
+  ConstEvaluator evaluator(program.get());
+  codegen.set_constant_folds(evaluator.fold_calls());
+  codegen.generate_program(program.get());
+
+  // The two the parser never parsed, and square, only called at compile time
+  EXPECT_EQ(codegen.eliminated_function_count(), 3);
+}
+
+TEST_F(CodeGenerationTest, GivesHelpersInternalLinkage) {
+  const std::string source = R"(
+const helper = fn(x: i32) -> i32 do return x + 1
+const main = fn() -> i32 do return helper(41)
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  EXPECT_EQ(codegen.eliminated_function_count(), 0);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("define internal i32 @helper(i32 %x)") !=
+              std::string::npos);
+  EXPECT_TRUE(output.find("define i32 @main()") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, KeepsFunctionsUsedFromAnonymousFunctions) {
+  const std::string source = R"(
+const square = fn(x: i32) -> i32 do return x * x
+const main = fn() -> i32 {
+  op := fn(x: i32) -> i32 do return square(x)
+  return op(3)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  EXPECT_EQ(codegen.eliminated_function_count(), 0);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("define internal i32 @square") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, ExportsEveryFunctionWithoutMain) {
+  const std::string source = R"(
+const first = fn() -> i32 do return 1
+const second = fn() -> i32 do return 2
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  EXPECT_EQ(codegen.eliminated_function_count(), 0);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("define i32 @first()") != std::string::npos);
+  EXPECT_TRUE(output.find("define i32 @second()") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, EmitsFoldedCallsAsConstants) {
+  const std::string source = R"(
+const square = fn(x: i32) -> i32 do return x * x
+const main = fn() -> i32 do return square(12)
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  ConstEvaluator evaluator(program.get());
+  codegen.set_constant_folds(evaluator.fold_calls());
+  codegen.generate_program(program.get());
+
+  // square is only called at compile time, so it isn't emitted at all
+  EXPECT_EQ(codegen.eliminated_function_count(), 1);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("ret i32 144") != std::string::npos);
+  EXPECT_TRUE(output.find("@square") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, AnonymousFunctionCannotSeeEnclosingLocals) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  hidden: i32 = 4
+  op := fn(x: i32) -> i32 do return x + hidden
+  return op(1)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  EXPECT_THROW(codegen.generate_program(program.get()), std::runtime_error);
+}
+
+TEST_F(CodeGenerationTest, CallsMonomorphicFunctionPointerDirectly) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const main = fn() -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  return operation(5, 3)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("call i32 @add(i32 5, i32 3)") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 %") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, FollowsReassignedFunctionPointer) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const multiply = fn(x: i32, y: i32) -> i32 do return x * y
+const main = fn() -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  first: i32 = operation(5, 3)
+  operation = multiply
+  quick: fn(i32, i32) -> i32 = fn(a: i32, b: i32) -> i32 do return a - b
+  return first + operation(4, 7) + quick(3, 4)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("call i32 @add(i32 5, i32 3)") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 @multiply(i32 4, i32 7)") !=
+              std::string::npos);
+  EXPECT_TRUE(output.find("call i32 @anon_") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 %") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, GuardsCallsWithFewKnownTargets) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const multiply = fn(x: i32, y: i32) -> i32 do return x * y
+const apply = fn(flag: bool) -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  if flag do operation = multiply
+  return operation(4, 7)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("devirt.match") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 @add(i32 4, i32 7)") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 @multiply(i32 4, i32 7)") !=
+              std::string::npos);
+  EXPECT_TRUE(output.find("devirt.result") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, JoinsFunctionPointerTargetsAcrossLoopIterations) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const multiply = fn(x: i32, y: i32) -> i32 do return x * y
+const run = fn(n: i32) -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  total: i32 = 0
+  loop i in 0..n {
+    total = operation(total, 2)
+    operation = multiply
+  }
+  return total
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // The first iteration calls add, later ones multiply
+  EXPECT_TRUE(output.find("devirt.match") != std::string::npos);
+  EXPECT_TRUE(output.find("@multiply(i32") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, KeepsCallsThroughParametersIndirect) {
+  const std::string source = R"(
+const apply = fn(operation: fn(i32, i32) -> i32) -> i32 {
+  return operation(1, 2)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("call i32 %") != std::string::npos);
+  EXPECT_TRUE(output.find("devirt.match") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, KeepsCallsThroughBorrowedFunctionPointersIndirect) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const sub = fn(x: i32, y: i32) -> i32 do return x - y
+const replace = fn(p: &mut fn(i32, i32) -> i32) {
+  p.* = sub
+}
+const main = fn() -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  first: i32 = operation(1, 1)
+  replace(&mut operation)
+  return first + operation(5, 3)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Only the call before the borrow still knows its target
+  EXPECT_TRUE(output.find("call i32 @add(i32 1, i32 1)") != std::string::npos);
+  EXPECT_TRUE(output.find("call i32 @add(i32 5, i32 3)") == std::string::npos);
+  EXPECT_TRUE(output.find("call i32 %") != std::string::npos);
+  EXPECT_EQ(codegen.run_jit(), 4);
+}
+
+TEST_F(CodeGenerationTest, GeneratesAnonymousFunctionWithDeclaredTypes) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  scale: fn(i64, i64) -> i64 = fn(a: i64, b: i64) -> i64 do return a + b * 2
+  result: i64 = scale(1, 2)
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("i64 @anon_") != std::string::npos);
+  EXPECT_TRUE(output.find("(i64 %a, i64 %b)") != std::string::npos);
+  EXPECT_TRUE(output.find("ret i64") != std::string::npos);
+  // Arguments are widened to the lambda's parameter types at the call
+  EXPECT_TRUE(output.find("(i64 1, i64 2)") != std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, MarksOnlySmallAnonymousFunctionsAlwaysInline) {
+  const std::string small_source = R"(
+const main = fn() -> i32 {
+  twice: fn(i32) -> i32 = fn(x: i32) -> i32 do return x * 2
+  return twice(4)
+}
+)";
+  const std::string looping_source = R"(
+const main = fn() -> i32 {
+  sum_to: fn(i32) -> i32 = fn(n: i32) -> i32 {
+    total: i32 = 0
+    loop i in 0..n do total = total + i
+    return total
+  }
+  return sum_to(4)
+}
+)";
+
+  auto small_program = ParseSource(small_source);
+  ASSERT_NE(small_program, nullptr);
+  CodeGenerator small_codegen;
+  small_codegen.generate_program(small_program.get());
+  testing::internal::CaptureStdout();
+  small_codegen.print_ir();
+  std::string small_output = testing::internal::GetCapturedStdout();
+
+  auto looping_program = ParseSource(looping_source);
+  ASSERT_NE(looping_program, nullptr);
+  CodeGenerator looping_codegen;
+  looping_codegen.generate_program(looping_program.get());
+  testing::internal::CaptureStdout();
+  looping_codegen.print_ir();
+  std::string looping_output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(small_output.find("alwaysinline") != std::string::npos);
+  EXPECT_TRUE(looping_output.find("alwaysinline") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, InlinesSmallAnonymousFunctionsAtDirectCalls) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  twice: fn(i32) -> i32 = fn(x: i32) -> i32 do return x * 2
+  return twice(4)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+  codegen.optimize(llvm::OptimizationLevel::O0);
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_TRUE(output.find("call i32 @anon_") == std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, GeneratesVectorOperations) {
+  const std::string source = R"(
+const test = fn(a: v4i32, b: v4u8) -> i32 {
+  c := a * v4i32(1, 2, 3, 4) + 1
+  d := b / v4u8(3)
+  m := simd.max(a, c)
+  picked := simd.select(c > a, c, a)
+  turned := simd.shuffle(picked, m, 3, 2, 5, 4)
+  if simd.any(d == v4u8(0)) {
+    return turned[1]
+  }
+  return simd.reduce_add(turned)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("define i32 @test(<4 x i32> %a, <4 x i8> %b)"),
+            std::string::npos);
+  EXPECT_NE(output.find("mul <4 x i32>"), std::string::npos);
+  EXPECT_NE(output.find("<i32 1, i32 2, i32 3, i32 4>"), std::string::npos);
+  EXPECT_NE(output.find("add <4 x i32> %multmp, <i32 1, i32 1, i32 1, i32 1>"),
+            std::string::npos);
+  EXPECT_NE(output.find("udiv <4 x i8>"), std::string::npos);
+  EXPECT_NE(output.find("@llvm.smax.v4i32"), std::string::npos);
+  EXPECT_NE(output.find("icmp sgt <4 x i32>"), std::string::npos);
+  EXPECT_NE(output.find("select <4 x i1>"), std::string::npos);
+  EXPECT_NE(output.find("<4 x i32> <i32 3, i32 2, i32 5, i32 4>"),
+            std::string::npos);
+  EXPECT_NE(output.find("@llvm.vector.reduce.or.v4i1"), std::string::npos);
+  EXPECT_NE(output.find("@llvm.vector.reduce.add.v4i32"), std::string::npos);
+  EXPECT_NE(output.find("extractelement <4 x i32>"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, RejectsMismatchedVectors) {
+  auto generate = [this](const std::string& source) {
+    auto program = ParseSource(source);
+    CodeGenerator codegen;
+    codegen.generate_program(program.get());
+  };
+
+  EXPECT_THROW(
+      generate("const f = fn(a: v4i32, b: v8i32) -> i32 do return a + b"),
+      std::runtime_error);
+  EXPECT_THROW(generate("const f = fn(a: v4i32) -> v4i32 do return v4i32(1, 2)"),
+               std::runtime_error);
+  EXPECT_THROW(
+      generate("const f = fn(a: v4i32) -> v4i32 do return simd.shuffle(a, a, "
+               "0, 8)"),
+      std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const f = fn() -> i32 {
+  values: [2]i32
+  v := v4i32.load(values, 0)
+  return 0
+}
+)"),
+               std::runtime_error);
+}
+
+// The assembly for a vector kernel, or "" if this host isn't covered
+std::string vector_kernel_assembly(const std::string& cpu) {
+  const std::string source = R"(
+const kernel = fn(a: v8i32, b: v8i32) -> v8i32 {
+  return a * b + a
+}
+)";
+  auto triple = llvm::sys::getDefaultTargetTriple();
+  if (!triple.starts_with("x86_64") && !triple.starts_with("aarch64")) {
+    return "";
+  }
+
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  for (Token token = lexer.next_token();; token = lexer.next_token()) {
+    tokens.push_back(token);
+    if (token.type == TokenType::EndOfFile) break;
+  }
+  auto program = Parser(std::move(tokens), FunctionSelection::All).parse();
+
+  CodeGenerator codegen;
+  codegen.set_target_cpu(cpu);
+  codegen.generate_library(program.get());
+  codegen.optimize();
+
+  auto path = std::filesystem::temp_directory_path() /
+              ("void_vector_kernel_" + cpu + ".s");
+  EXPECT_TRUE(codegen.compile_to_assembly(path.string()));
+  std::ifstream file(path);
+  std::string assembly((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  std::filesystem::remove(path);
+  return assembly;
+}
+
+TEST_F(CodeGenerationTest, EmitsVectorInstructions) {
+  std::string assembly = vector_kernel_assembly("generic");
+  if (assembly.empty()) GTEST_SKIP() << "no expectations for this target";
+
+  if (llvm::sys::getDefaultTargetTriple().starts_with("x86_64")) {
+    // SSE2 only, so 8 lanes take two 128-bit registers
+    EXPECT_NE(assembly.find("paddd"), std::string::npos);
+    EXPECT_EQ(assembly.find("%ymm"), std::string::npos);
+  } else {
+    EXPECT_NE(assembly.find(".4s"), std::string::npos);
+  }
+}
+
+TEST_F(CodeGenerationTest, EmitsWideVectorInstructionsForCapableCpus) {
+  if (!llvm::sys::getDefaultTargetTriple().starts_with("x86_64")) {
+    GTEST_SKIP() << "only x86-64 has a wider vector unit to opt into";
+  }
+
+  // AVX2 handles all 8 lanes in one instruction
+  std::string assembly = vector_kernel_assembly("haswell");
+  EXPECT_NE(assembly.find("vpmulld\t%ymm"), std::string::npos);
+  EXPECT_NE(assembly.find("vpaddd\t%ymm"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, TypesRangeCountersByTheirBounds) {
+  const std::string source = R"(
+const sum = fn(n: i64) -> i64 {
+  total: i64 = 0
+  loop i in 0..n do total = total + i
+  return total
+}
+
+const count = fn(n: u64) -> u64 {
+  total: u64 = 0
+  loop i in 0..n do total = total + 1
+  return total
+}
+
+const skip = fn(n: i64) -> i64 {
+  total: i64 = 0
+  loop i in 0..n {
+    total = total + i
+    i = i + 1
+  }
+  return total
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Counters are as wide as their bounds, compare with the bounds'
+  // signedness, and only a counter the body never assigns can't wrap
+  EXPECT_NE(output.find("icmp slt i64"), std::string::npos);
+  EXPECT_NE(output.find("add nsw i64"), std::string::npos);
+  EXPECT_NE(output.find("icmp ult i64"), std::string::npos);
+  EXPECT_NE(output.find("add nuw i64"), std::string::npos);
+  EXPECT_NE(output.find("%inc = add i64"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, LaysOutStructsLikeTheTarget) {
+  const std::string source = R"(
+const Mixed = struct { tag: u8, count: i32, total: i64 }
+const Header = packed struct { tag: u8, count: i32, total: i64 }
+const Counter = struct align(64) { hits: i64 }
+const Outer = struct { tag: u8, counter: Counter, after: i16 }
+)";
+
+  auto program = ParseSource(source);
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  // A natural struct matches what the host's C ABI would do
+  std::unique_ptr<llvm::TargetMachine> machine(
+      llvm::EngineBuilder().selectTarget());
+  ASSERT_NE(machine, nullptr);
+  llvm::LLVMContext context;
+  auto* mixed = llvm::StructType::get(
+      context, {llvm::Type::getInt8Ty(context), llvm::Type::getInt32Ty(context),
+                llvm::Type::getInt64Ty(context)});
+  const auto* layout = machine->createDataLayout().getStructLayout(mixed);
+  EXPECT_EQ(codegen.field_offset("Mixed", "count"),
+            layout->getElementOffset(1));
+  EXPECT_EQ(codegen.field_offset("Mixed", "total"),
+            layout->getElementOffset(2));
+  EXPECT_EQ(codegen.struct_size("Mixed"), layout->getSizeInBytes());
+
+  EXPECT_EQ(codegen.field_offset("Header", "count"), 1);
+  EXPECT_EQ(codegen.field_offset("Header", "total"), 5);
+  EXPECT_EQ(codegen.struct_size("Header"), 13);
+  EXPECT_EQ(codegen.struct_alignment("Header"), 1);
+
+  EXPECT_EQ(codegen.struct_size("Counter"), 64);
+  EXPECT_EQ(codegen.struct_alignment("Counter"), 64);
+
+  // An over-aligned member pads its container like it would in C
+  EXPECT_EQ(codegen.field_offset("Outer", "counter"), 64);
+  EXPECT_EQ(codegen.field_offset("Outer", "after"), 128);
+  EXPECT_EQ(codegen.struct_size("Outer"), 192);
+  EXPECT_EQ(codegen.struct_alignment("Outer"), 64);
+}
+
+TEST_F(CodeGenerationTest, GeneratesStructFieldAccess) {
+  const std::string source = R"(
+const Header = packed struct { tag: u8, length: i32 }
+const Counter = struct align(64) { hits: i64 }
+const Particle = soa struct { x: i32, v: i32 }
+const main = fn() -> i32 {
+  h: Header
+  h.length = 1000
+  counters: [4]Counter
+  counters[1].hits = 2
+  particles: [8]Particle
+  particles[3].v = 5
+  return h.length + counters[1].hits + particles[3].v
+}
+)";
+
+  auto program = ParseSource(source);
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("%Header = type <{ i8, i32 }>"), std::string::npos);
+  EXPECT_NE(output.find("%Counter = type { i64, [56 x i8] }"),
+            std::string::npos);
+  // Fields of a packed struct may be misaligned
+  bool unaligned_load = false;
+  std::istringstream lines(output);
+  for (std::string line; std::getline(lines, line);) {
+    if (line.find("load i32") != std::string::npos &&
+        line.find("align 1") != std::string::npos) {
+      unaligned_load = true;
+    }
+  }
+  EXPECT_TRUE(unaligned_load);
+  EXPECT_NE(output.find("alloca [4 x %Counter], align 64"), std::string::npos);
+  // A soa array keeps each field in its own column
+  EXPECT_NE(output.find("alloca { [8 x i32], [8 x i32] }"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, RejectsInvalidStructUse) {
+  auto generate = [this](const std::string& source) {
+    auto program = ParseSource(source);
+    CodeGenerator codegen;
+    codegen.generate_program(program.get());
+  };
+
+  EXPECT_THROW(generate("const Loop = struct { inner: Loop }"),
+               std::runtime_error);
+  EXPECT_THROW(generate("const Grid = struct { cells: [4]i32 }"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const Point = struct { x: i32, y: i32 }
+const f = fn(p: Point) -> i32 do return p.z
+)"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const Point = struct { x: i32, y: i32 }
+const f = fn(p: Point, q: Point) -> bool do return p == q
+)"),
+               std::runtime_error);
+  EXPECT_THROW(generate(R"(
+const Point = struct { x: i32, y: i32 }
+const f = fn() -> Point do return Point(1)
+)"),
+               std::runtime_error);
+}
+
+TEST_F(CodeGenerationTest, GeneratesBorrowParameters) {
+  const std::string source = R"(
+const Vec2 = struct { x: i32, y: i32 }
+const nudge = fn(v: &mut Vec2, dy: &i32) {
+  v.y = v.y + dy.*
+}
+const widen = fn(p: *i64) -> i64 do return p.*
+const main = fn() -> i32 {
+  v := Vec2(1, 2)
+  dy: i32 = 3
+  nudge(&mut v, &dy)
+  big: i64 = 4
+  w := widen(&big)
+  return v.x
+}
+)";
+
+  auto program = ParseSource(source);
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Borrows are pointers LLVM may assume nothing else reaches
+  EXPECT_NE(output.find("noalias nocapture nonnull align 4 "
+                        "dereferenceable(8)"),
+            std::string::npos);
+  EXPECT_NE(output.find("readonly align 4 dereferenceable(4)"),
+            std::string::npos);
+  // .* loads the pointee's type
+  EXPECT_NE(output.find("load i64, "), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, VectorizesThroughBorrowsWithoutAliasChecks) {
+  const std::string source = R"(
+const scale = fn(values: &mut [1024]i32, factor: &i32) {
+  loop i in 0..1024 do values[i] = values[i] * factor.*
+}
+)";
+
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  for (Token token = lexer.next_token();; token = lexer.next_token()) {
+    tokens.push_back(token);
+    if (token.type == TokenType::EndOfFile) break;
+  }
+  auto program = Parser(std::move(tokens), FunctionSelection::All).parse();
+
+  CodeGenerator codegen;
+  codegen.generate_library(program.get());
+  codegen.optimize();
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // factor can't alias values, so its load leaves the loop and the
+  // vectorizer needs no runtime overlap check
+  EXPECT_NE(output.find("vector.body"), std::string::npos);
+  EXPECT_EQ(output.find("vector.memcheck"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, GeneratesMatchAsSwitch) {
+  const std::string source = R"(
+const classify = fn(op: i32) -> i32 {
+  result: i32 = 0
+  match op {
+    0 do result = 10
+    1, 2 do result = 20
+    3..6 do result = 30
+    100..1000 do result = 40
+    else do result = 50
+  }
+  return result
+}
+)";
+
+  auto program = ParseSource(source);
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // One switch with a case per value of the narrow ranges
+  EXPECT_NE(output.find("switch i32"), std::string::npos);
+  for (int value : {0, 1, 2, 3, 4, 5}) {
+    EXPECT_NE(output.find("i32 " + std::to_string(value) + ", label %match.arm"),
+              std::string::npos);
+  }
+  EXPECT_EQ(output.find("i32 6, label"), std::string::npos);
+  // The wide range is a single compare once the switch misses
+  EXPECT_EQ(output.find("i32 100, label"), std::string::npos);
+  EXPECT_NE(output.find("%match.inrange = icmp ule i32 %match.offset, 899"),
+            std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, EmitsArithmeticForEachOverflowMode) {
+  const std::string source = R"(
+const wrapping = fn(a: i32, b: i32) -> i32 do return a * b + 1
+
+const assumed = overflow(undefined) fn(a: i64, b: u64) -> u64 {
+  x: i64 = a * a - 1
+  return b + b
+}
+
+const checked = overflow(trap) fn(a: i32, b: u8) -> u8 {
+  n: i32 = -a
+  return b - b
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Wrapping arithmetic has no flags
+  EXPECT_NE(output.find("%multmp = mul i32"), std::string::npos);
+  EXPECT_NE(output.find("%addtmp = add i32"), std::string::npos);
+  // Undefined overflow is nsw or nuw by the operands' signedness
+  EXPECT_NE(output.find("%multmp = mul nsw i64"), std::string::npos);
+  EXPECT_NE(output.find("%subtmp = sub nsw i64"), std::string::npos);
+  EXPECT_NE(output.find("%addtmp = add nuw i64"), std::string::npos);
+  // Trapping arithmetic is checked, negation as a signed 0 - a
+  EXPECT_NE(output.find("@llvm.ssub.with.overflow.i32(i32 0"),
+            std::string::npos);
+  EXPECT_NE(output.find("@llvm.usub.with.overflow.i8"), std::string::npos);
+  EXPECT_NE(output.find("overflow.fail:"), std::string::npos);
+  EXPECT_NE(output.find("call void @llvm.trap()"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, ProgramOverflowModeCoversUnannotatedFunctions) {
+  const std::string source = R"(
+const checked = fn(a: i32, b: i32) -> i32 do return a * b
+const wrapping = overflow(wrap) fn(a: i64, b: i64) -> i64 do return a * b
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  program->set_overflow_mode(OverflowMode::Trap);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("@llvm.smul.with.overflow.i32"), std::string::npos);
+  EXPECT_EQ(output.find("@llvm.smul.with.overflow.i64"), std::string::npos);
+  EXPECT_NE(output.find("%multmp = mul i64"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, EmitsTailCallsBetweenRecursiveFunctions) {
+  const std::string source = R"(
+const is_even = fn(n: u32) -> bool {
+  if n == 0 do return true
+  return musttail is_odd(n - 1)
+}
+
+const is_odd = fn(n: u32) -> bool {
+  if n == 0 do return false
+  return is_even(n - 1)
+}
+
+const half = fn(n: u32) -> u32 do return n / 2
+
+const main = fn() -> i32 {
+  if is_even(half(10)) do return 1
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // is_odd is called before it is defined
+  EXPECT_NE(output.find("define internal tailcc i1 @is_even"),
+            std::string::npos);
+  EXPECT_NE(output.find("define internal tailcc i1 @is_odd"),
+            std::string::npos);
+  EXPECT_NE(output.find("musttail call tailcc i1 @is_odd"), std::string::npos);
+  EXPECT_NE(output.find("tail call tailcc i1 @is_even"), std::string::npos);
+  // Functions that don't recurse keep the C convention
+  EXPECT_NE(output.find("define internal i32 @half"), std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, RejectsMustTailCallsItCantGuarantee) {
+  auto generate = [&](const std::string& source) -> std::string {
+    auto program = ParseSource(source);
+    CodeGenerator codegen;
+    try {
+      codegen.generate_program(program.get());
+    } catch (const std::runtime_error& e) {
+      return e.what();
+    }
+    return "";
+  };
+
+  // half never comes back to main
+  EXPECT_NE(generate(R"(
+const half = fn(n: i32) -> i32 do return n / 2
+const main = fn() -> i32 do return musttail half(8)
+)")
+                .find("must be recursive"),
+            std::string::npos);
+
+  EXPECT_NE(generate(R"(
+const wide = fn(n: i32) -> i64 {
+  if n == 0 do return 0
+  return narrow(n - 1)
+}
+const narrow = fn(n: i32) -> i32 do return musttail wide(n)
+const main = fn() -> i32 do return narrow(3)
+)")
+                .find("'wide' returns i64 but 'narrow' returns i32"),
+            std::string::npos);
+
+  EXPECT_NE(generate(R"(
+const walk = fn(p: *i32, n: i32) -> i32 {
+  if n == 0 do return p.*
+  return musttail walk(p, n - 1)
+}
+const main = fn() -> i32 {
+  x: i32 = 7
+  return walk(&x, 3)
+}
+)")
+                .find("a *i32 argument could point into the caller's frame"),
+            std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, EmitsFunctionAndBranchHints) {
+  const std::string source = R"(
+const square = pure fn(x: i32) -> i32 do return x * x
+const helper = inline fn(x: i32) -> i32 do return x + 1
+const report = cold noinline fn(x: i32) {
+  fmt.println("%d", x)
+}
+const step = hot fn(x: i32) -> i32 {
+  if unlikely x < 0 do report(x)
+  if likely x > 0 do return square(x)
+  return helper(x)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // Attribute groups are numbered in order of first use
+  auto attributes_of = [&](const std::string& function) {
+    size_t define = output.find("@" + function + "(");
+    size_t group = output.find('#', define);
+    std::string id = output.substr(group, output.find(' ', group) - group);
+    size_t line = output.find("attributes " + id + " = {");
+    return output.substr(line, output.find('}', line) - line);
+  };
+  EXPECT_NE(attributes_of("square").find("willreturn"), std::string::npos);
+  EXPECT_NE(attributes_of("square").find("nounwind"), std::string::npos);
+  EXPECT_NE(attributes_of("helper").find("alwaysinline"), std::string::npos);
+  EXPECT_NE(attributes_of("report").find("cold"), std::string::npos);
+  EXPECT_NE(attributes_of("report").find("noinline"), std::string::npos);
+  EXPECT_NE(attributes_of("step").find("hot"), std::string::npos);
+
+  EXPECT_NE(output.find("!{!\"branch_weights\", i32 1, i32 2000}"),
+            std::string::npos);
+  EXPECT_NE(output.find("!{!\"branch_weights\", i32 2000, i32 1}"),
+            std::string::npos);
+}
+
+TEST_F(CodeGenerationTest, ProfileFromInstrumentedRunWeighsBranches) {
+  const std::string source = R"(
+const classify = noinline fn(x: i32) -> i32 {
+  if x < 10 {
+    fmt.println("small %d", x)
+    return 1
+  }
+  return 2
+}
+
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop i in 0..1000 do total = total + classify(i)
+  return total / 100
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  auto profile =
+      std::filesystem::temp_directory_path() / "void_branch_profile.profdata";
+
+  // Train: the instrumented module counts its branches as it runs
+  CodeGenerator instrumented;
+  instrumented.set_profile_generate(true);
+  instrumented.generate_program(program.get());
+  instrumented.optimize();
+  testing::internal::CaptureStdout();
+  EXPECT_EQ(instrumented.run_jit(), 19);
+  testing::internal::GetCapturedStdout();
+  instrumented.write_jit_profile(profile.string());
+
+  CodeGenerator optimized;
+  optimized.set_profile_use(profile.string());
+  optimized.generate_program(program.get());
+  optimized.optimize();
+  std::filesystem::remove(profile);
+
+  testing::internal::CaptureStdout();
+  optimized.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  // classify ran 1000 times and took the small branch 10 of them
+  EXPECT_NE(output.find("!{!\"function_entry_count\", i64 1000}"),
+            std::string::npos);
+  EXPECT_NE(output.find("!{!\"branch_weights\", i32 10, i32 990}"),
+            std::string::npos);
+
+  CodeGenerator missing;
+  missing.set_profile_use(profile.string());
+  missing.generate_program(program.get());
+  EXPECT_THROW(missing.optimize(), std::runtime_error);
+}
+
+TEST_F(CodeGenerationTest, EmitsDebugInfoAndFramePointers) {
+  const std::string source = R"(
+const apply = fn(f: fn(i32) -> i32, x: i32) -> i32 do return f(x)
+
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop par i in 0..4 {
+    fmt.println("%d", i)
+  }
+  total = apply(fn(x: i32) -> i32 {
+    return x + 1
+  }, 2)
+  return total
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  CodeGenerator codegen;
+  codegen.set_debug_info("debug_info/prog.void");
+  codegen.set_frame_pointers(true);
+  codegen.generate_program(program.get());
+
+  testing::internal::CaptureStdout();
+  codegen.print_ir();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_NE(output.find("!DIFile(filename: \"prog.void\""), std::string::npos);
+  EXPECT_NE(output.find("!DISubprogram(name: \"main\""), std::string::npos);
+  EXPECT_NE(output.find("!DISubprogram(name: \"apply\""), std::string::npos);
+  // The anonymous function and the `loop par` body get their own
+  EXPECT_NE(output.find("!DISubprogram(name: \"anon_"), std::string::npos);
+  EXPECT_NE(output.find("!DISubprogram(name: \"main.par_body\""),
+            std::string::npos);
+  EXPECT_NE(output.find("!DILocation(line: 5, column: 3"), std::string::npos);
+  EXPECT_NE(output.find("!DILocation(line: 7, column: 5"), std::string::npos);
+  EXPECT_NE(output.find("!DILocation(line: 10, column: 5"), std::string::npos);
+  EXPECT_NE(output.find("\"frame-pointer\"=\"all\""), std::string::npos);
+
+  // Each location must be in its own function's subprogram, which the
+  // verifier in optimize() checks
+  EXPECT_NO_THROW(codegen.optimize());
+  auto assembly = std::filesystem::temp_directory_path() / "void_debug_info.s";
+  ASSERT_TRUE(codegen.compile_to_assembly(assembly.string()));
+  std::ifstream file(assembly);
+  std::stringstream text;
+  text << file.rdbuf();
+  std::filesystem::remove(assembly);
+  EXPECT_NE(text.str().find(".loc\t"), std::string::npos);
+  EXPECT_NE(text.str().find("movq\t%rsp, %rbp"), std::string::npos);
+}
+
 }  // namespace
 }  // namespace void_compiler
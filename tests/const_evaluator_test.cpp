@@ -0,0 +1,291 @@
+#include "const_evaluator.h"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+class ConstEvaluatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+  void TearDown() override {}
+
+  std::unique_ptr<Program> ParseSource(const std::string& source) {
+    Lexer lexer(source);
+    std::vector<Token> tokens;
+    Token token;
+    do {
+      token = lexer.next_token();
+      tokens.push_back(token);
+    } while (token.type != TokenType::EndOfFile);
+
+    Parser parser(std::move(tokens));
+    return parser.parse();
+  }
+};
+
+TEST_F(ConstEvaluatorTest, FoldsPureCallWithConstantArguments) {
+  const std::string source = R"(
+const pow = fn(base: i32, exponent: i32) -> i32 {
+  if exponent == 0 do return 1
+
+  result: i32 = 1
+  loop i in 0..exponent do result = result * base
+  return result
+}
+
+const main = fn() -> i32 {
+  return pow(2, 10)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, 1024);
+  EXPECT_EQ(folds.begin()->second.type, "i32");
+  ASSERT_EQ(evaluator.report().size(), 1);
+  EXPECT_EQ(evaluator.report()[0], "pow(2, 10) = 1024");
+}
+
+TEST_F(ConstEvaluatorTest, FoldsNestedAndRecursiveCalls) {
+  const std::string source = R"(
+const fact = fn(n: i32) -> i32 {
+  if n <= 1 do return 1
+  return n * fact(n - 1)
+}
+
+const main = fn() -> i32 {
+  return fact(fact(3))
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  // Only the outermost call is recorded; it covers the inner one
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, 720);
+}
+
+TEST_F(ConstEvaluatorTest, WrapsToDeclaredTypeWidth) {
+  const std::string source = R"(
+const narrow = fn(x: i32) -> i8 do return x
+const main = fn() -> i32 {
+  value: i8 = narrow(200)
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, -56);
+  EXPECT_EQ(folds.begin()->second.type, "i8");
+}
+
+TEST_F(ConstEvaluatorTest, DoesNotFoldImpureFunctions) {
+  const std::string source = R"(
+import fmt
+
+const noisy = fn(x: i32) -> i32 {
+  fmt.println("x: {:d}", x)
+  return x
+}
+
+const calls_noisy = fn(x: i32) -> i32 do return noisy(x) + 1
+
+const main = fn() -> i32 {
+  return calls_noisy(1)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  EXPECT_TRUE(evaluator.fold_calls().empty());
+}
+
+TEST_F(ConstEvaluatorTest, DoesNotFoldNonConstantArguments) {
+  const std::string source = R"(
+const double = fn(x: i32) -> i32 do return x * 2
+const main = fn() -> i32 {
+  y: i32 = 4
+  return double(y)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  EXPECT_TRUE(evaluator.fold_calls().empty());
+}
+
+TEST_F(ConstEvaluatorTest, LeavesDivisionByZeroForRuntime) {
+  const std::string source = R"(
+const divide = fn(x: i32, y: i32) -> i32 do return x / y
+const main = fn() -> i32 {
+  return divide(1, 0)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  EXPECT_TRUE(evaluator.fold_calls().empty());
+}
+
+TEST_F(ConstEvaluatorTest, GivesUpAtRecursionLimit) {
+  const std::string source = R"(
+const count = fn(n: i32) -> i32 {
+  if n == 0 do return 0
+  return 1 + count(n - 1)
+}
+
+const main = fn() -> i32 {
+  return count(10) + count(1000)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get(),
+                           EvaluationLimits{.max_steps = 1'000'000,
+                                            .max_recursion_depth = 64});
+  auto folds = evaluator.fold_calls();
+
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, 10);
+}
+
+TEST_F(ConstEvaluatorTest, GivesUpAtStepLimit) {
+  const std::string source = R"(
+const spin = fn() -> i32 {
+  loop if true do return 1
+  return 0
+}
+
+const forever = fn() -> i32 {
+  x: i32 = 0
+  loop if x >= 0 do x = 1
+  return x
+}
+
+const main = fn() -> i32 {
+  return spin() + forever()
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get(),
+                           EvaluationLimits{.max_steps = 10'000,
+                                            .max_recursion_depth = 64});
+  auto folds = evaluator.fold_calls();
+
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(evaluator.report()[0], "spin() = 1");
+}
+
+TEST_F(ConstEvaluatorTest, FoldsCallsThroughMatch) {
+  const std::string source = R"(
+const cost = fn(op: u8) -> i32 {
+  match op {
+    0 do return 1
+    1..10 do return 5
+    250..256 do return 9
+    else do return 2
+  }
+  return 0
+}
+
+const main = fn() -> i32 {
+  return cost(3) + cost(255)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  ASSERT_EQ(folds.size(), 2);
+  std::vector<int64_t> values;
+  for (const auto& [call, fold] : folds) values.push_back(fold.value);
+  std::ranges::sort(values);
+  EXPECT_EQ(values, (std::vector<int64_t>{5, 9}));
+}
+
+TEST_F(ConstEvaluatorTest, LeavesTrappingOverflowForRuntime) {
+  const std::string source = R"(
+const grow = fn(x: i32) -> i32 do return x * 65536
+const checked = overflow(trap) fn(x: i32) -> i32 do return x * 65536
+
+const main = fn() -> i32 {
+  return grow(65536) + checked(65536) + checked(2)
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  // Wrapping overflow folds, but checked(65536) has to trap when it runs
+  EXPECT_EQ(folds.size(), 2);
+  const auto& report = evaluator.report();
+  EXPECT_NE(std::ranges::find(report, "grow(65536) = 0"), report.end());
+  EXPECT_NE(std::ranges::find(report, "checked(2) = 131072"), report.end());
+}
+
+TEST_F(ConstEvaluatorTest, ZeroExtendsNarrowerUnsignedOperands) {
+  const std::string source = R"(
+const sum = fn(x: u32, y: u64) -> u64 do return x + y
+const main = fn() -> i32 {
+  if sum(-2147483647 - 1, 0) > 0 do return 1
+  return 2
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  // x holds 2^31, which stays positive as a u64
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, 2147483648);
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Interpret), 1);
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Jit), 1);
+}
+
+TEST_F(ConstEvaluatorTest, WidensMixedWidthOperandsLikeCodeGeneration) {
+  const std::string source = R"(
+const next = fn(x: i64) -> i64 do return 1 + x
+const main = fn() -> i32 {
+  if next(2147483647) > 2147483647 do return 1
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ConstEvaluator evaluator(program.get());
+  auto folds = evaluator.fold_calls();
+
+  // The i32 literal is sign extended, so the sum doesn't wrap at 32 bits
+  ASSERT_EQ(folds.size(), 1);
+  EXPECT_EQ(folds.begin()->second.value, 2147483648);
+  EXPECT_EQ(folds.begin()->second.type, "i64");
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Interpret), 1);
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Jit), 1);
+}
+
+}  // namespace
+}  // namespace void_compiler
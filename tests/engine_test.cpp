@@ -0,0 +1,110 @@
+#include "engine.h"
+
+#include <gtest/gtest.h>
+
+#include <thread>
+#include <vector>
+
+namespace void_compiler {
+namespace {
+
+TEST(EngineTest, ReturnsTypedNativeFunctions) {
+  auto mod = Engine::load(R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const scale = fn(x: i64) -> i64 do return x * 1000
+)");
+
+  auto add = mod.get<int32_t(int32_t, int32_t)>("add");
+  auto scale = mod.get<int64_t(int64_t)>("scale");
+  EXPECT_EQ(add(2, 3), 5);
+  EXPECT_EQ(scale(5'000'000'000), 5'000'000'000'000);
+}
+
+TEST(EngineTest, ChecksSignaturesAgainstDeclaredTypes) {
+  auto mod = Engine::load(R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+)");
+
+  EXPECT_TRUE(mod.contains("add"));
+  EXPECT_THROW(mod.get<int64_t(int64_t, int64_t)>("add"), std::runtime_error);
+  EXPECT_THROW(mod.get<int32_t(int32_t)>("add"), std::runtime_error);
+  EXPECT_THROW(mod.get<int32_t(int32_t, int32_t)>("sub"), std::runtime_error);
+}
+
+TEST(EngineTest, ExportsEveryFunctionAlongsideMain) {
+  auto mod = Engine::load(R"(
+const helper = fn() -> i32 do return 7
+const unused = fn() -> i32 do return 8
+const main = fn() -> i32 {
+  return helper()
+}
+)");
+
+  EXPECT_EQ(mod.get<int32_t()>("main")(), 7);
+  EXPECT_EQ(mod.get<int32_t()>("unused")(), 8);
+}
+
+TEST(EngineTest, ExtendsNarrowIntegersLikeC) {
+  auto mod = Engine::load(R"(
+const shift = fn(x: i8, flag: bool) -> i8 {
+  if flag do return x - 100
+  return x
+}
+const negate = fn(flag: bool) -> bool do return not flag
+)");
+
+  auto shift = mod.get<int8_t(int8_t, bool)>("shift");
+  EXPECT_EQ(shift(-100, true), 56);
+  EXPECT_EQ(shift(-5, false), -5);
+
+  auto negate = mod.get<bool(bool)>("negate");
+  EXPECT_TRUE(negate(false));
+  EXPECT_FALSE(negate(true));
+}
+
+TEST(EngineTest, PassesPointersAndCallbacks) {
+  auto mod = Engine::load(R"(
+const read = fn(p: *i32) -> i32 do return p.* + 1
+const apply = fn(f: fn(i32) -> i32, x: i32) -> i32 do return f(x) + f(x)
+)");
+
+  int32_t value = 41;
+  EXPECT_EQ(mod.get<int32_t(int32_t*)>("read")(&value), 42);
+
+  auto apply = mod.get<int32_t(int32_t (*)(int32_t), int32_t)>("apply");
+  EXPECT_EQ(apply(+[](int32_t x) { return x * 10; }, 2), 40);
+}
+
+TEST(EngineTest, SharesModulesAcrossCopiesAndThreads) {
+  int32_t (*fib)(int32_t) = nullptr;
+  {
+    auto mod = Engine::load(R"(
+const fib = fn(n: i32) -> i32 {
+  if n < 2 do return n
+  return fib(n - 1) + fib(n - 2)
+}
+)");
+    auto copy = mod;
+    fib = copy.get<int32_t(int32_t)>("fib");
+
+    std::vector<std::thread> threads;
+    std::vector<int32_t> results(4);
+    for (size_t i = 0; i < results.size(); ++i) {
+      threads.emplace_back(
+          [&, i] { results[i] = mod.get<int32_t(int32_t)>("fib")(20); });
+    }
+    for (auto& thread : threads) thread.join();
+    for (int32_t result : results) EXPECT_EQ(result, 6765);
+    EXPECT_EQ(fib(10), 55);
+  }
+}
+
+TEST(EngineTest, ReportsInvalidPrograms) {
+  EXPECT_THROW(Engine::load(R"(
+const broken = fn() -> i32 do return missing
+)"),
+               std::runtime_error);
+}
+
+}  // namespace
+}  // namespace void_compiler
@@ -1,5 +1,7 @@
 #include <gtest/gtest.h>
 
+#include <filesystem>
+
 #include "compiler.h"
 
 namespace void_compiler {
@@ -10,6 +12,20 @@ class IntegrationTest : public testing::Test {
   void SetUp() override {}
   void TearDown() override {}
 
+  // Runs source with the JIT, and checks the interpreter agrees, both on its
+  // own and when every function moves to native code after its first call
+  int compile_and_run(const std::string& source) {
+    int jit_result = compiler_.compile_and_run(source, ExecutionMode::Jit);
+    int interpreted_result =
+        compiler_.compile_and_run(source, ExecutionMode::Interpret);
+    EXPECT_EQ(interpreted_result, jit_result) << "interpreter and JIT differ";
+
+    compiler_.set_tier_up_policy({.threshold = 1, .synchronous = true});
+    int tiered_result = compiler_.compile_and_run(source, ExecutionMode::Tiered);
+    EXPECT_EQ(tiered_result, jit_result) << "tiered and JIT differ";
+    return jit_result;
+  }
+
   Compiler compiler_;
 };
 
@@ -20,7 +36,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -35,7 +51,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 8);
 }
 
@@ -50,7 +66,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   // 10 + 5 * 3 - 10 / 5 = 10 + 15 - 2 = 23
   EXPECT_EQ(result, 23);
 }
@@ -66,7 +82,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   // helper(5) = 10, helper(3) = 6, 10 + 6 * 2 = 10 + 12 = 22
   EXPECT_EQ(result, 22);
 }
@@ -86,7 +102,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   // multiply(2, 3) = 6, multiply(4, 5) = 20, add(6, 20) = 26
   EXPECT_EQ(result, 26);
 }
@@ -102,7 +118,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   // (7 + 3) * (7 - 3) = 10 * 4 = 40
   EXPECT_EQ(result, 40);
 }
@@ -118,7 +134,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 5);
 }
 
@@ -129,7 +145,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   // 2 + 3 * 4 - 8 / 2 = 2 + 12 - 4 = 10
   EXPECT_EQ(result, 10);
 }
@@ -145,7 +161,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 99);
 }
 
@@ -172,7 +188,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -186,7 +202,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 30);
 }
 
@@ -202,7 +218,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 23); // (5+3) + (5*3) = 8 + 15 = 23
 }
 
@@ -220,7 +236,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 24); // (10*2) + (8/2) = 20 + 4 = 24
 }
 
@@ -233,7 +249,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 200); // 100 * 2 = 200
 }
 
@@ -249,7 +265,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 36); // x=15, y=12, x=24, return 24+12=36
 }
 
@@ -266,7 +282,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 21); // (5+10) + (3*2) = 15 + 6 = 21
 }
 
@@ -281,7 +297,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 3); // ((0+1)*5)-2 = 3
 }
 
@@ -296,7 +312,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1);
 }
 
@@ -315,7 +331,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2); // 5 is not > 10, so returns 2
 }
 
@@ -336,7 +352,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2); // 15 is > 10 but not > 20
 }
 
@@ -367,7 +383,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // 10 > 5 is true
 }
 
@@ -386,7 +402,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // 15 > 10 AND 50 < 100 = true AND true = true
 }
 
@@ -405,7 +421,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // 15 > 100 OR 5 < 10 = false OR true = true
 }
 
@@ -424,7 +440,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // NOT(15 > 20) = NOT(false) = true
 }
 
@@ -443,7 +459,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // (5>10 AND 50<100) OR NOT(10==0) = (false AND true) OR NOT(false) = false OR true = true
 }
 
@@ -465,7 +481,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1); // (-1>0 AND -2>0) OR 5>0 = (false AND false) OR true = false OR true = true
 }
 
@@ -493,7 +509,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2); // x=5>0 is true, y=-3>0 is false, so return 2
 }
 
@@ -519,7 +535,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 3); // score=85 >= 80 but < 90, so grade = 3
 }
 
@@ -534,10 +550,124 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 10); // 0+1+2+3+4 = 10
 }
 
+TEST_F(IntegrationTest, CompileAndRunParallelRangeLoop) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  n :i32 = 20000
+  found :i32 = 0
+  loop par i in 0..n {
+    loop par j in 0..2 {
+      if i * i + j == 5929 {
+        found = i
+      }
+    }
+  }
+  return found
+}
+)";
+
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 77);
+}
+
+// Arrays only run natively, so these skip the interpreter comparison
+TEST_F(IntegrationTest, CompileAndRunArrays) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  values := [1, 2, 3, 4]
+  squares: [4]i64
+  loop i in 0..4 {
+    squares[i] = values[i] * values[i]
+  }
+  total: i64 = 0
+  loop square in squares do total = total + square
+  copy: [_]i64 = [0, 0, 0, 0]
+  copy = squares
+  mixed: [3]i32 = [values[0], values[3], 7]
+  return total + copy[3] + mixed[1] + mixed[2]
+}
+)";
+
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 57);
+}
+
+TEST_F(IntegrationTest, CompileAndRunLargeArrayInALoop) {
+  const std::string source = R"(
+const sum = fn(n: i32) -> i64 {
+  values: [100000]i64
+  loop i in 0..100000 do values[i] = i * n
+  total: i64 = 0
+  loop value in values do total = total + value
+  return total
+}
+
+const main = fn() -> i32 {
+  total: i64 = 0
+  loop n in 0..3 do total = total + sum(n)
+  return total / 1000000
+}
+)";
+
+  // 4999950000 * (0 + 1 + 2)
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 14999);
+}
+
+TEST_F(IntegrationTest, CompileAndRunVectors) {
+  const std::string source = R"(
+const dot = fn(a: v4i32, b: v4i32) -> i32 {
+  return simd.reduce_add(a * b)
+}
+
+const main = fn() -> i32 {
+  a := v4i32(1, 2, 3, 4)
+  b := v4i32(2)
+  c := a + b * 3
+  c[0] = 100
+  picked := simd.select(a > 2, a, v4i32(0))
+  s := simd.shuffle(a, b, 3, 2, 1, 0)
+  m := simd.max(a, v4i32(3))
+  flags: i32 = 0
+  if simd.any(a == 4) {
+    flags = flags + 1
+  }
+  if simd.all(a > 0 and a < 4) {
+    flags = flags + 1000
+  }
+  if simd.any(v4u8(200, 1, 2, 3) > v4u8(150)) {
+    flags = flags + 10
+  }
+  return simd.reduce_add(picked) + s[0] + c[0] + dot(a, b) +
+         simd.reduce_min(m) + flags - a[3]
+}
+)";
+
+  // 7 + 4 + 100 + 20 + 3 + 11 - 4
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 141);
+}
+
+TEST_F(IntegrationTest, CompileAndRunVectorKernelOverAnArray) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  values: [1024]i32
+  loop i in 0..1024 do values[i] = i
+  acc := v8i32(0)
+  loop i in 0..128 {
+    x := v8i32.load(values, i * 8)
+    simd.store(values, i * 8, x * 2)
+    acc = acc + x
+  }
+  return simd.reduce_add(acc) / 1000 + values[1023] / 1000
+}
+)";
+
+  // 523776 / 1000 + 2046 / 1000
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 525);
+}
+
 TEST_F(IntegrationTest, CompileAndRunConditionalLoop) {
   const std::string source = R"(
 const main = fn() -> i32 {
@@ -549,7 +679,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 5); // Loop increments x until x < 5 is false
 }
 
@@ -565,7 +695,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 7); // Should return when i reaches 7
 }
 
@@ -582,7 +712,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 9); // 3 * 3 = 9 iterations
 }
 
@@ -599,7 +729,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 10); // x=5, y=5, so 5+5=10
 }
 
@@ -618,7 +748,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 6); // 1+2+3 = 6
 }
 
@@ -636,7 +766,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 120); // 1*2*3*4*5 = 120 (first to exceed 100)
 }
 
@@ -657,7 +787,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 13); // Numbers 6,7,8,9,11,12,13,14 count as 1 each (8), plus 10 counts as 5, so 8+5=13
 }
 
@@ -680,7 +810,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 6); // Range loop: 0+1+2=3, Conditional loop: 0+1+2=3, Total: 3+3=6
 }
 
@@ -695,7 +825,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42); // Loop should not execute (5 not < 5), so sum remains 42
 }
 
@@ -710,7 +840,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 10); // Condition is false from start, so x remains 10
 }
 
@@ -724,7 +854,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -737,7 +867,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1);
 }
 
@@ -750,7 +880,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2);
 }
 
@@ -763,7 +893,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 10); // 0+1+2+3+4 = 10
 }
 
@@ -776,7 +906,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 5);
 }
 
@@ -791,7 +921,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2); // Only adds 2 (i=2), since i=0,1 don't satisfy i>1
 }
 
@@ -809,7 +939,7 @@ const main = fn() -> i32 {
 
   // We can't easily test stdout output in this test framework,
   // but we can verify the program compiles and runs without crashing
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -825,7 +955,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -840,7 +970,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -855,7 +985,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -872,7 +1002,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -887,7 +1017,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 0);
 }
 
@@ -902,7 +1032,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 127);
 }
 
@@ -917,7 +1047,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 32767);
 }
 
@@ -932,7 +1062,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1000000);
 }
 
@@ -947,7 +1077,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 255);
 }
 
@@ -962,7 +1092,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 65535);
 }
 
@@ -977,7 +1107,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -992,7 +1122,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 2000000);
 }
 
@@ -1018,7 +1148,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 600);  // 100 + 200 + 300
 }
 
@@ -1037,7 +1167,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -1052,7 +1182,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, -50000);
 }
 
@@ -1065,7 +1195,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, -15);
 }
 
@@ -1077,7 +1207,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 42);
 }
 
@@ -1091,7 +1221,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, 1);  // -10 < -5 is true
 }
 
@@ -1108,7 +1238,7 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, -42);
 }
 
@@ -1122,9 +1252,421 @@ const main = fn() -> i32 {
 }
 )";
 
-  int result = compiler_.compile_and_run(source);
+  int result = compile_and_run(source);
   EXPECT_EQ(result, -10);
 }
 
+TEST_F(IntegrationTest, RestoresOuterVariablesAfterAnonymousFunction) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  x: i32 = 4
+  op := fn(x: i32) -> i32 do return x + 1
+  return op(x) + x
+}
+)";
+
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 9);
+}
+
+TEST_F(IntegrationTest, LoopBodyVariablesShadowOuterOnes) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  total: i32 = 0
+  step: i32 = 100
+  loop i in 0..3 {
+    step: i32 = 1
+    total = total + step
+  }
+  return total + step
+}
+)";
+
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 103);
+}
+
+TEST_F(IntegrationTest, ZeroExtendsUnsignedOperandsWhenWidening) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  small: u32 = 2147483647
+  small = small + 1
+  wide: u64 = 0
+  if small + wide > 0 and wide + small == small + wide do return 1
+  return 2
+}
+)";
+
+  // small holds 2^31, which must not turn negative as a u64
+  EXPECT_EQ(compile_and_run(source), 1);
+}
+
+TEST_F(IntegrationTest, FindsTheParallelRuntimeLibrary) {
+  EXPECT_TRUE(std::filesystem::exists(
+      std::filesystem::path(runtime_library_directory()) /
+      "libvoid_runtime.a"));
+}
+
+TEST_F(IntegrationTest, StatsCountDeadFunctions) {
+  const std::string source = R"(
+const unused = fn() -> i32 do return 1
+const used = fn() -> i32 do return 2
+const main = fn() -> i32 do return used()
+)";
+
+  // unused is never parsed, and used() is folded at compile time
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 2);
+  EXPECT_EQ(compiler_.stats().functions_eliminated, 2);
+  EXPECT_EQ(compiler_.stats().folded_calls.size(), 1);
+}
+
+TEST_F(IntegrationTest, GuardedFunctionPointerCallsPickTheRightTarget) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const multiply = fn(x: i32, y: i32) -> i32 do return x * y
+const main = fn() -> i32 {
+  operation: fn(i32, i32) -> i32 = add
+  total: i32 = 0
+  loop i in 0..3 {
+    total = total + operation(i, 3)
+    operation = multiply
+  }
+  return total
+}
+)";
+
+  // add(0, 3) + multiply(1, 3) + multiply(2, 3)
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 12);
+}
+
+TEST_F(IntegrationTest, CompileAndRunCallbackLoopWithI64Lambda) {
+  const std::string source = R"(
+const sum_with = fn(n: i32, step: fn(i64, i64) -> i64) -> i64 {
+  total: i64 = 0
+  loop i in 0..n do total = step(total, i)
+  return total
+}
+
+const main = fn() -> i32 {
+  total: i64 = sum_with(100000, fn(acc: i64, x: i64) -> i64 do return acc + x)
+  return total / 100000000
+}
+)";
+
+  // 0 + 1 + ... + 99999 = 4999950000 overflows i32, so this only holds if
+  // the lambda really works in i64
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 49);
+}
+
+TEST_F(IntegrationTest, CompileAndRunRangeLoopsPastThirtyTwoBits) {
+  const std::string source = R"(
+const sum = fn(n: i64) -> i64 {
+  total: i64 = 0
+  loop i in 0..n do total = total + i
+  return total
+}
+
+const count = fn(n: u64) -> i64 {
+  total: i64 = 0
+  loop i in 0..n do total = total + 1
+  return total
+}
+
+const main = fn() -> i32 {
+  big: i64 = 1500000000
+  big = big * 2
+  steps: i64 = 0
+  loop i in big..big + 5 do steps = steps + i - big
+  return sum(100000) / 1000000000 + count(7) + steps
+}
+)";
+
+  int result = compile_and_run(source);
+  EXPECT_EQ(result, 21);
+}
+
+TEST_F(IntegrationTest, CompileAndRunStructs) {
+  const std::string source = R"(
+const Vec2 = struct { x: i32, y: i32 }
+const Body = struct {
+  position: Vec2,
+  mass: i64,
+  alive: bool,
+}
+const Header = packed struct { tag: u8, length: i32 }
+const Counter = struct align(64) { hits: i64 }
+const Particle = soa struct { x: i32, v: i32 }
+
+const add = fn(a: Vec2, b: Vec2) -> Vec2 {
+  return Vec2(a.x + b.x, a.y + b.y)
+}
+
+const push = fn(body: *Body, dx: i32) {
+  body.position.x = body.position.x + dx
+}
+
+const main = fn() -> i32 {
+  p := add(Vec2(1, 2), Vec2(10, 20))
+  body := Body(p, 5, true)
+  body.position.y = body.position.y + 100
+  push(&body, 7)
+  h: Header
+  h.tag = 3
+  h.length = 1000
+  counters: [4]Counter
+  loop i in 0..4 do counters[i].hits = i * 2
+  particles: [8]Particle
+  loop i in 0..8 {
+    particles[i].x = i
+    particles[i].v = 2
+  }
+  particles[3] = Particle(100, 0)
+  total: i64 = 0
+  loop q in particles do total = total + q.x + q.v
+  loop c in counters do total = total + c.hits
+  return body.position.x + body.position.y + body.mass + h.length / 100 + h.tag + total
+}
+)";
+
+  // Structs only run natively, so this skips the interpreter comparison.
+  // 18 + 122 + 5 + 10 + 3 + (125 + 14) + 12
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 309);
+}
+
+TEST_F(IntegrationTest, CompileAndRunOverAlignedStructsOnTheHeap) {
+  const std::string source = R"(
+const Counter = struct align(64) { hits: i64 }
+const Outer = struct { tag: u8, counter: Counter, after: i16 }
+const main = fn() -> i32 {
+  o: Outer
+  o.counter.hits = 5
+  o.after = 2
+  big: [2000]Counter
+  big[1999].hits = 9
+  return o.counter.hits + o.after + big[1999].hits
+}
+)";
+
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 16);
+}
+
+TEST_F(IntegrationTest, CompileAndRunBorrows) {
+  const std::string source = R"(
+const bump = fn(target: &mut i32, amount: &i32) {
+  target.* = target.* + amount.*
+}
+
+const bump_twice = fn(target: &mut i32, amount: &i32) {
+  bump(target, amount)
+  bump(target, amount)
+}
+
+const widen = fn(p: *i64) -> i64 do return p.* + 1
+
+const store = fn(p: *i8) {
+  p.* = 300
+}
+
+const main = fn() -> i32 {
+  total: i32 = 1
+  step: i32 = 5
+  bump_twice(&mut total, &step)
+  big: i64 = 40000
+  small: i8 = 0
+  store(&small)
+  return total + widen(&big) - 40000 + small
+}
+)";
+
+  // 11 + 1 + (300 wrapped to an i8)
+  EXPECT_EQ(compile_and_run(source), 56);
+}
+
+TEST_F(IntegrationTest, CompileAndRunBorrowedArraysAndStructs) {
+  const std::string source = R"(
+const Counter = struct align(64) { hits: i64 }
+
+const fill = fn(values: &mut [100000]i32, factor: &i32, c: &mut Counter) {
+  loop i in 0..100000 do values[i] = factor.*
+  c.hits = 3
+}
+
+const sum = fn(values: &[100000]i32) -> i32 {
+  total: i32 = 0
+  loop v in values do total = total + v
+  return total
+}
+
+const main = fn() -> i32 {
+  values: [100000]i32
+  big: [2000]Counter
+  k: i32 = 2
+  fill(&mut values, &k, &mut big[1999])
+  return sum(&values) - 199990 + big[1999].hits
+}
+)";
+
+  // Arrays and structs only run natively, so this skips the interpreter
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Jit), 13);
+}
+
+TEST_F(IntegrationTest, CompileAndRunMatch) {
+  const std::string source = R"(
+const classify = fn(op: u8) -> i32 {
+  result: i32 = 0
+  match op {
+    0 do result = 10
+    1, 2 do result = 20
+    3..10 {
+      result = 30
+      result = result + op
+    }
+    100..180 do result = 50
+    200..256 do return 40
+    else do result = -1
+  }
+  return result
+}
+
+const flag = fn(b: bool) -> i32 {
+  match b {
+    true do return 1
+    false do return 2
+  }
+  return 0
+}
+
+const main = fn() -> i32 {
+  x: i64 = -3
+  y: i32 = 0
+  match x - 1 {
+    -4 do y = 5
+    else do y = 6
+  }
+  total := classify(0) + classify(2) + classify(7) + classify(255)
+  total = total + classify(150) + classify(99)
+  return total + flag(true) * 100 + flag(false) * 1000 + y - 2000
+}
+)";
+
+  // 10 + 20 + 37 + 40 + 50 - 1 + 100 + 2000 + 5 - 2000
+  EXPECT_EQ(compile_and_run(source), 261);
+}
+
+TEST_F(IntegrationTest, OverflowModesAgreeWhenNothingOverflows) {
+  const std::string source = R"(
+const checked = overflow(trap) fn(n: i32) -> i32 {
+  total: i32 = 0
+  loop i in 0..n do total = total + i * 3 - 1
+  return total
+}
+
+const assumed = overflow(undefined) fn(n: u32) -> u32 {
+  total: u32 = 0
+  loop i in 0..n do total = total + 2
+  return total
+}
+
+const main = fn() -> i32 {
+  return checked(100) - assumed(50)
+}
+)";
+
+  // 3 * 4950 - 100 - 100
+  EXPECT_EQ(compile_and_run(source), 14650);
+}
+
+TEST_F(IntegrationTest, TrapsOnOverflowInTrapMode) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  const std::string source = R"(
+const main = fn() -> i32 {
+  total: i32 = 1
+  loop i in 0..40 do total = total * 2
+  return total
+}
+)";
+
+  // Wrapping doubles 1 past the top bit and out again
+  EXPECT_EQ(compile_and_run(source), 0);
+
+  // The interpreter reports the overflow and fails, native code reports it
+  // the same way before it traps
+  compiler_.set_overflow_mode(OverflowMode::Trap);
+  testing::internal::CaptureStderr();
+  EXPECT_EQ(compiler_.compile_and_run(source, ExecutionMode::Interpret), -1);
+  EXPECT_NE(testing::internal::GetCapturedStderr().find(
+                "Error: Integer overflow"),
+            std::string::npos);
+  EXPECT_DEATH(compiler_.compile_and_run(source, ExecutionMode::Jit),
+               "Error: Integer overflow");
+}
+
+TEST_F(IntegrationTest, ReportsOutOfBoundsIndicesBeforeTrapping) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  const std::string source = R"(
+const get = noinline fn(i: i32) -> i32 {
+  values := [1, 2, 3, 4]
+  return values[i]
+}
+const main = fn() -> i32 {
+  return get(3) + get(7)
+}
+)";
+
+  EXPECT_DEATH(compiler_.compile_and_run(source, ExecutionMode::Jit),
+               "Error: index 7 out of bounds for length 4");
+}
+
+TEST_F(IntegrationTest, TailCallsRunInConstantStack) {
+  const std::string source = R"(
+const is_even = fn(n: i32) -> bool {
+  if n == 0 do return true
+  return musttail is_odd(n - 1)
+}
+
+const is_odd = fn(n: i32) -> bool {
+  if n == 0 do return false
+  return musttail is_even(n - 1)
+}
+
+const main = fn() -> i32 {
+  if is_even(1000000) do return 1
+  return 0
+}
+)";
+
+  // A million frames would be past the interpreter's call depth limit
+  EXPECT_EQ(compile_and_run(source), 1);
+}
+
+TEST_F(IntegrationTest, HintsDontChangeResults) {
+  const std::string source = R"(
+const square = pure inline fn(x: i64) -> i64 do return x * x
+
+const penalty = cold noinline fn(x: i64) -> i64 do return 0 - x
+
+const score = hot fn(x: i64) -> i64 {
+  if unlikely x > 90 do return penalty(x)
+  if likely x > 0 {
+    return square(x)
+  } else if unlikely x == 0 {
+    return 7
+  }
+  return 1
+}
+
+const main = fn() -> i32 {
+  total: i64 = 0
+  loop i in 0..100 do total = total + score(i)
+  return total
+}
+)";
+
+  // 7 + 1 + 4 + ... + 90 * 90 - (91 + ... + 99)
+  EXPECT_EQ(compile_and_run(source), 7 + 247065 - 855);
+}
+
 }  // namespace
 }  // namespace void_compiler
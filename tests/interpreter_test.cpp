@@ -0,0 +1,360 @@
+#include "interpreter.h"
+
+#include <gtest/gtest.h>
+
+#include "bytecode_compiler.h"
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+class InterpreterTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<Program> ParseSource(const std::string& source) {
+    Lexer lexer(source);
+    std::vector<Token> tokens;
+    Token token;
+    do {
+      token = lexer.next_token();
+      tokens.push_back(token);
+    } while (token.type != TokenType::EndOfFile);
+
+    Parser parser(std::move(tokens));
+    return parser.parse();
+  }
+
+  int64_t Run(const std::string& source, InterpreterLimits limits = {}) {
+    auto program = ParseSource(source);
+    BytecodeModule module = BytecodeCompiler(program.get()).compile();
+    return Interpreter(module, limits).run();
+  }
+};
+
+TEST_F(InterpreterTest, RunsArithmeticAndCalls) {
+  const std::string source = R"(
+const add = fn(x: i32, y: i32) -> i32 do return x + y
+const main = fn() -> i32 {
+  return add(2, 3) * 4 - 10 / 5
+}
+)";
+
+  EXPECT_EQ(Run(source), 18);
+}
+
+TEST_F(InterpreterTest, WrapsToTheDeclaredWidth) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  small: i8 = 127
+  small = small + 1
+  return small
+}
+)";
+
+  EXPECT_EQ(Run(source), -128);
+}
+
+TEST_F(InterpreterTest, RunsLoopsAndBranches) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop i in 0..10 {
+    if i > 4 and i < 8 {
+      total = total + i
+    } else do total = total + 1
+  }
+  n: i32 = 0
+  loop if n < 3 do n = n + 1
+  return total + n
+}
+)";
+
+  // 5 + 6 + 7 + 7 * 1 + 3
+  EXPECT_EQ(Run(source), 28);
+}
+
+TEST_F(InterpreterTest, CallsThroughFunctionPointers) {
+  const std::string source = R"(
+const double = fn(x: i64) -> i64 do return x * 2
+const apply = fn(f: fn(i64) -> i64, x: i64) -> i64 do return f(x)
+const main = fn() -> i32 {
+  op: fn(i64) -> i64 = double
+  first: i64 = apply(op, 10)
+  op = fn(x: i64) -> i64 do return x + 1
+  return first + apply(op, 10)
+}
+)";
+
+  EXPECT_EQ(Run(source), 31);
+}
+
+TEST_F(InterpreterTest, ReadsThroughBorrows) {
+  const std::string source = R"(
+const read = fn(p: *i32) -> i32 do return p.* + 1
+const main = fn() -> i32 {
+  value: i32 = 41
+  return read(&value)
+}
+)";
+
+  EXPECT_EQ(Run(source), 42);
+}
+
+TEST_F(InterpreterTest, RecursesWithoutUsingTheNativeStack) {
+  const std::string source = R"(
+const sum = fn(n: i32) -> i32 {
+  if n == 0 do return 0
+  return n + sum(n - 1)
+}
+const main = fn() -> i32 {
+  return sum(50000)
+}
+)";
+
+  EXPECT_EQ(Run(source), 1250025000);
+}
+
+TEST_F(InterpreterTest, ThrowsOnRunawayRecursion) {
+  const std::string source = R"(
+const forever = fn(n: i32) -> i32 do return 1 + forever(n + 1)
+const main = fn() -> i32 {
+  return forever(0)
+}
+)";
+
+  EXPECT_THROW(Run(source, {.max_call_depth = 100}), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, TailCallsReuseTheCallersFrame) {
+  const std::string source = R"(
+const ping = fn(n: i32, total: i64) -> i64 {
+  if n == 0 do return total
+  return pong(n - 1, total + 1)
+}
+const pong = fn(n: i32, total: i64) -> i64 {
+  if n == 0 do return total
+  return musttail ping(n - 1, total + 2)
+}
+const main = fn() -> i32 {
+  return ping(1000, 0)
+}
+)";
+
+  EXPECT_EQ(Run(source, {.max_call_depth = 10}), 1500);
+}
+
+TEST_F(InterpreterTest, ThrowsOnDivisionByZero) {
+  const std::string source = R"(
+const divide = fn(x: i32, y: i32) -> i32 do return x / y
+const main = fn() -> i32 {
+  return divide(1, 0)
+}
+)";
+
+  EXPECT_THROW(Run(source), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, PrintsLikePrintf) {
+  const std::string source = R"(
+import fmt
+const main = fn() -> i32 {
+  big: i64 = 65536
+  big = big * big + 2
+  fmt.println("{:s} = {:d}, low bits {:d}", "answer", 42, big)
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  testing::internal::CaptureStdout();
+  Interpreter(module).run();
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_EQ(output, "answer = 42, low bits 2\n");
+}
+
+TEST_F(InterpreterTest, CompilesOnlyFunctionsReachableFromMain) {
+  const std::string source = R"(
+const used = fn() -> i32 do return 1
+const unused = fn() -> i32 do return 2
+const main = fn() -> i32 {
+  return used()
+}
+)";
+
+  auto program = ParseSource(source);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  EXPECT_EQ(module.functions.size(), 2);
+}
+
+TEST_F(InterpreterTest, ReportsUnknownVariablesAtCompileTime) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  return missing
+}
+)";
+
+  auto program = ParseSource(source);
+  EXPECT_THROW(BytecodeCompiler(program.get()).compile(), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, CompilerInterpretsSmallProgramsByDefault) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  return 7
+}
+)";
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source), 7);
+  EXPECT_TRUE(compiler.stats().interpreted);
+
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Jit), 7);
+  EXPECT_FALSE(compiler.stats().interpreted);
+}
+
+TEST_F(InterpreterTest, VoidMainExitsWithZeroInEveryTier) {
+  const std::string source = R"(
+const square = fn(x: i32) -> i32 do return x * x
+const main = fn() {
+  total: i32 = square(3) + 6
+}
+)";
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source), 0);
+  EXPECT_TRUE(compiler.stats().interpreted);
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Jit), 0);
+}
+
+TEST_F(InterpreterTest, SmallProgramsWithArraysAreJitCompiled) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  values := [3, 4]
+  return values[0] + values[1]
+}
+)";
+
+  auto program = ParseSource(source);
+  EXPECT_THROW(BytecodeCompiler(program.get()).compile(), std::runtime_error);
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source), 7);
+  EXPECT_FALSE(compiler.stats().interpreted);
+}
+
+TEST_F(InterpreterTest, SmallProgramsWithVectorsAreJitCompiled) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  values := v4i32(1, 2, 3, 4)
+  return simd.reduce_add(values * 2)
+}
+)";
+
+  auto program = ParseSource(source);
+  EXPECT_THROW(BytecodeCompiler(program.get()).compile(), std::runtime_error);
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source), 20);
+  EXPECT_FALSE(compiler.stats().interpreted);
+}
+
+TEST_F(InterpreterTest, SmallProgramsWithStructsAreJitCompiled) {
+  const std::string source = R"(
+const Point = struct { x: i32, y: i32 }
+const main = fn() -> i32 {
+  p := Point(3, 4)
+  return p.x + p.y
+}
+)";
+
+  auto program = ParseSource(source);
+  EXPECT_THROW(BytecodeCompiler(program.get()).compile(), std::runtime_error);
+
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source), 7);
+  EXPECT_FALSE(compiler.stats().interpreted);
+}
+
+TEST_F(InterpreterTest, ReadsAndWritesThroughBorrows) {
+  const std::string source = R"(
+const bump = fn(target: &mut i16, amount: &i16) {
+  target.* = target.* + amount.*
+}
+const main = fn() -> i32 {
+  total: i16 = 32767
+  step: i16 = 2
+  bump(&mut total, &step)
+  return total
+}
+)";
+
+  // The store through target wraps to its pointee's width
+  EXPECT_EQ(Run(source), -32767);
+}
+
+TEST_F(InterpreterTest, MatchesUnsignedValuesAboveTheSignBit) {
+  const std::string source = R"(
+const classify = fn(value: u8) -> i32 {
+  match value {
+    0..100 do return 1
+    100..200 do return 2
+    else do return 3
+  }
+  return 0
+}
+const main = fn() -> i32 {
+  big: u8 = 150
+  bigger: u8 = 250
+  return classify(5) + classify(big) * 10 + classify(bigger) * 100
+}
+)";
+
+  // Registers hold 150 sign extended, so the 100..200 test is split in two
+  EXPECT_EQ(Run(source), 321);
+}
+
+TEST_F(InterpreterTest, StopsOnOverflowInTrapMode) {
+  auto run_main = [this](const std::string& body) {
+    return Run(R"(
+const add = overflow(trap) fn(x: i8, y: i8) -> i8 do return x + y
+const take = overflow(trap) fn(x: u32, y: u32) -> u32 do return x - y
+const wrapping_add = fn(x: i8, y: i8) -> i8 do return x + y
+const main = fn() -> i32 {
+)" + body + "\n}");
+  };
+
+  EXPECT_EQ(run_main("return add(100, 27)"), 127);
+  EXPECT_EQ(run_main("return take(3, 1)"), 2);
+  EXPECT_EQ(run_main("return wrapping_add(100, 28)"), -128);
+  EXPECT_THROW(run_main("return add(100, 28)"), std::runtime_error);
+  EXPECT_THROW(run_main("return add(-100, -29)"), std::runtime_error);
+  EXPECT_THROW(run_main("return take(1, 3)"), std::runtime_error);
+}
+
+TEST_F(InterpreterTest, UnsignedLoopBoundsAboveTheSignBit) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  count: i32 = 0
+  n: u8 = 200
+  loop i in 0..n do count = count + 1
+  start: u32 = 2147483645
+  end: u32 = start + 5
+  loop j in start..end do count = count + 1
+  return count
+}
+)";
+
+  // The u32 range crosses the sign bit of the registers holding it
+  EXPECT_EQ(Run(source), 205);
+  Compiler compiler;
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Interpret), 205);
+  EXPECT_EQ(compiler.compile_and_run(source, ExecutionMode::Jit), 205);
+}
+
+}  // namespace
+}  // namespace void_compiler
@@ -0,0 +1,92 @@
+#include "jit_events.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "code_generation.h"
+#include "compiler.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+const std::string kSource = R"(
+const square = noinline fn(x: i32) -> i32 do return x * x
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop i in 0..4 {
+    total = total + square(i)
+  }
+  return total
+}
+)";
+
+std::unique_ptr<Program> ParseSource(const std::string& source) {
+  Lexer lexer(source);
+  std::vector<Token> tokens;
+  Token token;
+  do {
+    token = lexer.next_token();
+    tokens.push_back(token);
+  } while (token.type != TokenType::EndOfFile);
+  return Parser(std::move(tokens)).parse();
+}
+
+TEST(JitEventsTest, ParsesListenerNames) {
+  auto perf = parse_jit_events("perf");
+  ASSERT_TRUE(perf.has_value());
+  EXPECT_TRUE(perf->perf);
+  EXPECT_FALSE(perf->gdb);
+
+  auto both = parse_jit_events("gdb,perf");
+  ASSERT_TRUE(both.has_value());
+  EXPECT_TRUE(both->perf);
+  EXPECT_TRUE(both->gdb);
+
+  EXPECT_FALSE(parse_jit_events("").has_value());
+  EXPECT_FALSE(parse_jit_events("perf,").has_value());
+  EXPECT_FALSE(parse_jit_events("vtune").has_value());
+}
+
+TEST(JitEventsTest, PerfMapNamesJitCompiledFunctions) {
+  auto program = ParseSource(kSource);
+  CodeGenerator codegen;
+  codegen.set_jit_events({.perf = true});
+  codegen.generate_program(program.get());
+  codegen.optimize();
+  uint64_t main_address = codegen.jit_function_address("main");
+
+  std::ifstream map(perf_map_path());
+  ASSERT_TRUE(map.is_open());
+  bool found_main = false;
+  bool found_square = false;
+  std::string line;
+  while (std::getline(map, line)) {
+    std::istringstream fields(line);
+    uint64_t address;
+    uint64_t size;
+    std::string name;
+    fields >> std::hex >> address >> size >> name;
+    if (name == "main") {
+      found_main = address == main_address && size > 0;
+    } else if (name == "square") {
+      found_square = size > 0;
+    }
+  }
+  EXPECT_TRUE(found_main);
+  EXPECT_TRUE(found_square);
+  std::filesystem::remove(perf_map_path());
+}
+
+TEST(JitEventsTest, ListenersLeaveResultsUnchanged) {
+  Compiler compiler;
+  compiler.set_jit_events({.gdb = true});
+  EXPECT_EQ(compiler.compile_and_run(kSource, ExecutionMode::Jit), 14);
+}
+
+}  // namespace
+}  // namespace void_compiler
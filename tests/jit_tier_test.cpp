@@ -0,0 +1,161 @@
+#include "jit_tier.h"
+
+#include <gtest/gtest.h>
+
+#include "bytecode_compiler.h"
+#include "compiler.h"
+#include "interpreter.h"
+#include "lexer.h"
+#include "parser.h"
+
+namespace void_compiler {
+namespace {
+
+class JitTierTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<Program> ParseSource(const std::string& source) {
+    Lexer lexer(source);
+    std::vector<Token> tokens;
+    Token token;
+    do {
+      token = lexer.next_token();
+      tokens.push_back(token);
+    } while (token.type != TokenType::EndOfFile);
+
+    Parser parser(std::move(tokens));
+    return parser.parse();
+  }
+};
+
+const std::string kHotLoop = R"(
+const step = fn(total: i64, i: i32) -> i64 {
+  if i > 50 do return total + i * 2
+  return total + 1
+}
+const main = fn() -> i32 {
+  total: i64 = 0
+  loop i in 0..100 {
+    total = step(total, i)
+  }
+  return total / 1000
+}
+)";
+
+TEST_F(JitTierTest, SwitchesHotFunctionsToNativeCode) {
+  auto program = ParseSource(kHotLoop);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  JitTier jit(program.get(), module, {.threshold = 10, .synchronous = true});
+  Interpreter interpreter(module, {}, &jit);
+  int64_t result = interpreter.run();
+
+  // 51 + 2 * (51 + ... + 99)
+  EXPECT_EQ(result, 7401 / 1000);
+  EXPECT_EQ(interpreter.native_calls(), 90);
+
+  auto events = jit.finish();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].function, "step");
+  EXPECT_EQ(events[0].hotness, 10);
+  EXPECT_TRUE(events[0].error.empty());
+}
+
+TEST_F(JitTierTest, NativeCodeMatchesTheInterpreter) {
+  const std::string source = R"(
+const narrow = fn(x: i8, flag: bool) -> i8 {
+  if flag do return x + 100
+  return x
+}
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop i in 0..20 {
+    total = total + narrow(i, i > 10)
+  }
+  return total
+}
+)";
+
+  auto program = ParseSource(source);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+  int64_t interpreted = Interpreter(module).run();
+
+  JitTier jit(program.get(), module, {.threshold = 1, .synchronous = true});
+  Interpreter interpreter(module, {}, &jit);
+  EXPECT_EQ(interpreter.run(), interpreted);
+  EXPECT_EQ(interpreter.native_calls(), 19);
+}
+
+TEST_F(JitTierTest, KeepsPointerFunctionsInterpreted) {
+  const std::string source = R"(
+const read = fn(p: *i32) -> i32 do return p.*
+const main = fn() -> i32 {
+  value: i32 = 3
+  total: i32 = 0
+  loop i in 0..10 {
+    total = total + read(&value)
+  }
+  return total
+}
+)";
+
+  auto program = ParseSource(source);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  JitTier jit(program.get(), module, {.threshold = 1, .synchronous = true});
+  Interpreter interpreter(module, {}, &jit);
+  EXPECT_EQ(interpreter.run(), 30);
+  EXPECT_EQ(interpreter.native_calls(), 0);
+  EXPECT_TRUE(jit.finish().empty());
+}
+
+TEST_F(JitTierTest, ReportsFailedTierUps) {
+  auto program = ParseSource(kHotLoop);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  // LLVM gets a program without the hot function, so compiling it fails
+  auto other = ParseSource("const main = fn() -> i32 do return 0");
+  JitTier jit(other.get(), module, {.threshold = 10, .synchronous = true});
+  Interpreter interpreter(module, {}, &jit);
+  EXPECT_EQ(interpreter.run(), 7);
+  EXPECT_EQ(interpreter.native_calls(), 0);
+
+  auto events = jit.finish();
+  ASSERT_EQ(events.size(), 1);
+  EXPECT_EQ(events[0].function, "step");
+  EXPECT_EQ(events[0].error, "Function 'step' not found");
+}
+
+TEST_F(JitTierTest, CompilesInTheBackground) {
+  auto program = ParseSource(kHotLoop);
+  BytecodeModule module = BytecodeCompiler(program.get()).compile();
+
+  // Whether the compile finishes before main does is up to the scheduler,
+  // but the result must not depend on it
+  JitTier jit(program.get(), module, {.threshold = 10});
+  Interpreter interpreter(module, {}, &jit);
+  EXPECT_EQ(interpreter.run(), 7);
+
+  auto events = jit.finish();
+  EXPECT_LE(events.size(), 1);
+  if (interpreter.native_calls() > 0) {
+    ASSERT_EQ(events.size(), 1);
+    EXPECT_EQ(events[0].function, "step");
+  }
+}
+
+TEST_F(JitTierTest, CompilerReportsTierUps) {
+  Compiler compiler;
+  compiler.set_tier_up_policy({.threshold = 10, .synchronous = true});
+
+  EXPECT_EQ(compiler.compile_and_run(kHotLoop, ExecutionMode::Tiered), 7);
+  EXPECT_TRUE(compiler.stats().tiered);
+  ASSERT_EQ(compiler.stats().tier_ups.size(), 1);
+  EXPECT_EQ(compiler.stats().tier_ups[0].function, "step");
+
+  EXPECT_EQ(compiler.compile_and_run(kHotLoop, ExecutionMode::Interpret), 7);
+  EXPECT_FALSE(compiler.stats().tiered);
+  EXPECT_TRUE(compiler.stats().tier_ups.empty());
+}
+
+}  // namespace
+}  // namespace void_compiler
@@ -0,0 +1,107 @@
+#include "object_cache.h"
+
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "compiler.h"
+
+namespace void_compiler {
+namespace {
+
+class ObjectCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    directory_ = std::filesystem::temp_directory_path() /
+                 ("void_object_cache_" +
+                  std::string(testing::UnitTest::GetInstance()
+                                  ->current_test_info()
+                                  ->name()));
+    std::filesystem::remove_all(directory_);
+    compiler_.set_cache_directory(directory_.string());
+  }
+
+  void TearDown() override { std::filesystem::remove_all(directory_); }
+
+  size_t cached_objects() const {
+    if (!std::filesystem::exists(directory_)) return 0;
+    return std::distance(std::filesystem::directory_iterator(directory_),
+                         std::filesystem::directory_iterator());
+  }
+
+  std::filesystem::path directory_;
+  Compiler compiler_;
+};
+
+const std::string kSource = R"(
+const square = fn(x: i32) -> i32 do return x * x
+const main = fn() -> i32 {
+  total: i32 = 0
+  loop i in 0..4 {
+    total = total + square(i)
+  }
+  return total
+}
+)";
+
+TEST_F(ObjectCacheTest, SecondRunSkipsCodegen) {
+  EXPECT_EQ(compiler_.compile_and_run(kSource, ExecutionMode::Jit), 14);
+  EXPECT_FALSE(compiler_.stats().jit_cache_hit);
+  EXPECT_EQ(cached_objects(), 1);
+
+  EXPECT_EQ(compiler_.compile_and_run(kSource, ExecutionMode::Jit), 14);
+  EXPECT_TRUE(compiler_.stats().jit_cache_hit);
+  EXPECT_EQ(cached_objects(), 1);
+}
+
+TEST_F(ObjectCacheTest, ChangedSourceIsCompiledAgain) {
+  compiler_.compile_and_run(kSource, ExecutionMode::Jit);
+
+  std::string changed = kSource;
+  changed.replace(changed.find("0..4"), 4, "0..5");
+  EXPECT_EQ(compiler_.compile_and_run(changed, ExecutionMode::Jit), 30);
+  EXPECT_FALSE(compiler_.stats().jit_cache_hit);
+  EXPECT_EQ(cached_objects(), 2);
+}
+
+TEST_F(ObjectCacheTest, DamagedEntryIsRecompiled) {
+  compiler_.compile_and_run(kSource, ExecutionMode::Jit);
+  for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+    std::ofstream(entry.path(), std::ios::trunc) << "not an object file";
+  }
+
+  EXPECT_EQ(compiler_.compile_and_run(kSource, ExecutionMode::Jit), 14);
+  EXPECT_FALSE(compiler_.stats().jit_cache_hit);
+
+  EXPECT_EQ(compiler_.compile_and_run(kSource, ExecutionMode::Jit), 14);
+  EXPECT_TRUE(compiler_.stats().jit_cache_hit);
+}
+
+TEST_F(ObjectCacheTest, PreloadedEntrySurvivesEviction) {
+  compiler_.compile_and_run(kSource, ExecutionMode::Jit);
+  std::filesystem::path entry =
+      std::filesystem::directory_iterator(directory_)->path();
+  std::string key = entry.stem().string();
+
+  DiskObjectCache cache(directory_.string());
+  EXPECT_FALSE(cache.preload("missing"));
+  ASSERT_TRUE(cache.preload(key));
+  std::filesystem::remove(entry);
+
+  llvm::LLVMContext context;
+  llvm::Module module(key, context);
+  EXPECT_NE(cache.getObject(&module), nullptr);
+  EXPECT_EQ(cache.getObject(&module), nullptr);
+}
+
+TEST_F(ObjectCacheTest, DisabledByDefault) {
+  Compiler compiler;
+  compiler.compile_and_run(kSource, ExecutionMode::Jit);
+  compiler.compile_and_run(kSource, ExecutionMode::Jit);
+  EXPECT_FALSE(compiler.stats().jit_cache_hit);
+  EXPECT_EQ(cached_objects(), 0);
+}
+
+}  // namespace
+}  // namespace void_compiler
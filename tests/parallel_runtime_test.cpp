@@ -0,0 +1,38 @@
+#include "parallel_runtime.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <vector>
+
+namespace {
+
+void count_visits(int64_t begin, int64_t end, void* context) {
+  auto& visits = *static_cast<std::vector<std::atomic<int>>*>(context);
+  for (int64_t i = begin; i < end; ++i) visits[i]++;
+}
+
+TEST(ParallelRuntimeTest, RunsEveryIterationOnce) {
+  std::vector<std::atomic<int>> visits(10007);
+  void_parallel_for(0, 10007, count_visits, &visits);
+  for (const auto& count : visits) EXPECT_EQ(count.load(), 1);
+
+  // Empty and reversed ranges don't run the body at all
+  void_parallel_for(5, 5, count_visits, &visits);
+  void_parallel_for(9, 3, count_visits, &visits);
+  EXPECT_EQ(visits[5].load(), 1);
+}
+
+void run_inner_loop(int64_t begin, int64_t end, void* context) {
+  for (int64_t i = begin; i < end; ++i) {
+    void_parallel_for(0, 100, count_visits, context);
+  }
+}
+
+TEST(ParallelRuntimeTest, RunsNestedLoops) {
+  std::vector<std::atomic<int>> visits(100);
+  void_parallel_for(0, 64, run_inner_loop, &visits);
+  for (const auto& count : visits) EXPECT_EQ(count.load(), 64);
+}
+
+}  // namespace
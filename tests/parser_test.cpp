@@ -12,7 +12,9 @@ class ParserTest : public ::testing::Test {
   void SetUp() override {}
   void TearDown() override {}
 
-  std::unique_ptr<Program> ParseSource(const std::string& source) {
+  std::unique_ptr<Program> ParseSource(
+      const std::string& source,
+      FunctionSelection selection = FunctionSelection::ReachableFromMain) {
     Lexer lexer(source);
     std::vector<Token> tokens;
     Token token;
@@ -21,7 +23,7 @@ class ParserTest : public ::testing::Test {
       tokens.push_back(token);
     } while (token.type != TokenType::EndOfFile);
 
-    Parser parser(std::move(tokens));
+    Parser parser(std::move(tokens), selection);
     return parser.parse();
   }
 };
@@ -1056,6 +1058,39 @@ const test = fn() -> i32 {
   ASSERT_NE(ret_stmt, nullptr);
 }
 
+TEST_F(ParserTest, ParsesParallelRangeLoop) {
+  const std::string source = R"(
+const test = fn() -> i32 {
+  par :i32 = 0
+  loop par i in 0..10 {
+    par = i
+  }
+  loop par in 0..10 {
+    par = par
+  }
+  return par
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  const auto& func = program->functions()[0];
+  ASSERT_EQ(func->body().size(), 4);
+
+  const auto* parallel =
+      dynamic_cast<const LoopStatement*>(func->body()[1].get());
+  ASSERT_NE(parallel, nullptr);
+  EXPECT_TRUE(parallel->is_parallel());
+  EXPECT_EQ(parallel->variable_name(), "i");
+
+  // "par" alone is still the loop variable
+  const auto* sequential =
+      dynamic_cast<const LoopStatement*>(func->body()[2].get());
+  ASSERT_NE(sequential, nullptr);
+  EXPECT_FALSE(sequential->is_parallel());
+  EXPECT_EQ(sequential->variable_name(), "par");
+}
+
 TEST_F(ParserTest, ParsesConditionalLoop) {
   const std::string source = R"(
 const test = fn() -> i32 {
@@ -2540,5 +2575,610 @@ const test = fn() -> i32 {
   EXPECT_EQ(deref_op->operator_type(), TokenType::DotStar);
 }
 
+TEST_F(ParserTest, SkipsBodiesOfFunctionsUnreachableFromMain) {
+  const std::string source = R"(
+const used = fn(x: i32) -> i32 do return x * 2
+
+// never referenced from main, so its (invalid) body is never parsed
+const unused = fn() -> i32 {
+  this is not valid { void code }
+}
+
+const main = fn() -> i32 {
+  return used(21)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->functions().size(), 2);
+  EXPECT_EQ(program->functions()[0]->name(), "used");
+  EXPECT_EQ(program->functions()[1]->name(), "main");
+}
+
+TEST_F(ParserTest, KeepsTransitivelyReachableFunctions) {
+  const std::string source = R"(
+const leaf = fn() -> i32 do return 1
+const via_pointer = fn(x: i32, y: i32) -> i32 do return x + y
+const middle = fn() -> i32 {
+  op: fn(i32, i32) -> i32 = via_pointer
+  return op(leaf(), 2)
+}
+const orphan = fn() -> i32 do return leaf()
+const main = fn() -> i32 do return middle()
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->functions().size(), 4);
+  EXPECT_EQ(program->functions()[0]->name(), "leaf");
+  EXPECT_EQ(program->functions()[1]->name(), "via_pointer");
+  EXPECT_EQ(program->functions()[2]->name(), "middle");
+  EXPECT_EQ(program->functions()[3]->name(), "main");
+}
+
+TEST_F(ParserTest, ParsesAllFunctionsWithoutMain) {
+  const std::string source = R"(
+const first = fn() -> i32 do return 1
+const second = fn() -> i32 do return 2
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  EXPECT_EQ(program->functions().size(), 2);
+}
+
+TEST_F(ParserTest, ParsesAllFunctionsWhenAskedTo) {
+  const std::string source = R"(
+const exported = fn() -> i32 do return 1
+const main = fn() -> i32 do return 0
+)";
+
+  auto program = ParseSource(source, FunctionSelection::All);
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->functions().size(), 2);
+  EXPECT_EQ(program->functions()[0]->name(), "exported");
+}
+
+TEST_F(ParserTest, ThrowsOnUnterminatedFunctionBody) {
+  const std::string source = R"(
+const main = fn() -> i32 {
+  return 1
+)";
+
+  EXPECT_THROW(ParseSource(source), std::runtime_error);
+}
+
+TEST_F(ParserTest, InfersTypeOfLongExpressionChain) {
+  // Each node's type is cached when it is built, so inferring the type of a
+  // 10k-term chain is a lookup rather than a 10k-deep recursion
+  std::string source = "const test = fn() -> i32 {\n  a := 1\n  x := a";
+  for (int i = 1; i < 10000; ++i) {
+    source += i % 2 == 0 ? " + a" : " - 1";
+  }
+  source += "\n  return x\n}\n";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->functions().size(), 1);
+
+  const auto& func = program->functions()[0];
+  ASSERT_EQ(func->body().size(), 3);
+
+  const auto* var_decl =
+      dynamic_cast<const VariableDeclaration*>(func->body()[1].get());
+  ASSERT_NE(var_decl, nullptr);
+  EXPECT_EQ(var_decl->type(), "i32");
+  EXPECT_EQ(var_decl->value()->inferred_type(), "i32");
+}
+
+TEST_F(ParserTest, CachesInferredTypesOnExpressionNodes) {
+  const std::string source = R"(
+const test = fn() -> bool {
+  flag := 1 + 2 > 2 and true
+  return flag
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  const auto* var_decl = dynamic_cast<const VariableDeclaration*>(
+      program->functions()[0]->body()[0].get());
+  ASSERT_NE(var_decl, nullptr);
+  EXPECT_EQ(var_decl->type(), "bool");
+
+  const auto* and_op = dynamic_cast<const BinaryOperation*>(var_decl->value());
+  ASSERT_NE(and_op, nullptr);
+  EXPECT_EQ(and_op->inferred_type(), "bool");
+
+  const auto* comparison =
+      dynamic_cast<const BinaryOperation*>(and_op->left());
+  ASSERT_NE(comparison, nullptr);
+  EXPECT_EQ(comparison->inferred_type(), "bool");
+  EXPECT_EQ(comparison->left()->inferred_type(), "i32");
+}
+
+TEST_F(ParserTest, ParsesArrays) {
+  const std::string source = R"(
+const test = fn() -> i32 {
+  values := [1, 2, 3]
+  fixed: [_]i64 = [4, 5]
+  zeroed: [8]u8
+  zeroed[values[0]] = 1
+  loop value in values do fixed[0] = value
+  return values[2]
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  const auto& body = program->functions()[0]->body();
+  ASSERT_EQ(body.size(), 6);
+
+  const auto* values = dynamic_cast<const VariableDeclaration*>(body[0].get());
+  ASSERT_NE(values, nullptr);
+  EXPECT_EQ(values->type(), "[3]i32");
+  const auto* literal = dynamic_cast<const ArrayLiteral*>(values->value());
+  ASSERT_NE(literal, nullptr);
+  EXPECT_EQ(literal->elements().size(), 3);
+
+  const auto* fixed = dynamic_cast<const VariableDeclaration*>(body[1].get());
+  ASSERT_NE(fixed, nullptr);
+  EXPECT_EQ(fixed->type(), "[2]i64");
+
+  // No value means zeroed, an empty literal
+  const auto* zeroed = dynamic_cast<const VariableDeclaration*>(body[2].get());
+  ASSERT_NE(zeroed, nullptr);
+  EXPECT_EQ(zeroed->type(), "[8]u8");
+  const auto* empty = dynamic_cast<const ArrayLiteral*>(zeroed->value());
+  ASSERT_NE(empty, nullptr);
+  EXPECT_TRUE(empty->elements().empty());
+
+  const auto* assign = dynamic_cast<const IndexAssignment*>(body[3].get());
+  ASSERT_NE(assign, nullptr);
+  EXPECT_EQ(assign->array_name(), "zeroed");
+  const auto* index = dynamic_cast<const IndexExpression*>(assign->index());
+  ASSERT_NE(index, nullptr);
+  EXPECT_EQ(index->array_name(), "values");
+  EXPECT_EQ(index->inferred_type(), "i32");
+
+  const auto* loop = dynamic_cast<const LoopStatement*>(body[4].get());
+  ASSERT_NE(loop, nullptr);
+  EXPECT_TRUE(loop->is_array_loop());
+  EXPECT_EQ(loop->variable_name(), "value");
+}
+
+TEST_F(ParserTest, InferredArrayLengthNeedsALiteral) {
+  const std::string source = R"(
+const test = fn() {
+  values: [_]i32
+}
+)";
+
+  EXPECT_THROW(ParseSource(source), std::runtime_error);
+}
+
+TEST_F(ParserTest, ParsesVectorTypes) {
+  const std::string source = R"(
+const test = fn(a: v8i32) -> i32 {
+  b := v8i32(2)
+  sum := a + b * 3
+  mask := sum > a
+  lane := sum[0]
+  total := simd.reduce_add(sum)
+  half := simd.shuffle(a, b, 0, 1, 2, 3)
+  values: [16]i32
+  loaded := v8i32.load(values, 8)
+  return total + lane
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  const auto* func = program->functions()[0].get();
+  EXPECT_EQ(func->parameters()[0]->type(), "v8i32");
+
+  const auto& body = func->body();
+  std::vector<std::string> types;
+  for (const auto& stmt : body) {
+    if (const auto* decl = dynamic_cast<const VariableDeclaration*>(stmt.get())) {
+      types.push_back(decl->type());
+    }
+  }
+  EXPECT_EQ(types, (std::vector<std::string>{"v8i32", "v8i32", "v8bool", "i32",
+                                             "i32", "v4i32", "[16]i32",
+                                             "v8i32"}));
+}
+
+TEST_F(ParserTest, ParsesVectorTypeNames) {
+  EXPECT_EQ(VectorType::parse("v16u8")->lanes, 16);
+  EXPECT_EQ(VectorType::parse("v16u8")->element_type, "u8");
+  EXPECT_TRUE(VectorType::parse("v4bool")->is_mask());
+  EXPECT_TRUE(VectorType::parse("v2u64")->is_unsigned());
+  EXPECT_FALSE(VectorType::parse("v3i32"));    // not a power of two
+  EXPECT_FALSE(VectorType::parse("v128i8"));   // too many lanes
+  EXPECT_FALSE(VectorType::parse("v4string"));
+  EXPECT_FALSE(VectorType::parse("values"));
+}
+
+TEST_F(ParserTest, InfersRangeCounterTypeFromBounds) {
+  const std::string source = R"(
+const test = fn(n: i64, m: u64, k: i16) -> i32 {
+  loop i in 0..n do k = k
+  loop j in 0..m do k = k
+  loop l in k..n do k = k
+  loop x in 0..10 do k = k
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  std::vector<std::string> types;
+  for (const auto& stmt : program->functions()[0]->body()) {
+    if (const auto* loop = dynamic_cast<const LoopStatement*>(stmt.get())) {
+      const auto* range = dynamic_cast<const RangeExpression*>(loop->range());
+      ASSERT_NE(range, nullptr);
+      types.push_back(range->counter_type());
+    }
+  }
+  EXPECT_EQ(types, (std::vector<std::string>{"i64", "u64", "i64", "i32"}));
+}
+
+TEST_F(ParserTest, ParsesStructDeclarations) {
+  const std::string source = R"(
+const Point = struct { x: i32, y: i32 }
+const Header = packed struct { tag: u8, length: i32 }
+const Counter = struct align(64) { hits: i64 }
+const Particle = soa struct { position: Point, alive: bool }
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  ASSERT_EQ(program->structs().size(), 4);
+
+  const auto& point = program->structs()[0];
+  EXPECT_EQ(point->name(), "Point");
+  ASSERT_EQ(point->fields().size(), 2);
+  EXPECT_EQ(point->fields()[1].name, "y");
+  EXPECT_EQ(point->fields()[1].type, "i32");
+  EXPECT_EQ(point->field_index("y"), 1);
+  EXPECT_FALSE(point->field_index("z"));
+
+  EXPECT_TRUE(program->structs()[1]->layout().packed);
+  EXPECT_EQ(program->structs()[2]->layout().alignment, 64);
+  EXPECT_TRUE(program->structs()[3]->layout().soa);
+  EXPECT_EQ(program->structs()[3]->fields()[0].type, "Point");
+}
+
+TEST_F(ParserTest, ParsesFieldAccessAndAssignment) {
+  const std::string source = R"(
+const Point = struct { x: i32, y: i64 }
+const Line = struct { start: Point, end: Point }
+const test = fn(line: Line, pointer: *Point) -> i32 {
+  p := line.start
+  y := line.end.y
+  x := pointer.x
+  points: [4]Point
+  q := points[2].y
+  origin: Point
+  origin.x = 1
+  line.end.y = 2
+  points[1].x = 3
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+
+  std::vector<std::string> types;
+  std::vector<std::string> assigned_fields;
+  for (const auto& stmt : program->functions()[0]->body()) {
+    if (const auto* decl =
+            dynamic_cast<const VariableDeclaration*>(stmt.get())) {
+      types.push_back(decl->type());
+    } else if (const auto* assignment =
+                   dynamic_cast<const FieldAssignment*>(stmt.get())) {
+      assigned_fields.push_back(assignment->field_name());
+    }
+  }
+  EXPECT_EQ(types, (std::vector<std::string>{"Point", "i64", "i32", "[4]Point",
+                                             "i64", "Point"}));
+  EXPECT_EQ(assigned_fields, (std::vector<std::string>{"x", "y", "x"}));
+}
+
+TEST_F(ParserTest, RejectsInvalidStructDeclarations) {
+  EXPECT_THROW(ParseSource("const P = struct { x: i32, x: i32 }"),
+               std::runtime_error);
+  EXPECT_THROW(ParseSource("const P = struct { }"), std::runtime_error);
+  EXPECT_THROW(ParseSource("const P = struct align(3) { x: i32 }"),
+               std::runtime_error);
+  EXPECT_THROW(ParseSource("const P = soa packed struct { x: i32 }"),
+               std::runtime_error);
+  EXPECT_THROW(ParseSource(R"(
+const P = struct { x: i32 }
+const P = fn() -> i32 do return 0
+)"),
+               std::runtime_error);
+}
+
+TEST_F(ParserTest, ParsesBorrows) {
+  const std::string source = R"(
+const test = fn(target: &mut i64, source: &[4]i32, raw: *i8) -> i32 {
+  target.* = source[1]
+  a := target.*
+  b := raw.*
+  x: i32 = 0
+  p := &x
+  return update(&mut x, &x)
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  const auto& func = program->functions()[0];
+  EXPECT_EQ(func->parameters()[0]->type(), "&mut i64");
+  EXPECT_EQ(func->parameters()[1]->type(), "&[4]i32");
+
+  const auto& body = func->body();
+  const auto* write = dynamic_cast<const DereferenceAssignment*>(body[0].get());
+  ASSERT_NE(write, nullptr);
+  EXPECT_EQ(write->pointer_name(), "target");
+  // Dereferencing gives the pointee, and & outside a call makes a pointer
+  EXPECT_EQ(dynamic_cast<const VariableDeclaration*>(body[1].get())->type(),
+            "i64");
+  EXPECT_EQ(dynamic_cast<const VariableDeclaration*>(body[2].get())->type(),
+            "i8");
+  EXPECT_EQ(dynamic_cast<const VariableDeclaration*>(body[4].get())->type(),
+            "*i32");
+
+  const auto* ret = dynamic_cast<const ReturnStatement*>(body[5].get());
+  const auto* call = dynamic_cast<const FunctionCall*>(ret->expression());
+  ASSERT_NE(call, nullptr);
+  const auto* mutable_borrow =
+      dynamic_cast<const UnaryOperation*>(call->arguments()[0].get());
+  const auto* shared_borrow =
+      dynamic_cast<const UnaryOperation*>(call->arguments()[1].get());
+  ASSERT_NE(mutable_borrow, nullptr);
+  ASSERT_NE(shared_borrow, nullptr);
+  EXPECT_TRUE(mutable_borrow->is_mutable());
+  EXPECT_FALSE(shared_borrow->is_mutable());
+  EXPECT_EQ(mutable_borrow->inferred_type(), "&mut i32");
+}
+
+TEST_F(ParserTest, ParsesMatchStatements) {
+  const std::string source = R"(
+const test = fn(op: i8, flag: bool) -> i32 {
+  match = 1
+  match op {
+    0 do return 1
+    1, -3..-1 {
+      match = 2
+      return match
+    }
+    else do return 3
+  }
+  match (flag) {
+    true do return 4
+  }
+  return 0
+}
+)";
+
+  auto program = ParseSource(source);
+  ASSERT_NE(program, nullptr);
+  const auto& body = program->functions()[0]->body();
+  // match is still a name outside a match statement
+  EXPECT_NE(dynamic_cast<const VariableAssignment*>(body[0].get()), nullptr);
+
+  const auto* ops = dynamic_cast<const MatchStatement*>(body[1].get());
+  ASSERT_NE(ops, nullptr);
+  ASSERT_EQ(ops->arms().size(), 2);
+  EXPECT_EQ(ops->arms()[0].ranges,
+            (std::vector<std::pair<int64_t, int64_t>>{{0, 0}}));
+  // Ranges exclude their end, like loop ranges
+  EXPECT_EQ(ops->arms()[1].ranges,
+            (std::vector<std::pair<int64_t, int64_t>>{{1, 1}, {-3, -2}}));
+  EXPECT_EQ(ops->arms()[1].body.size(), 2);
+  EXPECT_EQ(ops->else_body().size(), 1);
+
+  const auto* flags = dynamic_cast<const MatchStatement*>(body[2].get());
+  ASSERT_NE(flags, nullptr);
+  EXPECT_EQ(flags->arms()[0].ranges,
+            (std::vector<std::pair<int64_t, int64_t>>{{1, 1}}));
+  EXPECT_TRUE(flags->else_body().empty());
+}
+
+TEST_F(ParserTest, RejectsInvalidMatchStatements) {
+  auto parse_match = [this](const std::string& arms) {
+    return ParseSource("const f = fn(x: u8, s: const string) {\n" + arms +
+                       "\n}");
+  };
+
+  // Overlapping arms
+  EXPECT_THROW(parse_match("match x { 1..5 do x = 1\n 4 do x = 2 }"),
+               std::runtime_error);
+  // Values a u8 can't hold
+  EXPECT_THROW(parse_match("match x { 256 do x = 1 }"), std::runtime_error);
+  EXPECT_THROW(parse_match("match x { -1 do x = 1 }"), std::runtime_error);
+  EXPECT_THROW(parse_match("match x { 5..5 do x = 1 }"), std::runtime_error);
+  EXPECT_THROW(parse_match("match x { else do x = 1\n 1 do x = 2 }"),
+               std::runtime_error);
+  EXPECT_THROW(parse_match("match x { true do x = 1 }"), std::runtime_error);
+  EXPECT_THROW(parse_match("match s { 1 do x = 1 }"), std::runtime_error);
+}
+
+TEST_F(ParserTest, ParsesOverflowAnnotations) {
+  auto program = ParseSource(R"(
+const plain = fn(x: i32) -> i32 do return x + 1
+const checked = overflow(trap) fn(x: i32) -> i32 do return x + 1
+const fast = overflow(undefined) fn(x: i32) -> i32 do return x + 1
+)");
+
+  const auto& functions = program->functions();
+  ASSERT_EQ(functions.size(), 3);
+  EXPECT_EQ(functions[0]->overflow_mode(), std::nullopt);
+  EXPECT_EQ(functions[1]->overflow_mode(), OverflowMode::Trap);
+  EXPECT_EQ(functions[2]->overflow_mode(), OverflowMode::Undefined);
+
+  // Unannotated functions follow the program, the others keep their own
+  EXPECT_EQ(program->overflow_mode(*functions[0]), OverflowMode::Wrap);
+  program->set_overflow_mode(OverflowMode::Trap);
+  EXPECT_EQ(program->overflow_mode(*functions[0]), OverflowMode::Trap);
+  EXPECT_EQ(program->overflow_mode(*functions[2]), OverflowMode::Undefined);
+
+  EXPECT_THROW(ParseSource("const f = overflow(saturate) fn() {}"),
+               std::runtime_error);
+}
+
+TEST_F(ParserTest, ParsesMustTailReturns) {
+  auto program = ParseSource(R"(
+const f = fn(x: i32) -> i32 {
+  if x == 0 do return x
+  return musttail f(x - 1)
+}
+)");
+
+  const auto& body = program->functions()[0]->body();
+  ASSERT_EQ(body.size(), 2);
+  const auto* plain =
+      dynamic_cast<const IfStatement*>(body[0].get())->then_body()[0].get();
+  EXPECT_FALSE(dynamic_cast<const ReturnStatement*>(plain)->must_tail());
+  const auto* ret = dynamic_cast<const ReturnStatement*>(body[1].get());
+  ASSERT_NE(ret, nullptr);
+  EXPECT_TRUE(ret->must_tail());
+  EXPECT_NE(dynamic_cast<const FunctionCall*>(ret->expression()), nullptr);
+
+  EXPECT_THROW(ParseSource(R"(
+const f = fn(x: i32) -> i32 do return musttail f(x) + 1
+)"),
+               std::runtime_error);
+}
+
+TEST_F(ParserTest, ParsesFunctionAndBranchHints) {
+  auto program = ParseSource(R"(
+const square = pure inline fn(x: i32) -> i32 do return x * x
+const report = cold noinline fn(x: i32) {
+  fmt.println("%d", x)
+}
+const step = overflow(trap) hot fn(x: i32) -> i32 {
+  if unlikely x < 0 do report(x)
+  if likely not (x == 0) do return square(x)
+  likely: bool = x > 1
+  if likely do return 1
+  return 0
+}
+)");
+
+  const auto& functions = program->functions();
+  ASSERT_EQ(functions.size(), 3);
+  EXPECT_TRUE(functions[0]->hints().pure);
+  EXPECT_TRUE(functions[0]->hints().always_inline);
+  EXPECT_FALSE(functions[0]->hints().never_inline);
+  EXPECT_TRUE(functions[1]->hints().cold);
+  EXPECT_TRUE(functions[1]->hints().never_inline);
+  EXPECT_TRUE(functions[2]->hints().hot);
+  EXPECT_EQ(functions[2]->overflow_mode(), OverflowMode::Trap);
+
+  const auto& body = functions[2]->body();
+  auto hint = [&](size_t i) {
+    return dynamic_cast<const IfStatement*>(body[i].get())->hint();
+  };
+  EXPECT_EQ(hint(0), BranchHint::Unlikely);
+  EXPECT_EQ(hint(1), BranchHint::Likely);
+  // A variable called likely is still a condition
+  EXPECT_EQ(hint(3), BranchHint::None);
+
+  EXPECT_THROW(ParseSource("const f = inline noinline fn() {}"),
+               std::runtime_error);
+  EXPECT_THROW(ParseSource("const f = hot cold fn() {}"), std::runtime_error);
+  EXPECT_THROW(ParseSource("const f = fast fn() {}"), std::runtime_error);
+}
+
+TEST_F(ParserTest, RejectsImpurePureFunctions) {
+  EXPECT_THROW(ParseSource(R"(
+const f = pure fn(x: i32) -> i32 {
+  fmt.println("%d", x)
+  return x
+}
+)"),
+               std::runtime_error);
+
+  EXPECT_THROW(ParseSource(R"(
+const g = fn(x: i32) -> i32 do return x
+const f = pure fn(x: i32) -> i32 do return g(x)
+)"),
+               std::runtime_error);
+
+  EXPECT_THROW(ParseSource("const f = pure fn(p: *i32) -> i32 do return p.*"),
+               std::runtime_error);
+
+  // Calls through a function pointer could reach an impure function
+  EXPECT_THROW(ParseSource(R"(
+const noisy = fn(x: i32) -> i32 {
+  fmt.println("side effect")
+  return x
+}
+const f = pure fn(x: i32) -> i32 {
+  op: fn(i32) -> i32 = noisy
+  return op(x)
+}
+)"),
+               std::runtime_error);
+  EXPECT_THROW(ParseSource(R"(
+const g = pure fn(x: i32) -> i32 do return x
+const f = pure fn(x: i32) -> i32 {
+  op := fn(y: i32) -> i32 do return y
+  return op(x)
+}
+)"),
+               std::runtime_error);
+
+  // Pure functions may call each other, and themselves
+  EXPECT_NO_THROW(ParseSource(R"(
+const g = pure fn(x: i32) -> i32 do return x + 1
+const f = pure fn(x: i32) -> i32 {
+  if x > 10 do return f(x - 1)
+  return g(x)
+}
+)"));
+  EXPECT_NO_THROW(ParseSource(R"(
+const g = pure fn(x: i32) -> i32 do return x + 1
+const f = pure fn(x: i32) -> i32 {
+  h: fn(i32) -> i32 = g
+  return x
+}
+)"));
+}
+
+TEST_F(ParserTest, RecordsSourceLocations) {
+  auto program = ParseSource(R"(
+const twice = fn(x: i32) -> i32 {
+  y := x * 2
+  if y > 10 {
+    return 10
+  }
+    return y
+}
+)");
+
+  const auto& func = program->functions()[0];
+  EXPECT_EQ(func->location().line, 2);
+  EXPECT_EQ(func->location().column, 1);
+  const auto& body = func->body();
+  ASSERT_EQ(body.size(), 3);
+  EXPECT_EQ(body[0]->location().line, 3);
+  EXPECT_EQ(body[0]->location().column, 3);
+  EXPECT_EQ(body[1]->location().line, 4);
+  const auto* if_stmt = dynamic_cast<const IfStatement*>(body[1].get());
+  EXPECT_EQ(if_stmt->then_body()[0]->location().line, 5);
+  EXPECT_EQ(if_stmt->then_body()[0]->location().column, 5);
+  EXPECT_EQ(body[2]->location().line, 7);
+  EXPECT_EQ(body[2]->location().column, 5);
+}
+
 }  // namespace
 }  // namespace void_compiler
@@ -0,0 +1,78 @@
+#include "session.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+
+namespace void_compiler {
+namespace {
+
+TEST(SessionTest, DefinesFunctionsAndEvaluatesExpressions) {
+  Session session;
+  EXPECT_EQ(session.evaluate("const add = fn(x: i32, y: i32) -> i32 do "
+                             "return x + y"),
+            "");
+  EXPECT_TRUE(session.contains("add"));
+  EXPECT_EQ(session.evaluate("add(2, 3)"), "5");
+  EXPECT_EQ(session.evaluate("add(2, 3) * 10"), "50");
+}
+
+TEST(SessionTest, LaterInputsCallEarlierFunctions) {
+  Session session;
+  session.evaluate("const square = fn(x: i64) -> i64 do return x * x");
+  session.evaluate(R"(
+const sum_squares = fn(n: i32) -> i64 {
+  total: i64 = 0
+  loop i in 1..n {
+    total = total + square(i)
+  }
+  return total
+}
+)");
+
+  EXPECT_EQ(session.evaluate("sum_squares(4)"), "14");
+  EXPECT_EQ(session.evaluate("square(100000)"), "10000000000");
+}
+
+TEST(SessionTest, FormatsNarrowIntegersAndBools) {
+  Session session;
+  session.evaluate("const negate = fn(x: i8) -> i8 do return 0 - x");
+  session.evaluate("const small = fn(x: i8) -> bool do return x < 10");
+
+  EXPECT_EQ(session.evaluate("negate(-100)"), "100");
+  EXPECT_EQ(session.evaluate("small(negate(20))"), "true");
+  EXPECT_EQ(session.evaluate("small(20)"), "false");
+}
+
+TEST(SessionTest, RunsStatements) {
+  Session session;
+  session.evaluate("const twice = fn(x: i32) -> i32 do return x * 2");
+
+  testing::internal::CaptureStdout();
+  std::string value = session.evaluate(R"(
+value := twice(21)
+fmt.println("value {:d}", value)
+)");
+  std::fflush(stdout);
+  std::string output = testing::internal::GetCapturedStdout();
+
+  EXPECT_EQ(value, "");
+  EXPECT_NE(output.find("value 42\n"), std::string::npos);
+}
+
+TEST(SessionTest, RejectedInputsLeaveTheSessionUsable) {
+  Session session;
+  session.evaluate("const one = fn() -> i32 do return 1");
+
+  EXPECT_THROW(session.evaluate("const one = fn() -> i32 do return 2"),
+               std::runtime_error);
+  EXPECT_THROW(session.evaluate("missing(1)"), std::runtime_error);
+  EXPECT_THROW(session.evaluate("const broken = fn() -> i32 do return nope"),
+               std::runtime_error);
+  EXPECT_FALSE(session.contains("broken"));
+
+  EXPECT_EQ(session.evaluate("one()"), "1");
+}
+
+}  // namespace
+}  // namespace void_compiler
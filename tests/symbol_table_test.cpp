@@ -0,0 +1,76 @@
+#include "symbol_table.h"
+
+#include <gtest/gtest.h>
+
+namespace void_compiler {
+namespace {
+
+class SymbolTableTest : public ::testing::Test {
+ protected:
+  void SetUp() override {}
+  void TearDown() override {}
+
+  SymbolTable table;
+};
+
+TEST_F(SymbolTableTest, LooksUpDeclaredSymbol) {
+  auto scope = table.function_scope();
+  table.declare("x", {nullptr, "i32"});
+
+  const Symbol* symbol = table.lookup("x");
+  ASSERT_NE(symbol, nullptr);
+  EXPECT_EQ(symbol->type, "i32");
+  EXPECT_EQ(table.lookup("y"), nullptr);
+}
+
+TEST_F(SymbolTableTest, InnerScopeShadowsOuterUntilPopped) {
+  auto scope = table.function_scope();
+  table.declare("x", {nullptr, "i32"});
+  {
+    auto inner = table.scope();
+    table.declare("x", {nullptr, "i64"});
+    table.declare("y", {nullptr, "bool"});
+    EXPECT_EQ(table.lookup("x")->type, "i64");
+    EXPECT_EQ(table.lookup("y")->type, "bool");
+  }
+
+  EXPECT_EQ(table.lookup("x")->type, "i32");
+  EXPECT_EQ(table.lookup("y"), nullptr);
+}
+
+TEST_F(SymbolTableTest, RedeclarationInSameScopeReplacesBinding) {
+  auto scope = table.function_scope();
+  table.declare("x", {nullptr, "i32"});
+  {
+    auto inner = table.scope();
+    table.declare("x", {nullptr, "i8"});
+    table.declare("x", {nullptr, "i16"});
+    EXPECT_EQ(table.lookup("x")->type, "i16");
+  }
+
+  EXPECT_EQ(table.lookup("x")->type, "i32");
+}
+
+TEST_F(SymbolTableTest, FunctionScopeHidesEnclosingFunction) {
+  auto scope = table.function_scope();
+  table.declare("outer", {nullptr, "i32"});
+  {
+    auto nested = table.function_scope();
+    EXPECT_EQ(table.lookup("outer"), nullptr);
+
+    table.declare("param", {nullptr, "i32"});
+    auto block = table.scope();
+    EXPECT_NE(table.lookup("param"), nullptr);
+    EXPECT_EQ(table.lookup("outer"), nullptr);
+  }
+
+  EXPECT_NE(table.lookup("outer"), nullptr);
+  EXPECT_EQ(table.lookup("param"), nullptr);
+}
+
+TEST_F(SymbolTableTest, ThrowsWhenDeclaringOutsideAnyScope) {
+  EXPECT_THROW(table.declare("x", {nullptr, "i32"}), std::runtime_error);
+}
+
+}  // namespace
+}  // namespace void_compiler